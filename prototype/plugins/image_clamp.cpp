@@ -6,28 +6,26 @@
 /* Plugin name */
 #define self plugin_image_clamp
 
-class self : public asf::plugin_pixel_filter {
+class self : public asf::plugin_pixel_pointwise {
 	asf::parameter_real *max; /* Scale of features in test pattern (default 20 pixels) */
 	asf::parameter_real *min; /* Value at which features wrap around (default 1.0) */
 public:
 	ASF_plugin_class(self)
 	self(asf::plugin_parameters &param) 
-		:asf::plugin_pixel_filter(param)
+		:asf::plugin_pixel_pointwise(param)
 	{
 		asf::optional(param,"max",&max);
 		asf::optional(param,"min",&min);
 	}
 	
-	void execute(void) { 
+	void pointwise(float *values,int n) { 
 		double lo=-1.0e99; if (min) lo=*min;
 		double hi=+1.0e99; if (max) hi=*max;
-		for (int b=0;b<in->bands();b++) {
-			ASF_FOR_PIXELS(x,y,in->pixels()) {
-				double v=in->at(x,y,b);
-				if (v<lo) v=lo;
-				if (v>hi) v=hi;
-				out->at(x,y,b)=v;
-			}
+		for (int i=0;i<n;i++) {
+			double v=values[i];
+			if (v<lo) v=lo;
+			if (v>hi) v=hi;
+			values[i]=v;
 		}
 	}
 };
@@ -6,26 +6,24 @@
 /* Plugin name */
 #define self plugin_image_fma
 
-class self : public asf::plugin_pixel_filter {
+class self : public asf::plugin_pixel_pointwise {
 	asf::parameter_real *mul; /* Value to multiply pixels by (default 1.0) */
 	asf::parameter_real *add; /* Value to add to pixels (default 0.0) */
 public:
 	ASF_plugin_class(self)
 	self(asf::plugin_parameters &param) 
-		:asf::plugin_pixel_filter(param)
+		:asf::plugin_pixel_pointwise(param)
 	{
 		asf::optional(param,"mul",&mul);
 		asf::optional(param,"add",&add);
 	}
 	
-	void execute(void) { 
+	void pointwise(float *values,int n) { 
 		double m=1.0; if (mul) m=*mul;
 		double a=0.0; if (add) a=*add;
-		for (int b=0;b<in->bands();b++) {
-			ASF_FOR_PIXELS(x,y,in->pixels()) {
-				double v=in->at(x,y,b);
-				out->at(x,y,b)=v*m+a;
-			}
+		for (int i=0;i<n;i++) {
+			double v=values[i];
+			values[i]=v*m+a;
 		}
 	}
 };
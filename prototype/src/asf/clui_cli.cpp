@@ -15,11 +15,13 @@ Orion Sky Lawlor, olawlor@acm.org, 2005/09/08 (copyright ASF)
 #include "asf/plugin.h"
 #include "asf/clui.h"
 #include "asf/plugin_loader.h"
+#include <string.h> /* for strcmp */
 
 void usage(std::string why) {
 	fprintf(stderr,
-		"Usage: clui [ -v[<level>] ] [ -l ] <script>\n"
+		"Usage: clui [ -v[<level>] ] [ -l ] [ -t <size> | -t auto ] <script>\n"
 		"  Runs ASF plugins controlled by script.\n"
+		"  -t sets the processing tile size; \"auto\" tunes it for this script.\n"
 		"  Use ASF_LIBRARY_PATH environment variable point to plugin directory\n");
 	const char *dirs=getenv("ASF_LIBRARY_PATH");
 	if (dirs!=NULL) 
@@ -49,7 +51,10 @@ int main(int argc,const char *argv[]) {
 				asf::plugin_load_verbose=1;
 			} break;
 			case 't': { /* Tile size */
-				tile_size=atoi(argv[++argi]);
+				const char *t=argv[++argi];
+				if (t==0) usage("-t needs a tile size");
+				if (0==strcmp(t,"auto")) tile_size=-1; /* calibrate */
+				else tile_size=atoi(t);
 			} break;
 			default:
 				usage("Unknown argument "+std::string(argv[argi]));
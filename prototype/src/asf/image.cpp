@@ -486,6 +486,46 @@ asf::location_function *asf::plugin_pixel_filter::image_in_from_out(int i,int o)
 	return new asf::location_function_identity();
 }
 
+/**** Plugin */
+/* static */ const asf::type asf::plugin_pixel_pointwise::static_type(
+  /* parent  */ &asf::plugin_pixel_filter::static_type,
+  /* name    */ "pixel_pointwise",
+  /* desc    */ "Computes each pixel value from the same input pixel only",
+  /* authors */ "v1.0 by the ASF tools team",
+  /* version */ 1.0
+);
+
+asf::plugin_pixel_pointwise::plugin_pixel_pointwise(asf::plugin_parameters &param)
+	:asf::plugin_pixel_filter(param) {}
+
+void asf::plugin_pixel_pointwise::execute(void)
+{
+	plugin_pixel_pointwise *self=this;
+	execute_chain(&self,1);
+}
+
+/**
+ Copy each row of the input into one small buffer, run every
+ plugin's pointwise over it, and copy it to the output.
+*/
+void asf::plugin_pixel_pointwise::execute_chain(plugin_pixel_pointwise **chain,int n)
+{
+	asf::parameter_float_image *in=chain[0]->in, *out=chain[n-1]->out;
+	int bands=out->bands();
+	asf::pixel_rectangle r=out->pixels();
+	std::vector<float> row(bands*r.width());
+	if (row.size()==0) return;
+	for (int y=r.lo_y;y<r.hi_y;y++) {
+		float *v=&row[0];
+		for (int x=r.lo_x;x<r.hi_x;x++)
+		for (int b=0;b<bands;b++) *v++=in->at(x,y,b);
+		for (int p=0;p<n;p++) chain[p]->pointwise(&row[0],row.size());
+		v=&row[0];
+		for (int x=r.lo_x;x<r.hi_x;x++)
+		for (int b=0;b<bands;b++) out->at(x,y,b)=*v++;
+	}
+}
+
 /**** Plugin */
 /* static */ const asf::type asf::plugin_pixel_kernel::static_type(
   /* parent  */ &asf::plugin::static_type,
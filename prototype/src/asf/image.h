@@ -793,6 +793,38 @@ public:
 	static const asf::type static_type;
 };
 
+/**
+ A "pixel_pointwise" plugin--a pixel_filter where each output pixel 
+ depends only on the same input pixel, band by band, like a scale or
+ a clamp.  Subclasses implement "pointwise" instead of "execute".
+ 
+ The executor fuses a chain of pointwise plugins into a single pass:
+ each row of the first plugin's input goes through every plugin's
+ "pointwise" while it's in cache, and only the last output is stored.
+*/
+class ASF_COREDLL plugin_pixel_pointwise : public asf::plugin_pixel_filter {
+public:
+	plugin_pixel_pointwise(asf::plugin_parameters &param);
+	
+	/**
+	  Replace each of these n values with its output value.
+	  The values are whole pixels, all bands of each pixel in turn.
+	*/
+	virtual void pointwise(float *values,int n) =0;
+	
+	/** Run pointwise over our whole "in" image, writing "out". */
+	virtual void execute(void);
+	
+	/**
+	  Run this chain of pointwise plugins over chain[0]'s "in" image, 
+	  writing the last plugin's "out" image.  The intermediate images
+	  are never touched.
+	*/
+	static void execute_chain(plugin_pixel_pointwise **chain,int n);
+	
+	static const asf::type static_type;
+};
+
 /**
  A "pixel_kernel" plugin--a plugin that computes each output pixel
  based on a fixed-size neighborhood ("kernel") of surrounding input pixels.
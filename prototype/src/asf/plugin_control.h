@@ -55,6 +55,8 @@ private:
 /**
  Execute the plugins in this list in some sensible order,
  creating tiles as needed, and pruning useless branches.
+ tile_size is the processing tile size in pixels: 0 for the default,
+ or -1 to calibrate a tile size for this list (see plugin_execute.cpp).
 */
 void ASF_COREDLL execute_list(const asf::parameter_control_list &list,int tile_size=0);
 
@@ -32,6 +32,11 @@ Orion Sky Lawlor, olawlor@acm.org, 2005/11/29.
 #include "asf/plugin.h"
 #include "asf/plugin_control.h"
 #include "asf/image.h"
+#include "osl/thread.h"
+#include <time.h>
+#ifndef WIN32
+#include <unistd.h> /* for sysconf */
+#endif
 
 /* Base execution logging level */
 #define ex_loglevel 20
@@ -40,6 +45,8 @@ using namespace asf;
 
 class execute_plugin; /* forward declaration */
 class execute_image;
+class execute_bands;
+class execute_tiles;
 
 /**
   Cover a rectangle with tiles of the given size.
@@ -139,6 +146,9 @@ public:
 	/** Set up the sizes of all our images */
 	void set_size(const set_size_param &preferred);
 	
+	/** Pick a tile size for our plugins by calibration (see execute_list) */
+	pixel_size tune_tile_size(void);
+	
 	/** Execute all sink plugins to render at this size and detail */
 	void render(const render_request &req);
 private:
@@ -276,7 +286,7 @@ private:
 class execute_plugin {
 public:
 	execute_plugin(plugin *p,execute_block &r) {setup(p,r);}
-	virtual ~execute_plugin() {}
+	virtual ~execute_plugin();
 	
 	/// Compute this meta rectangle of our output image(s), which are already allocated.
 	virtual void render(const render_request &req);
@@ -320,11 +330,28 @@ public:
 	execute_plugins out_dep;
 	/// Our plugin's output images
 	std::vector<execute_image *> out_img;
+	
+	/// Runs our plugin on several threads, or NULL to run it normally
+	execute_bands *bands;
+	/// For sinks: renders several of our tiles at once, or NULL
+	execute_tiles *tiler;
+	/// Chain of pointwise plugins run fused into one pass, ending with us.
+	///  Empty unless there's a pointwise plugin upstream to fuse with.
+	std::vector<execute_plugin *> fused;
+	std::vector<plugin_pixel_pointwise *> fused_pl;
+	/// True once we've decided whether to use "bands", "fused" or "tiler"
+	bool strategy_checked;
 protected:
+	friend class execute_tiles;
 	execute_plugin() {} /* MUST call setup afterwards! */
 	void setup(plugin *p,execute_block &r);
 	/// Render all inputs needed for this output rectangle. 
-	void render_inputs(const render_request &req);
+	///  If images is false, only render our non-image inputs.
+	void render_inputs(const render_request &req,bool images=true);
+	/// Set up "fused", if our plugin can be fused with the ones upstream
+	void find_fused(void);
+	/// Compute this tile of our output using the "fused" chain
+	void render_fused(const render_request &req);
 	/// Indicate to all our output dependencies that we've been flushed
 	void out_flush(void);
 };
@@ -346,6 +373,101 @@ private:
 	plugin_control_flow *plf;
 };
 
+/**
+  Runs a pixel_filter plugin on several threads at once, by
+  splitting each output tile into horizontal bands of rows.
+  
+  Each thread gets its own copy of the plugin, so the plugin's own
+  scratch variables aren't shared.  The copies' "in" and "out" images
+  point into their band of the tile images allocated for the real 
+  plugin, so this takes no extra image memory; all other parameters
+  are shared with the real plugin, and must only be read.
+*/
+class execute_bands {
+public:
+	/** Return a new execute_bands for this plugin, or NULL if 
+	  the plugin can't (or needn't) be run on several threads. */
+	static execute_bands *make(execute_plugin *ep);
+	~execute_bands();
+	
+	/** Compute this tile of the plugin's output, which has been 
+	  set up just like before calling pl->execute(). */
+	void execute(const render_request &t);
+private:
+	execute_bands(execute_plugin *ep,plugin_pixel_filter *f,int work);
+	
+	/// One thread's copy of the plugin
+	class worker {
+	public:
+		plugin_parameter_list params;
+		parameter_float_image in, out;
+		plugin_pixel_filter *pl;
+	};
+	std::vector<worker *> workers;
+	
+	execute_plugin *ep;
+	plugin_pixel_filter *filter; ///< Real plugin
+	int work; ///< Arithmetic per output pixel (bands times kernel area)
+	
+	static void execute_worker(int i,void *arg);
+};
+
+/**
+  Renders several tiles of a sink plugin at once.
+  
+  This works when the sink's input comes through a chain of 
+  pixel_filter plugins whose images nobody else reads.  Tiles go 
+  through in batches of one tile per thread: for each tile, the 
+  chain's first input image is rendered as usual on this thread 
+  (it may read files), and copied into a private "slot".  Then each 
+  slot runs its own copies of the chain's plugins on its own thread.
+  Finally the sink consumes the finished tiles one at a time, in order.
+  
+  There's one slot per thread, so at most that many tiles are in 
+  flight; the extra memory is one tile of each chain image per thread.
+  The batches aren't pipelined--the next batch's inputs are read 
+  while the workers wait.
+*/
+class execute_tiles {
+public:
+	/** Return a new execute_tiles for this sink plugin, or NULL if 
+	  its tiles can't (or needn't) be rendered concurrently. */
+	static execute_tiles *make(execute_plugin *sink);
+	~execute_tiles();
+	
+	/** Render these tiles of the sink's input, and run the sink on each. */
+	void render(const rect_tiling &tiles,const render_request &req);
+private:
+	execute_tiles(execute_plugin *sink,const std::vector<execute_plugin *> &chain);
+	
+	/// One tile in flight
+	class slot {
+	public:
+		/// Sink tile we're rendering
+		render_request t;
+		/// Region of each chain image we need for t
+		std::vector<pixel_rectangle> rect;
+		/// Chain images, as seen by our copies of the plugins.
+		///  Image k is the input of plugin k and the output of plugin k-1.
+		std::vector<parameter_float_image *> img;
+		/// Pixel storage for img, and how big each one is
+		std::vector<parameter_float_image *> store;
+		std::vector<pixel_size> store_size;
+		/// Our copies of the chain's plugins, and their parameters
+		std::vector<plugin_parameter_list *> params;
+		std::vector<plugin_pixel_filter *> pl;
+		
+		/** Point img[k] at rect[k], growing store[k] if needed */
+		void allocate(int k,int bands,const pixel_rectangle &bounds);
+	};
+	std::vector<slot *> slots;
+	
+	execute_plugin *sink;
+	std::vector<execute_plugin *> chain; ///< Filters feeding the sink, upstream first
+	
+	static void execute_slot(int i,void *arg);
+};
+
 /************* block *****************/
 /** Create a new empty top-level block */
 execute_block::execute_block(void) {
@@ -564,6 +686,7 @@ void execute_image::size_pass(plug_img *pi)
 void execute_plugin::setup(plugin *pl_,execute_block &r) {
 	pl=pl_;
 	state=state_needy;
+	bands=0; tiler=0; strategy_checked=false;
 	
 /* Figure out what parameters this plugin takes, and where they come from */
 	const plugin_parameter_signature *sig=pl->get_signature();
@@ -626,6 +749,15 @@ void execute_plugin::render(const render_request &req)
 			SUBTLE: ei->Pimg gives the maximum region we should consider touching.
 		*/
 		rect_tiling tiles(req.rect,ei->Pimg->total_meta_bounds(),p->tile);
+		if (!strategy_checked) {
+			find_fused();
+			if (fused.size()==0) bands=execute_bands::make(this);
+			if (fused.size()==0 && bands==0) tiler=execute_tiles::make(this);
+			strategy_checked=true;
+		}
+		if (tiler && tiles.tile_count.x*tiles.tile_count.y>1)
+			tiler->render(tiles,req); /* several tiles at once */
+		else {
 		tile_location t;
 		for (t.y=0;t.y<tiles.tile_count.y;t.y++)
 		for (t.x=0;t.x<tiles.tile_count.x;t.x++)
@@ -634,24 +766,86 @@ void execute_plugin::render(const render_request &req)
 			pl->log(ex_loglevel,"execute_plugin>  rendering tile (%d,%d)\n",t.x,t.y);
 			state=state_needy; /* flush outputs; need output tile */
 			
-			/* Prepare input images */
 			render_request t; t.rect=tile_r; t.zoom=req.zoom;
+			if (fused.size()>0) { /* one pass through the whole chain */
+				render_fused(t);
+				continue;
+			}
+			
+			/* Prepare input images */
 			render_inputs(t);
 			
 			/* Compute outputs from inputs */
 			ei->Pimg->pixel_pointat(ei->Aimg,t.rect,t.zoom);
 			pl->log(ex_loglevel-5,"execute_plugin>  execute plugin  "req_fmt"\n",req_args(t));
-			pl->execute();
+			if (bands) bands->execute(t);
+			else pl->execute();
 			pl->log(ex_loglevel,"execute_plugin>  } execute plugin\n");
 		}
+		}
 	}
 	
 	state=state_ready; /* our outputs are now ready */
 	pl->log(ex_loglevel,"execute_plugin> } render\n");
 }
 
+/** Return this plugin as a pointwise plugin, if it's one we can fuse:
+  exactly one image in and out, with no size constraints. */
+static plugin_pixel_pointwise *fusible(execute_plugin *ep)
+{
+	plugin_pixel_pointwise *p=dynamic_cast<plugin_pixel_pointwise *>(ep->pl);
+	if (p==0 || ep->in_img.size()!=1 || ep->out_img.size()!=1) return 0;
+	execute_image *in=ep->in_img[0], *out=ep->out_img[0];
+	if (in->Pimg!=p->in || out->Pimg!=p->out) return 0;
+	if (in->get_img(ep)->constraint || out->get_img(ep)->constraint) return 0;
+	return p;
+}
+
+void execute_plugin::find_fused(void)
+{
+	if (!fusible(this)) return;
+	/* Walk upstream while our input image is private to the chain:
+	   written by one pointwise plugin, and read by nobody else. */
+	std::vector<execute_plugin *> chain;
+	chain.push_back(this);
+	execute_plugin *cur=this;
+	while (true) {
+		execute_image *src=cur->in_img[0];
+		if (src->inp.size()!=1 || src->outp.size()!=1) break;
+		execute_plugin *up=src->inp[0]->p;
+		if (up==this || !fusible(up) || up->out_img[0]!=src) break;
+		chain.insert(chain.begin(),up);
+		cur=up;
+	}
+	if (chain.size()<2) return; /* nothing to fuse with */
+	
+	fused=chain;
+	for (unsigned int i=0;i<fused.size();i++)
+		fused_pl.push_back(fusible(fused[i]));
+	pl->log(ex_loglevel-5,"execute_plugin> fusing %d pointwise plugins, starting with %s\n",
+		(int)fused.size(),fused[0]->pl->get_type()->name());
+}
+
+void execute_plugin::render_fused(const render_request &t)
+{
+	/* Only the first plugin's input image is real; the others are 
+	   never computed, but their non-image inputs may be. */
+	for (unsigned int i=0;i<fused.size();i++) {
+		fused[i]->state=state_needy;
+		fused[i]->render_inputs(t,i==0);
+	}
+	
+	execute_image *ei=out_img[0];
+	ei->Pimg->pixel_pointat(ei->Aimg,t.rect,t.zoom);
+	pl->log(ex_loglevel-5,"execute_plugin>  execute fused plugins  "req_fmt"\n",req_args(t));
+	plugin_pixel_pointwise::execute_chain(&fused_pl[0],fused_pl.size());
+	
+	for (unsigned int i=0;i+1<fused.size();i++)
+		fused[i]->state=state_ready;
+}
+
 /* Make sure each input image is really there */
-void execute_plugin::render_inputs(const render_request &req) {
+void execute_plugin::render_inputs(const render_request &req,bool images) {
 	unsigned int i;
 	
 	pl->log(ex_loglevel,"execute_plugin>  render_inputs { "req_fmt"\n",req_args(req));
@@ -666,6 +860,7 @@ void execute_plugin::render_inputs(const render_request &req) {
 	}
 	
 	/* Make sure each input image is ready */
+	if (images)
 	for (i=0;i<in_img.size();i++) {
 		render_request in;
 		/* Find the portion of the input image we'll need to cover this part of our output. */
@@ -748,6 +943,450 @@ void execute_image::flush(void)
 	finished_rect=empty_rect;
 }
 
+/************* execute_bands **************
+  Splits a plugin's tiles into bands for the worker threads.
+*/
+
+/** Don't bother splitting off a band with less work than this:
+  waking a thread up costs about as much as this many pixel operations. */
+#define min_band_work 32768
+
+/**
+  Make a new copy of this pixel_filter plugin that reads "in" and writes
+  "out", but shares all its other parameters with the original.
+  "params" holds the copy's parameters, so it must outlive the copy.
+*/
+static plugin_pixel_filter *copy_filter(plugin_pixel_filter *f,plugin_parameter_list &params,
+	parameter_float_image *in,parameter_float_image *out)
+{
+	const plugin_parameter_signature *sig=f->get_signature();
+	plugin_parameters &ps=f->get_parameters();
+	const plugin_parameter_signature::params *v[3]={
+		&sig->inputs(), &sig->optionals(), &sig->outputs()
+	};
+	const plugin_parameters::dir_t dir[3]={
+		plugin_parameters::dir_input, plugin_parameters::dir_optional, 
+		plugin_parameters::dir_output
+	};
+	for (int d=0;d<3;d++)
+	for (unsigned int i=0;i<v[d]->size();i++) {
+		parameter *pa=0;
+		ps.param((*v[d])[i]->name,(*v[d])[i]->t,&pa,0,0,dir[d]);
+		if (pa==f->in) pa=in;
+		else if (pa==f->out) pa=out;
+		if (pa) params.add((*v[d])[i]->name,pa);
+	}
+	plugin *c=system_registry().plugin_factory(f->get_type()->name())(params);
+	plugin_pixel_filter *cf=dynamic_cast<plugin_pixel_filter *>(c);
+	if (cf==0 || cf->in!=in || cf->out!=out)
+		asf::die("copy_filter> copy of plugin doesn't use its own images!");
+	return cf;
+}
+
+execute_bands *execute_bands::make(execute_plugin *ep)
+{
+	plugin_pixel_filter *f=dynamic_cast<plugin_pixel_filter *>(ep->pl);
+	if (f==0 || f->has_side_effects()) return 0;
+	if (osl_thread_count()<=1) return 0;
+	
+	/* Only the simple case: one image in, one image out, and the
+	   images are the ones the executor allocates tiles for. */
+	if (ep->in_img.size()!=1 || ep->out_img.size()!=1) return 0;
+	execute_image *in=ep->in_img[0], *out=ep->out_img[0];
+	if (in->Pimg!=f->in || out->Pimg!=f->out) return 0;
+	/* Constrained plugins (e.g., whole-scanline) need whole tiles. */
+	if (in->get_img(ep)->constraint || out->get_img(ep)->constraint) return 0;
+	
+	int work=f->in->bands();
+	plugin_pixel_kernel *k=dynamic_cast<plugin_pixel_kernel *>(f);
+	if (k) {
+		plugin_pixel_kernel::kernel_geometry g=k->get_kernel_geometry();
+		work*=(int)((g.neighborhood.width()+1)*(g.neighborhood.height()+1)
+			*g.scale.x*g.scale.y);
+	}
+	if (work<1) work=1;
+	
+	f->log(ex_loglevel,"execute_bands> running on %d threads\n",osl_thread_count());
+	return new execute_bands(ep,f,work);
+}
+
+execute_bands::execute_bands(execute_plugin *ep_,plugin_pixel_filter *f,int work_)
+	:ep(ep_), filter(f), work(work_)
+{
+	for (int t=0;t<osl_thread_count();t++) {
+		worker *w=new worker;
+		w->pl=copy_filter(f,w->params,&w->in,&w->out);
+		workers.push_back(w);
+	}
+}
+
+execute_bands::~execute_bands()
+{
+	for (unsigned int i=0;i<workers.size();i++) {
+		delete workers[i]->pl;
+		delete workers[i];
+	}
+}
+
+void execute_bands::execute(const render_request &t)
+{
+	/* Number of rows and pixels in this tile, and how many bands that's worth */
+	int step=1<<t.zoom;
+	int rows=(t.rect.height()+step-1)/step;
+	double pixels=(double)rows*((t.rect.width()+step-1)/step);
+	int n=(int)std::min((double)workers.size(),pixels*work/min_band_work);
+	n=std::min(n,rows);
+	if (n<=1) { /* small tile: not worth waking anybody up */
+		filter->execute();
+		return;
+	}
+	
+	execute_image *in=ep->in_img[0], *out=ep->out_img[0];
+	location_function *map=ep->in_map[0];
+	for (int i=0;i<n;i++) {
+		worker *w=workers[i];
+		pixel_rectangle band(t.rect.lo_x,t.rect.lo_y+step*(rows*i/n),
+			t.rect.hi_x,t.rect.lo_y+step*(rows*(i+1)/n));
+		if (i==n-1) band.hi_y=t.rect.hi_y;
+		
+		w->out.meta_setsize(filter->out->bands(),filter->out->total_meta_bounds());
+		w->out.pixel_pointat(out->Aimg,band,t.zoom);
+		w->in.meta_setsize(filter->in->bands(),filter->in->total_meta_bounds());
+		w->in.pixel_pointat(in->Aimg,map?map->apply_rectangle(band):band,t.zoom);
+	}
+	osl_parallel_for(n,execute_worker,this);
+}
+
+void execute_bands::execute_worker(int i,void *arg)
+{
+	execute_bands *b=(execute_bands *)arg;
+	b->workers[i]->pl->execute();
+}
+
+/************* execute_tiles **************
+  Renders a sink's tiles in batches, one tile per thread.
+*/
+
+execute_tiles *execute_tiles::make(execute_plugin *sink)
+{
+	if (osl_thread_count()<=1) return 0;
+	if (sink->in_img.size()!=1 || sink->out_img.size()!=0) return 0;
+	
+	/* Walk upstream while the image is private to the chain: written 
+	   by one pure pixel_filter plugin, and read by nobody else. */
+	std::vector<execute_plugin *> chain;
+	execute_image *cur=sink->in_img[0];
+	while (cur->inp.size()==1 && cur->outp.size()==1) {
+		execute_plugin *up=cur->inp[0]->p;
+		plugin_pixel_filter *f=dynamic_cast<plugin_pixel_filter *>(up->pl);
+		if (up==sink || f==0 || f->has_side_effects()) break;
+		if (up->in_img.size()!=1 || up->out_img.size()!=1 || up->out_img[0]!=cur) break;
+		execute_image *src=up->in_img[0];
+		if (src->Pimg!=f->in || cur->Pimg!=f->out) break;
+		if (src->get_img(up)->constraint || cur->get_img(up)->constraint) break;
+		bool seen=false; /* don't go around a loop forever */
+		for (unsigned int i=0;i<chain.size();i++) if (chain[i]==up) seen=true;
+		if (seen) break;
+		chain.insert(chain.begin(),up);
+		cur=src;
+	}
+	/* Nothing to run concurrently, or nothing to render the chain's input */
+	if (chain.size()==0 || cur->inp.size()==0) return 0;
+	
+	sink->pl->log(ex_loglevel,"execute_tiles> rendering %d tiles at once through %d plugins\n",
+		osl_thread_count(),(int)chain.size());
+	return new execute_tiles(sink,chain);
+}
+
+execute_tiles::execute_tiles(execute_plugin *sink_,const std::vector<execute_plugin *> &chain_)
+	:sink(sink_), chain(chain_)
+{
+	int m=chain.size();
+	for (int t=0;t<osl_thread_count();t++) {
+		slot *s=new slot;
+		s->rect.resize(m+1);
+		for (int k=0;k<=m;k++) {
+			s->img.push_back(new parameter_float_image);
+			s->store.push_back(new parameter_float_image);
+			s->store_size.push_back(pixel_size(0,0));
+		}
+		for (int k=0;k<m;k++) {
+			plugin_pixel_filter *f=dynamic_cast<plugin_pixel_filter *>(chain[k]->pl);
+			s->params.push_back(new plugin_parameter_list);
+			s->pl.push_back(copy_filter(f,*s->params[k],s->img[k],s->img[k+1]));
+		}
+		slots.push_back(s);
+	}
+}
+
+execute_tiles::~execute_tiles()
+{
+	for (unsigned int i=0;i<slots.size();i++) {
+		slot *s=slots[i];
+		for (unsigned int k=0;k<s->pl.size();k++) {
+			delete s->pl[k];
+			delete s->params[k];
+		}
+		for (unsigned int k=0;k<s->img.size();k++) {
+			delete s->img[k];
+			delete s->store[k];
+		}
+		delete s;
+	}
+}
+
+void execute_tiles::slot::allocate(int k,int bands,const pixel_rectangle &bounds)
+{
+	/* parameter_float_image::pixel_setsize keeps its buffer whenever the
+	   row size matches, so always allocate the same size, and only ever 
+	   grow it, by replacing the image. */
+	pixel_size sz=rect[k].size();
+	if (sz.x>store_size[k].x || sz.y>store_size[k].y) {
+		store_size[k]=pixel_size(std::max(sz.x,store_size[k].x),std::max(sz.y,store_size[k].y));
+		delete store[k];
+		store[k]=new parameter_float_image;
+	}
+	pixel_rectangle r(rect[k].lo_x,rect[k].lo_y,
+		rect[k].lo_x+store_size[k].x,rect[k].lo_y+store_size[k].y);
+	/* The storage can hang off the edge of the image at the last tiles */
+	pixel_rectangle all(std::min(r.lo_x,bounds.lo_x),std::min(r.lo_y,bounds.lo_y),
+		std::max(r.hi_x,bounds.hi_x),std::max(r.hi_y,bounds.hi_y));
+	store[k]->meta_setsize(bands,all);
+	store[k]->pixel_setsize(r,t.zoom);
+	img[k]->meta_setsize(bands,bounds);
+	img[k]->pixel_pointat(store[k],rect[k],t.zoom);
+}
+
+void execute_tiles::render(const rect_tiling &tiles,const render_request &req)
+{
+	int m=chain.size();
+	execute_image *head=chain[0]->in_img[0], *ei=sink->in_img[0];
+	int n_tiles=tiles.tile_count.x*tiles.tile_count.y;
+	for (int first=0;first<n_tiles;first+=slots.size()) {
+		int n=std::min((int)slots.size(),n_tiles-first);
+		
+		/* Work out each tile's regions, and fill in its first image */
+		for (int i=0;i<n;i++) {
+			slot *s=slots[i];
+			tile_location l((first+i)%tiles.tile_count.x,(first+i)/tiles.tile_count.x);
+			s->t=render_request(tiles.get_outline(l),req.zoom);
+			sink->pl->log(ex_loglevel,"execute_tiles>  rendering tile (%d,%d) in slot %d\n",l.x,l.y,i);
+			
+			sink->state=execute_plugin::state_needy;
+			sink->render_inputs(s->t,false);
+			s->rect[m]=sink->in_map[0]?sink->in_map[0]->apply_rectangle(s->t.rect):s->t.rect;
+			for (int k=m-1;k>=0;k--) {
+				execute_plugin *c=chain[k];
+				c->state=execute_plugin::state_needy;
+				c->render_inputs(render_request(s->rect[k+1],req.zoom),false);
+				s->rect[k]=c->in_map[0]?c->in_map[0]->apply_rectangle(s->rect[k+1]):s->rect[k+1];
+			}
+			for (int k=0;k<=m;k++) {
+				execute_image *e=k<m?chain[k]->in_img[0]:ei;
+				s->allocate(k,e->Pimg->bands(),e->Pimg->total_meta_bounds());
+			}
+			
+			render_request in(s->rect[0],req.zoom);
+			head->render(in);
+			parameter_float_image src;
+			src.meta_setsize(head->Pimg->bands(),head->Pimg->total_meta_bounds());
+			src.pixel_pointat(head->Aimg,in.rect,in.zoom);
+			parameter_float_image *dest=s->img[0];
+			for (int y=0;y<src.size_y();y++)
+			for (int x=0;x<src.size_x();x++)
+			for (int b=0;b<src.bands();b++)
+				dest->at(x,y,b)=src.at(x,y,b);
+		}
+		
+		/* Run the chain on every tile at once */
+		sink->pl->log(ex_loglevel-5,"execute_tiles>  execute %d plugins on %d tiles\n",m,n);
+		osl_parallel_for(n,execute_slot,this);
+		for (int k=0;k<m;k++) chain[k]->state=execute_plugin::state_ready;
+		
+		/* Hand the tiles to the sink, in order */
+		for (int i=0;i<n;i++) {
+			slot *s=slots[i];
+			ei->Pimg->pixel_pointat(s->img[m],s->t.rect,s->t.zoom);
+			sink->pl->log(ex_loglevel-5,"execute_tiles>  execute sink "req_fmt"\n",req_args(s->t));
+			sink->pl->execute();
+		}
+	}
+}
+
+void execute_tiles::execute_slot(int i,void *arg)
+{
+	execute_tiles *et=(execute_tiles *)arg;
+	slot *s=et->slots[i];
+	for (unsigned int k=0;k<s->pl.size();k++)
+		s->pl[k]->execute();
+}
+
+execute_plugin::~execute_plugin()
+{
+	delete bands;
+	delete tiler;
+}
+
+/************* Tile size tuning **************
+  Picks a tile size that suits one particular chain of plugins.
+  
+  The data a tile touches--every image in the chain, plus kernel
+  padding--should fit in the processor's L2 cache, so the next plugin
+  finds its input still in cache.  Of the tile shapes that fit, we time
+  each pure pixel_filter plugin in the chain on a scratch tile (so 
+  nothing is written anywhere), and keep the shape with the lowest 
+  cost per pixel, preferring bigger tiles when the costs are close.
+  
+  Results are remembered in the file $ASF_TILE_CACHE (default 
+  $HOME/.asf_tile_sizes), one line per chain: "<width> <height> <chain>".
+  The chain is the plugin types, the floats stored per pixel, and the 
+  cache size, so a different machine or image gets tuned again.
+*/
+
+/** Return the bytes of cache a tile's working set should fit into.
+  The ASF_CACHE_SIZE environment variable overrides the real L2 size. */
+static int tune_cache_size(void)
+{
+	const char *env=getenv("ASF_CACHE_SIZE");
+	if (env && atoi(env)>0) return atoi(env);
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	long l2=sysconf(_SC_LEVEL2_CACHE_SIZE);
+	if (l2>0) return (int)l2;
+#endif
+	return 256*1024; /* a typical L2 */
+}
+
+/** Return the name of the file we remember tuned tile sizes in, or "" */
+static std::string tune_file_name(void)
+{
+	const char *env=getenv("ASF_TILE_CACHE");
+	if (env) return env;
+	const char *home=getenv("HOME");
+	if (home==0) home=getenv("USERPROFILE");
+	if (home==0) return "";
+	return std::string(home)+"/.asf_tile_sizes";
+}
+
+/** Look up the tile size remembered for this chain.  Returns false if none. */
+static bool tune_lookup(const std::string &chain,pixel_size *sz)
+{
+	std::string file=tune_file_name();
+	FILE *f=file.size()?fopen(file.c_str(),"r"):0;
+	if (f==0) return false;
+	char line[2048];
+	bool found=false;
+	while (!found && fgets(line,sizeof(line),f)) {
+		int w,h,len=0;
+		if (sscanf(line,"%d %d %n",&w,&h,&len)<2 || len==0) continue;
+		std::string rest(line+len);
+		while (rest.size() && (rest[rest.size()-1]=='\n' || rest[rest.size()-1]=='\r'))
+			rest.erase(rest.size()-1);
+		if (rest==chain && w>0 && h>0) {
+			*sz=pixel_size(w,h);
+			found=true;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+/** Remember this tile size for this chain. */
+static void tune_remember(const std::string &chain,const pixel_size &sz)
+{
+	std::string file=tune_file_name();
+	FILE *f=file.size()?fopen(file.c_str(),"a"):0;
+	if (f==0) return; /* can't remember--we'll just tune again next time */
+	fprintf(f,"%d %d %s\n",sz.x,sz.y,chain.c_str());
+	fclose(f);
+}
+
+/** Return the seconds per output pixel this plugin takes on a w x h tile. */
+static double tune_time_filter(plugin_pixel_filter *f,int w,int h)
+{
+	parameter_float_image in, out;
+	plugin_parameter_list params;
+	plugin_pixel_filter *c=copy_filter(f,params,&in,&out);
+	pixel_rectangle r(w,h);
+	location_function *map=f->image_in_from_out(0,0);
+	in.flat_setsize(f->in->bands(),map?map->apply_rectangle(r):r);
+	delete map;
+	out.flat_setsize(f->out->bands(),r);
+	in.set(0.0f);
+	
+	/* Run it enough times to get a measurable time */
+	int reps=0;
+	clock_t start=clock(), end;
+	do {
+		c->execute();
+		reps++;
+		end=clock();
+	} while (end-start<CLOCKS_PER_SEC/200 && reps<100);
+	delete c;
+	return (end-start)/(double)CLOCKS_PER_SEC/reps/((double)w*h);
+}
+
+pixel_size execute_block::tune_tile_size(void)
+{
+	/* Describe our chain of plugins, and find the ones we can time */
+	std::string chain;
+	std::vector<plugin_pixel_filter *> filters;
+	int pad=0;
+	for (unsigned int i=0;i<plugins.size();i++) {
+		execute_plugin *ep=plugins[i];
+		chain+=ep->pl->get_type()->name(); chain+=" ";
+		plugin_pixel_filter *f=dynamic_cast<plugin_pixel_filter *>(ep->pl);
+		if (f && !f->has_side_effects() && ep->in_img.size()==1 && ep->out_img.size()==1)
+			filters.push_back(f);
+		plugin_pixel_kernel *k=dynamic_cast<plugin_pixel_kernel *>(ep->pl);
+		if (k) {
+			plugin_pixel_kernel::kernel_geometry g=k->get_kernel_geometry();
+			pad=std::max(pad,std::max(g.neighborhood.width(),g.neighborhood.height()));
+		}
+	}
+	int floats=0;
+	for (images_t::iterator it=images.begin();it!=images.end();++it)
+		floats+=(*it).second->Pimg->bands();
+	int cache=tune_cache_size();
+	char buf[1024];
+	sprintf(buf,"floats=%d cache=%d",floats,cache);
+	chain+=buf;
+	
+	pixel_size best(16,16);
+	if (tune_lookup(chain,&best)) {
+		sprintf(buf,"plugin_execute> Tile size %d x %d (remembered for this chain)\n",best.x,best.y);
+		asf::log(1,buf);
+		return best;
+	}
+	
+	/* Try each tile shape that fits in cache; rows are contiguous, so
+	   shapes are at least as wide as they are tall. */
+	double best_cost=-1;
+	for (int h=16;h<=512;h*=2)
+	for (int w=h;w<=1024;w*=2) {
+		double bytes=sizeof(float)*(double)floats*(w+pad)*(h+pad);
+		if (bytes>cache) continue;
+		double cost=0;
+		for (unsigned int i=0;i<filters.size();i++)
+			cost+=tune_time_filter(filters[i],w,h);
+		if (filters.size()==0) cost=1.0/(w*h); /* nothing to time: fewest tiles wins */
+		sprintf(buf,"plugin_execute>   tile %d x %d: %.0f bytes, %.3g ns/pixel\n",w,h,bytes,cost*1.0e9);
+		asf::log(ex_loglevel-1,buf);
+		
+		if (best_cost<0 || cost<0.95*best_cost
+		  || (cost<1.05*best_cost && w*h>best.x*best.y)) 
+		{
+			best_cost=cost;
+			best=pixel_size(w,h);
+		}
+	}
+	
+	sprintf(buf,"plugin_execute> Tile size %d x %d (tuned for %d byte cache, %d floats per pixel)\n",
+		best.x,best.y,cache,floats);
+	asf::log(1,buf);
+	tune_remember(chain,best);
+	return best;
+}
+
 /************* execute_plugin_control **************
   Wraps plugins capable of control flow management, like loops.
 */
@@ -824,7 +1463,8 @@ Figure out how big our image tiles should be at each stage of processing.
 	asf::log(ex_loglevel-1,"plugin_execute> Finding tile sizes\n");
 	set_size_param preferred;
 	if (tile_size==0) tile_size=64; /* Default tile size */
-	preferred.size=pixel_size(tile_size,tile_size);
+	if (tile_size<0) preferred.size=r.tune_tile_size(); /* Calibrate */
+	else preferred.size=pixel_size(tile_size,tile_size);
 	preferred.zoom=0;
 	r.set_size(preferred); /* find processed tile sizes */
 
@@ -0,0 +1,138 @@
+/**
+Worker thread pool for osl_parallel_for, on all platforms.
+*/
+#include "osl/thread.h"
+#include <stdlib.h>
+
+#ifdef WIN32 /**************** Windows ****************
+Needs Vista or later for condition variables.
+*/
+#include <windows.h>
+
+typedef CRITICAL_SECTION osl_lock_t;
+typedef CONDITION_VARIABLE osl_cond_t;
+static void lock_init(osl_lock_t *l) {InitializeCriticalSection(l);}
+static void lock(osl_lock_t *l) {EnterCriticalSection(l);}
+static void unlock(osl_lock_t *l) {LeaveCriticalSection(l);}
+static void cond_init(osl_cond_t *c) {InitializeConditionVariable(c);}
+static void cond_wait(osl_cond_t *c,osl_lock_t *l) {SleepConditionVariableCS(c,l,INFINITE);}
+static void cond_broadcast(osl_cond_t *c) {WakeAllConditionVariable(c);}
+static int cpu_count(void) {
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors;
+}
+static DWORD WINAPI worker_main(LPVOID);
+static void start_thread(void) {
+	CloseHandle(CreateThread(NULL,0,worker_main,NULL,0,NULL));
+}
+#define WORKER_RETURN return 0
+
+#else /************ UNIX pthreads version ****************/
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t osl_lock_t;
+typedef pthread_cond_t osl_cond_t;
+static void lock_init(osl_lock_t *l) {pthread_mutex_init(l,NULL);}
+static void lock(osl_lock_t *l) {pthread_mutex_lock(l);}
+static void unlock(osl_lock_t *l) {pthread_mutex_unlock(l);}
+static void cond_init(osl_cond_t *c) {pthread_cond_init(c,NULL);}
+static void cond_wait(osl_cond_t *c,osl_lock_t *l) {pthread_cond_wait(c,l);}
+static void cond_broadcast(osl_cond_t *c) {pthread_cond_broadcast(c);}
+static int cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+	return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	return 1;
+#endif
+}
+static void *worker_main(void *);
+static void start_thread(void) {
+	pthread_t t;
+	if (pthread_create(&t,NULL,worker_main,NULL)==0)
+		pthread_detach(t);
+}
+#define WORKER_RETURN return NULL
+
+#endif
+
+/* The pool.  Everything below is protected by pool_lock. */
+static int pool_threads=0; /* 0: not set up yet */
+static osl_lock_t pool_lock;
+static osl_cond_t work_ready, work_done;
+static int busy=0; /* an osl_parallel_for is running */
+static unsigned int generation=0; /* bumped for each new piece of work */
+static osl_parallel_fn work_fn;
+static void *work_arg;
+static int work_n, work_next, work_finished;
+
+/* Do pieces of the current work until there are none left.
+   Called with pool_lock held; returns with it held. */
+static void do_work(void)
+{
+	while (work_next<work_n) {
+		int i=work_next++;
+		unlock(&pool_lock);
+		work_fn(i,work_arg);
+		lock(&pool_lock);
+		if (++work_finished==work_n) cond_broadcast(&work_done);
+	}
+}
+
+#ifdef WIN32
+static DWORD WINAPI worker_main(LPVOID)
+#else
+static void *worker_main(void *)
+#endif
+{
+	lock(&pool_lock);
+	unsigned int seen=generation;
+	while (1) {
+		while (seen==generation) cond_wait(&work_ready,&pool_lock);
+		seen=generation;
+		do_work();
+	}
+	unlock(&pool_lock);
+	WORKER_RETURN;
+}
+
+int osl_thread_count(void)
+{
+	if (pool_threads==0) { /* first call: decide, and start the workers */
+		const char *env=getenv("ASF_THREADS");
+		int n=env?atoi(env):cpu_count();
+		if (n<1) n=1;
+		lock_init(&pool_lock);
+		cond_init(&work_ready);
+		cond_init(&work_done);
+		for (int t=1;t<n;t++) start_thread(); /* caller is thread 0 */
+		pool_threads=n;
+	}
+	return pool_threads;
+}
+
+void osl_parallel_for(int n,osl_parallel_fn fn,void *arg)
+{
+	int serial=(n<=1 || osl_thread_count()<=1);
+	if (!serial) {
+		lock(&pool_lock);
+		if (busy) serial=1; /* nested, or another thread got here first */
+		else busy=1;
+		unlock(&pool_lock);
+	}
+	if (serial) {
+		for (int i=0;i<n;i++) fn(i,arg);
+		return;
+	}
+
+	lock(&pool_lock);
+	work_fn=fn; work_arg=arg;
+	work_n=n; work_next=0; work_finished=0;
+	generation++;
+	cond_broadcast(&work_ready);
+	do_work();
+	while (work_finished<work_n) cond_wait(&work_done,&pool_lock);
+	busy=0;
+	unlock(&pool_lock);
+}
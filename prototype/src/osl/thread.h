@@ -0,0 +1,37 @@
+/**
+Run independent pieces of work on all the processors of the machine.
+C or C++ interface and implementation.
+
+The worker threads are created the first time they're needed, and
+then stay around (waiting) until the program exits, so calling
+osl_parallel_for on small pieces of work is cheap.
+*/
+#ifndef __OSL_THREAD_H
+#define __OSL_THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** One piece of work: called with i=0..n-1 */
+typedef void (*osl_parallel_fn)(int i,void *arg);
+
+/**
+  Call fn(i,arg) for every i from 0 to n-1, in any order and on
+  any thread, and return once they're all done.  The calling thread
+  does its share of the work.  Calls made from inside fn (or while
+  another thread is inside osl_parallel_for) just run serially.
+*/
+void osl_parallel_for(int n,osl_parallel_fn fn,void *arg);
+
+/**
+  Return the number of threads osl_parallel_for will use: the
+  ASF_THREADS environment variable if set, else the number of processors.
+*/
+int osl_thread_count(void);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -354,6 +354,76 @@ void asfLineMeter(int currentLine, int totalLines);
 void asfPercentMeter(double inPercent);
 void asfRunWatchDog(double delay);
 void asfStopWatchDog(void);
+/* Makes the next progress report stop the program, as if the user had
+   created stop.txt in the tmp dir.  Safe to call from a signal handler. */
+void asfRequestStop(void);
+
+/* Prototypes from job.c ****************************************************/
+/* A job runs library code with its own log, quiet flag, tmp dir and
+   libasf_proj average height, and turns errors that would exit the
+   program into an error return from asfJobRun().  See job.c. */
+typedef struct {
+  int status;               /* 0, or the exit code of the error that
+                               stopped the job */
+  char error[4096];         /* message of that error */
+  FILE *log;                /* job's log file, NULL for none */
+  int quiet;                /* job's quietflag */
+  char *tmp_dir;            /* job's tmp dir, NULL for the process one */
+  double proj_avg_height;   /* see project_set_avg_height() */
+  struct asf_job_file *files;/* opened with FOPEN while running */
+} asf_job_t;
+typedef int asf_job_fn(void *data);
+/* asfJobRun() return when a job is already running in another thread */
+#define ASF_JOB_BUSY (-1)
+asf_job_t *asfJobNew(const char *log_file, const char *tmp_dir, int quiet);
+void asfJobFree(asf_job_t *job);
+int asfJobRun(asf_job_t *job, asf_job_fn *fn, void *data);
+const char *asfJobError(const asf_job_t *job);
+/* The job running in this thread, or NULL */
+asf_job_t *asfCurrentJob(void);
+/* Stops the job running in this thread; returns only if there is none,
+   or if threads it started may still be running (see below) */
+void asfJobFail(int code, const char *message);
+/* Bracket code that has other threads running (parallel_rows(), reader
+   threads): an error in between exits the program even inside a job */
+void asfJobEnterThreads(void);
+void asfJobLeaveThreads(void);
+/* Used by FOPEN/FCLOSE: files still open when a job fails are closed */
+void asfJobAddFile(FILE *fp);
+void asfJobRemoveFile(FILE *fp);
+
+/* Prototypes from profile.c ************************************************/
+/* Run profiling: per-stage wall/CPU time and counters, plus named timers.
+   Everything is a no-op until asfProfileStart() is called. */
+typedef enum {
+  PROFILE_BYTES_READ,
+  PROFILE_BYTES_WRITTEN,
+  PROFILE_LINES_READ,
+  PROFILE_LINES_WRITTEN,
+  PROFILE_TILE_HITS,
+  PROFILE_TILE_MISSES,
+  PROFILE_TILE_EVICTIONS,
+  PROFILE_PROJ_CALLS,
+  PROFILE_PROJ_POINTS,
+  PROFILE_COUNTER_COUNT
+} asf_profile_counter_t;
+typedef struct {
+  int id;
+  double wall, cpu;
+} asf_profile_timer_t;
+extern int asf_profile_enabled;
+extern long long asf_profile_counts[PROFILE_COUNTER_COUNT];
+/* Cheap enough for inner loops: one flag test when profiling is off */
+#define asfProfileCount(counter, n) \
+  do { if (asf_profile_enabled) asf_profile_counts[counter] += (n); } while (0)
+/* Report goes to out_file, as JSON if it ends in .json, otherwise CSV */
+void asfProfileStart(const char *out_file);
+/* End the current stage and start a new one (update_status() calls this) */
+void asfProfileStage(const char *name);
+void asfProfileTimerStart(asf_profile_timer_t *timer, const char *name);
+void asfProfileTimerStop(asf_profile_timer_t *timer);
+/* Write the report and turn profiling off */
+void asfProfileFinish(void);
 
 /* Prototype from splash_screen.c ********************************************/
 /* Print the commandline captured, date, and PID to screen & logfile */
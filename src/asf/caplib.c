@@ -26,6 +26,13 @@ possible.
 
 behavior_on_error_t caplib_behavior_on_error = BEHAVIOR_ON_ERROR_ABORT;
 
+/* Inside a job (see job.c) the error stops just the job */
+static void caplib_exit(int code, const char *message)
+{
+    asfJobFail(code, message);
+    exit(code);
+}
+
 void programmer_error(char *mess)
 {
     char error_message[1024];
@@ -44,7 +51,7 @@ void programmer_error(char *mess)
       fprintf(fLog,"%s",error_message);
 
         /* always abort for programmer error */
-    exit(199);
+    caplib_exit(199, error_message);
 }
 
 void bail(const char *mess, ...)
@@ -72,7 +79,13 @@ void bail(const char *mess, ...)
   }
 
   /* bail ignores behavior_on_error, always aborts */
-  exit(198);
+  {
+    char error_message[1024];
+    va_start(ap, mess);
+    vsnprintf(error_message, sizeof(error_message), mess, ap);
+    va_end(ap);
+    caplib_exit(198, error_message);
+  }
 }
 
 /* MALLOC ignores behavior_on_error -- if out of memory, we should quit */
@@ -100,7 +113,7 @@ void *MALLOC(size_t size)
             if (fLog!=NULL)
               fprintf(fLog,"%s",error_message);
 
-                        exit(200);
+                        caplib_exit(200, error_message);
         }
 #endif
 #ifdef EAGAIN
@@ -126,7 +139,7 @@ void *MALLOC(size_t size)
                 if (fLog!=NULL)
                   fprintf(fLog,"%s",error_message);
 
-                                exit(201);
+                                caplib_exit(201, error_message);
             }
             else return ret;
         }
@@ -146,7 +159,7 @@ void *MALLOC(size_t size)
         if (fLog!=NULL)
           fprintf(fLog,"%s",error_message);
 
-                exit(202);
+                caplib_exit(202, error_message);
     }
     return ret;
 }
@@ -176,7 +189,7 @@ void *CALLOC(size_t nmemb, size_t size)
       if (fLog!=NULL)
         fprintf(fLog,"%s",error_message);
 
-      exit(200);
+      caplib_exit(200, error_message);
     }
 #endif
 #ifdef EAGAIN
@@ -202,7 +215,7 @@ void *CALLOC(size_t nmemb, size_t size)
         if (fLog!=NULL)
           fprintf(fLog,"%s",error_message);
 
-        exit(201);
+        caplib_exit(201, error_message);
       }
       else return ret;
     }
@@ -222,7 +235,7 @@ void *CALLOC(size_t nmemb, size_t size)
     if (fLog!=NULL)
       fprintf(fLog,"%s",error_message);
 
-    exit(202);
+    caplib_exit(202, error_message);
   }
   return ret;
 }
@@ -293,9 +306,13 @@ FILE *FOPEN(const char *file,const char *mode)
                 fprintf(stderr,"%s",error_message);
                 if (fLog!=NULL) fprintf(fLog,"%s",error_message);
 
-                if (caplib_behavior_on_error == BEHAVIOR_ON_ERROR_ABORT)
-                    exit(203);
+                if (caplib_behavior_on_error == BEHAVIOR_ON_ERROR_ABORT) {
+                    sprintf(error_message, "Cannot open file: %.900s\n", file);
+                    caplib_exit(203, error_message);
+                }
     }
+    else
+        asfJobAddFile(ret);
     return ret;
 }
 
@@ -335,13 +352,13 @@ size_t FREAD(void *ptr,size_t size,size_t nitems,FILE *stream)
 	      fprintf(fLog,"%s",error_message);
 
             if (caplib_behavior_on_error == BEHAVIOR_ON_ERROR_ABORT)
-                exit(204);
+                caplib_exit(204, error_message);
             else
                 return ret;
 
             // not reached
             fprintf(stderr, "%s",error_message);
-            exit(204);
+            caplib_exit(204, error_message);
         }
 
         sprintf(error_message,
@@ -365,8 +382,11 @@ size_t FREAD(void *ptr,size_t size,size_t nitems,FILE *stream)
         if (fLog!=NULL)
 	  fprintf(fLog,"%s",error_message);
 
-        if (caplib_behavior_on_error == BEHAVIOR_ON_ERROR_ABORT)
-            exit(205);
+        if (caplib_behavior_on_error == BEHAVIOR_ON_ERROR_ABORT) {
+            sprintf(error_message, "Error reading file stream %p: %s\n",
+                    stream, strerror(errno));
+            caplib_exit(205, error_message);
+        }
     }
     return ret;
 }
@@ -432,7 +452,7 @@ size_t FWRITE(const void *ptr,size_t size,size_t nitems,FILE *stream)
           fprintf(fLog,"%s",error_message);
 
                 /* write errors we will still make fatal */
-                exit(206);
+                caplib_exit(206, error_message);
     }
     return ret;
 }
@@ -523,8 +543,10 @@ long long FTELL64(FILE *stream)
 
 int FCLOSE(FILE *stream)
 {
-    if (stream)
+    if (stream) {
+        asfJobRemoveFile(stream);
         return (int) fclose(stream);
+    }
     else
         return 0;
 }
@@ -0,0 +1,271 @@
+/******************************************************************************
+NAME:
+ job.c
+
+DESCRIPTION:
+ Jobs: running library code without the process going down with it.
+
+ Normally asfPrintError() and the caplib routines (MALLOC, FOPEN, FREAD
+ ...) exit the program when something goes wrong, and the log file, the
+ quiet flag, the tmp dir and the average height used by libasf_proj are
+ process-wide.  That is fine for the command line tools, but a worker
+ that processes scene after scene would have to start a new process for
+ each one, throwing away everything it has cached.
+
+ asfJobRun() runs a function as a job.  While it runs, output goes to
+ the job's own log and quiet setting, and get_asf_tmp_dir() and the
+ libasf_proj average height are the job's.  An error anywhere in the
+ job stops the job instead of the program: asfJobRun() returns the exit
+ code the error would have used, and asfJobError() has the message.
+
+SPECIAL CONSIDERATIONS:
+ Errors unwind straight back to asfJobRun() with longjmp(), so nothing
+ between the error and asfJobRun() gets to clean up.  What that leaves
+ behind after a failed job:
+
+  - Files the job opened with FOPEN and has not closed with FCLOSE are
+    closed by asfJobRun().  Files opened with plain fopen() stay open.
+  - Memory the job had allocated is not released.  That is a leak per
+    failed scene, not per scene.
+  - The metadata parser's block stack and the lexer's buffered input
+    are dropped by the next parse_metadata(), which also resets the
+    rest of the parser's state.  The meta_read() cache only ever holds
+    complete entries.
+  - Any other static state in the libraries is left as the failed job
+    had it.  Code that keeps such state must not rely on a job
+    finishing.
+
+ Not every error goes through asfPrintError(): the metadata parser and
+ a good deal of older library code call exit() directly, and a crash
+ or failed assert takes the process down as well.  Jobs therefore
+ suit a worker that can afford to lose the process now and then; the
+ batch modes of asf_convert and asf_mapready still run each item as a
+ child process.
+
+ Only one job runs at a time: much of the library (the metadata parser,
+ for one) keeps static state.  asfJobRun() fails with ASF_JOB_BUSY if
+ another thread is running a job; run concurrent scenes in separate
+ worker processes.
+
+ Unwinding is not safe while other threads may still use the stack or
+ buffers of the job -- parallel_rows() runs its last chunk on the
+ calling thread, for instance.  Such code is bracketed with
+ asfJobEnterThreads() and asfJobLeaveThreads(), and an error in between
+ exits the program as it would outside a job.  Threads started by the
+ job are not part of it, and exit on an error as well.
+******************************************************************************/
+#include "asf.h"
+#include <setjmp.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __GNUC__
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
+// Job running in this thread, and where to go if it fails
+static THREAD_LOCAL asf_job_t *current_job = NULL;
+static THREAD_LOCAL jmp_buf *current_recover = NULL;
+
+// Nesting depth of asfJobEnterThreads() in this thread
+static THREAD_LOCAL int threads_live = 0;
+
+// Set while a thread is running a job
+static volatile int job_running = FALSE;
+
+// A file opened with FOPEN while a job was running.  The device and
+// inode are used to make sure the descriptor still belongs to that file
+// before closing it, in case it was closed with fclose() rather than
+// FCLOSE and then reused.
+struct asf_job_file {
+  FILE *fp;
+  int fd;
+  dev_t dev;
+  ino_t ino;
+  struct asf_job_file *next;
+};
+
+void asfJobAddFile(FILE *fp)
+{
+  asf_job_t *job = current_job;
+  struct asf_job_file *f;
+  struct stat st;
+
+  if (!job || !fp || fstat(fileno(fp), &st) != 0)
+    return;
+  f = (struct asf_job_file *) MALLOC(sizeof(struct asf_job_file));
+  f->fp = fp;
+  f->fd = fileno(fp);
+  f->dev = st.st_dev;
+  f->ino = st.st_ino;
+  f->next = job->files;
+  job->files = f;
+}
+
+void asfJobRemoveFile(FILE *fp)
+{
+  asf_job_t *job = current_job;
+  struct asf_job_file **p;
+
+  if (!job)
+    return;
+  for (p = &job->files; *p; p = &(*p)->next) {
+    if ((*p)->fp == fp) {
+      struct asf_job_file *f = *p;
+      *p = f->next;
+      FREE(f);
+      return;
+    }
+  }
+}
+
+// Forgets the files of a job once it is done.  If the job failed they
+// are closed.  Otherwise they stay open, and are handed on to the
+// enclosing job, if any, in case that one fails.
+static void release_files(asf_job_t *job, asf_job_t *outer_job, int failed)
+{
+  while (job->files) {
+    struct asf_job_file *f = job->files;
+    job->files = f->next;
+    if (!failed && outer_job) {
+      f->next = outer_job->files;
+      outer_job->files = f;
+      continue;
+    }
+    if (failed) {
+      struct stat st;
+      if (fstat(f->fd, &st) == 0 && st.st_dev == f->dev &&
+          st.st_ino == f->ino)
+        fclose(f->fp);
+    }
+    FREE(f);
+  }
+}
+
+void asfJobEnterThreads(void)
+{
+  ++threads_live;
+}
+
+void asfJobLeaveThreads(void)
+{
+  if (threads_live > 0)
+    --threads_live;
+}
+
+asf_job_t *asfJobNew(const char *log_file, const char *tmp_dir, int quiet)
+{
+  asf_job_t *job = (asf_job_t *) CALLOC(1, sizeof(asf_job_t));
+
+  job->status = 0;
+  job->error[0] = '\0';
+  job->log = NULL;
+  if (log_file && strlen(log_file) > 0) {
+    job->log = fopen(log_file, "a");
+    if (!job->log)
+      asfPrintWarning("Could not open job log file: %s\n", log_file);
+  }
+  job->quiet = quiet;
+  job->tmp_dir = NULL;
+  if (tmp_dir && strlen(tmp_dir) > 0) {
+    job->tmp_dir = STRDUP(tmp_dir);
+    if (job->tmp_dir[strlen(job->tmp_dir) - 1] == DIR_SEPARATOR)
+      job->tmp_dir[strlen(job->tmp_dir) - 1] = '\0';
+  }
+  job->proj_avg_height = 0.0;
+  job->files = NULL;
+
+  return job;
+}
+
+void asfJobFree(asf_job_t *job)
+{
+  if (job) {
+    if (job->log)
+      fclose(job->log);
+    FREE(job->tmp_dir);
+    FREE(job);
+  }
+}
+
+asf_job_t *asfCurrentJob(void)
+{
+  return current_job;
+}
+
+const char *asfJobError(const asf_job_t *job)
+{
+  return job->error;
+}
+
+/* Run fn(data) as a job.  Returns what fn returned, or, if an error
+   stopped the job, the exit code the error would have exited with. */
+int asfJobRun(asf_job_t *job, asf_job_fn *fn, void *data)
+{
+  asf_job_t *outer_job = current_job;
+  jmp_buf *outer_recover = current_recover;
+  int outer_threads = threads_live;
+  jmp_buf recover;
+  volatile int ret;
+
+  // A job started from within a job is part of the same run
+  if (!outer_job) {
+#ifdef __GNUC__
+    if (!__sync_bool_compare_and_swap(&job_running, FALSE, TRUE)) {
+#else
+    if (job_running) {
+#endif
+      job->status = ASF_JOB_BUSY;
+      strcpy(job->error, "Another job is already running.\n");
+      return job->status;
+    }
+#ifndef __GNUC__
+    job_running = TRUE;
+#endif
+  }
+
+  job->status = 0;
+  job->error[0] = '\0';
+  current_job = job;
+  current_recover = &recover;
+
+  threads_live = 0;
+
+  if (setjmp(recover) == 0) {
+    ret = fn(data);
+    release_files(job, outer_job, FALSE);
+  }
+  else {
+    ret = job->status;
+    release_files(job, outer_job, TRUE);
+  }
+
+  threads_live = outer_threads;
+  current_job = outer_job;
+  current_recover = outer_recover;
+  if (!outer_job)
+    job_running = FALSE;
+  if (job->log)
+    fflush(job->log);
+
+  return ret;
+}
+
+/* Stop the job running in this thread, reporting code and message to
+   asfJobRun().  Returns (so the caller can exit as usual) if this thread
+   isn't running a job, or is between asfJobEnterThreads() and
+   asfJobLeaveThreads(). */
+void asfJobFail(int code, const char *message)
+{
+  asf_job_t *job = current_job;
+
+  if (!job || !current_recover || threads_live > 0)
+    return;
+
+  job->status = code ? code : EXIT_FAILURE;
+  strncpy(job->error, message ? message : "", sizeof(job->error) - 1);
+  job->error[sizeof(job->error) - 1] = '\0';
+  longjmp(*current_recover, 1);
+}
@@ -33,6 +33,18 @@ void set_status_file(const char *status_file)
 
 void update_status(const char *format, ...)
 {
+  // Every status update starts a new stage in the run profile
+  if (asf_profile_enabled) {
+    char stage[256];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(stage, sizeof(stage), format, ap);
+    va_end(ap);
+    asfProfileStage(stage);
+  }
+  // The status file belongs to the process, not to a job
+  if (asfCurrentJob())
+    return;
   if (statusflag && g_status_file && strlen(g_status_file) > 0) {
     FILE *fStat = fopen(g_status_file, "w");
     if (fStat) {
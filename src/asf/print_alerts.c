@@ -7,26 +7,142 @@ DESCRIPTION:
 ******************************************************************************/
 #include "asf.h"
 #include <sys/time.h>
+#include <signal.h>
+#include <unistd.h>
 
 report_level_t g_report_level=REPORT_LEVEL_WARNING;
 
+// Status output is flushed at most this often (seconds), the meters
+// update at most this often, and the tmp dir is checked for a stop.txt
+// at most this often.  Progress reporting sits in the inner loops of
+// geocoding, terrain correction, import ... so it has to be cheap.
+#define FLUSH_INTERVAL 0.25
+#define METER_INTERVAL 0.2
+#define STOP_CHECK_INTERVAL 1.0
+
+static volatile sig_atomic_t stop_requested = FALSE;
+static double last_flush = 0;
+static int output_pending = FALSE;
+
+static double wall_clock()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+/* Ask the running process to stop, at the next progress report.  Only
+   sets a flag, so it is safe to call from a signal handler. */
+void asfRequestStop(void)
+{
+  stop_requested = TRUE;
+}
+
+#ifdef SIGUSR1
+static void stop_signal_handler(int sig)
+{
+  stop_requested = TRUE;
+}
+#endif
+
+// Stopping is requested by creating stop.txt in the tmp dir (that's what
+// the GUIs do), by calling asfRequestStop(), or by sending SIGUSR1 -- as
+// long as the program hasn't set up a handler of its own for that.
 static void check_stop()
 {
-    snprintf(logbuf, sizeof(logbuf), "%s/stop.txt", get_asf_tmp_dir());
-    if (fileExists(logbuf)) {
-        remove(logbuf);
-        asfPrintError("Interrupted by user.\n");
+  static double last_check = -1;
+  static int handler_installed = FALSE;
+
+#ifdef SIGUSR1
+  if (!handler_installed) {
+    struct sigaction sa, old_sa;
+    handler_installed = TRUE;
+    if (sigaction(SIGUSR1, NULL, &old_sa) == 0 &&
+        old_sa.sa_handler == SIG_DFL) {
+      memset(&sa, 0, sizeof(sa));
+      sa.sa_handler = stop_signal_handler;
+      sigemptyset(&sa.sa_mask);
+      sigaction(SIGUSR1, &sa, NULL);
     }
+  }
+#endif
+
+  if (!stop_requested) {
+    double now = wall_clock();
+    if (last_check >= 0 && now - last_check < STOP_CHECK_INTERVAL)
+      return;
+    last_check = now;
+
+    char stop_file[1024];
+    snprintf(stop_file, sizeof(stop_file), "%s/stop.txt", get_asf_tmp_dir());
+    if (!fileExists(stop_file))
+      return;
+    remove(stop_file);
+  }
+
+  stop_requested = FALSE;
+  asfPrintError("Interrupted by user.\n");
+}
+
+// Where output goes: the log and quiet flag of the job running in this
+// thread (see job.c), if any, otherwise the process-wide ones.
+static FILE *report_log()
+{
+  asf_job_t *job = asfCurrentJob();
+
+  if (job)
+    return job->log;
+  if (logflag && !fLog) {
+    // re-entry here, but it's ok since we change the flag...
+    logflag = FALSE;
+    asfPrintWarning("Error writing to log file: invalid file pointer\n");
+  }
+  return logflag ? fLog : NULL;
+}
+
+static int report_quiet()
+{
+  asf_job_t *job = asfCurrentJob();
+  return job ? job->quiet : quietflag;
+}
+
+// Flushes the terminal and the log, unless we did that very recently.
+// Output left in the buffers goes out with the next report, or at exit.
+// Holding output back is only done when someone is watching a terminal:
+// when stdout goes to a pipe or a file (the GUIs run the tools that way)
+// every report goes out right away, as nothing would flush it otherwise
+// while the tool is busy.
+static void flush_output(int force)
+{
+  static int stdout_is_tty = -1;
+  double now = wall_clock();
+
+  if (stdout_is_tty < 0)
+    stdout_is_tty = isatty(fileno(stdout)) ? TRUE : FALSE;
+
+  if (!force && stdout_is_tty && now - last_flush < FLUSH_INTERVAL) {
+    output_pending = TRUE;
+    return;
+  }
+
+  FILE *log = report_log();
+
+  fflush(stdout);
+  if (log)
+    fflush(log);
+  last_flush = now;
+  output_pending = FALSE;
 }
 
 /* Do not print to the terminal, only report to the log file */
 void asfPrintToLogOnly(const char *format, ...)
 {
+  FILE *log = report_log();
   va_list ap;
   va_start(ap, format);
-  if (logflag) {
-    vfprintf(fLog, format, ap);
-    fflush (fLog);
+  if (log) {
+    vfprintf(log, format, ap);
+    fflush (log);
   }
   va_end(ap);
 }
@@ -34,49 +150,40 @@ void asfPrintToLogOnly(const char *format, ...)
 /* Basically a printf that pays attention to quiet & log flags */
 void asfPrintStatus(const char *format, ...)
 {
+  FILE *log = report_log();
   va_list ap;
-  if (!quietflag) {
+  if (!report_quiet()) {
     va_start(ap, format);
     vprintf(format, ap);
     va_end(ap);
-  
-    fflush (stdout);
   }
-  if (logflag) {
-    if (!fLog) {
-      logflag = FALSE;
-      asfPrintWarning("Error writing to log file: invalid file pointer\n");
-    }
+  if (log) {
     va_start(ap, format);
-    vfprintf(fLog, format, ap);
+    vfprintf(log, format, ap);
     va_end(ap);
-
-    fflush (fLog);
   }
 
+  flush_output(FALSE);
   check_stop();
 }
 
 /* Basically a printf that pays attention to log flag but NOT the quiet flag */
 void asfForcePrintStatus(const char *format, ...)
 {
+  FILE *log = report_log();
   va_list ap;
 
   va_start(ap, format);
   vprintf(format, ap);
   va_end(ap);
 
-  if (logflag) {
-    if (!fLog) {
-      logflag = FALSE;
-      asfPrintWarning("Error writing to log file: invalid file pointer\n");
-    }
+  if (log) {
     va_start(ap, format);
-    vfprintf(fLog, format, ap);
+    vfprintf(log, format, ap);
     va_end(ap);
-
-    fflush (fLog);
   }
+
+  flush_output(FALSE);
 }
 
 /* Report warning to user & log file, then continue the program  */
@@ -84,39 +191,34 @@ void asfPrintWarning(const char *format, ...)
 {
   const char *warningBegin = "\n** Warning: ********\n";
   const char *warningEnd = "** End of warning **\n\n";
-
-  if (logflag && !fLog) {
-    // re-entry here, but it's ok since we change the flag...
-    logflag = FALSE;
-    asfPrintWarning("Error writing to log file: invalid file pointer\n");
-  }
+  FILE *log = report_log();
+  int quiet = report_quiet();
 
   va_list ap;
 
-  if (quietflag < 2)
+  if (quiet < 2)
     printf("%s", warningBegin);
-  if (logflag)
-    fprintf(fLog, "%s", warningBegin);
+  if (log)
+    fprintf(log, "%s", warningBegin);
 
-  if (quietflag < 2) {
+  if (quiet < 2) {
     va_start(ap, format);
     vprintf(format, ap);
     va_end(ap);
   }
-  if (logflag) {
+  if (log) {
     va_start(ap, format);
-    vfprintf(fLog, format, ap);
+    vfprintf(log, format, ap);
     va_end(ap);
   }
   
-  if (quietflag < 2) {
+  if (quiet < 2)
     printf("%s", warningEnd);
-    fflush (stdout);
-  }
-  if (logflag) {
-    fprintf(fLog, "%s", warningEnd);
-    fflush (fLog);
-  }
+  if (log)
+    fprintf(log, "%s", warningEnd);
+
+  // warnings go out right away
+  flush_output(TRUE);
 }
 
 
@@ -125,6 +227,21 @@ void asfPrintError(const char *format, ...)
 {
   const char *errorBegin = "\n** Error: ********\n";
   const char *errorEnd = "** End of error **\n\n";
+  asf_job_t *job = asfCurrentJob();
+
+  // Inside a job, the error goes to the job's log and stops just the job
+  if (job) {
+    char message[4096];
+    va_list ap;
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+    if (!job->quiet)
+      printf("%s%s%s", errorBegin, message, errorEnd);
+    if (job->log)
+      fprintf(job->log, "%s%s%s", errorBegin, message, errorEnd);
+    asfJobFail(EXIT_FAILURE, message);
+  }
 
   if (logflag && !fLog) {
     logflag = FALSE;
@@ -199,21 +316,27 @@ void asfReport(report_level_t level, const char *format, ...)
 }
 
 /******************************************************************************
- * Report the number of lines processed out of the total number of lines */
+ * Report the number of lines processed out of the total number of lines.
+ * Called for every line, so this only does real work a few times a second */
 void asfLineMeter(int currentLine, int totalLines)
 {
+  static double last_report = 0;
   char *null="", *newline="\n", *endline;
   char *present="ing", *past="ed ", *tense;
-  int blather;
+  double now;
 
   /* Since C is 0 indexed and totalLines is 1 indexed, add 1 to currentLine*/
   currentLine++;
 
-  /* Flag to report every 128 lines */
-  blather = currentLine%128==0 || currentLine==1 || currentLine==totalLines;
-
-  /* Leave if we're not going to blather at the user (or log) */
-  if (!blather) return;
+  /* Report the first and the last line, and in between every so often */
+  if (currentLine!=1 && currentLine!=totalLines) {
+    now = wall_clock();
+    if (now - last_report < METER_INTERVAL)
+      return;
+  }
+  else
+    now = wall_clock();
+  last_report = now;
 
   /* Concoct status message */
   endline = (currentLine!=totalLines) ? null : newline;
@@ -222,21 +345,26 @@ void asfLineMeter(int currentLine, int totalLines)
           tense, currentLine, totalLines, endline);
 
   /* Report to terminal */
-  if (!quietflag) {
+  if (!report_quiet()) {
     printf("%c%s",'\r',logbuf);
-    fflush(NULL);
+    fflush(stdout);
   }
 
   /* Report to the log as well */
   /* Only on the last line */
-  if (logflag && currentLine==totalLines) {
-    strcat(logbuf, "\n");
-    printLog(logbuf);
+  if (currentLine==totalLines) {
+    FILE *log = report_log();
+    if (log)
+      fprintf(log, "%s\n", logbuf);
   }
 
-  /* Check if we should abort every once in a while */
-  if (currentLine%640==0 || currentLine==totalLines)
-    check_stop();
+  /* Status messages held back by flush_output() go out with the meter,
+     and so does the log line we wrote when done */
+  if (output_pending || currentLine==totalLines)
+    flush_output(FALSE);
+
+  /* Check if we should abort */
+  check_stop();
 }
 
 /******************************************************************************
@@ -245,39 +373,46 @@ void asfPercentMeter(double inPercent)
 {
   char *null="", *newline="\n", *endline;
   static int oldPercent=-1;
+  static double last_report = 0;
   int newPercent;
-  int blather;
 
   /* Get inPercent to integer form */
   newPercent = (int)(inPercent * 100.0);
 
-  /* Flag to report every 1% or more */
-  blather = newPercent-oldPercent >= 1;
+  /* Report every 1% or more, but not more often than the line meter.
+     Always report when we're done. */
+  if (newPercent == oldPercent)
+    return;
+  if (newPercent != 100 && oldPercent >= 0 && newPercent > oldPercent &&
+      wall_clock() - last_report < METER_INTERVAL)
+    return;
   oldPercent = newPercent;
-
-  /* Quit now if we're not going to blather at the user */
-  if (!blather) return;
+  last_report = wall_clock();
 
   /* Figure status message in correct format & tense */
   endline = (newPercent!=100) ? null : newline;
   sprintf(logbuf,"Processed %3d%%%s", newPercent, endline);
 
   /* Report to terminal */
-  if (!quietflag) {
+  if (!report_quiet()) {
     printf("%c%s",'\r',logbuf);
-    fflush(NULL);
-    inPercent++;
+    fflush(stdout);
   }
   /* Report to the log as well */
   /* Only on the last line */
-  if (logflag && newPercent==100) {
-    strcat(logbuf, "\n");
-    printLog(logbuf);
+  if (newPercent==100) {
+    FILE *log = report_log();
+    if (log)
+      fprintf(log, "%s\n", logbuf);
   }
 
-  /* Check if we should abort, 10 times during processing */
-  if (newPercent%10==0)
-    check_stop();
+  /* Status messages held back by flush_output() go out with the meter,
+     and so does the log line we wrote when done */
+  if (output_pending || newPercent==100)
+    flush_output(FALSE);
+
+  /* Check if we should abort */
+  check_stop();
 }
 
 // Cute watch dog indicator ...just something on the screen
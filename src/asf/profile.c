@@ -0,0 +1,299 @@
+/******************************************************************************
+NAME:
+ profile.c
+
+DESCRIPTION:
+ Lightweight instrumentation for finding out where a run spends its time.
+
+ A run is split into stages (asfProfileStage(), which update_status()
+ calls with its message, so every step asf_mapready reports to the GUI
+ is a stage).  For each stage we record the wall clock and CPU time,
+ and how much the counters incremented with asfProfileCount() moved --
+ bytes and lines through ioLine.c, FloatImage tile cache hits, misses
+ and evictions, and libproj calls.  Named timers (asfProfileTimerStart()
+ / asfProfileTimerStop()) accumulate time spent in one piece of code
+ across the whole run.
+
+ Nothing is recorded until asfProfileStart() is called, and while it is
+ off asfProfileCount() is a single test of a global flag, so the hooks
+ can stay in the inner loops.  asfProfileFinish() writes the report, as
+ JSON if the file name ends in ".json" and as CSV otherwise.
+
+ The counters are plain (not atomic) adds, so counts made from several
+ threads at the same time may come up a little short.
+******************************************************************************/
+#include "asf.h"
+#include <sys/time.h>
+#include <time.h>
+
+#define MAX_PROFILE_TIMERS 64
+
+int asf_profile_enabled = FALSE;
+long long asf_profile_counts[PROFILE_COUNTER_COUNT];
+
+static const char *counter_names[PROFILE_COUNTER_COUNT] = {
+  "bytes_read",
+  "bytes_written",
+  "lines_read",
+  "lines_written",
+  "tile_hits",
+  "tile_misses",
+  "tile_evictions",
+  "proj_calls",
+  "proj_points"
+};
+
+typedef struct {
+  char *name;
+  double wall, cpu;
+  long long counts[PROFILE_COUNTER_COUNT];
+} profile_stage_t;
+
+typedef struct {
+  const char *name;
+  long long calls;
+  double wall, cpu;
+} profile_timer_t;
+
+static char *profile_file = NULL;
+static profile_stage_t *stages = NULL;
+static int num_stages = 0, max_stages = 0;
+static int stage_open = FALSE;
+static double run_wall, run_cpu;
+static profile_timer_t timers[MAX_PROFILE_TIMERS];
+static int num_timers = 0;
+
+static double wall_clock()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static double cpu_clock()
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static void end_stage()
+{
+  profile_stage_t *s;
+  int ii;
+
+  if (!stage_open)
+    return;
+  s = &stages[num_stages-1];
+  s->wall = wall_clock() - s->wall;
+  s->cpu = cpu_clock() - s->cpu;
+  for (ii=0; ii<PROFILE_COUNTER_COUNT; ii++)
+    s->counts[ii] = asf_profile_counts[ii] - s->counts[ii];
+  stage_open = FALSE;
+}
+
+/* Turn profiling on.  The report goes to out_file when asfProfileFinish()
+   is called. */
+void asfProfileStart(const char *out_file)
+{
+  int ii;
+
+  FREE(profile_file);
+  profile_file = STRDUP(out_file);
+  for (ii=0; ii<num_stages; ii++)
+    FREE(stages[ii].name);
+  num_stages = 0;
+  stage_open = FALSE;
+  num_timers = 0;
+  for (ii=0; ii<PROFILE_COUNTER_COUNT; ii++)
+    asf_profile_counts[ii] = 0;
+  run_wall = wall_clock();
+  run_cpu = cpu_clock();
+  asf_profile_enabled = TRUE;
+}
+
+/* End the current stage, if any, and start a new one */
+void asfProfileStage(const char *name)
+{
+  profile_stage_t *s;
+  int ii;
+
+  if (!asf_profile_enabled)
+    return;
+  end_stage();
+
+  // Repeating the current stage (a status that is updated as the work
+  // goes on) doesn't start a new one
+  if (num_stages > 0 && strcmp(stages[num_stages-1].name, name) == 0) {
+    s = &stages[num_stages-1];
+    s->wall = wall_clock() - s->wall;
+    s->cpu = cpu_clock() - s->cpu;
+    for (ii=0; ii<PROFILE_COUNTER_COUNT; ii++)
+      s->counts[ii] = asf_profile_counts[ii] - s->counts[ii];
+    stage_open = TRUE;
+    return;
+  }
+
+  if (num_stages == max_stages) {
+    profile_stage_t *more;
+    max_stages = max_stages ? 2*max_stages : 32;
+    more = (profile_stage_t *) MALLOC(sizeof(profile_stage_t)*max_stages);
+    if (num_stages > 0)
+      memcpy(more, stages, sizeof(profile_stage_t)*num_stages);
+    FREE(stages);
+    stages = more;
+  }
+  s = &stages[num_stages++];
+  s->name = STRDUP(name);
+  s->wall = wall_clock();
+  s->cpu = cpu_clock();
+  for (ii=0; ii<PROFILE_COUNTER_COUNT; ii++)
+    s->counts[ii] = asf_profile_counts[ii];
+  stage_open = TRUE;
+}
+
+/* Start timing a piece of code.  Timers with the same name add up; name
+   must stay valid until the report is written (a string literal). */
+void asfProfileTimerStart(asf_profile_timer_t *timer, const char *name)
+{
+  timer->id = -1;
+  if (!asf_profile_enabled)
+    return;
+  for (timer->id=0; timer->id<num_timers; timer->id++)
+    if (timers[timer->id].name == name ||
+        strcmp(timers[timer->id].name, name) == 0)
+      break;
+  if (timer->id == num_timers) {
+    if (num_timers == MAX_PROFILE_TIMERS) {
+      timer->id = -1;
+      return;
+    }
+    timers[num_timers].name = name;
+    timers[num_timers].calls = 0;
+    timers[num_timers].wall = timers[num_timers].cpu = 0.0;
+    num_timers++;
+  }
+  timer->wall = wall_clock();
+  timer->cpu = cpu_clock();
+}
+
+void asfProfileTimerStop(asf_profile_timer_t *timer)
+{
+  profile_timer_t *t;
+
+  if (timer->id < 0 || !asf_profile_enabled)
+    return;
+  t = &timers[timer->id];
+  t->calls++;
+  t->wall += wall_clock() - timer->wall;
+  t->cpu += cpu_clock() - timer->cpu;
+}
+
+static int is_json(const char *file)
+{
+  const char *ext = findExt(file);
+  return ext && strcmp_case(ext, ".json") == 0;
+}
+
+static void write_json(FILE *fp, double wall, double cpu)
+{
+  int ii, kk;
+
+  fprintf(fp, "{\n  \"wall_s\": %.6f,\n  \"cpu_s\": %.6f,\n", wall, cpu);
+  fprintf(fp, "  \"counters\": {");
+  for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+    fprintf(fp, "%s\"%s\": %lld", kk ? ", " : "", counter_names[kk],
+            asf_profile_counts[kk]);
+  fprintf(fp, "},\n  \"stages\": [\n");
+  for (ii=0; ii<num_stages; ii++) {
+    profile_stage_t *s = &stages[ii];
+    const char *c;
+    fprintf(fp, "    {\"name\": \"");
+    for (c=s->name; *c; c++) {
+      if (*c == '"' || *c == '\\')
+        fprintf(fp, "\\%c", *c);
+      else if ((unsigned char)*c >= ' ')
+        fputc(*c, fp);
+    }
+    fprintf(fp, "\", \"wall_s\": %.6f, \"cpu_s\": %.6f", s->wall, s->cpu);
+    for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+      fprintf(fp, ", \"%s\": %lld", counter_names[kk], s->counts[kk]);
+    fprintf(fp, "}%s\n", ii < num_stages-1 ? "," : "");
+  }
+  fprintf(fp, "  ],\n  \"timers\": [\n");
+  for (ii=0; ii<num_timers; ii++)
+    fprintf(fp, "    {\"name\": \"%s\", \"calls\": %lld, \"wall_s\": %.6f, "
+            "\"cpu_s\": %.6f}%s\n", timers[ii].name, timers[ii].calls,
+            timers[ii].wall, timers[ii].cpu, ii < num_timers-1 ? "," : "");
+  fprintf(fp, "  ]\n}\n");
+}
+
+static void write_csv(FILE *fp, double wall, double cpu)
+{
+  int ii, kk;
+
+  fprintf(fp, "kind,name,calls,wall_s,cpu_s");
+  for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+    fprintf(fp, ",%s", counter_names[kk]);
+  fprintf(fp, "\n");
+  for (ii=0; ii<num_stages; ii++) {
+    profile_stage_t *s = &stages[ii];
+    const char *c;
+    fprintf(fp, "stage,\"");
+    for (c=s->name; *c; c++) {
+      if (*c == '"')
+        fputc('"', fp);
+      if ((unsigned char)*c >= ' ')
+        fputc(*c, fp);
+    }
+    fprintf(fp, "\",1,%.6f,%.6f", s->wall, s->cpu);
+    for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+      fprintf(fp, ",%lld", s->counts[kk]);
+    fprintf(fp, "\n");
+  }
+  for (ii=0; ii<num_timers; ii++) {
+    fprintf(fp, "timer,\"%s\",%lld,%.6f,%.6f", timers[ii].name,
+            timers[ii].calls, timers[ii].wall, timers[ii].cpu);
+    for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+      fprintf(fp, ",");
+    fprintf(fp, "\n");
+  }
+  fprintf(fp, "total,\"\",1,%.6f,%.6f", wall, cpu);
+  for (kk=0; kk<PROFILE_COUNTER_COUNT; kk++)
+    fprintf(fp, ",%lld", asf_profile_counts[kk]);
+  fprintf(fp, "\n");
+}
+
+/* End the current stage, write the report and turn profiling off */
+void asfProfileFinish(void)
+{
+  FILE *fp;
+  double wall, cpu;
+  int ii;
+
+  if (!asf_profile_enabled)
+    return;
+  end_stage();
+  asf_profile_enabled = FALSE;
+  wall = wall_clock() - run_wall;
+  cpu = cpu_clock() - run_cpu;
+
+  fp = fopen(profile_file, "w");
+  if (!fp) {
+    asfPrintWarning("Could not write the profile to %s\n", profile_file);
+  }
+  else {
+    if (is_json(profile_file))
+      write_json(fp, wall, cpu);
+    else
+      write_csv(fp, wall, cpu);
+    fclose(fp);
+    asfPrintStatus("Wrote profile: %s\n", profile_file);
+  }
+
+  for (ii=0; ii<num_stages; ii++)
+    FREE(stages[ii].name);
+  FREE(stages);
+  stages = NULL;
+  num_stages = max_stages = 0;
+  FREE(profile_file);
+  profile_file = NULL;
+}
@@ -11,6 +11,17 @@ static char * s_tmp_dir = 0;
 void
 set_asf_tmp_dir(const char *tmp_dir)
 {
+    asf_job_t *job = asfCurrentJob();
+
+    /* inside a job, the tmp dir is the job's */
+    if (job) {
+      FREE(job->tmp_dir);
+      job->tmp_dir = STRDUP(tmp_dir);
+      if (job->tmp_dir[strlen(job->tmp_dir) - 1] == DIR_SEPARATOR)
+        job->tmp_dir[strlen(job->tmp_dir) - 1] = '\0';
+      return;
+    }
+
     s_tmp_dir = strdup(tmp_dir);
 
     /* remove trailing path separator, if one is present */
@@ -25,6 +36,11 @@ set_asf_tmp_dir(const char *tmp_dir)
 const char *
 get_asf_tmp_dir()
 {
+  asf_job_t *job = asfCurrentJob();
+
+  if (job && job->tmp_dir)
+    return job->tmp_dir;
+
   if (!s_tmp_dir) {
 
     // default to current directory
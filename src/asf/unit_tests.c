@@ -7,6 +7,7 @@
 
 /* System headers.  */
 #include <unistd.h>
+#include <fcntl.h>
 
 /* ASF headers.  */
 #include <asf.h>
@@ -192,13 +193,84 @@ START_TEST(test_get_float_line_from_real_star_8)
 }
 END_TEST
 
+/* Jobs (see job.c).  */
+
+/* Job that opens a file, then fails.  */
+static int failing_job(void *data)
+{
+  FILE *fp = FOPEN(BYTE_META_FILE, "r");
+  *(int *) data = fileno(fp);
+  asfPrintError("Failing on purpose (%d).\n", 42);
+  return EXIT_SUCCESS;
+}
+
+/* Job that opens a file and returns without closing it.  */
+static int open_file_job(void *data)
+{
+  *(FILE **) data = FOPEN(BYTE_META_FILE, "r");
+  return 7;
+}
+
+/* Job that fails while other threads would still be running.  */
+static int failing_threads_job(void *data)
+{
+  asfJobEnterThreads();
+  asfPrintError("Failing with threads running.\n");
+  asfJobLeaveThreads();
+  return EXIT_SUCCESS;
+}
+
+START_TEST(test_job_error_returns)
+{
+  asf_job_t *job = asfJobNew(NULL, NULL, TRUE);
+  int fd = -1;
+
+  fail_unless(asfJobRun(job, failing_job, &fd) == EXIT_FAILURE,
+              "failed job did not return its exit code");
+  fail_unless(strcmp(asfJobError(job), "Failing on purpose (42).\n") == 0,
+              "failed job did not keep the error message");
+  fail_unless(asfCurrentJob() == NULL,
+              "job still current after it failed");
+  fail_unless(fd >= 0 && fcntl(fd, F_GETFD) == -1,
+              "file opened by the failed job was not closed");
+
+  asfJobFree(job);
+}
+END_TEST
+
+START_TEST(test_job_keeps_files_on_success)
+{
+  asf_job_t *job = asfJobNew(NULL, NULL, TRUE);
+  FILE *fp = NULL;
+
+  fail_unless(asfJobRun(job, open_file_job, &fp) == 7,
+              "job did not return what its function returned");
+  fail_unless(fp && fcntl(fileno(fp), F_GETFD) != -1,
+              "file left open by a successful job was closed");
+  FCLOSE(fp);
+
+  asfJobFree(job);
+}
+END_TEST
+
+/* Must exit the process rather than unwind past the threads.  */
+START_TEST(test_job_error_with_threads_exits)
+{
+  asf_job_t *job = asfJobNew(NULL, NULL, TRUE);
+  asfJobRun(job, failing_threads_job, NULL);
+  asfJobFree(job);
+}
+END_TEST
+
 /* Machinery for running the 'check' tests.  */
 Suite *asf_suite(void)
 {
   Suite *asf = suite_create("asf");
   TCase *core = tcase_create("core");
+  TCase *jobs = tcase_create("jobs");
   
   suite_add_tcase(asf, core);
+  suite_add_tcase(asf, jobs);
 
   tcase_add_checked_fixture(core, setup, teardown);
   
@@ -206,6 +278,10 @@ Suite *asf_suite(void)
   tcase_add_test(core, test_get_float_line_from_byte);
   tcase_add_test(core, test_get_float_line_from_real_star_8);
 
+  tcase_add_test(jobs, test_job_error_returns);
+  tcase_add_test(jobs, test_job_keeps_files_on_success);
+  tcase_add_exit_test(jobs, test_job_error_with_threads_exits, EXIT_FAILURE);
+
   return asf;
 }
 
@@ -25,8 +25,8 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 
 #define ASF_USAGE_STRING \
 "   "ASF_NAME_STRING" [-create] [-input <inFile>] [-output <outFile>]\n"\
-"                [-tmpdir <dir>] [-log <logFile>] [-quiet] [-license]\n"\
-"                [-version] [-help]\n"\
+"                [-tmpdir <dir>] [-log <logFile>] [-profile <file>]\n"\
+"                [-quiet] [-license] [-version] [-help]\n"\
 "                <config_file>\n"
 
 #define ASF_DESCRIPTION_STRING \
@@ -64,6 +64,11 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 "   -log <logFile>\n"\
 "        Set the name and location of the log file. Default behavior is to\n"\
 "        log to tmp<processIDnumber>.log\n"\
+"   -profile <file>\n"\
+"        Write a timing profile of the run to <file>: wall clock and CPU time,\n"\
+"        bytes and lines read and written, tile cache and libproj usage for\n"\
+"        each processing step. Written as JSON if <file> ends in .json,\n"\
+"        otherwise as CSV.\n"\
 "   -quiet\n"\
 "        Suppresses most non-essential output.\n"\
 "   -license\n"\
@@ -175,6 +180,10 @@ int main(int argc, char *argv[])
   // This is an undocumented option, for internal use (by the GUI)
   int save_dem = extract_flag_options(&argc, &argv, "-save-dem", "--save-dem", NULL);
 
+  char profileFile[1024];
+  int profile = extract_string_options(&argc, &argv, profileFile,
+                                       "-profile", "--profile", NULL);
+
   // Check which options were provided
   create_f = checkForOption("-create", argc, argv);
   log_f    = checkForOption("-log", argc, argv);
@@ -279,11 +288,17 @@ int main(int argc, char *argv[])
 
   // End command line parsing *************************************************
 
+  if (profile)
+    asfProfileStart(profileFile);
+
   if (tmpConfigFile)
     asf_convert_ext(createflag, tmpConfigFile, save_dem);
   else
     asf_convert_ext(createflag, configFileName, save_dem);
 
+  if (profile)
+    asfProfileFinish();
+
   // remove log file if we created it (leave it if the user asked for it)
   FCLOSE(fLog);
   if (log_f == FLAG_NOT_SET)
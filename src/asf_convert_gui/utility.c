@@ -534,7 +534,7 @@ gboolean is_terrasarx(const char *infile)
 	(satellite && strncmp_case(satellite, "TDX", 3) == 0))
       found = TRUE;
     fclose(fp);
-    xmlFreeDoc(doc);
+    xml_free_doc(doc);
     xmlCleanupParser();
   }
    
@@ -562,7 +562,7 @@ gboolean is_radarsat2(const char *infile)
 	strcmp_case(satellite, "RADARSAT-2") == 0)
       found = TRUE;
     fclose(fp);
-    xmlFreeDoc(doc);
+    xml_free_doc(doc);
     xmlCleanupParser();
   }
 
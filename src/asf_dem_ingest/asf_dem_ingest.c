@@ -24,7 +24,8 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 
 #define ASF_USAGE_STRING \
 "   "ASF_NAME_STRING" [-proj <projFile>] [-pixel-size <pixel size>] [-list]\n"\
-"                [-log <logFile>] [-quiet] [-license] [-version] [-help]\n"\
+"                [-overlap <method>] [-log <logFile>] [-quiet] [-license]\n"\
+"                [-version] [-help]\n"\
 "                <inFile> <outFile> <dem type>\n"
 
 #define ASF_DESCRIPTION_STRING \
@@ -49,6 +50,10 @@ file. Save yourself the time and trouble, and use edit_man_header.pl. :)
 "   -list <file>\n"\
 "        The input file is list of (most probably zipped) DEM files.\n"\
 "        All these tiles are going to be mosaicked together.\n"\
+"   -overlap <method>\n"\
+"        How to fill pixels where mosaicked tiles overlap: MINIMUM, MAXIMUM,\n"\
+"        AVERAGE or OVERLAY (the value of the first tile in the list).\n"\
+"        Default is OVERLAY.\n"\
 "   -log <logFile>\n"\
 "        Set the name and location of the log file. Default behavior is to\n"\
 "        log to tmp<processIDnumber>.log\n"\
@@ -150,13 +155,29 @@ static char *get_proj_file(char *projFile)
   return ret;
 }
 
+static overlap_method_t get_overlap_method(const char *method)
+{
+  if (strcmp_case(method, "MINIMUM") == 0)
+    return MIN_OVERLAP;
+  else if (strcmp_case(method, "MAXIMUM") == 0)
+    return MAX_OVERLAP;
+  else if (strcmp_case(method, "AVERAGE") == 0)
+    return AVG_OVERLAP;
+  else if (strcmp_case(method, "OVERLAY") == 0)
+    return OVERLAY_OVERLAP;
+  else
+    asfPrintError("Overlap method '%s' not supported!\n", method);
+  return OVERLAY_OVERLAP;
+}
+
 int main(int argc, char *argv[])
 {
   char inFile[512], outFile[512], *projFile=NULL, type[10];
+  char overlap[20];
   const int pid = getpid();
   extern int logflag, quietflag;
   int quiet_f;  /* log_f is a static global */
-  int proj_f, pixel_f, list_f, ii, file_count, list=FALSE;
+  int proj_f, pixel_f, list_f, overlap_f, ii, file_count, list=FALSE;
   char **import_files;
   double pixel_size = -99;
 
@@ -178,6 +199,7 @@ int main(int argc, char *argv[])
   proj_f   = checkForOption("-proj", argc, argv);
   pixel_f  = checkForOption("-pixel-size", argc, argv);
   list_f   = checkForOption("-list", argc, argv);
+  overlap_f = checkForOption("-overlap", argc, argv);
 
   // We need to make sure the user specified the proper number of arguments
   int needed_args = 3 + REQUIRED_ARGS; // command & REQUIRED_ARGS
@@ -187,6 +209,7 @@ int main(int argc, char *argv[])
   if (proj_f != FLAG_NOT_SET) {needed_args += 2; num_flags++;} // option & param
   if (pixel_f != FLAG_NOT_SET) {needed_args += 2; num_flags++;} // option & param
   if (list_f != FLAG_NOT_SET) {needed_args += 1; num_flags++;} // option
+  if (overlap_f != FLAG_NOT_SET) {needed_args += 2; num_flags++;} // option & param
   
   // Make sure we have the right number of args
   if(argc != needed_args) {
@@ -217,6 +240,12 @@ int main(int argc, char *argv[])
   if (list_f != FLAG_NOT_SET) {
     list = TRUE;
   }
+  if (overlap_f != FLAG_NOT_SET) {
+    strncpy_safe(overlap, argv[overlap_f+1], 20);
+    get_overlap_method(overlap);
+  }
+  else
+    strcpy(overlap, "OVERLAY");
   if (log_f != FLAG_NOT_SET) {
     strcpy(logFile, argv[log_f+1]);
   }
@@ -268,7 +297,7 @@ int main(int argc, char *argv[])
     if (file_count > 1)
       asf_mosaic(&pps, proj_type, FALSE, RESAMPLE_BILINEAR, 0.0, datum, 
 		 spheroid, pixel_size, FALSE, 0, import_files, outFile, 0.0, 
-		 -999, 999, -999, 999, "OVERLAY", FALSE);
+		 -999, 999, -999, 999, overlap, FALSE);
     else 
       asf_geocode(&pps, proj_type, FALSE, RESAMPLE_BILINEAR, 0.0, datum, 
 		  pixel_size, NULL, tmpFile, outFile, 0.0, FALSE);
@@ -288,7 +317,8 @@ int main(int argc, char *argv[])
     FREE(imgFile);
     FREE(metaFile);
     */
-    combine(import_files, file_count, outFile);
+    combine_ext(import_files, file_count, outFile,
+		get_overlap_method(overlap));
   }
   for (ii=0; ii<file_count; ii++)
     FREE(import_files[ii]);
@@ -576,6 +576,13 @@ void ddr2meta(struct DDR *ddr, meta_parameters *meta);
 /* In meta_copy.c: Allocates new structure and fills it will values from src */
 meta_parameters *meta_copy(meta_parameters *src);
 
+/* In meta_cache.c: Keeps parsed metadata around, in memory and in a
+   binary <name>.meta.bin sidecar, so that reading the same file again is
+   cheap.  Used by meta_read() and meta_write(). */
+meta_parameters *meta_cache_read(const char *meta_name);
+void meta_cache_store(const char *meta_name, meta_parameters *meta);
+void meta_cache_forget(const char *meta_name);
+
 /* In meta_write.c */
 char *data_type2str(data_type_t data_type);
 char *image_data_type2str(image_data_type_t image_data_type);
@@ -687,6 +694,36 @@ int meta_get_latLon(meta_parameters *sar,
                     double yLine, double xSample,double elev,
                     double *lat,double *lon);
 
+/* Geolocation of every pixel of an image, for latitude/longitude layers
+and the like: exact meta_get_latLon() values on a sparse grid, spline
+interpolated in between.  The grid is refined until the interpolation
+error (checked in the middle of every grid cell) is below the tolerance
+in meters (a tenth of a pixel if the tolerance given is zero).  In
+latlon_grid.c.
+*/
+typedef struct {
+  meta_parameters *meta;
+  int line_count, sample_count;  /* Image size                           */
+  int grid_lines, grid_samples;  /* Number of grid nodes                 */
+  double line_step, sample_step; /* Node spacing in pixels               */
+  double elev;                   /* Elevation used for the geolocation   */
+  double lon_ref;                /* Longitudes are unwrapped around this */
+  double *lat, *lon;             /* Node values                          */
+  double tolerance;              /* Requested accuracy (m)               */
+  double max_error;              /* Largest error found (m)              */
+  int exact;                     /* TRUE if no grid is used, in which
+                                    case the lookups are not thread safe */
+} latlon_grid_t;
+
+latlon_grid_t *latlon_grid_new(meta_parameters *meta, double elev,
+                               double tolerance);
+void latlon_grid_free(latlon_grid_t *grid);
+void latlon_grid_get(const latlon_grid_t *grid, double line, double sample,
+                     double *lat, double *lon);
+/* Latitudes and longitudes of a whole line; either array may be NULL */
+void latlon_grid_get_line(const latlon_grid_t *grid, int line,
+                          float *lats, float *lons);
+
 /* Finds line and sample corresponding to given
 latitude and longitude. */
 void meta_set_lineSamp_tolerance(double tol);
@@ -965,8 +1002,20 @@ void create_cal_params(const char *inSAR, meta_parameters *meta,
 		       report_level_t level);
 void create_cal_params_ext(const char *inSAR, meta_parameters *meta, int db);
 float *incid_init(meta_parameters *meta);
+int get_cal_coefficients(meta_parameters *meta, float incidence_angle,
+                         int sample, char *bandExt, double *a, double *b);
 float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
 		 float inDn, char *bandExt, int dbFlag);
+// Status codes of cal_dn(), which works like get_cal_dn() but returns
+// the problem instead of reporting it, for use from worker threads
+#define CAL_OK 0
+#define CAL_NO_CALIBRATION 1
+#define CAL_SAMPLE_UNDEFINED 2
+#define CAL_UNSUPPORTED_RADIOMETRY 3
+#define CAL_UNKNOWN_TYPE 4
+int cal_dn(meta_parameters *meta, float incidence_angle, int sample,
+           float inDn, char *bandExt, int dbFlag, float *calValue);
+const char *cal_status_message(int status);
 float get_rad_cal_dn(meta_parameters *meta, int line, int sample, char *bandExt,
 		     float inDn, float radCorr);
 float cal2amp(meta_parameters *meta, float incid, int sample, char *bandExt, 
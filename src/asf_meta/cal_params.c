@@ -710,20 +710,27 @@ float *incid_init(meta_parameters *meta)
 }
 
 /*----------------------------------------------------------------------
-  Get_cal_dn:
-        Convert amplitude image data number into calibrated image data
-        number (in power scale), given the current noise value.
+  Get_cal_coefficients:
+        For all calibration schemes except UAVSAR, the scaled power of a
+        pixel is a quadratic function of its (amplitude) data number,
+        scaledPower = a*inDn*inDn + b, where a and b only depend on the
+        sample and the incidence angle.  Returns FALSE if the calibration
+        is not of that form, so importers can compute the coefficients
+        once per sample and apply them to every line.
 ----------------------------------------------------------------------*/
-float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
-                 float inDn, char *bandExt, int dbFlag)
+// Does the work of get_cal_coefficients() without reporting anything:
+// returns CAL_OK, CAL_NO_CALIBRATION, CAL_SAMPLE_UNDEFINED, or
+// CAL_UNKNOWN_TYPE if the calibration is not quadratic (UAVSAR)
+static int cal_coefficients(meta_parameters *meta, float incidence_angle,
+                            int sample, char *bandExt, double *a, double *b)
 {
-  double scaledPower=0, calValue=0, invIncAngle=1;
+  double invIncAngle=1;
   radiometry_t radiometry = meta->general->radiometry;
 
-  if (!meta->calibration) {
-    asfPrintWarning("Called get_cal_dn with no calibration block!\n");
-    return 0;
-  }
+  *a = 0.0;
+  *b = 0.0;
+  if (!meta->calibration)
+    return CAL_NO_CALIBRATION;
 
   // Calculate according to the calibration data type
   if (meta->calibration->type == asf_cal) { // ASF style data (PP and SSP)
@@ -753,7 +760,8 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
     // Removed the noise floor removal
     //scaledPower =
     //(p->a1*(inDn*inDn-p->a0*noiseValue) + p->a2)*invIncAngle;
-    scaledPower = (p->a1*inDn*inDn + p->a2)*invIncAngle;
+    *a = p->a1*invIncAngle;
+    *b = p->a2*invIncAngle;
   }
   else if (meta->calibration->type == asf_scansar_cal) { // ASF style ScanSar
 
@@ -766,43 +774,26 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
     else if (radiometry == r_BETA || radiometry == r_BETA_DB)
       invIncAngle = 1/sin(incidence_angle);
 
-    double look = 25.0; // FIXME: hack to get things compiled
-    double index = (look-16.3)*10.0;
-    double noiseValue;
-    double *noise = p->noise;
-
-    if (index <= 0)
-      noiseValue = noise[0];
-    else if (index >= 255)
-      noiseValue = noise[255];
-    else {
-      // Use linear interpolation on noise array
-      int base = (int)index;
-      double frac = index - base;
-
-      noiseValue = noise[base] + frac*(noise[base+1] - noise[base]);
-    }
-
     // Convert (amplitude) data number to scaled
-    // Remove the noise floor removal
+    // Remove the noise floor removal (so the noise value, looked up at a
+    // hard-coded look angle of 25 degrees, is not needed)
     //scaledPower =
     //  (p->a1*(inDn*inDn-p->a0*noiseValue) + p->a2)*invIncAngle;
-    scaledPower = (p->a1*inDn*inDn + p->a2)*invIncAngle;
+    *a = p->a1*invIncAngle;
+    *b = p->a2*invIncAngle;
   }
   else if (meta->calibration->type == esa_cal) { // ESA style ERS and JERS data
 
     esa_cal_params *p = meta->calibration->esa;
 
     if (radiometry == r_BETA || radiometry == r_BETA_DB)
-      scaledPower = inDn*inDn/p->k;
+      *a = 1.0/p->k;
     else if (radiometry == r_SIGMA || radiometry == r_SIGMA_DB)
-      scaledPower =
-    inDn*inDn/p->k*sin(p->ref_incid*D2R)/sin(incidence_angle);
+      *a = 1.0/p->k*sin(p->ref_incid*D2R)/sin(incidence_angle);
     else if (radiometry == r_GAMMA || radiometry == r_GAMMA_DB) {
       invIncAngle = 1/cos(incidence_angle*D2R);
-      scaledPower =
-    inDn*inDn/p->k*sin(p->ref_incid*D2R)/sin(incidence_angle) /
-    invIncAngle;
+      *a = 1.0/p->k*sin(p->ref_incid*D2R)/sin(incidence_angle) /
+        invIncAngle;
     }
 
   }
@@ -829,9 +820,11 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
       a2 = p->lut[p->n-1] +
     ((p->lut[p->n-1] - p->lut[p->n-2])*((sample/p->samp_inc) - p->n-1));
     if (p->slc)
-      scaledPower = (inDn*inDn)/(a2*a2)*invIncAngle;
-    else
-      scaledPower = (inDn*inDn + p->a3)/a2*invIncAngle;
+      *a = 1.0/(a2*a2)*invIncAngle;
+    else {
+      *a = 1.0/a2*invIncAngle;
+      *b = p->a3/a2*invIncAngle;
+    }
   }
   else if (meta->calibration->type == alos_cal) { // ALOS data
 
@@ -855,7 +848,7 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
     else
       cf = p->cf_hh;
  
-    scaledPower = pow(10, cf/10.0)*inDn*inDn*invIncAngle;
+    *a = pow(10, cf/10.0)*invIncAngle;
   }
   else if (meta->calibration->type == tsx_cal) { // TerraSAR-X data
 
@@ -867,37 +860,91 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
       invIncAngle = tan(incidence_angle);
 
     double cf = meta->calibration->tsx->k;
-    scaledPower = cf*inDn*inDn*invIncAngle;
+    *a = cf*invIncAngle;
   }
   else if (meta->calibration->type == r2_cal) { // Radarsat-2 data
     
-    if (sample > meta->calibration->r2->num_elements)
-      asfPrintError("Calibration not defined for sample (%d)!\n", sample);
-    double a;
+    if (sample < 0 || sample >= meta->calibration->r2->num_elements)
+      return CAL_SAMPLE_UNDEFINED;
+    double gain;
     if (radiometry == r_BETA || radiometry == r_BETA_DB)
-      a = meta->calibration->r2->a_beta[sample];
+      gain = meta->calibration->r2->a_beta[sample];
     else if (radiometry == r_SIGMA || radiometry == r_SIGMA_DB)
-      a = meta->calibration->r2->a_sigma[sample];
+      gain = meta->calibration->r2->a_sigma[sample];
     else if (radiometry == r_GAMMA || radiometry == r_GAMMA_DB)
-      a = meta->calibration->r2->a_gamma[sample];
+      gain = meta->calibration->r2->a_gamma[sample];
 
     if (meta->calibration->r2->slc)
-      scaledPower = inDn*inDn/(a*a);
-    else
-      scaledPower = (inDn*inDn + meta->calibration->r2->b)/a;
+      *a = 1.0/(gain*gain);
+    else {
+      *a = 1.0/gain;
+      *b = meta->calibration->r2->b/gain;
+    }
   }
-  else if (meta->calibration->type == uavsar_cal) {
-    if (radiometry == r_BETA || radiometry == r_BETA_DB)
-      asfPrintError("Calibration currently does not support BETA values!\n");
-    else if (radiometry == r_SIGMA || radiometry == r_SIGMA_DB)
-      asfPrintError("Calibration currently does not support SIGMA values!\n");
-    else
-      // Values are already stored as "linear power"
-      scaledPower = inDn;
+  else
+    // UAVSAR (linear in the data number) or unknown
+    return CAL_UNKNOWN_TYPE;
+
+  return CAL_OK;
+}
+
+int get_cal_coefficients(meta_parameters *meta, float incidence_angle,
+                         int sample, char *bandExt, double *a, double *b)
+{
+  int status = cal_coefficients(meta, incidence_angle, sample, bandExt, a, b);
+
+  if (status == CAL_SAMPLE_UNDEFINED)
+    asfPrintError("Calibration not defined for sample (%d)!\n", sample);
+
+  return status == CAL_OK;
+}
+
+const char *cal_status_message(int status)
+{
+  switch (status) {
+    case CAL_OK:
+      return "No error";
+    case CAL_NO_CALIBRATION:
+      return "No calibration block";
+    case CAL_SAMPLE_UNDEFINED:
+      return "Calibration not defined for sample";
+    case CAL_UNSUPPORTED_RADIOMETRY:
+      return "Calibration does not support this radiometry";
+    case CAL_UNKNOWN_TYPE:
+    default:
+      return "Unknown calibration data type";
+  }
+}
+
+/*----------------------------------------------------------------------
+  Cal_dn:
+        Same as get_cal_dn, but never prints or exits: the calibrated
+        value goes into *calValue (zero if there is none) and the
+        return value is CAL_OK or what went wrong.  Safe to call from
+        worker threads.
+----------------------------------------------------------------------*/
+int cal_dn(meta_parameters *meta, float incidence_angle, int sample,
+           float inDn, char *bandExt, int dbFlag, float *calValue)
+{
+  double scaledPower=0, a, b;
+  radiometry_t radiometry = meta->general->radiometry;
+  int status;
+
+  *calValue = 0;
+  status = cal_coefficients(meta, incidence_angle, sample, bandExt, &a, &b);
+  if (status == CAL_OK) {
+    scaledPower = a*inDn*inDn + b;
+  }
+  else if (status == CAL_UNKNOWN_TYPE &&
+           meta->calibration->type == uavsar_cal) {
+    if (radiometry == r_BETA || radiometry == r_BETA_DB ||
+        radiometry == r_SIGMA || radiometry == r_SIGMA_DB)
+      return CAL_UNSUPPORTED_RADIOMETRY;
+    // Values are already stored as "linear power"
+    scaledPower = inDn;
   }
   else
-    // should never get here
-    asfPrintError("Unknown calibration data type!\n");
+    return status;
 
   // We don't want to convert the scaled power image into dB values
   // since it messes up the statistics
@@ -922,10 +969,45 @@ float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
   // Now that the noise floor is not removed anymore, we don't need to look for
   // outlier in form of negative values anymore. 
   if (dbFlag)
-    calValue = 10.0 * log10(scaledPower);
+    *calValue = 10.0 * log10(scaledPower);
   else
-    calValue = scaledPower;
-  
+    *calValue = scaledPower;
+
+  return CAL_OK;
+}
+
+/*----------------------------------------------------------------------
+  Get_cal_dn:
+        Convert amplitude image data number into calibrated image data
+        number (in power scale), given the current noise value.
+----------------------------------------------------------------------*/
+float get_cal_dn(meta_parameters *meta, float incidence_angle, int sample,
+                 float inDn, char *bandExt, int dbFlag)
+{
+  radiometry_t radiometry = meta->general->radiometry;
+  float calValue;
+
+  switch (cal_dn(meta, incidence_angle, sample, inDn, bandExt, dbFlag,
+                 &calValue)) {
+    case CAL_OK:
+      break;
+    case CAL_NO_CALIBRATION:
+      asfPrintWarning("Called get_cal_dn with no calibration block!\n");
+      return 0;
+    case CAL_SAMPLE_UNDEFINED:
+      asfPrintError("Calibration not defined for sample (%d)!\n", sample);
+      break;
+    case CAL_UNSUPPORTED_RADIOMETRY:
+      if (radiometry == r_BETA || radiometry == r_BETA_DB)
+        asfPrintError("Calibration currently does not support BETA values!\n");
+      else
+        asfPrintError("Calibration currently does not support SIGMA values!\n");
+      break;
+    default:
+      // should never get here
+      asfPrintError("Unknown calibration data type!\n");
+  }
+
   return calValue;
 }
 
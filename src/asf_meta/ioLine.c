@@ -107,6 +107,8 @@ int get_data_lines(FILE *file, meta_parameters *meta,
         sample_size, num_samples_to_get, file);
     samples_gotten += line_samples_gotten;
   }
+  asfProfileCount(PROFILE_BYTES_READ, (long long)samples_gotten*sample_size);
+  asfProfileCount(PROFILE_LINES_READ, num_lines_to_get);
 
   /* Fill in destination array.  */
   switch (data_type) {
@@ -542,6 +544,8 @@ static int put_data_lines(FILE *file, meta_parameters *meta, int band_number,
   }
   samples_put = FWRITE(out_buffer, sample_size, num_samples_to_put, file);
   FREE(out_buffer);
+  asfProfileCount(PROFILE_BYTES_WRITTEN, (long long)samples_put*sample_size);
+  asfProfileCount(PROFILE_LINES_WRITTEN, num_lines_to_put);
 
   if ( samples_put != num_samples_to_put ) {
     printf("put_data_lines: failed to write the correct number of samples\n");
@@ -0,0 +1,291 @@
+/****************************************************************
+FUNCTION NAME:  latlon_grid_*
+
+DESCRIPTION:
+   Geolocation of every pixel of an image.  Exact geolocation with
+   meta_get_latLon() is expensive for SAR geometries (every call
+   solves for the orbit position and the doppler), so it is only
+   done on a sparse grid of nodes, and the latitude and longitude of
+   the pixels in between are interpolated with cubic (Catmull-Rom)
+   splines.
+
+   Before the grid is used, the interpolation is checked against the
+   exact geolocation at the center of every grid cell.  If the error
+   anywhere is above the tolerance, the grid is made denser, and if
+   even the densest grid does not meet the tolerance we fall back to
+   calling meta_get_latLon() for every pixel.
+
+   Once built, latlon_grid_get() and latlon_grid_get_line() only read
+   the grid, so they may be called from several threads at once --
+   unless grid->exact is set, since meta_get_latLon() is not thread
+   safe.
+
+RETURN VALUE:
+
+SPECIAL CONSIDERATIONS:
+   Longitudes are interpolated unwrapped around the center of the
+   image, so scenes crossing the date line are fine.  Scenes very
+   close to a pole usually end up with a dense grid or exact
+   geolocation.
+****************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+
+// Spacing of the first grid tried, and of the densest one, in pixels
+#define LATLON_GRID_SPACING 64
+#define LATLON_GRID_MIN_SPACING 4
+
+// Rough earth radius, only used to turn the interpolation error into
+// meters
+#define LATLON_GRID_RADIUS 6371000.0
+
+static double wrap_lon(double lon)
+{
+  while (lon > 180.0) lon -= 360.0;
+  while (lon <= -180.0) lon += 360.0;
+  return lon;
+}
+
+// Node value.  The nodes just outside the grid are extrapolated so that
+// the splines stay exact for quadratics up to the edge (Keys, 1981), or
+// linearly if the grid is only two nodes wide.
+static double extrapolate(double p0, double p1, double p2, int n)
+{
+  return n > 2 ? 3.0*p0 - 3.0*p1 + p2 : 2.0*p0 - p1;
+}
+
+static double node(const latlon_grid_t *grid, const double *v, int r, int c)
+{
+  int nr = grid->grid_lines, nc = grid->grid_samples;
+  const double *row;
+  if (r < 0)
+    return extrapolate(node(grid, v, 0, c), node(grid, v, 1, c),
+                       nr > 2 ? node(grid, v, 2, c) : 0.0, nr);
+  if (r >= nr)
+    return extrapolate(node(grid, v, nr-1, c), node(grid, v, nr-2, c),
+                       nr > 2 ? node(grid, v, nr-3, c) : 0.0, nr);
+  row = v + r*nc;
+  if (c < 0)
+    return extrapolate(row[0], row[1], nc > 2 ? row[2] : 0.0, nc);
+  if (c >= nc)
+    return extrapolate(row[nc-1], row[nc-2], nc > 2 ? row[nc-3] : 0.0, nc);
+  return row[c];
+}
+
+// Catmull-Rom weights for the nodes at -1, 0, 1 and 2
+static void spline_weights(double t, double *w)
+{
+  double t2 = t*t, t3 = t2*t;
+  w[0] = 0.5*(-t3 + 2.0*t2 - t);
+  w[1] = 0.5*(3.0*t3 - 5.0*t2 + 2.0);
+  w[2] = 0.5*(-3.0*t3 + 4.0*t2 + t);
+  w[3] = 0.5*(t3 - t2);
+}
+
+// Grid cell containing the position, and the offset within it
+static int grid_cell(double pos, double step, int nodes, double *t)
+{
+  double u = pos / step;
+  int i = (int) floor(u);
+  if (i < 0) i = 0;
+  if (i > nodes - 2) i = nodes - 2;
+  *t = u - i;
+  return i;
+}
+
+static void interpolate(const latlon_grid_t *grid, double line, double sample,
+                        double *lat, double *lon)
+{
+  double wl[4], ws[4], tl, ts;
+  int r = grid_cell(line, grid->line_step, grid->grid_lines, &tl);
+  int c = grid_cell(sample, grid->sample_step, grid->grid_samples, &ts);
+  int ii, kk;
+
+  spline_weights(tl, wl);
+  spline_weights(ts, ws);
+  *lat = *lon = 0.0;
+  for (ii=0; ii<4; ii++) {
+    for (kk=0; kk<4; kk++) {
+      double w = wl[ii]*ws[kk];
+      *lat += w*node(grid, grid->lat, r+ii-1, c+kk-1);
+      *lon += w*node(grid, grid->lon, r+ii-1, c+kk-1);
+    }
+  }
+  *lon = wrap_lon(*lon);
+}
+
+static double distance(double lat1, double lon1, double lat2, double lon2)
+{
+  double dy = (lat2 - lat1)*D2R;
+  double dx = wrap_lon(lon2 - lon1)*D2R*cos(0.5*(lat1 + lat2)*D2R);
+  return LATLON_GRID_RADIUS*sqrt(dx*dx + dy*dy);
+}
+
+// Geolocates the nodes of a grid with the given spacing, and returns the
+// largest interpolation error found at the cell centers
+static double build_grid(latlon_grid_t *grid, meta_parameters *meta,
+                         int spacing)
+{
+  int nl = grid->line_count, ns = grid->sample_count;
+  int ii, kk;
+  double lat, lon, max_error = 0.0;
+
+  grid->grid_lines = (nl - 1 + spacing - 1) / spacing + 1;
+  grid->grid_samples = (ns - 1 + spacing - 1) / spacing + 1;
+  if (grid->grid_lines < 2) grid->grid_lines = 2;
+  if (grid->grid_samples < 2) grid->grid_samples = 2;
+  grid->line_step = nl > 1 ? (double)(nl - 1)/(grid->grid_lines - 1) : 1.0;
+  grid->sample_step =
+    ns > 1 ? (double)(ns - 1)/(grid->grid_samples - 1) : 1.0;
+
+  FREE(grid->lat);
+  FREE(grid->lon);
+  grid->lat =
+    (double *) MALLOC(sizeof(double)*grid->grid_lines*grid->grid_samples);
+  grid->lon =
+    (double *) MALLOC(sizeof(double)*grid->grid_lines*grid->grid_samples);
+
+  meta_get_latLon(meta, 0.5*(nl - 1), 0.5*(ns - 1), grid->elev, &lat, &lon);
+  grid->lon_ref = lon;
+  for (ii=0; ii<grid->grid_lines; ii++) {
+    for (kk=0; kk<grid->grid_samples; kk++) {
+      int n = ii*grid->grid_samples + kk;
+      meta_get_latLon(meta, ii*grid->line_step, kk*grid->sample_step,
+                      grid->elev, &lat, &lon);
+      grid->lat[n] = lat;
+      grid->lon[n] = grid->lon_ref + wrap_lon(lon - grid->lon_ref);
+    }
+  }
+
+  // Check the interpolation where it is worst: in the middle of the cells
+  for (ii=0; ii<grid->grid_lines-1; ii++) {
+    for (kk=0; kk<grid->grid_samples-1; kk++) {
+      double line = (ii + 0.5)*grid->line_step;
+      double sample = (kk + 0.5)*grid->sample_step;
+      double ilat, ilon, error;
+      meta_get_latLon(meta, line, sample, grid->elev, &lat, &lon);
+      interpolate(grid, line, sample, &ilat, &ilon);
+      error = distance(lat, lon, ilat, ilon);
+      if (error > max_error)
+        max_error = error;
+    }
+  }
+
+  return max_error;
+}
+
+latlon_grid_t *latlon_grid_new(meta_parameters *meta, double elev,
+                               double tolerance)
+{
+  latlon_grid_t *grid = (latlon_grid_t *) MALLOC(sizeof(latlon_grid_t));
+  int spacing;
+
+  grid->meta = meta;
+  grid->line_count = meta->general->line_count;
+  grid->sample_count = meta->general->sample_count;
+  grid->elev = elev;
+  grid->lat = NULL;
+  grid->lon = NULL;
+  grid->exact = FALSE;
+  grid->max_error = 0.0;
+
+  if (tolerance <= 0.0) {
+    double pixel_size = meta->general->x_pixel_size;
+    if (meta->general->y_pixel_size < pixel_size)
+      pixel_size = meta->general->y_pixel_size;
+    tolerance = meta_is_valid_double(pixel_size) && pixel_size > 0.0 ?
+      0.1*pixel_size : 1.0;
+  }
+  grid->tolerance = tolerance;
+
+  // Images that come with a geolocation for every pixel already don't
+  // need a grid
+  if (meta->latlon) {
+    grid->exact = TRUE;
+    return grid;
+  }
+
+  for (spacing=LATLON_GRID_SPACING; spacing>=LATLON_GRID_MIN_SPACING;
+       spacing/=2) {
+    grid->max_error = build_grid(grid, meta, spacing);
+    if (grid->max_error <= tolerance)
+      return grid;
+    asfPrintStatus("Geolocation grid with %d pixel spacing is off by up to "
+                   "%.3f m, refining ...\n", spacing, grid->max_error);
+  }
+
+  asfPrintStatus("No geolocation grid meets the %.3f m tolerance, "
+                 "geolocating every pixel.\n", tolerance);
+  FREE(grid->lat);
+  FREE(grid->lon);
+  grid->lat = grid->lon = NULL;
+  grid->exact = TRUE;
+  grid->max_error = 0.0;
+
+  return grid;
+}
+
+void latlon_grid_free(latlon_grid_t *grid)
+{
+  if (grid) {
+    FREE(grid->lat);
+    FREE(grid->lon);
+    FREE(grid);
+  }
+}
+
+void latlon_grid_get(const latlon_grid_t *grid, double line, double sample,
+                     double *lat, double *lon)
+{
+  if (grid->exact)
+    meta_get_latLon(grid->meta, line, sample, grid->elev, lat, lon);
+  else
+    interpolate(grid, line, sample, lat, lon);
+}
+
+void latlon_grid_get_line(const latlon_grid_t *grid, int line,
+                          float *lats, float *lons)
+{
+  int ns = grid->sample_count;
+  int nc = grid->grid_samples;
+  double lat, lon, wl[4], ws[4], tl, ts;
+  int r, c, ii, kk;
+
+  if (grid->exact) {
+    for (kk=0; kk<ns; kk++) {
+      meta_get_latLon(grid->meta, line, kk, grid->elev, &lat, &lon);
+      if (lats) lats[kk] = lat;
+      if (lons) lons[kk] = lon;
+    }
+    return;
+  }
+
+  // Interpolate the grid in the line direction first, giving a row of
+  // nodes (including the extrapolated ones at either end) for this line
+  double *row_lat = (double *) MALLOC(sizeof(double)*(nc+2));
+  double *row_lon = (double *) MALLOC(sizeof(double)*(nc+2));
+  r = grid_cell(line, grid->line_step, grid->grid_lines, &tl);
+  spline_weights(tl, wl);
+  for (c=-1; c<=nc; c++) {
+    row_lat[c+1] = row_lon[c+1] = 0.0;
+    for (ii=0; ii<4; ii++) {
+      row_lat[c+1] += wl[ii]*node(grid, grid->lat, r+ii-1, c);
+      row_lon[c+1] += wl[ii]*node(grid, grid->lon, r+ii-1, c);
+    }
+  }
+
+  for (kk=0; kk<ns; kk++) {
+    c = grid_cell(kk, grid->sample_step, nc, &ts);
+    spline_weights(ts, ws);
+    lat = lon = 0.0;
+    for (ii=0; ii<4; ii++) {
+      lat += ws[ii]*row_lat[c+ii];
+      lon += ws[ii]*row_lon[c+ii];
+    }
+    if (lats) lats[kk] = lat;
+    if (lons) lons[kk] = wrap_lon(lon);
+  }
+
+  FREE(row_lat);
+  FREE(row_lon);
+}
@@ -107,27 +107,13 @@ radarsat2_doppler_params *radarsat2_doppler_init(int numDopplerEstimates)
 
 static double *read_radarsat2_lut(const char *dataFile, int gain_count)
 {
-  int ii;
-  char *gainStr = (char *) MALLOC(sizeof(char)*100000);
-  char *p, *q;
+  int ii, count;
   double *gain = (double *) MALLOC(sizeof(double)*gain_count);
   xmlDoc *doc = xmlReadFile(dataFile, NULL, 0);
-  strcpy(gainStr, xml_get_string_value(doc, "lut.gains"));
-  p = gainStr;
-  for (ii=0; ii<gain_count; ii++) {
-    if (ii == 0)
-      q = p;
-    else {
-      if (strchr(p, ' ')) {
-	q = strchr(p, ' ');
-	q++;
-      }
-    }
-    sscanf(q, "%lf", &gain[ii]);
-    p = q;
-  } 
-  FREE(gainStr);
-  xmlFreeDoc(doc);
+  count = xml_get_double_array(doc, gain, gain_count, "lut.gains");
+  for (ii=count; ii<gain_count; ii++)
+    gain[ii] = MAGIC_UNSET_DOUBLE;
+  xml_free_doc(doc);
   xmlCleanupParser();
   
   return gain;
@@ -341,10 +327,11 @@ radarsat2_meta *read_radarsat2_meta(const char *dataFile)
     date_terrasar2date(radarsat2->zeroDopplerTimeLastLine, 
 		       &imgStartDate, &imgStartTime);
   
-  // FIXME: determine numStateVector from data - count the entries
-  //numStateVectors = xml_get_int_value(doc, 
-  //   "product.platform.orbit.orbitHeader.numStateVectors");
-  numStateVectors = 5;
+  numStateVectors = xml_get_element_count(doc, 
+     "product.sourceAttributes.orbitAndAttitude.orbitInformation.stateVector");
+  if (numStateVectors < 1)
+    asfPrintError("No state vectors found in metadata file (%s)!\n",
+		  dataFile);
   radarsat2->state_vectors = meta_state_vectors_init(numStateVectors);
   radarsat2->state_vectors->year = imgStartDate.year;
   date_ymd2jd(&imgStartDate, &julianDate);
@@ -465,7 +452,7 @@ radarsat2_meta *read_radarsat2_meta(const char *dataFile)
   FREE(attribute);
   FREE(fileName);
 
-  xmlFreeDoc(doc);
+  xml_free_doc(doc);
   xmlCleanupParser();
 
   return radarsat2;
@@ -324,7 +324,7 @@ terrasar_meta *read_terrasar_meta(const char *dataFile)
     terrasar->cal_factor = xml_get_double_value(doc,
        "level1Product.calibration.calibrationConstant.calFactor");
 
-  xmlFreeDoc(doc);
+  xml_free_doc(doc);
   xmlCleanupParser();
 
   return terrasar;
@@ -0,0 +1,1320 @@
+/****************************************************************
+FUNCTION NAME:  meta_cache_*
+
+DESCRIPTION:
+   Parsing a text .meta file takes far longer than using it, and
+   many tools read the same metadata over and over.  So meta_read()
+   keeps the most recently parsed files in an in-process cache, and
+   hands out copies of them.  meta_write() drops the entry of the
+   file it writes.
+
+   Across processes, the parsed metadata is kept in a compact binary
+   sidecar next to the text file (<name>.meta.bin).  meta_read()
+   loads the sidecar instead of running the parser as long as it is
+   fresh, and writes one after parsing a file that has none (or a
+   stale one).  The text .meta stays the canonical copy: the sidecar
+   is never read unless the text file exists, meta_write() deletes
+   it, and it is simply rebuilt whenever it is missing or can't be
+   used.
+
+   Both caches are keyed on a stamp of the text file: its size,
+   modification time (to the nanosecond where the file system keeps
+   it) and a checksum of its contents.  Whole second time stamps
+   alone miss a .meta rewritten at the same size within a second,
+   and the file is small enough that checksumming it costs next to
+   nothing next to parsing it.
+
+   The sidecar stores each field explicitly, in a fixed little endian
+   encoding, in the order given by the field tables below, so it does
+   not depend on structure layout, padding or byte order.  Its header
+   holds META_SIDECAR_VERSION and a signature of the field tables.
+   A sidecar with a different version or signature, or whose
+   trailing checksum doesn't match, is ignored.
+   Bump the version whenever the encoding changes other than
+   through the tables.
+
+RETURN VALUE:
+
+SPECIAL CONSIDERATIONS:
+   The cache is not thread safe -- like the rest of the metadata
+   I/O, meta_read() and meta_write() should only be called from the
+   main thread.
+
+   Only what parse_metadata() fills in is stored; meta_read() does
+   the rest of its work (lat/lon layers, ...) on the result either
+   way.
+****************************************************************/
+#include "asf.h"
+#include "asf_meta.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Number of parsed metadata files kept in memory
+#define META_CACHE_SIZE 16
+
+#define META_SIDECAR_MAGIC "ASFMETAB"
+#define META_SIDECAR_VERSION 3
+
+typedef struct {
+  long long size;
+  long long mtime;
+  long long mtime_nsec;
+  unsigned int check;
+} meta_file_stamp;
+
+typedef struct {
+  char *file_name;
+  meta_file_stamp stamp;
+  meta_parameters *meta;
+  unsigned long last_used;
+} meta_cache_entry;
+
+static meta_cache_entry meta_cache[META_CACHE_SIZE];
+static unsigned long meta_cache_clock = 0;
+
+#define FNV_START 2166136261u
+
+// FNV-1a, continued over n more bytes
+static unsigned int fnv_add(unsigned int hash, const unsigned char *buf,
+                            size_t n)
+{
+  size_t ii;
+
+  for (ii=0; ii<n; ii++)
+    hash = (hash ^ buf[ii]) * 16777619u;
+  return hash;
+}
+
+// FNV-1a over a whole file
+static int checksum_file(const char *file_name, unsigned int *check)
+{
+  unsigned char buf[4096];
+  unsigned int hash = FNV_START;
+  size_t n;
+  FILE *fp = fopen(file_name, "rb");
+
+  if (!fp)
+    return FALSE;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    hash = fnv_add(hash, buf, n);
+  fclose(fp);
+  *check = hash;
+  return TRUE;
+}
+
+static int get_stamp(const char *file_name, meta_file_stamp *stamp)
+{
+  struct stat st;
+
+  if (stat(file_name, &st) != 0)
+    return FALSE;
+  stamp->size = (long long) st.st_size;
+  stamp->mtime = (long long) st.st_mtime;
+#if defined(win32)
+  stamp->mtime_nsec = 0;
+#elif defined(darwin) || defined(__APPLE__)
+  stamp->mtime_nsec = (long long) st.st_mtimespec.tv_nsec;
+#else
+  stamp->mtime_nsec = (long long) st.st_mtim.tv_nsec;
+#endif
+  return checksum_file(file_name, &stamp->check);
+}
+
+static int same_stamp(const meta_file_stamp *a, const meta_file_stamp *b)
+{
+  return a->size == b->size && a->mtime == b->mtime &&
+    a->mtime_nsec == b->mtime_nsec && a->check == b->check;
+}
+
+/* Sidecar field tables ***************************************************/
+
+typedef enum {
+  FIELD_INT,      // int, and the enums, which are ints
+  FIELD_DOUBLE,
+  FIELD_FLOAT,
+  FIELD_CHAR,     // a single char
+  FIELD_STRING    // a char array, count is its size
+} field_type_t;
+
+typedef struct {
+  const char *name;
+  field_type_t type;
+  size_t offset;
+  int count;          // array elements (FIELD_STRING: array size)
+  int count_offset;   // >= 0: only as many elements as this int says
+} meta_field_t;
+
+#define FIELD(s,f,t) { #f, t, offsetof(s,f), 1, -1 }
+#define FIELDS(s,f,t,n) { #f, t, offsetof(s,f), n, -1 }
+#define STRING(s,f) \
+  { #f, FIELD_STRING, offsetof(s,f), sizeof(((s *)0)->f), -1 }
+#define COUNTED(s,f,n,c) { #f, FIELD_DOUBLE, offsetof(s,f), n, offsetof(s,c) }
+#define END_FIELDS { NULL, FIELD_INT, 0, 0, -1 }
+
+static const meta_field_t general_fields[] = {
+  STRING(meta_general, basename),
+  STRING(meta_general, sensor),
+  STRING(meta_general, sensor_name),
+  STRING(meta_general, mode),
+  STRING(meta_general, processor),
+  FIELD(meta_general, data_type, FIELD_INT),
+  FIELD(meta_general, image_data_type, FIELD_INT),
+  FIELD(meta_general, radiometry, FIELD_INT),
+  STRING(meta_general, acquisition_date),
+  FIELD(meta_general, orbit, FIELD_INT),
+  FIELD(meta_general, orbit_direction, FIELD_CHAR),
+  FIELD(meta_general, frame, FIELD_INT),
+  FIELD(meta_general, band_count, FIELD_INT),
+  STRING(meta_general, bands),
+  FIELD(meta_general, line_count, FIELD_INT),
+  FIELD(meta_general, sample_count, FIELD_INT),
+  FIELD(meta_general, start_line, FIELD_INT),
+  FIELD(meta_general, start_sample, FIELD_INT),
+  FIELD(meta_general, line_scaling, FIELD_DOUBLE),
+  FIELD(meta_general, sample_scaling, FIELD_DOUBLE),
+  FIELD(meta_general, x_pixel_size, FIELD_DOUBLE),
+  FIELD(meta_general, y_pixel_size, FIELD_DOUBLE),
+  FIELD(meta_general, center_latitude, FIELD_DOUBLE),
+  FIELD(meta_general, center_longitude, FIELD_DOUBLE),
+  FIELD(meta_general, re_major, FIELD_DOUBLE),
+  FIELD(meta_general, re_minor, FIELD_DOUBLE),
+  FIELD(meta_general, bit_error_rate, FIELD_DOUBLE),
+  FIELD(meta_general, missing_lines, FIELD_INT),
+  FIELD(meta_general, no_data, FIELD_FLOAT),
+  END_FIELDS
+};
+
+static const meta_field_t sar_fields[] = {
+  FIELD(meta_sar, image_type, FIELD_CHAR),
+  FIELD(meta_sar, look_direction, FIELD_CHAR),
+  FIELD(meta_sar, azimuth_look_count, FIELD_INT),
+  FIELD(meta_sar, range_look_count, FIELD_INT),
+  FIELD(meta_sar, deskewed, FIELD_INT),
+  FIELD(meta_sar, original_line_count, FIELD_INT),
+  FIELD(meta_sar, original_sample_count, FIELD_INT),
+  FIELD(meta_sar, line_increment, FIELD_DOUBLE),
+  FIELD(meta_sar, sample_increment, FIELD_DOUBLE),
+  FIELD(meta_sar, range_time_per_pixel, FIELD_DOUBLE),
+  FIELD(meta_sar, azimuth_time_per_pixel, FIELD_DOUBLE),
+  FIELD(meta_sar, slant_shift, FIELD_DOUBLE),
+  FIELD(meta_sar, time_shift, FIELD_DOUBLE),
+  FIELD(meta_sar, slant_range_first_pixel, FIELD_DOUBLE),
+  FIELD(meta_sar, wavelength, FIELD_DOUBLE),
+  FIELD(meta_sar, prf, FIELD_DOUBLE),
+  FIELD(meta_sar, earth_radius, FIELD_DOUBLE),
+  FIELD(meta_sar, earth_radius_pp, FIELD_DOUBLE),
+  FIELD(meta_sar, satellite_height, FIELD_DOUBLE),
+  STRING(meta_sar, satellite_binary_time),
+  STRING(meta_sar, satellite_clock_time),
+  FIELDS(meta_sar, range_doppler_coefficients, FIELD_DOUBLE, 3),
+  FIELDS(meta_sar, azimuth_doppler_coefficients, FIELD_DOUBLE, 3),
+  FIELD(meta_sar, azimuth_processing_bandwidth, FIELD_DOUBLE),
+  FIELD(meta_sar, chirp_rate, FIELD_DOUBLE),
+  FIELD(meta_sar, pulse_duration, FIELD_DOUBLE),
+  FIELD(meta_sar, range_sampling_rate, FIELD_DOUBLE),
+  STRING(meta_sar, polarization),
+  FIELD(meta_sar, multilook, FIELD_INT),
+  FIELD(meta_sar, pitch, FIELD_DOUBLE),
+  FIELD(meta_sar, roll, FIELD_DOUBLE),
+  FIELD(meta_sar, yaw, FIELD_DOUBLE),
+  FIELDS(meta_sar, incid_a, FIELD_DOUBLE, 6),
+  END_FIELDS
+};
+
+static const meta_field_t optical_fields[] = {
+  STRING(meta_optical, pointing_direction),
+  FIELD(meta_optical, off_nadir_angle, FIELD_DOUBLE),
+  STRING(meta_optical, correction_level),
+  FIELD(meta_optical, cloud_percentage, FIELD_DOUBLE),
+  FIELD(meta_optical, sun_azimuth_angle, FIELD_DOUBLE),
+  FIELD(meta_optical, sun_elevation_angle, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t thermal_fields[] = {
+  FIELD(meta_thermal, band_gain, FIELD_DOUBLE),
+  FIELD(meta_thermal, band_gain_change, FIELD_DOUBLE),
+  FIELD(meta_thermal, day, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t projection_fields[] = {
+  FIELD(meta_projection, type, FIELD_INT),
+  FIELD(meta_projection, startX, FIELD_DOUBLE),
+  FIELD(meta_projection, startY, FIELD_DOUBLE),
+  FIELD(meta_projection, perX, FIELD_DOUBLE),
+  FIELD(meta_projection, perY, FIELD_DOUBLE),
+  STRING(meta_projection, units),
+  FIELD(meta_projection, hem, FIELD_CHAR),
+  FIELD(meta_projection, spheroid, FIELD_INT),
+  FIELD(meta_projection, re_major, FIELD_DOUBLE),
+  FIELD(meta_projection, re_minor, FIELD_DOUBLE),
+  FIELD(meta_projection, datum, FIELD_INT),
+  FIELD(meta_projection, height, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+// The projection parameters are a union; only the member that goes
+// with the projection type (as meta_write() sees it) is stored.
+static const meta_field_t albers_fields[] = {
+  FIELD(meta_projection, param.albers.std_parallel1, FIELD_DOUBLE),
+  FIELD(meta_projection, param.albers.std_parallel2, FIELD_DOUBLE),
+  FIELD(meta_projection, param.albers.center_meridian, FIELD_DOUBLE),
+  FIELD(meta_projection, param.albers.orig_latitude, FIELD_DOUBLE),
+  FIELD(meta_projection, param.albers.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.albers.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t atct_fields[] = {
+  FIELD(meta_projection, param.atct.rlocal, FIELD_DOUBLE),
+  FIELD(meta_projection, param.atct.alpha1, FIELD_DOUBLE),
+  FIELD(meta_projection, param.atct.alpha2, FIELD_DOUBLE),
+  FIELD(meta_projection, param.atct.alpha3, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t lamaz_fields[] = {
+  FIELD(meta_projection, param.lamaz.center_lon, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamaz.center_lat, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamaz.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamaz.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t lamcc_fields[] = {
+  FIELD(meta_projection, param.lamcc.plat1, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.plat2, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.lat0, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.lon0, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.false_northing, FIELD_DOUBLE),
+  FIELD(meta_projection, param.lamcc.scale_factor, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t ps_fields[] = {
+  FIELD(meta_projection, param.ps.slat, FIELD_DOUBLE),
+  FIELD(meta_projection, param.ps.slon, FIELD_DOUBLE),
+  FIELD(meta_projection, param.ps.is_north_pole, FIELD_INT),
+  FIELD(meta_projection, param.ps.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.ps.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t utm_fields[] = {
+  FIELD(meta_projection, param.utm.zone, FIELD_INT),
+  FIELD(meta_projection, param.utm.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.utm.false_northing, FIELD_DOUBLE),
+  FIELD(meta_projection, param.utm.lat0, FIELD_DOUBLE),
+  FIELD(meta_projection, param.utm.lon0, FIELD_DOUBLE),
+  FIELD(meta_projection, param.utm.scale_factor, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t state_fields[] = {
+  FIELD(meta_projection, param.state.zone, FIELD_INT),
+  STRING(meta_projection, param.state.projection),
+  FIELD(meta_projection, param.state.orig_latitude, FIELD_DOUBLE),
+  FIELD(meta_projection, param.state.central_meridian, FIELD_DOUBLE),
+  FIELD(meta_projection, param.state.scale_factor, FIELD_DOUBLE),
+  FIELD(meta_projection, param.state.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.state.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t mer_fields[] = {
+  FIELD(meta_projection, param.mer.orig_latitude, FIELD_DOUBLE),
+  FIELD(meta_projection, param.mer.central_meridian, FIELD_DOUBLE),
+  FIELD(meta_projection, param.mer.standard_parallel, FIELD_DOUBLE),
+  FIELD(meta_projection, param.mer.scale_factor, FIELD_DOUBLE),
+  FIELD(meta_projection, param.mer.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.mer.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t eqr_fields[] = {
+  FIELD(meta_projection, param.eqr.orig_latitude, FIELD_DOUBLE),
+  FIELD(meta_projection, param.eqr.central_meridian, FIELD_DOUBLE),
+  FIELD(meta_projection, param.eqr.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.eqr.false_northing, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t eqc_fields[] = {
+  FIELD(meta_projection, param.eqc.orig_latitude, FIELD_DOUBLE),
+  FIELD(meta_projection, param.eqc.central_meridian, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t sin_fields[] = {
+  FIELD(meta_projection, param.sin.longitude_center, FIELD_DOUBLE),
+  FIELD(meta_projection, param.sin.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.sin.false_northing, FIELD_DOUBLE),
+  FIELD(meta_projection, param.sin.sphere, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t cea_fields[] = {
+  FIELD(meta_projection, param.cea.standard_parallel, FIELD_DOUBLE),
+  FIELD(meta_projection, param.cea.central_meridian, FIELD_DOUBLE),
+  FIELD(meta_projection, param.cea.false_easting, FIELD_DOUBLE),
+  FIELD(meta_projection, param.cea.false_northing, FIELD_DOUBLE),
+  FIELD(meta_projection, param.cea.sphere, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t transform_fields[] = {
+  STRING(meta_transform, type),
+  FIELD(meta_transform, source_pixel_size, FIELD_DOUBLE),
+  FIELD(meta_transform, target_pixel_size, FIELD_DOUBLE),
+  FIELD(meta_transform, parameter_count, FIELD_INT),
+  FIELDS(meta_transform, x, FIELD_DOUBLE, 25),
+  FIELDS(meta_transform, y, FIELD_DOUBLE, 25),
+  FIELD(meta_transform, origin_pixel, FIELD_DOUBLE),
+  FIELD(meta_transform, origin_line, FIELD_DOUBLE),
+  FIELDS(meta_transform, l, FIELD_DOUBLE, 25),
+  FIELDS(meta_transform, s, FIELD_DOUBLE, 25),
+  FIELD(meta_transform, origin_lat, FIELD_DOUBLE),
+  FIELD(meta_transform, origin_lon, FIELD_DOUBLE),
+  FIELDS(meta_transform, map2ls_a, FIELD_DOUBLE, 10),
+  FIELDS(meta_transform, map2ls_b, FIELD_DOUBLE, 10),
+  FIELDS(meta_transform, incid_a, FIELD_DOUBLE, 6),
+  FIELD(meta_transform, use_reverse_transform, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t airsar_fields[] = {
+  FIELD(meta_airsar, scale_factor, FIELD_DOUBLE),
+  FIELD(meta_airsar, gps_altitude, FIELD_DOUBLE),
+  FIELD(meta_airsar, lat_peg_point, FIELD_DOUBLE),
+  FIELD(meta_airsar, lon_peg_point, FIELD_DOUBLE),
+  FIELD(meta_airsar, head_peg_point, FIELD_DOUBLE),
+  FIELD(meta_airsar, along_track_offset, FIELD_DOUBLE),
+  FIELD(meta_airsar, cross_track_offset, FIELD_DOUBLE),
+  FIELD(meta_airsar, elevation_increment, FIELD_DOUBLE),
+  FIELD(meta_airsar, elevation_offset, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t uavsar_fields[] = {
+  STRING(meta_uavsar, id),
+  FIELD(meta_uavsar, scale_factor, FIELD_DOUBLE),
+  FIELD(meta_uavsar, gps_altitude, FIELD_DOUBLE),
+  FIELD(meta_uavsar, lat_peg_point, FIELD_DOUBLE),
+  FIELD(meta_uavsar, lon_peg_point, FIELD_DOUBLE),
+  FIELD(meta_uavsar, head_peg_point, FIELD_DOUBLE),
+  FIELD(meta_uavsar, along_track_offset, FIELD_DOUBLE),
+  FIELD(meta_uavsar, cross_track_offset, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t dem_fields[] = {
+  STRING(meta_dem, source),
+  STRING(meta_dem, format),
+  STRING(meta_dem, tiles),
+  FIELD(meta_dem, min_value, FIELD_DOUBLE),
+  FIELD(meta_dem, max_value, FIELD_DOUBLE),
+  FIELD(meta_dem, mean_value, FIELD_DOUBLE),
+  FIELD(meta_dem, standard_deviation, FIELD_DOUBLE),
+  STRING(meta_dem, unit_type),
+  FIELD(meta_dem, no_data, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t stats_fields[] = {
+  STRING(meta_stats, band_id),
+  FIELD(meta_stats, min, FIELD_DOUBLE),
+  FIELD(meta_stats, max, FIELD_DOUBLE),
+  FIELD(meta_stats, mean, FIELD_DOUBLE),
+  FIELD(meta_stats, rmse, FIELD_DOUBLE),
+  FIELD(meta_stats, std_deviation, FIELD_DOUBLE),
+  FIELD(meta_stats, mask, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t state_vectors_fields[] = {
+  FIELD(meta_state_vectors, year, FIELD_INT),
+  FIELD(meta_state_vectors, julDay, FIELD_INT),
+  FIELD(meta_state_vectors, second, FIELD_DOUBLE),
+  FIELD(meta_state_vectors, num, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t state_loc_fields[] = {
+  FIELD(state_loc, time, FIELD_DOUBLE),
+  FIELD(state_loc, vec.pos.x, FIELD_DOUBLE),
+  FIELD(state_loc, vec.pos.y, FIELD_DOUBLE),
+  FIELD(state_loc, vec.pos.z, FIELD_DOUBLE),
+  FIELD(state_loc, vec.vel.x, FIELD_DOUBLE),
+  FIELD(state_loc, vec.vel.y, FIELD_DOUBLE),
+  FIELD(state_loc, vec.vel.z, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t location_fields[] = {
+  FIELD(meta_location, lat_start_near_range, FIELD_DOUBLE),
+  FIELD(meta_location, lon_start_near_range, FIELD_DOUBLE),
+  FIELD(meta_location, lat_start_far_range, FIELD_DOUBLE),
+  FIELD(meta_location, lon_start_far_range, FIELD_DOUBLE),
+  FIELD(meta_location, lat_end_near_range, FIELD_DOUBLE),
+  FIELD(meta_location, lon_end_near_range, FIELD_DOUBLE),
+  FIELD(meta_location, lat_end_far_range, FIELD_DOUBLE),
+  FIELD(meta_location, lon_end_far_range, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t calibration_fields[] = {
+  FIELD(meta_calibration, type, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t asf_cal_fields[] = {
+  FIELD(asf_cal_params, a0, FIELD_DOUBLE),
+  FIELD(asf_cal_params, a1, FIELD_DOUBLE),
+  FIELD(asf_cal_params, a2, FIELD_DOUBLE),
+  FIELDS(asf_cal_params, noise, FIELD_DOUBLE, 256),
+  FIELD(asf_cal_params, sample_count, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t asf_scansar_cal_fields[] = {
+  FIELD(asf_scansar_cal_params, a0, FIELD_DOUBLE),
+  FIELD(asf_scansar_cal_params, a1, FIELD_DOUBLE),
+  FIELD(asf_scansar_cal_params, a2, FIELD_DOUBLE),
+  FIELDS(asf_scansar_cal_params, noise, FIELD_DOUBLE, 256),
+  END_FIELDS
+};
+
+static const meta_field_t esa_cal_fields[] = {
+  FIELD(esa_cal_params, k, FIELD_DOUBLE),
+  FIELD(esa_cal_params, ref_incid, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t rsat_cal_fields[] = {
+  FIELD(rsat_cal_params, n, FIELD_INT),
+  COUNTED(rsat_cal_params, lut, 1024, n),
+  FIELD(rsat_cal_params, samp_inc, FIELD_INT),
+  FIELD(rsat_cal_params, a3, FIELD_DOUBLE),
+  FIELD(rsat_cal_params, slc, FIELD_INT),
+  FIELD(rsat_cal_params, focus, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t alos_cal_fields[] = {
+  FIELD(alos_cal_params, cf_hh, FIELD_DOUBLE),
+  FIELD(alos_cal_params, cf_hv, FIELD_DOUBLE),
+  FIELD(alos_cal_params, cf_vh, FIELD_DOUBLE),
+  FIELD(alos_cal_params, cf_vv, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t tsx_cal_fields[] = {
+  FIELD(tsx_cal_params, k, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t r2_cal_fields[] = {
+  FIELD(r2_cal_params, num_elements, FIELD_INT),
+  COUNTED(r2_cal_params, a_beta, 8192, num_elements),
+  COUNTED(r2_cal_params, a_gamma, 8192, num_elements),
+  COUNTED(r2_cal_params, a_sigma, 8192, num_elements),
+  FIELD(r2_cal_params, b, FIELD_DOUBLE),
+  FIELD(r2_cal_params, slc, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t uavsar_cal_fields[] = {
+  FIELD(uavsar_cal_params, semi_major, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, slant_range_first_pixel, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, range_spacing, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, azimuth_spacing, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, pitch, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, steering_angle, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, altitude, FIELD_DOUBLE),
+  FIELD(uavsar_cal_params, terrain_height, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t colormap_fields[] = {
+  STRING(meta_colormap, look_up_table),
+  STRING(meta_colormap, band_id),
+  FIELD(meta_colormap, num_elements, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t doppler_fields[] = {
+  FIELD(meta_doppler, type, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t tsx_doppler_fields[] = {
+  FIELD(tsx_doppler_params, year, FIELD_INT),
+  FIELD(tsx_doppler_params, julDay, FIELD_INT),
+  FIELD(tsx_doppler_params, second, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t tsx_estimate_fields[] = {
+  FIELD(tsx_doppler_t, time, FIELD_DOUBLE),
+  FIELD(tsx_doppler_t, first_range_time, FIELD_DOUBLE),
+  FIELD(tsx_doppler_t, reference_time, FIELD_DOUBLE),
+  FIELD(tsx_doppler_t, poly_degree, FIELD_INT),
+  END_FIELDS
+};
+
+static const meta_field_t r2_doppler_fields[] = {
+  FIELD(radarsat2_doppler_params, ref_time_centroid, FIELD_DOUBLE),
+  FIELD(radarsat2_doppler_params, ref_time_rate, FIELD_DOUBLE),
+  FIELD(radarsat2_doppler_params, time_first_sample, FIELD_DOUBLE),
+  END_FIELDS
+};
+
+static const meta_field_t insar_fields[] = {
+  STRING(meta_insar, processor),
+  STRING(meta_insar, master_image),
+  STRING(meta_insar, slave_image),
+  STRING(meta_insar, master_acquisition_date),
+  STRING(meta_insar, slave_acquisition_date),
+  FIELD(meta_insar, center_look_angle, FIELD_DOUBLE),
+  STRING(meta_insar, center_look_angle_units),
+  FIELD(meta_insar, doppler, FIELD_DOUBLE),
+  STRING(meta_insar, doppler_units),
+  FIELD(meta_insar, doppler_rate, FIELD_DOUBLE),
+  STRING(meta_insar, doppler_rate_units),
+  FIELD(meta_insar, baseline_length, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_length_units),
+  FIELD(meta_insar, baseline_parallel, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_parallel_units),
+  FIELD(meta_insar, baseline_parallel_rate, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_parallel_rate_units),
+  FIELD(meta_insar, baseline_perpendicular, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_perpendicular_units),
+  FIELD(meta_insar, baseline_perpendicular_rate, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_perpendicular_rate_units),
+  FIELD(meta_insar, baseline_temporal, FIELD_INT),
+  STRING(meta_insar, baseline_temporal_units),
+  FIELD(meta_insar, baseline_critical, FIELD_DOUBLE),
+  STRING(meta_insar, baseline_critical_units),
+  END_FIELDS
+};
+
+// Every table, in a fixed order, for the signature
+static const meta_field_t *all_tables[] = {
+  general_fields, sar_fields, optical_fields, thermal_fields,
+  projection_fields, albers_fields, atct_fields, lamaz_fields,
+  lamcc_fields, ps_fields, utm_fields, state_fields, mer_fields,
+  eqr_fields, eqc_fields, sin_fields, cea_fields, transform_fields,
+  airsar_fields, uavsar_fields, dem_fields, stats_fields,
+  state_vectors_fields, state_loc_fields, location_fields,
+  calibration_fields, asf_cal_fields, asf_scansar_cal_fields,
+  esa_cal_fields, rsat_cal_fields, alos_cal_fields, tsx_cal_fields,
+  r2_cal_fields, uavsar_cal_fields, colormap_fields, doppler_fields,
+  tsx_doppler_fields, tsx_estimate_fields, r2_doppler_fields,
+  insar_fields, NULL
+};
+
+// Parameter table for the projection type, NULL if it has none
+static const meta_field_t *param_fields(projection_type_t type)
+{
+  switch (type) {
+    case UNIVERSAL_TRANSVERSE_MERCATOR: return utm_fields;
+    case POLAR_STEREOGRAPHIC:           return ps_fields;
+    case ALBERS_EQUAL_AREA:             return albers_fields;
+    case LAMBERT_CONFORMAL_CONIC:       return lamcc_fields;
+    case LAMBERT_AZIMUTHAL_EQUAL_AREA:  return lamaz_fields;
+    case STATE_PLANE:                   return state_fields;
+    case SCANSAR_PROJECTION:            return atct_fields;
+    case MERCATOR:                      return mer_fields;
+    case EQUI_RECTANGULAR:              return eqr_fields;
+    case EQUIDISTANT:                   return eqc_fields;
+    case SINUSOIDAL:                    return sin_fields;
+    case EASE_GRID_NORTH:
+    case EASE_GRID_SOUTH:               return lamaz_fields;
+    case EASE_GRID_GLOBAL:              return cea_fields;
+    default:                            return NULL;
+  }
+}
+
+// Hash of the names, types and sizes of all fields: a sidecar written
+// with different tables is not read.
+static unsigned int tables_signature(void)
+{
+  unsigned int hash = 2166136261u;
+  const meta_field_t *f;
+  const char *c;
+  int ii;
+
+  for (ii=0; all_tables[ii]; ii++) {
+    for (f=all_tables[ii]; f->name; f++) {
+      for (c=f->name; *c; c++)
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+      hash = (hash ^ f->type) * 16777619u;
+      hash = (hash ^ f->count) * 16777619u;
+      hash = (hash ^ (f->count_offset >= 0)) * 16777619u;
+    }
+    hash = (hash ^ 0xff) * 16777619u;
+  }
+
+  return hash;
+}
+
+/* Sidecar writing ********************************************************/
+
+static void out_u32(FILE *fp, unsigned int v)
+{
+  fputc(v & 0xff, fp);
+  fputc((v >> 8) & 0xff, fp);
+  fputc((v >> 16) & 0xff, fp);
+  fputc((v >> 24) & 0xff, fp);
+}
+
+static void out_u64(FILE *fp, unsigned long long v)
+{
+  out_u32(fp, (unsigned int)(v & 0xffffffffu));
+  out_u32(fp, (unsigned int)(v >> 32));
+}
+
+static void out_int(FILE *fp, int v)
+{
+  out_u32(fp, (unsigned int) v);
+}
+
+static void out_double(FILE *fp, double v)
+{
+  unsigned long long bits;
+  memcpy(&bits, &v, sizeof(bits));
+  out_u64(fp, bits);
+}
+
+static void out_float(FILE *fp, float v)
+{
+  unsigned int bits;
+  memcpy(&bits, &v, sizeof(bits));
+  out_u32(fp, bits);
+}
+
+static void out_fields(FILE *fp, const void *block, const meta_field_t *fields)
+{
+  const char *base = (const char *) block;
+  const meta_field_t *f;
+  int ii, n, len;
+
+  for (f=fields; f->name; f++) {
+    const char *p = base + f->offset;
+    n = f->count;
+    if (f->count_offset >= 0) {
+      n = *(const int *)(base + f->count_offset);
+      if (n < 0) n = 0;
+      if (n > f->count) n = f->count;
+    }
+    switch (f->type) {
+      case FIELD_INT:
+        for (ii=0; ii<n; ii++)
+          out_int(fp, ((const int *) p)[ii]);
+        break;
+      case FIELD_DOUBLE:
+        for (ii=0; ii<n; ii++)
+          out_double(fp, ((const double *) p)[ii]);
+        break;
+      case FIELD_FLOAT:
+        for (ii=0; ii<n; ii++)
+          out_float(fp, ((const float *) p)[ii]);
+        break;
+      case FIELD_CHAR:
+        fputc((unsigned char) *p, fp);
+        break;
+      case FIELD_STRING:
+        for (len=0; len<n-1 && p[len]; len++);
+        out_int(fp, len);
+        fwrite(p, 1, len, fp);
+        break;
+    }
+  }
+}
+
+// An optional block: a flag, then its fields
+static int out_block(FILE *fp, const void *block, const meta_field_t *fields)
+{
+  fputc(block != NULL, fp);
+  if (block)
+    out_fields(fp, block, fields);
+  return block != NULL;
+}
+
+static char *sidecar_name(const char *meta_name)
+{
+  char *name = (char *) MALLOC(strlen(meta_name) + 5);
+  sprintf(name, "%s.bin", meta_name);
+  return name;
+}
+
+static void sidecar_write(const char *meta_name, const meta_file_stamp *stamp,
+                          meta_parameters *meta)
+{
+  char *name = sidecar_name(meta_name);
+  char *tmp_name = (char *) MALLOC(strlen(name) + 5);
+  meta_calibration *cal = meta->calibration;
+  int ii, n, ok;
+  FILE *fp;
+
+  // The sidecar is just an optimization, so it's fine if we can't write
+  // it.  It's written under a temporary name and renamed when complete,
+  // so another process never sees half of it.
+  sprintf(tmp_name, "%s.tmp", name);
+  fp = fopen(tmp_name, "wb");
+  if (!fp) {
+    FREE(tmp_name);
+    FREE(name);
+    return;
+  }
+
+  fwrite(META_SIDECAR_MAGIC, 1, 8, fp);
+  out_int(fp, META_SIDECAR_VERSION);
+  out_u32(fp, tables_signature());
+  out_u64(fp, (unsigned long long) stamp->size);
+  out_u64(fp, (unsigned long long) stamp->mtime);
+  out_u64(fp, (unsigned long long) stamp->mtime_nsec);
+  out_u32(fp, stamp->check);
+  out_double(fp, meta->meta_version);
+
+  out_block(fp, meta->general, general_fields);
+  out_block(fp, meta->sar, sar_fields);
+  out_block(fp, meta->optical, optical_fields);
+  out_block(fp, meta->thermal, thermal_fields);
+  if (out_block(fp, meta->projection, projection_fields)) {
+    const meta_field_t *param = param_fields(meta->projection->type);
+    if (param)
+      out_fields(fp, meta->projection, param);
+  }
+  out_block(fp, meta->transform, transform_fields);
+  out_block(fp, meta->airsar, airsar_fields);
+  out_block(fp, meta->uavsar, uavsar_fields);
+  out_block(fp, meta->location, location_fields);
+  out_block(fp, meta->insar, insar_fields);
+  out_block(fp, meta->dem, dem_fields);
+
+  fputc(meta->stats != NULL, fp);
+  if (meta->stats) {
+    out_int(fp, meta->stats->band_count);
+    for (ii=0; ii<meta->stats->band_count; ii++)
+      out_fields(fp, &meta->stats->band_stats[ii], stats_fields);
+  }
+
+  fputc(meta->state_vectors != NULL, fp);
+  if (meta->state_vectors) {
+    out_int(fp, meta->state_vectors->vector_count);
+    out_fields(fp, meta->state_vectors, state_vectors_fields);
+    for (ii=0; ii<meta->state_vectors->vector_count; ii++)
+      out_fields(fp, &meta->state_vectors->vecs[ii], state_loc_fields);
+  }
+
+  if (out_block(fp, cal, calibration_fields)) {
+    out_block(fp, cal->asf, asf_cal_fields);
+    out_block(fp, cal->asf_scansar, asf_scansar_cal_fields);
+    out_block(fp, cal->esa, esa_cal_fields);
+    out_block(fp, cal->rsat, rsat_cal_fields);
+    out_block(fp, cal->alos, alos_cal_fields);
+    out_block(fp, cal->tsx, tsx_cal_fields);
+    out_block(fp, cal->r2, r2_cal_fields);
+    out_block(fp, cal->uavsar, uavsar_cal_fields);
+  }
+
+  if (out_block(fp, meta->colormap, colormap_fields)) {
+    meta_rgb *rgb = meta->colormap->rgb;
+    n = rgb && meta->colormap->num_elements > 0 ?
+      meta->colormap->num_elements : 0;
+    out_int(fp, n);
+    for (ii=0; ii<n; ii++) {
+      fputc(rgb[ii].red, fp);
+      fputc(rgb[ii].green, fp);
+      fputc(rgb[ii].blue, fp);
+    }
+  }
+
+  if (out_block(fp, meta->doppler, doppler_fields)) {
+    tsx_doppler_params *tsx = meta->doppler->tsx;
+    radarsat2_doppler_params *r2 = meta->doppler->r2;
+    if (out_block(fp, tsx, tsx_doppler_fields)) {
+      n = tsx->dop ? tsx->doppler_count : 0;
+      out_int(fp, n);
+      for (ii=0; ii<n; ii++) {
+        tsx_doppler_t *est = &tsx->dop[ii];
+        int kk, coefs = est->coefficient ? est->poly_degree + 1 : 0;
+        out_fields(fp, est, tsx_estimate_fields);
+        out_int(fp, coefs);
+        for (kk=0; kk<coefs; kk++)
+          out_double(fp, est->coefficient[kk]);
+      }
+    }
+    if (out_block(fp, r2, r2_doppler_fields)) {
+      n = r2->centroid && r2->rate ? r2->doppler_count : 0;
+      out_int(fp, n);
+      for (ii=0; ii<n; ii++)
+        out_double(fp, r2->centroid[ii]);
+      for (ii=0; ii<n; ii++)
+        out_double(fp, r2->rate[ii]);
+    }
+  }
+
+  // Last comes a checksum of everything before it, so that a damaged
+  // sidecar is thrown away rather than loaded
+  ok = !ferror(fp);
+  if (fclose(fp) != 0)
+    ok = FALSE;
+  if (ok) {
+    unsigned int check;
+    ok = checksum_file(tmp_name, &check) &&
+      (fp = fopen(tmp_name, "ab")) != NULL;
+    if (ok) {
+      out_u32(fp, check);
+      ok = !ferror(fp);
+      if (fclose(fp) != 0)
+        ok = FALSE;
+    }
+  }
+  if (ok) {
+#ifdef win32
+    // rename() doesn't replace an existing file here
+    remove(name);
+#endif
+    ok = rename(tmp_name, name) == 0;
+  }
+  if (!ok)
+    remove(tmp_name);
+  FREE(tmp_name);
+  FREE(name);
+}
+
+/* Sidecar reading ********************************************************/
+
+// The whole sidecar, and how far into it we are.  Reading past the
+// end clears ok and returns zeros from then on.
+typedef struct {
+  const unsigned char *data;
+  size_t size, pos;
+  int ok;
+} sidecar_in;
+
+static const unsigned char *in_bytes(sidecar_in *in, size_t n)
+{
+  const unsigned char *p;
+
+  if (!in->ok || n > in->size - in->pos) {
+    in->ok = FALSE;
+    return NULL;
+  }
+  p = in->data + in->pos;
+  in->pos += n;
+  return p;
+}
+
+static unsigned int in_u32(sidecar_in *in)
+{
+  const unsigned char *p = in_bytes(in, 4);
+
+  if (!p)
+    return 0;
+  return (unsigned int) p[0] | ((unsigned int) p[1] << 8) |
+    ((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static unsigned long long in_u64(sidecar_in *in)
+{
+  unsigned long long lo = in_u32(in);
+  unsigned long long hi = in_u32(in);
+  return lo | (hi << 32);
+}
+
+static int in_int(sidecar_in *in)
+{
+  return (int) in_u32(in);
+}
+
+static double in_double(sidecar_in *in)
+{
+  unsigned long long bits = in_u64(in);
+  double v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+static float in_float(sidecar_in *in)
+{
+  unsigned int bits = in_u32(in);
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+static int in_flag(sidecar_in *in)
+{
+  const unsigned char *p = in_bytes(in, 1);
+  return p && *p;
+}
+
+// A count of array elements that must follow, at least bytes each
+static int in_count(sidecar_in *in, size_t bytes)
+{
+  int n = in_int(in);
+
+  if (n < 0 || (size_t) n > (in->size - in->pos) / bytes) {
+    in->ok = FALSE;
+    return 0;
+  }
+  return n;
+}
+
+static void in_fields(sidecar_in *in, void *block, const meta_field_t *fields)
+{
+  char *base = (char *) block;
+  const meta_field_t *f;
+  const unsigned char *s;
+  int ii, n, len;
+
+  for (f=fields; f->name && in->ok; f++) {
+    char *p = base + f->offset;
+    n = f->count;
+    if (f->count_offset >= 0) {
+      // The count is an earlier field of the same table
+      n = *(int *)(base + f->count_offset);
+      if (n < 0) n = 0;
+      if (n > f->count) n = f->count;
+    }
+    switch (f->type) {
+      case FIELD_INT:
+        for (ii=0; ii<n; ii++)
+          ((int *) p)[ii] = in_int(in);
+        break;
+      case FIELD_DOUBLE:
+        for (ii=0; ii<n; ii++)
+          ((double *) p)[ii] = in_double(in);
+        break;
+      case FIELD_FLOAT:
+        for (ii=0; ii<n; ii++)
+          ((float *) p)[ii] = in_float(in);
+        break;
+      case FIELD_CHAR:
+        s = in_bytes(in, 1);
+        *p = s ? (char) *s : '\0';
+        break;
+      case FIELD_STRING:
+        len = in_int(in);
+        if (len < 0 || len >= n) {
+          in->ok = FALSE;
+          break;
+        }
+        s = in_bytes(in, len);
+        if (s)
+          memcpy(p, s, len);
+        p[len] = '\0';
+        break;
+    }
+  }
+}
+
+// Reads an optional block into a structure from init (or zeroed
+// memory of the given size), NULL if it isn't there
+static void *in_block(sidecar_in *in, void *(*init)(void), size_t size,
+                       const meta_field_t *fields)
+{
+  void *block;
+
+  if (!in_flag(in))
+    return NULL;
+  block = init ? init() : CALLOC(1, size);
+  in_fields(in, block, fields);
+  return block;
+}
+
+#define IN_BLOCK(in, init, type, fields) \
+  ((type *) in_block(in, (void *(*)(void)) (init), sizeof(type), fields))
+
+static meta_parameters *sidecar_parse(sidecar_in *in,
+                                      const meta_file_stamp *stamp)
+{
+  meta_file_stamp file_stamp;
+  meta_parameters *meta;
+  meta_calibration *cal;
+  const unsigned char *magic;
+  int ii, n;
+
+  magic = in_bytes(in, 8);
+  if (!magic || memcmp(magic, META_SIDECAR_MAGIC, 8) != 0 ||
+      in_int(in) != META_SIDECAR_VERSION ||
+      in_u32(in) != tables_signature())
+    return NULL;
+  file_stamp.size = (long long) in_u64(in);
+  file_stamp.mtime = (long long) in_u64(in);
+  file_stamp.mtime_nsec = (long long) in_u64(in);
+  file_stamp.check = in_u32(in);
+  if (!in->ok || !same_stamp(&file_stamp, stamp))
+    return NULL;
+
+  // Blocks are hooked into meta as soon as they are allocated, so that
+  // meta_free() can clean up after a broken sidecar at any point
+  meta = raw_init();
+  meta->meta_version = in_double(in);
+
+  if (in_flag(in))
+    in_fields(in, meta->general, general_fields);
+  else {
+    FREE(meta->general);
+    meta->general = NULL;
+  }
+  meta->sar = IN_BLOCK(in, meta_sar_init, meta_sar, sar_fields);
+  meta->optical = IN_BLOCK(in, meta_optical_init, meta_optical,
+                            optical_fields);
+  meta->thermal = IN_BLOCK(in, meta_thermal_init, meta_thermal,
+                            thermal_fields);
+  meta->projection = IN_BLOCK(in, meta_projection_init, meta_projection,
+                               projection_fields);
+  if (meta->projection && in->ok) {
+    const meta_field_t *param = param_fields(meta->projection->type);
+    if (param)
+      in_fields(in, meta->projection, param);
+  }
+  meta->transform = IN_BLOCK(in, meta_transform_init, meta_transform,
+                              transform_fields);
+  meta->airsar = IN_BLOCK(in, meta_airsar_init, meta_airsar,
+                           airsar_fields);
+  meta->uavsar = IN_BLOCK(in, meta_uavsar_init, meta_uavsar,
+                           uavsar_fields);
+  meta->location = IN_BLOCK(in, meta_location_init, meta_location,
+                             location_fields);
+  meta->insar = IN_BLOCK(in, meta_insar_init, meta_insar, insar_fields);
+  meta->dem = IN_BLOCK(in, meta_dem_init, meta_dem, dem_fields);
+
+  if (in_flag(in)) {
+    n = in_count(in, 1);
+    meta->stats = meta_statistics_init(n);
+    for (ii=0; ii<n; ii++)
+      in_fields(in, &meta->stats->band_stats[ii], stats_fields);
+  }
+
+  if (in_flag(in)) {
+    n = in_count(in, 1);
+    meta->state_vectors = meta_state_vectors_init(n);
+    in_fields(in, meta->state_vectors, state_vectors_fields);
+    for (ii=0; ii<n; ii++)
+      in_fields(in, &meta->state_vectors->vecs[ii], state_loc_fields);
+  }
+
+  cal = meta->calibration =
+    IN_BLOCK(in, meta_calibration_init, meta_calibration,
+              calibration_fields);
+  if (cal) {
+    cal->asf = IN_BLOCK(in, NULL, asf_cal_params, asf_cal_fields);
+    cal->asf_scansar = IN_BLOCK(in, NULL, asf_scansar_cal_params,
+                                 asf_scansar_cal_fields);
+    cal->esa = IN_BLOCK(in, NULL, esa_cal_params, esa_cal_fields);
+    cal->rsat = IN_BLOCK(in, NULL, rsat_cal_params, rsat_cal_fields);
+    cal->alos = IN_BLOCK(in, NULL, alos_cal_params, alos_cal_fields);
+    cal->tsx = IN_BLOCK(in, NULL, tsx_cal_params, tsx_cal_fields);
+    cal->r2 = IN_BLOCK(in, NULL, r2_cal_params, r2_cal_fields);
+    cal->uavsar = IN_BLOCK(in, NULL, uavsar_cal_params, uavsar_cal_fields);
+  }
+
+  meta->colormap = IN_BLOCK(in, meta_colormap_init, meta_colormap,
+                             colormap_fields);
+  if (meta->colormap) {
+    n = in_count(in, 3);
+    if (n > 0) {
+      meta_rgb *rgb = (meta_rgb *) CALLOC(n, sizeof(meta_rgb));
+      meta->colormap->rgb = rgb;
+      for (ii=0; ii<n; ii++) {
+        const unsigned char *p = in_bytes(in, 3);
+        if (p) {
+          rgb[ii].red = p[0];
+          rgb[ii].green = p[1];
+          rgb[ii].blue = p[2];
+        }
+      }
+    }
+    if (n > 0 && n != meta->colormap->num_elements)
+      in->ok = FALSE;
+  }
+
+  meta->doppler = IN_BLOCK(in, meta_doppler_init, meta_doppler,
+                            doppler_fields);
+  if (meta->doppler) {
+    tsx_doppler_params *tsx = meta->doppler->tsx =
+      IN_BLOCK(in, NULL, tsx_doppler_params, tsx_doppler_fields);
+    radarsat2_doppler_params *r2;
+    if (tsx) {
+      n = in_count(in, 1);
+      tsx->dop = n > 0 ?
+        (tsx_doppler_t *) CALLOC(n, sizeof(tsx_doppler_t)) : NULL;
+      tsx->doppler_count = n;
+      for (ii=0; ii<n && in->ok; ii++) {
+        tsx_doppler_t *est = &tsx->dop[ii];
+        int kk, coefs;
+        in_fields(in, est, tsx_estimate_fields);
+        coefs = in_count(in, 8);
+        if (coefs > 0) {
+          est->coefficient = (double *) MALLOC(sizeof(double)*coefs);
+          for (kk=0; kk<coefs; kk++)
+            est->coefficient[kk] = in_double(in);
+        }
+      }
+    }
+    r2 = meta->doppler->r2 =
+      IN_BLOCK(in, NULL, radarsat2_doppler_params, r2_doppler_fields);
+    if (r2) {
+      n = in_count(in, 16);
+      r2->doppler_count = n;
+      if (n > 0) {
+        r2->centroid = (double *) MALLOC(sizeof(double)*n);
+        r2->rate = (double *) MALLOC(sizeof(double)*n);
+        for (ii=0; ii<n; ii++)
+          r2->centroid[ii] = in_double(in);
+        for (ii=0; ii<n; ii++)
+          r2->rate[ii] = in_double(in);
+      }
+    }
+  }
+
+  if (!in->ok || in->pos != in->size) {
+    meta_free(meta);
+    return NULL;
+  }
+
+  return meta;
+}
+
+static meta_parameters *sidecar_read(const char *meta_name,
+                                     const meta_file_stamp *stamp)
+{
+  char *name = sidecar_name(meta_name);
+  meta_parameters *meta = NULL;
+  unsigned char *data;
+  sidecar_in in;
+  struct stat st;
+  FILE *fp;
+
+  fp = stat(name, &st) == 0 ? fopen(name, "rb") : NULL;
+  FREE(name);
+  if (!fp)
+    return NULL;
+
+  data = (unsigned char *) MALLOC(st.st_size > 0 ? st.st_size : 1);
+  if (st.st_size > 4 &&
+      fread(data, 1, st.st_size, fp) == (size_t) st.st_size) {
+    in.data = data;
+    in.size = st.st_size;
+    in.pos = in.size - 4;
+    in.ok = TRUE;
+    if (in_u32(&in) == fnv_add(FNV_START, data, in.size - 4)) {
+      in.size -= 4;
+      in.pos = 0;
+      meta = sidecar_parse(&in, stamp);
+    }
+  }
+  fclose(fp);
+  FREE(data);
+
+  return meta;
+}
+
+/* In-process cache *******************************************************/
+
+static void drop_entry(meta_cache_entry *entry)
+{
+  FREE(entry->file_name);
+  meta_free(entry->meta);
+  entry->file_name = NULL;
+  entry->meta = NULL;
+}
+
+// Keeps the metadata parsed from the given file; takes over meta
+static void cache_put(const char *meta_name, const meta_file_stamp *stamp,
+                      meta_parameters *meta)
+{
+  meta_cache_entry *slot = NULL;
+  char *file_name;
+  int ii;
+
+  // Allocate first, so that an error stopping a job (see job.c) can't
+  // leave a half filled entry behind
+  file_name = STRDUP(meta_name);
+
+  // Reuse the entry for this file if there is one, otherwise an empty or
+  // the least recently used one
+  for (ii=0; ii<META_CACHE_SIZE; ii++) {
+    meta_cache_entry *entry = &meta_cache[ii];
+    if (entry->file_name && strcmp(entry->file_name, meta_name) == 0) {
+      slot = entry;
+      break;
+    }
+    if (!slot || (slot->file_name &&
+                  (!entry->file_name || entry->last_used < slot->last_used)))
+      slot = entry;
+  }
+  if (slot->file_name)
+    drop_entry(slot);
+
+  slot->file_name = file_name;
+  slot->stamp = *stamp;
+  slot->meta = meta;
+  slot->last_used = ++meta_cache_clock;
+}
+
+meta_parameters *meta_cache_read(const char *meta_name)
+{
+  meta_file_stamp stamp;
+  meta_parameters *meta;
+  int ii;
+
+  if (!get_stamp(meta_name, &stamp))
+    return NULL;
+
+  for (ii=0; ii<META_CACHE_SIZE; ii++) {
+    meta_cache_entry *entry = &meta_cache[ii];
+    if (entry->file_name && strcmp(entry->file_name, meta_name) == 0) {
+      if (same_stamp(&entry->stamp, &stamp)) {
+        entry->last_used = ++meta_cache_clock;
+        return meta_copy(entry->meta);
+      }
+      // the file has changed since we parsed it
+      drop_entry(entry);
+      break;
+    }
+  }
+
+  // Not parsed in this process yet, maybe in another one
+  meta = sidecar_read(meta_name, &stamp);
+  if (!meta)
+    return NULL;
+  cache_put(meta_name, &stamp, meta_copy(meta));
+
+  return meta;
+}
+
+void meta_cache_store(const char *meta_name, meta_parameters *meta)
+{
+  meta_file_stamp stamp;
+
+  if (!get_stamp(meta_name, &stamp))
+    return;
+
+  cache_put(meta_name, &stamp, meta_copy(meta));
+  sidecar_write(meta_name, &stamp, meta);
+}
+
+void meta_cache_forget(const char *meta_name)
+{
+  char *name = sidecar_name(meta_name);
+  int ii;
+
+  for (ii=0; ii<META_CACHE_SIZE; ii++)
+    if (meta_cache[ii].file_name &&
+        strcmp(meta_cache[ii].file_name, meta_name) == 0)
+      drop_entry(&meta_cache[ii]);
+
+  // The text file is being rewritten, so its sidecar is out of date
+  remove(name);
+  FREE(name);
+}
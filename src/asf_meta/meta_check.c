@@ -224,7 +224,7 @@ int isTerrasar_ext(char *dataFile, int checkPolarimetry, char **error)
       }
     }
     fclose(fp);
-    xmlFreeDoc(doc);
+    xml_free_doc(doc);
     xmlCleanupParser();
     if (path)
       FREE(path);
@@ -325,7 +325,7 @@ int isRadarsat2(char *dataFile, char **error)
     }
     if (fp) {
       fclose(fp);
-      xmlFreeDoc(doc);
+      xml_free_doc(doc);
       xmlCleanupParser();
     }
   }    
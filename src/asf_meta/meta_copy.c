@@ -41,7 +41,8 @@ meta_parameters *meta_copy(meta_parameters *src)
 
   if (src->stats) {
     if (!ret->stats) ret->stats = meta_statistics_init(src->stats->band_count);
-    memcpy(ret->stats, src->stats, sizeof(meta_stats));
+    memcpy(ret->stats, src->stats, sizeof(meta_statistics) +
+           (src->stats->band_count - 1)*sizeof(meta_stats));
   } else
     ret->stats = NULL;
 
@@ -126,9 +127,55 @@ meta_parameters *meta_copy(meta_parameters *src)
       memcpy(ret->calibration->uavsar, src->calibration->uavsar,
 	     sizeof(uavsar_cal_params));
     }
+    if(src->calibration->r2) {
+      ret->calibration->r2 = (r2_cal_params *) MALLOC(sizeof(r2_cal_params));
+      memcpy(ret->calibration->r2, src->calibration->r2, sizeof(r2_cal_params));
+    }
   } else
     ret->calibration = NULL;
 
+  if (src->doppler) {
+    ret->doppler = meta_doppler_init();
+    ret->doppler->type = src->doppler->type;
+    if (src->doppler->tsx) {
+      tsx_doppler_params *tsx = src->doppler->tsx;
+      int ii;
+      ret->doppler->tsx =
+        (tsx_doppler_params *) MALLOC(sizeof(tsx_doppler_params));
+      memcpy(ret->doppler->tsx, tsx, sizeof(tsx_doppler_params));
+      ret->doppler->tsx->dop =
+        (tsx_doppler_t *) MALLOC(sizeof(tsx_doppler_t)*tsx->doppler_count);
+      memcpy(ret->doppler->tsx->dop, tsx->dop,
+             sizeof(tsx_doppler_t)*tsx->doppler_count);
+      for (ii=0; ii<tsx->doppler_count; ii++) {
+        size_t sz = sizeof(double)*(tsx->dop[ii].poly_degree + 1);
+        ret->doppler->tsx->dop[ii].coefficient = (double *) MALLOC(sz);
+        memcpy(ret->doppler->tsx->dop[ii].coefficient,
+               tsx->dop[ii].coefficient, sz);
+      }
+    }
+    if (src->doppler->r2) {
+      radarsat2_doppler_params *r2 = src->doppler->r2;
+      size_t sz = sizeof(double)*r2->doppler_count;
+      ret->doppler->r2 =
+        (radarsat2_doppler_params *) MALLOC(sizeof(radarsat2_doppler_params));
+      memcpy(ret->doppler->r2, r2, sizeof(radarsat2_doppler_params));
+      ret->doppler->r2->centroid = (double *) MALLOC(sz);
+      memcpy(ret->doppler->r2->centroid, r2->centroid, sz);
+      ret->doppler->r2->rate = (double *) MALLOC(sz);
+      memcpy(ret->doppler->r2->rate, r2->rate, sz);
+    }
+  } else
+    ret->doppler = NULL;
+
+  if (src->latlon) {
+    int nl = src->general->line_count, ns = src->general->sample_count;
+    ret->latlon = meta_latlon_init(nl, ns);
+    memcpy(ret->latlon->lat, src->latlon->lat, sizeof(float)*nl*ns);
+    memcpy(ret->latlon->lon, src->latlon->lon, sizeof(float)*nl*ns);
+  } else
+    ret->latlon = NULL;
+
   if (src->colormap) {
     // free default created one, if there
     if (ret->colormap) {
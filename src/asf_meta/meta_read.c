@@ -73,7 +73,17 @@ meta_parameters *meta_read(const char *inName)
       meta_read_old(meta, meta_name);
     }
     else {
-      parse_metadata(meta, meta_name);
+      // Parsing is slow, so use the cached copy (in memory, or the
+      // .meta.bin sidecar) if the file hasn't changed
+      meta_parameters *cached = meta_cache_read(meta_name);
+      if (cached) {
+        meta_free(meta);
+        meta = cached;
+      }
+      else {
+        parse_metadata(meta, meta_name);
+        meta_cache_store(meta_name, meta);
+      }
     }
   }
   // Generate metadata if CEOS files could be detected
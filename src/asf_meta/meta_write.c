@@ -200,9 +200,13 @@ void meta_write(meta_parameters *meta, const char *file_name)
   /* Maximum file name length, including trailing null.  */
 #define FILE_NAME_MAX 1000
   char *file_name_with_extension = appendExt(file_name, ".meta");
-  FILE *fp = FOPEN(file_name_with_extension, "w");
+  FILE *fp;
   char comment[256];
 
+  // Whatever we parsed from this file before is out of date now
+  meta_cache_forget(file_name_with_extension);
+  fp = FOPEN(file_name_with_extension, "w");
+
   // dump the envi header if we were told to do so, and envi supports
   // the type of data that we have
   if (dump_envi_header) {
@@ -1184,10 +1188,13 @@ void meta_write_old(meta_parameters *meta, const char *file_name)
   /* Maximum file name length, including trailing null.  */
 #define FILE_NAME_MAX 1000
   char *file_name_with_extension = appendExt(file_name, ".meta");
-  FILE *fp = FOPEN(file_name_with_extension, "w");
+  FILE *fp;
   geo_parameters *geo=meta->geo;
   ifm_parameters *ifm=meta->ifm;
 
+  meta_cache_forget(file_name_with_extension);
+  fp = FOPEN(file_name_with_extension, "w");
+
   FREE(file_name_with_extension);
 
   /* Write an 'about meta file' comment  */
@@ -1696,6 +1696,8 @@ block_start:   NAME '{'
 int parse_metadata(meta_parameters *dest, char *file_name)
 {
   extern FILE *meta_yyin;
+  extern int looking_at_numeric_string;
+  void meta_yyrestart(FILE *input_file);
   int ret_val;
 
   global_meta = dest;
@@ -1715,8 +1717,15 @@ int parse_metadata(meta_parameters *dest, char *file_name)
   doppler_count = 0;
   stats_block_count = 0;
 
+  /* A parse stopped by an error inside a job (see job.c) leaves its
+     block stack and the lexer's buffered input behind; drop them.  */
+  while ( stack_top != NULL ) {
+    block_stack_pop (&stack_top);
+  }
+  looking_at_numeric_string = 0;
+
   meta_yyin = FOPEN(file_name, "r");
-  stack_top = NULL;
+  meta_yyrestart(meta_yyin);
   block_stack_push(&stack_top, "outermost_section", dest);
 
   /* Parse metadata file.  */
@@ -8,175 +8,427 @@
 #define MAX_LEN 100000
 static char buf[MAX_LEN];
 
-static xmlNode *findNode(xmlDoc *doc, xmlNode *node, char *name, int desired)
-{
-  // the "count" refers to how many Nodes with that name we've found,
-  // in case we are supposed to find one that isn't the first in a list
-  int count = 0;
-  xmlNode *cur = node->xmlChildrenNode;
-
-  //printf("XML>> Looking for: %s (occurence: %d)\n", name, desired);
-  while (cur != NULL) {
-    //printf("XML>>... %s?\n", (char*)cur->name);
-    if (!xmlStrcmp(cur->name, (const xmlChar *)name)) {
-      ++count;
-      //printf("XML>>    yes!  that's %d!\n", count);
-      if (count == desired) {
-        //printf("XML>>      ... which is the one we want!\n");
-        return cur;
+// Longest dotted path (after the printf-style expansion) we handle
+#define MAX_PATH_LEN 4096
+
+// Lookups are indexed per document, so that reading long lists such as
+// the state vectors or the geolocation grid of a RADARSAT-2 or TerraSAR-X
+// product does not rescan the tree for every element.  The index is
+// built lazily, hangs off doc->_private and is released by xml_free_doc().
+// It has two parts:
+//  - for each node we have looked below, its children sorted by name, so
+//    that "name[k]" is a binary search instead of a scan of the siblings
+//  - a cache mapping the dotted paths (and every prefix of them) we have
+//    resolved to their nodes, so that "a.b.c[12].x" only has to resolve
+//    the last element when "a.b.c[12]" was looked up before.
+typedef struct {
+  const char *name;
+  int pos;
+  xmlNode *node;
+} xml_child_t;
+
+typedef struct xml_child_index {
+  xmlNode *parent;
+  int count;
+  xml_child_t *children;
+  struct xml_child_index *next;
+} xml_child_index_t;
+
+typedef struct xml_path_entry {
+  char *path;
+  unsigned int hash;
+  xmlNode *node;
+  struct xml_path_entry *next;
+} xml_path_entry_t;
+
+typedef struct {
+  int path_count, path_size;
+  xml_path_entry_t **paths;
+  int child_count, child_size;
+  xml_child_index_t **children;
+} xml_index_t;
+
+#define XML_INDEX_INITIAL_SIZE 256
+
+static unsigned int hash_string(const char *str, int len)
+{
+  // FNV-1a
+  unsigned int h = 2166136261u;
+  int i;
+  for (i=0; i<len; ++i) {
+    h ^= (unsigned char)str[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static unsigned int hash_node(const xmlNode *node)
+{
+  return (unsigned int)(((size_t)node >> 4) * 2654435761u);
+}
+
+static xml_index_t *get_index(xmlDoc *doc)
+{
+  xml_index_t *index = (xml_index_t*)doc->_private;
+  if (!index) {
+    index = MALLOC(sizeof(xml_index_t));
+    index->path_count = index->child_count = 0;
+    index->path_size = index->child_size = XML_INDEX_INITIAL_SIZE;
+    index->paths = CALLOC(index->path_size, sizeof(xml_path_entry_t*));
+    index->children = CALLOC(index->child_size, sizeof(xml_child_index_t*));
+    doc->_private = index;
+  }
+  return index;
+}
+
+static void free_index(xml_index_t *index)
+{
+  int i;
+  for (i=0; i<index->path_size; ++i) {
+    xml_path_entry_t *e = index->paths[i];
+    while (e) {
+      xml_path_entry_t *next = e->next;
+      FREE(e->path);
+      FREE(e);
+      e = next;
+    }
+  }
+  for (i=0; i<index->child_size; ++i) {
+    xml_child_index_t *c = index->children[i];
+    while (c) {
+      xml_child_index_t *next = c->next;
+      FREE(c->children);
+      FREE(c);
+      c = next;
+    }
+  }
+  FREE(index->paths);
+  FREE(index->children);
+  FREE(index);
+}
+
+void xml_free_doc(xmlDoc *doc)
+{
+  if (doc) {
+    if (doc->_private) {
+      free_index((xml_index_t*)doc->_private);
+      doc->_private = NULL;
+    }
+    xmlFreeDoc(doc);
+  }
+}
+
+static int compare_children(const void *a, const void *b)
+{
+  const xml_child_t *ca = (const xml_child_t*)a;
+  const xml_child_t *cb = (const xml_child_t*)b;
+  int c = strcmp(ca->name, cb->name);
+  return c != 0 ? c : ca->pos - cb->pos;
+}
+
+static xml_child_index_t *get_children(xml_index_t *index, xmlNode *node)
+{
+  unsigned int h = hash_node(node);
+  xml_child_index_t *c = index->children[h % index->child_size];
+  xmlNode *cur;
+  int i, n;
+
+  while (c) {
+    if (c->parent == node)
+      return c;
+    c = c->next;
+  }
+
+  // first time we look below this node -- sort its children by name,
+  // keeping the document order among children with the same name
+  n = 0;
+  for (cur = node->xmlChildrenNode; cur != NULL; cur = cur->next)
+    ++n;
+  c = MALLOC(sizeof(xml_child_index_t));
+  c->parent = node;
+  c->count = n;
+  c->children = MALLOC(sizeof(xml_child_t)*(n > 0 ? n : 1));
+  for (cur = node->xmlChildrenNode, i = 0; cur != NULL; cur = cur->next, ++i) {
+    c->children[i].name = cur->name ? (const char*)cur->name : "";
+    c->children[i].pos = i;
+    c->children[i].node = cur;
+  }
+  qsort(c->children, n, sizeof(xml_child_t), compare_children);
+
+  if (index->child_count >= 2*index->child_size) {
+    int new_size = 4*index->child_size;
+    xml_child_index_t **tab = CALLOC(new_size, sizeof(xml_child_index_t*));
+    for (i=0; i<index->child_size; ++i) {
+      xml_child_index_t *e = index->children[i];
+      while (e) {
+        xml_child_index_t *next = e->next;
+        unsigned int b = hash_node(e->parent) % new_size;
+        e->next = tab[b];
+        tab[b] = e;
+        e = next;
       }
     }
-    cur = cur->next;
+    FREE(index->children);
+    index->children = tab;
+    index->child_size = new_size;
   }
-  return NULL;
+  c->next = index->children[h % index->child_size];
+  index->children[h % index->child_size] = c;
+  ++index->child_count;
+
+  return c;
+}
+
+// Position of the first child called "name" in the sorted child list,
+// and how many children have that name
+static int find_children(xml_child_index_t *c, const char *name, int *count)
+{
+  int lo = 0, hi = c->count, first;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (strcmp(c->children[mid].name, name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  first = lo;
+  hi = c->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (strcmp(c->children[mid].name, name) <= 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  *count = lo - first;
+  return first;
 }
 
-static void extract_array_specifier(const char *in, char **out_p, int *n)
+static xmlNode *findNode(xml_index_t *index, xmlNode *node, const char *name,
+                         int desired)
 {
-  char *out=NULL;
-  int len = strlen(in);
-  int has_array_specifier = FALSE;
+  // the "desired" refers to which of the Nodes with that name we want
+  // (1 is the first), in case we are supposed to find one that isn't the
+  // first in a list
+  xml_child_index_t *c = get_children(index, node);
+  int count;
+  int first = find_children(c, name, &count);
+  if (desired < 1 || desired > count)
+    return NULL;
+  return c->children[first+desired-1].node;
+}
 
-  if (in[len-1] == ']') {
-    int m = len-2;
-    if (isdigit(in[m])) {
-      while (isdigit(in[m])) --m;
-      if (in[m] == '[') {
-        // looks like it has the form "blahblah[%d]" -- strip off the end
-        out = CALLOC(strlen(in)+1, sizeof(char));
-        strncpy(out, in, m);
-        *n = 1+atoi(&in[m+1]);
-        has_array_specifier = TRUE;
+static xml_path_entry_t *lookup_path(xml_index_t *index, const char *path,
+                                     int len, unsigned int h)
+{
+  xml_path_entry_t *e = index->paths[h % index->path_size];
+  while (e) {
+    if (e->hash == h && strncmp(e->path, path, len) == 0 &&
+        e->path[len] == '\0')
+      return e;
+    e = e->next;
+  }
+  return NULL;
+}
+
+static void add_path(xml_index_t *index, const char *path, int len,
+                     unsigned int h, xmlNode *node)
+{
+  xml_path_entry_t *e;
+  int i;
+
+  if (index->path_count >= 2*index->path_size) {
+    int new_size = 4*index->path_size;
+    xml_path_entry_t **tab = CALLOC(new_size, sizeof(xml_path_entry_t*));
+    for (i=0; i<index->path_size; ++i) {
+      e = index->paths[i];
+      while (e) {
+        xml_path_entry_t *next = e->next;
+        e->next = tab[e->hash % new_size];
+        tab[e->hash % new_size] = e;
+        e = next;
       }
     }
+    FREE(index->paths);
+    index->paths = tab;
+    index->path_size = new_size;
   }
 
-  if (!has_array_specifier) {
-    out = STRDUP(in);
-    *n=1;
+  e = MALLOC(sizeof(xml_path_entry_t));
+  e->path = MALLOC(sizeof(char)*(len+1));
+  strncpy(e->path, path, len);
+  e->path[len] = '\0';
+  e->hash = h;
+  e->node = node;
+  e->next = index->paths[h % index->path_size];
+  index->paths[h % index->path_size] = e;
+  ++index->path_count;
+}
+
+// Splits a path element of the form "name" or "name[k]" -- k counts from
+// zero in the path, "desired" from one.  Returns FALSE if the element
+// does not fit in the name buffer.
+static int parse_path_element(const char *in, int len, char *name, int *desired)
+{
+  int m = len-2;
+
+  *desired = 1;
+  if (len > 2 && in[len-1] == ']' && isdigit(in[m])) {
+    while (m > 0 && isdigit(in[m])) --m;
+    if (in[m] == '[') {
+      // looks like it has the form "blahblah[%d]" -- strip off the end
+      *desired = 1+atoi(&in[m+1]);
+      len = m;
+    }
   }
+  if (len >= MAX_PATH_LEN)
+    return FALSE;
+  strncpy(name, in, len);
+  name[len] = '\0';
+  return TRUE;
+}
 
-  *out_p = out;
+// Resolves the first "elements" elements of the dotted path (all of them
+// if elements is negative).  The first element has to match the name of
+// the root node.  Returns NULL if the path does not exist, including when
+// the first element names a different root, so the xml_get_* functions
+// below treat a root mismatch like any other missing element: string
+// lookups return MAGIC_UNSET_STRING and numeric ones the MAGIC_UNSET
+// value.  (The old lookup returned the text of the root node instead.)
+static xmlNode *find_path(xmlDoc *doc, const char *path, int elements)
+{
+  xml_index_t *index;
+  xmlNode *cur;
+  char name[MAX_PATH_LEN];
+  const char *start, *end, *dot;
+  int n, desired;
+
+  cur = xmlDocGetRootElement(doc);
+  if (!cur)
+    return NULL;
+  index = get_index(doc);
+
+  // find the end of the part of the path we need
+  end = path;
+  n = 1;
+  while ((dot = strchr(end, '.')) != NULL && (elements < 0 || n < elements)) {
+    end = dot + 1;
+    ++n;
+  }
+  end = dot ? dot : end + strlen(end);
+
+  // find the longest prefix we have already resolved
+  start = end;
+  while (TRUE) {
+    xml_path_entry_t *e;
+    int len = start - path;
+    e = lookup_path(index, path, len, hash_string(path, len));
+    if (e) {
+      cur = e->node;
+      if (start == end)
+        return cur;
+      ++start;
+      break;
+    }
+    while (start > path && *(start-1) != '.')
+      --start;
+    if (start == path) {
+      // nothing cached: check the first item against the root
+      const char *dot = strchr(path, '.');
+      int len = dot && dot < end ? dot - path : end - path;
+      if (strncmp(path, (char*)cur->name, len) != 0 ||
+          cur->name[len] != '\0')
+        return NULL;
+      add_path(index, path, len, hash_string(path, len), cur);
+      if (path + len == end)
+        return cur;
+      start = path + len + 1;
+      break;
+    }
+    --start;
+  }
+
+  // subsequent items specify the search path through the xml tree
+  while (start < end) {
+    const char *dot = strchr(start, '.');
+    int len;
+    if (!dot || dot > end)
+      dot = end;
+    if (!parse_path_element(start, dot - start, name, &desired))
+      return NULL;
+    cur = findNode(index, cur, name, desired);
+    if (!cur)
+      return NULL;
+    len = dot - path;
+    add_path(index, path, len, hash_string(path, len), cur);
+    start = dot + 1;
+  }
+
+  return cur;
 }
 
 int xml_get_element_exists(xmlDoc *doc, char *str)
 {
-  const char *val = xml_get_string_value(doc, str);
-  return val != NULL;
+  return find_path(doc, str, -1) != NULL;
 }
 
 const char *xml_get_string_value(xmlDoc *doc, char *format, ...)
 {
   va_list ap;
-  char str[100000];
+  char str[MAX_PATH_LEN];
 
   va_start(ap, format);
-  vsnprintf(str, 99999, format, ap);
+  vsnprintf(str, MAX_PATH_LEN-1, format, ap);
   va_end(ap);
 
-  int i,n;
-  char **arr;
-  int found = TRUE;
-
-  split_into_array(str, '.', &n, &arr);
-
-  xmlNode *cur = xmlDocGetRootElement(doc);
-
-  // first item much match the name of the root
-  if (strcmp(arr[0], (char*)cur->name)!=0) {
-    // root node doesn't match -- return empty string
-    strcpy(buf, "");
-  }
-  else {
-    // subsequent items specify the search path through the xml tree
-    for (i=1; i<n; ++i) {
-      char *elem;
-      int k;
-      extract_array_specifier(arr[i], &elem, &k);
-
-      xmlNode *next = findNode(doc, cur, elem, k);
-      if (!next) {
-        // not found -- return NULL
-        found = FALSE;
-        strcpy(buf, "");
-        FREE(elem);
-        break;
-      }
-      
-      FREE(elem);
-      cur = next;
-    }
-  }
+  xmlNode *cur = find_path(doc, str, -1);
 
-  if (found) {
-    assert(cur != NULL);
+  if (cur) {
     xmlChar *ret = xmlNodeListGetString(doc, cur->xmlChildrenNode, 1);
-    strncpy_safe(buf, (char*)ret, MAX_LEN-1);
-    xmlFree(ret);
+    if (ret) {
+      strncpy_safe(buf, (char*)ret, MAX_LEN-1);
+      xmlFree(ret);
+    }
+    else {
+      strcpy(buf, "");
+    }
   }
   else {
     strcpy(buf, MAGIC_UNSET_STRING);
   }
 
-  free_char_array(&arr, n);
-
   return buf;
 }
 
 const char *xml_get_string_attribute(xmlDoc *doc, char *format, ...)
 {
   va_list ap;
-  char str[4096];
+  char str[MAX_PATH_LEN];
 
   va_start(ap, format);
-  vsnprintf(str, 4095, format, ap);
+  vsnprintf(str, MAX_PATH_LEN-1, format, ap);
   va_end(ap);
 
-  int i,n;
-  char **arr;
-  int found = TRUE;
-
-  split_into_array(str, '.', &n, &arr);
-
-  xmlNode *cur = xmlDocGetRootElement(doc);
-
-  // first item much match the name of the root
-  if (strcmp(arr[0], (char*)cur->name)!=0) {
-    // root node doesn't match -- return empty string
-    strcpy(buf, "");
-  }
-  else {
-    // subsequent items specify the search path through the xml tree
-    // all except the last one -- that is the attribute name
-    for (i=1; i<n-1; ++i) {
-      char *elem;
-      int k;
-      extract_array_specifier(arr[i], &elem, &k);
-
-      xmlNode *next = findNode(doc, cur, elem, k);
-      if (!next) {
-        // not found -- return NULL
-        found = FALSE;
-        strcpy(buf, "");
-        FREE(elem);
-        break;
+  // all elements except the last one -- that is the attribute name
+  const char *attr = strrchr(str, '.');
+  int found = FALSE;
+
+  if (attr) {
+    int elements = 1;
+    const char *p;
+    for (p=str; p<attr; ++p)
+      if (*p == '.') ++elements;
+
+    xmlNode *cur = find_path(doc, str, elements);
+    if (cur) {
+      xmlChar *val = xmlGetProp(cur, (xmlChar*)(attr+1));
+      if (val) {
+        strncpy_safe(buf, (char*)val, MAX_LEN-1);
+        xmlFree(val);
+        found = TRUE;
       }
-      
-      FREE(elem);
-      cur = next;
-    }
-  }
-
-  if (found) {
-    assert(cur != NULL);
-    xmlChar *val = xmlGetProp(cur, (xmlChar*)(arr[n-1]));
-    if (val) {
-      strncpy_safe(buf, (char*)val, MAX_LEN-1);
-      xmlFree(val);
-    }
-    else {
-      // found the node, but it did not have the requested attribute
-      found = FALSE;
+      // otherwise, we found the node, but it did not have the
+      // requested attribute
     }
   }
 
@@ -184,7 +436,6 @@ const char *xml_get_string_attribute(xmlDoc *doc, char *format, ...)
     strcpy(buf, MAGIC_UNSET_STRING);
   }
 
-  free_char_array(&arr, n);
   return buf;
 }
 
@@ -284,6 +535,95 @@ long xml_get_long_attribute(xmlDoc *doc, char *format, ...)
     return MAGIC_UNSET_INT;
 }
 
+// Finds the element named by the path, and the sorted child list of its
+// parent together with the position of the element in it and the number
+// of siblings from there on that have the same name.  *siblings is set
+// to NULL for the root element.  Returns NULL if the path does not exist.
+static xmlNode *find_siblings(xmlDoc *doc, const char *path,
+                              xml_child_index_t **siblings, int *first,
+                              int *count)
+{
+  xmlNode *cur = find_path(doc, path, -1);
+  xml_child_index_t *c;
+  int n, start;
+
+  *siblings = NULL;
+  *first = -1;
+  *count = cur ? 1 : 0;
+  if (!cur || !cur->parent || cur->parent->type != XML_ELEMENT_NODE)
+    return cur;
+
+  c = get_children(get_index(doc), cur->parent);
+  start = find_children(c, (const char*)cur->name, &n);
+  *first = start;
+  while (c->children[*first].node != cur)
+    ++(*first);
+  *count = start + n - *first;
+  *siblings = c;
+  return cur;
+}
+
+int xml_get_element_count(xmlDoc *doc, char *format, ...)
+{
+  va_list ap;
+  char str[MAX_PATH_LEN];
+  xml_child_index_t *c;
+  int first, count;
+
+  va_start(ap, format);
+  vsnprintf(str, MAX_PATH_LEN-1, format, ap);
+  va_end(ap);
+
+  find_siblings(doc, str, &c, &first, &count);
+  return count;
+}
+
+// Parses the whitespace separated numbers in the text of a node into
+// values[*n], values[*n+1], ... (only the first max_count are stored),
+// advancing *n past all of them
+static void parse_doubles(xmlDoc *doc, xmlNode *node, double *values,
+                          int max_count, int *n)
+{
+  xmlChar *ret = xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+  char *p, *q;
+
+  if (!ret)
+    return;
+  p = (char*)ret;
+  while (TRUE) {
+    double d = strtod(p, &q);
+    if (q == p)
+      break;
+    if (*n < max_count)
+      values[*n] = d;
+    ++(*n);
+    p = q;
+  }
+  xmlFree(ret);
+}
+
+int xml_get_double_array(xmlDoc *doc, double *values, int max_count,
+                         char *format, ...)
+{
+  va_list ap;
+  char str[MAX_PATH_LEN];
+  xml_child_index_t *c;
+  int i, first, count, n = 0;
+
+  va_start(ap, format);
+  vsnprintf(str, MAX_PATH_LEN-1, format, ap);
+  va_end(ap);
+
+  xmlNode *cur = find_siblings(doc, str, &c, &first, &count);
+  if (cur && !c)
+    parse_doubles(doc, cur, values, max_count, &n);
+  else if (cur)
+    for (i=first; i<first+count; ++i)
+      parse_doubles(doc, c->children[i].node, values, max_count, &n);
+
+  return n;
+}
+
 // Whole bunch of test code... 
 
 static int n_ok=0;
@@ -646,6 +986,8 @@ void xml_test()
   test_string(doc, TOP "." DESC "[1].StortDate", us);
   test_double(doc, TOP "." DESC "[1].Heigth", MAGIC_UNSET_DOUBLE);
   test_string(doc, TOP "." DESC "[1].Heigth", us);
+  test_string(doc, "WrongRoot." DESC "[0].SiteName", us);
+  test_string(doc, "WrongRoot", us);
 
   // testing attributes
   test_string_attr(doc, TOP "." DESC "[0].ReflectorNumber.type", "string"); 
@@ -677,7 +1019,7 @@ void xml_test()
     printf("**** Not all tests passed!\n"
            "**** Number of failures: %d\n", n_bad);
 
-  xmlFreeDoc(doc);
+  xml_free_doc(doc);
   xmlCleanupParser();
   unlink("test.xml");
   exit(1);
@@ -5,13 +5,26 @@
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 
+// Lookups build an index that is kept with the document, so documents
+// queried through these functions should be released with xml_free_doc()
+// instead of xmlFreeDoc(), and should not be modified once queried.
+void xml_free_doc(xmlDoc *doc);
+
 int xml_get_element_exists(xmlDoc *doc, char *str);
+int xml_get_element_count(xmlDoc *doc, char *format, ...);
 
 const char *xml_get_string_value(xmlDoc *doc, char *format, ...);
 double xml_get_double_value(xmlDoc *doc, char *format, ...);
 int xml_get_int_value(xmlDoc *doc, char *format, ...);
 long xml_get_long_value(xmlDoc *doc, char *format, ...);
 
+// Reads the numbers in the element given by the path and in all of its
+// following siblings of the same name (whitespace separated lists inside
+// an element are read too).  At most max_count values are stored, the
+// return value is the total number found.
+int xml_get_double_array(xmlDoc *doc, double *values, int max_count,
+                         char *format, ...);
+
 const char *xml_get_string_attribute(xmlDoc *doc, char *format, ...);
 double xml_get_double_attribute(xmlDoc *doc, char *format, ...);
 int xml_get_int_attribute(xmlDoc *doc, char *format, ...);
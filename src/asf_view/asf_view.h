@@ -245,6 +245,7 @@ int open_uavsar_data(const char *filename, int multilook,
 /* big_image.c */
 GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair);
 void fill_big(ImageInfo *ii);
+void big_image_tile_loaded(void *unused);
 void update_zoom(void);
 int get_big_image_width_full(void);
 int get_big_image_width2_full(void);
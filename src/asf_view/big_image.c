@@ -705,6 +705,14 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
       background_blue = 138;
     }
 
+    // let the cache know what we're about to draw, so it can load (or
+    // start loading) the tiles, and won't make us wait for the disk
+    double view_l0, view_s0, view_l1, view_s1;
+    img2ls(0, 0, &view_l0, &view_s0);
+    img2ls(biw-1, bih-1, &view_l1, &view_s1);
+    cached_image_begin_render(ii->data_ci, (int)floor(view_l0),
+                              (int)ceil(view_l1));
+
     if (!mask) {
         int mm = 0;
         for (i=0; i<bih; ++i) {
@@ -766,9 +774,9 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
                         int rt=0, gt=0, bt=0;
                         for (m=0; m<3; ++m) {
                             for (n=0; n<3; ++n) {
-                                cached_image_get_rgb(ii->data_ci,
-                                                    l2+m*fac, s2+n*fac,
-                                                    &r, &g, &b);
+                                cached_image_get_rgb_reduced(
+                                    ii->data_ci, fac, l2+m*fac, s2+n*fac,
+                                    &r, &g, &b);
                                 rt += (int)r;
                                 gt += (int)g;
                                 bt += (int)b;
@@ -855,6 +863,8 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
             }
         }
     }
+    cached_image_end_render(ii->data_ci);
+
     // Create the pixbuf
     GdkPixbuf *pb =
         gdk_pixbuf_new_from_data(bdata, GDK_COLORSPACE_RGB, FALSE, 
@@ -952,6 +962,25 @@ GdkPixbuf * make_big_image(ImageInfo *ii, int show_crosshair)
     return pb;
 }
 
+// Set by the loader thread, cleared by the main loop -- atomically, so a
+// tile arriving while the redraw runs still gets its own redraw
+static gint redraw_scheduled = FALSE;
+
+static gboolean redraw_when_idle(gpointer data)
+{
+    g_atomic_int_compare_and_exchange(&redraw_scheduled, TRUE, FALSE);
+    if (curr && curr->data_ci)
+        fill_big(curr);
+    return FALSE;
+}
+
+// Called from the cache's background loader when a tile has arrived
+void big_image_tile_loaded(void *unused)
+{
+    if (g_atomic_int_compare_and_exchange(&redraw_scheduled, FALSE, TRUE))
+        g_idle_add(redraw_when_idle, NULL);
+}
+
 void fill_big(ImageInfo *ii)
 {
     GdkPixbuf *pb = NULL;
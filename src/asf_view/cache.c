@@ -75,45 +75,63 @@ static void print_cache_size(CachedImage *self)
         (float)size/1024./1024.);
 }
 
-static unsigned char *get_pixel(CachedImage *self, int line, int samp)
+// A tile or an overview level for the background loader to read, and,
+// once it has, the data it read.  A request with neither is the signal
+// for the loader to quit.
+typedef struct {
+    int tile;
+    int level;
+    unsigned char *data;
+} LoadRequest;
+
+static void lock_reads(CachedImage *self)
 {
-    // check if outside the image
-    static unsigned char zero = 0;
-    if (line<0 || samp<0 || line >= self->nl || samp >= self->ns)
-        return &zero;
+    if (self->read_lock)
+        g_mutex_lock(self->read_lock);
+}
 
-    // size of each pixel
+static void unlock_reads(CachedImage *self)
+{
+    if (self->read_lock)
+        g_mutex_unlock(self->read_lock);
+}
+
+// Reads a tile from the file into the given buffer.  Only touches the
+// client, so this is what the background loader uses as well.
+static void read_tile(CachedImage *self, int tile, unsigned char *data)
+{
     int ds = data_size(self);
+    int rs = tile * self->rows_per_tile;
 
-    int i;
-    for (i=0; i<self->n_tiles; ++i) {
-        int rs = self->rowstarts[i];
-        if (rs >= 0) {
-            if (line >= rs && line < rs+self->rows_per_tile) {
-                // found the right cache
-                assert(self->cache[i]);
-
-                // this probably won't ever happen, but here we go anyway
-                if (self->n_access > 1024*1024*1024) {
-                    asfPrintStatus("Resetting n_access.\n");
-                    for (i=0; i<self->n_tiles; ++i)
-                        self->access_counts[i] = 0;
-                    self->n_access = 1;
-                }
-
-                // mark this as the most recently accessed
-                self->access_counts[i] = self->n_access++;
-
-                // return pointer to the cached value
-                return &self->cache[i][((line-rs)*self->ns + samp)*ds];
-            }
-        }
-    }
+    // clear out the buffer -- we may not fill up the tile, if
+    // we are near the end of the file, and we don't want old data
+    // to appear
+    memset(data, 0, ds*self->ns*self->rows_per_tile);
+
+    // ensure we don't read past the end of the file
+    int rows_to_get = self->rows_per_tile;
+    if (rs + self->rows_per_tile > self->nl)
+        rows_to_get = self->nl - rs;
+
+    lock_reads(self);
+    self->client->read_fn(rs, rows_to_get, (void*)data,
+        self->client->read_client_info, self->meta, self->client->data_type);
+    unlock_reads(self);
+}
+
+// Finds the spot for a tile about to be loaded: a new one while the cache
+// can still grow, otherwise the least recently used one.  The spot is
+// given the tile's data if that has been read already, otherwise it keeps
+// (or gets) a buffer for the caller to read into.
+static int claim_spot(CachedImage *self, int tile, unsigned char *data)
+{
+    int ds = data_size(self);
+    int i, spot = 0;
 
-    int spot = 0;
     if (!self->reached_max_tiles) {
         assert(self->cache[self->n_tiles] == NULL);
-        unsigned char *data = malloc(ds*self->ns*self->rows_per_tile);
+        if (!data)
+            data = malloc(ds*self->ns*self->rows_per_tile);
         if (!data) {
             // if this is the first tile -- abort, we are out of memory
             if (self->n_tiles == 0)
@@ -128,6 +146,7 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
         } else {
             spot = self->n_tiles;
             self->cache[spot] = data;
+            data = NULL;
             ++self->n_tiles;
         }
     }
@@ -142,6 +161,10 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
                 spot = i;
             }
         }
+        if (data) {
+            free(self->cache[spot]);
+            self->cache[spot] = data;
+        }
     }
 
     if (!self->reached_max_tiles && self->n_tiles == MAX_TILES) {
@@ -151,42 +174,193 @@ static unsigned char *get_pixel(CachedImage *self, int line, int samp)
         self->reached_max_tiles = TRUE;
     }
 
-    // load info from file
     assert(spot >= 0 && spot < self->n_tiles);
     assert(self->cache[spot] != NULL);
 
-    // clear out the cache -- we may not fill up the tile, if
-    // we are near the end of the file, and we don't want old data
-    // to appear
-    int ns = self->ns;
-    memset(self->cache[spot], 0, ds*ns*self->rows_per_tile);
-
-    // update where this cache entry starts
-    int rs = (line / self->rows_per_tile) * self->rows_per_tile;
-    self->rowstarts[spot] = rs;
+    // update where this cache entry starts, and the index
+    if (self->rowstarts[spot] >= 0)
+        self->tile_spots[self->rowstarts[spot] / self->rows_per_tile] = -1;
+    self->rowstarts[spot] = tile * self->rows_per_tile;
+    self->tile_spots[tile] = spot;
 
     // mark this tile as the most recently accessed
     self->access_counts[spot] = self->n_access++;
 
-    //printf("Updated entry #%d:\n"
-    //    "     row start: %d\n"
-    //    "     row end: %d\n"
-    //    "     access count: %d\n", spot,
-    //    rs, rs+self->rows_per_tile-1, self->access_counts[spot]);
+    return spot;
+}
 
-    // ensure we don't read past the end of the file
-    int rows_to_get = self->rows_per_tile;
-    if (rs + self->rows_per_tile > self->nl)
-        rows_to_get = self->nl - rs;
+// Puts what the background loader has read into the cache.  If wait is
+// TRUE, blocks until everything requested so far has arrived.
+static int install_loaded(CachedImage *self, int wait)
+{
+    int n = 0;
+
+    if (!self->loader)
+        return 0;
+
+    while (self->n_pending > 0) {
+        LoadRequest *r = wait ? g_async_queue_pop(self->loaded)
+                              : g_async_queue_try_pop(self->loaded);
+        if (!r)
+            break;
+        if (r->tile >= 0) {
+            // If the loader ran out of memory, the tile isn't asked for
+            // again while drawing (the thumbnail is shown instead), but
+            // is read the old way when it is needed otherwise.
+            self->tile_pending[r->tile] = FALSE;
+            if (!r->data)
+                self->tile_failed[r->tile] = TRUE;
+            if (r->data && self->tile_spots[r->tile] < 0)
+                claim_spot(self, r->tile, r->data);
+            else
+                free(r->data);
+        }
+        else {
+            self->level_pending[r->level] = FALSE;
+            if (!r->data)
+                self->level_failed[r->level] = TRUE;
+            if (!self->levels[r->level] && r->data) {
+                int f = 1 << r->level;
+                self->levels[r->level] = r->data;
+                self->level_nl[r->level] = (self->nl + f - 1) / f;
+                self->level_ns[r->level] = (self->ns + f - 1) / f;
+            }
+            else
+                FREE(r->data);
+        }
+        --self->n_pending;
+        ++n;
+        FREE(r);
+    }
+
+    return n;
+}
+
+static void request_load(CachedImage *self, int tile, int level)
+{
+    LoadRequest *r = MALLOC(sizeof(LoadRequest));
+    r->tile = tile;
+    r->level = level;
+    r->data = NULL;
+    if (tile >= 0)
+        self->tile_pending[tile] = TRUE;
+    else
+        self->level_pending[level] = TRUE;
+    ++self->n_pending;
+    g_async_queue_push(self->requests, r);
+}
+
+static void request_tile(CachedImage *self, int tile)
+{
+    if (tile >= 0 && tile < self->n_tiles_required &&
+        self->tile_spots[tile] < 0 && !self->tile_pending[tile] &&
+        !self->tile_failed[tile])
+        request_load(self, tile, -1);
+}
+
+static unsigned char *read_level(CachedImage *self, int k);
+
+// The background loader: reads whatever is requested, in order, and hands
+// it back through the "loaded" queue.  It never touches the cache itself,
+// that is only done on the main thread, in install_loaded().
+static gpointer loader_thread(gpointer user_data)
+{
+    CachedImage *self = (CachedImage *) user_data;
+    int ds = data_size(self);
+
+    while (1) {
+        LoadRequest *r = g_async_queue_pop(self->requests);
+        if (r->tile < 0 && r->level < 0) {
+            FREE(r);
+            break;
+        }
+        if (r->tile >= 0) {
+            r->data = malloc(ds*self->ns*self->rows_per_tile);
+            if (r->data)
+                read_tile(self, r->tile, r->data);
+        }
+        else
+            r->data = read_level(self, r->level);
+        g_async_queue_push(self->loaded, r);
+        if (self->loaded_fn)
+            self->loaded_fn(self->loaded_data);
+    }
+
+    return NULL;
+}
+
+static unsigned char *get_pixel(CachedImage *self, int line, int samp)
+{
+    // check if outside the image
+    static unsigned char zero[16] = {0};
+    if (line<0 || samp<0 || line >= self->nl || samp >= self->ns)
+        return zero;
+
+    // size of each pixel
+    int ds = data_size(self);
+
+    // tiles are found through the index, which maps each band of
+    // rows_per_tile rows to the spot it is loaded in (or -1)
+    int i;
+    int tile = line / self->rows_per_tile;
+    int hit = self->tile_spots[tile];
+
+    if (hit < 0 && self->loader) {
+        // maybe the background loader has it by now
+        if (install_loaded(self, FALSE) > 0)
+            hit = self->tile_spots[tile];
+
+        // While drawing, we don't wait for tiles.  Instead we ask the
+        // loader for it, and show the thumbnail for now.
+        if (hit < 0 && self->rendering) {
+            request_tile(self, tile);
+            if (!self->preview)
+                return zero;
+            int pl = line * self->preview_nl / self->nl;
+            int ps = samp * self->preview_ns / self->ns;
+            return &self->preview[(pl*self->preview_ns + ps)*ds];
+        }
+
+        // Otherwise, if the tile is on its way, wait for it rather than
+        // reading it twice
+        if (hit < 0 && self->tile_pending[tile]) {
+            while (self->tile_pending[tile])
+                install_loaded(self, TRUE);
+            hit = self->tile_spots[tile];
+        }
+    }
+
+    if (hit >= 0) {
+        int rs = self->rowstarts[hit];
+        assert(self->cache[hit] && rs == tile*self->rows_per_tile);
+
+        // this probably won't ever happen, but here we go anyway
+        if (self->n_access > 1024*1024*1024) {
+            asfPrintStatus("Resetting n_access.\n");
+            for (i=0; i<self->n_tiles; ++i)
+                self->access_counts[i] = 0;
+            self->n_access = 1;
+        }
+
+        // mark this as the most recently accessed
+        self->access_counts[hit] = self->n_access++;
+
+        // return pointer to the cached value
+        return &self->cache[hit][((line-rs)*self->ns + samp)*ds];
+    }
+
+    // load info from file
+    int spot = claim_spot(self, tile, NULL);
+    int rs = self->rowstarts[spot];
 
     if (!quiet) {
+        int re = rs + self->rows_per_tile;
         asfPrintStatus("Cache: loading into spot #%d: rows %d-%d\n",
-            spot, rs, rs+rows_to_get);
+            spot, rs, re < self->nl ? re : self->nl);
         //print_cache_size(self);
     }
 
-    self->client->read_fn(rs, rows_to_get, (void*)(self->cache[spot]),
-        self->client->read_client_info, self->meta, self->client->data_type);
+    read_tile(self, tile, self->cache[spot]);
 
     assert((line-rs)*self->ns + samp <= self->ns*self->rows_per_tile);
     return &self->cache[spot][((line-rs)*self->ns + samp)*ds];
@@ -224,10 +398,20 @@ void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
 
         quiet=FALSE;
     } else {
+        lock_reads(self);
         self->client->thumb_fn(thumb_size_x, thumb_size_y,
             self->meta, self->client->read_client_info, dest_void,
             self->client->data_type);
+        unlock_reads(self);
     }
+
+    // keep a copy, to show while tiles are loading in the background
+    int size = data_size(self)*thumb_size_x*thumb_size_y;
+    FREE(self->preview);
+    self->preview = MALLOC(size);
+    memcpy(self->preview, dest_void, size);
+    self->preview_nl = thumb_size_y;
+    self->preview_ns = thumb_size_x;
 }
 
 CachedImage * cached_image_new_from_file(
@@ -293,6 +477,32 @@ CachedImage * cached_image_new_from_file(
 
     self->n_access = 0;
 
+    self->n_tiles_required = n_tiles_required;
+    self->tile_spots = MALLOC(sizeof(int)*n_tiles_required);
+    for (i=0; i<n_tiles_required; ++i)
+        self->tile_spots[i] = -1;
+
+    for (i=0; i<CACHE_MAX_LEVELS; ++i) {
+        self->levels[i] = NULL;
+        self->level_nl[i] = self->level_ns[i] = 0;
+        self->level_pending[i] = FALSE;
+        self->level_failed[i] = FALSE;
+    }
+
+    // no background loading until asked for
+    self->loader = NULL;
+    self->requests = self->loaded = NULL;
+    self->read_lock = NULL;
+    self->tile_pending = NULL;
+    self->tile_failed = NULL;
+    self->n_pending = 0;
+    self->rendering = FALSE;
+    self->view_first = self->view_last = -1;
+    self->loaded_fn = NULL;
+    self->loaded_data = NULL;
+    self->preview = NULL;
+    self->preview_nl = self->preview_ns = 0;
+
     asfPrintStatus("Number of tiles required for the entire image: %d\n",
         n_tiles_required);
     asfPrintStatus("Fits in memory: %s\n",
@@ -320,12 +530,13 @@ float cached_image_get_pixel (CachedImage *self, int line, int samp)
     return 0;
 }
 
-void cached_image_get_rgb(CachedImage *self, int line, int samp,
-                          unsigned char *r, unsigned char *g,
-                          unsigned char *b)
+// Display color of a pixel of the given data, as returned by get_pixel()
+static void pixel_to_rgb(CachedImage *self, const unsigned char *p,
+                         unsigned char *r, unsigned char *g,
+                         unsigned char *b)
 {
     if (self->data_type == GREYSCALE_FLOAT) {
-        float f = cached_image_get_pixel(self, line, samp);
+        float f = *((float*)p);
         if (have_lut()) {
             // do not scale in the case of a lut
             apply_lut((int)f, r, g, b);
@@ -336,26 +547,24 @@ void cached_image_get_rgb(CachedImage *self, int line, int samp,
     }
     else if (self->data_type == GREYSCALE_BYTE) {
         if (have_lut()) {
-            apply_lut((int)(*(get_pixel(self, line, samp))), r, g, b);
+            apply_lut((int)(*p), r, g, b);
         }
         else {
-            float f = (float) *(get_pixel(self, line, samp));
+            float f = (float) *p;
             *r = *g = *b =
                 (unsigned char)calc_scaled_pixel_value(self->stats, f);
         }
     }
     else if (self->data_type == RGB_BYTE) {
-        unsigned char *uc = get_pixel(self, line, samp);
-
         *r = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_r,
-                                                        (float)uc[0]);
+                                                        (float)p[0]);
         *g = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_g,
-                                                        (float)uc[1]);
+                                                        (float)p[1]);
         *b = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_b,
-                                                        (float)uc[2]);
+                                                        (float)p[2]);
     }
     else if (self->data_type == RGB_FLOAT) {
-        float *f = (float*)get_pixel(self, line, samp);
+        float *f = (float*)p;
 
         *r = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_r,f[0]);
         *g = (unsigned char)calc_rgb_scaled_pixel_value(self->stats_g,f[1]);
@@ -368,6 +577,147 @@ void cached_image_get_rgb(CachedImage *self, int line, int samp,
     }
 }
 
+void cached_image_get_rgb(CachedImage *self, int line, int samp,
+                          unsigned char *r, unsigned char *g,
+                          unsigned char *b)
+{
+    pixel_to_rgb(self, get_pixel(self, line, samp), r, g, b);
+}
+
+// Reads overview level k, which has every 2^k'th line and sample of the
+// image, straight from the file -- only the lines that are needed.  Only
+// touches the client, so the background loader uses this too.
+static unsigned char *read_level(CachedImage *self, int k)
+{
+    int ds = data_size(self);
+    int f = 1 << k;
+    int nl = (self->nl + f - 1) / f;
+    int ns = (self->ns + f - 1) / f;
+    int i, j;
+
+    unsigned char *data = malloc(ds*nl*ns);
+    unsigned char *row = malloc(ds*self->ns);
+    if (!data || !row) {
+        free(data);
+        free(row);
+        return NULL;
+    }
+
+    for (i=0; i<nl; ++i) {
+        lock_reads(self);
+        self->client->read_fn(i*f, 1, (void*)row,
+            self->client->read_client_info, self->meta,
+            self->client->data_type);
+        unlock_reads(self);
+        for (j=0; j<ns; ++j)
+            memcpy(data + (i*ns + j)*ds, row + j*f*ds, ds);
+    }
+    free(row);
+
+    return data;
+}
+
+// Level k is small enough to keep around
+static int level_fits(CachedImage *self, int k)
+{
+    int f = 1 << k;
+    double nl = (self->nl + f - 1) / f;
+    double ns = (self->ns + f - 1) / f;
+
+    // same budget as a single tile
+    return nl*ns*data_size(self) <= 64.*1024.*1024.;
+}
+
+// Builds overview level k.  Made from a finer level, if we have one,
+// otherwise read from the file -- in the background if we are drawing
+// and have a loader, in which case this returns FALSE for now.
+static int build_level(CachedImage *self, int k)
+{
+    int ds = data_size(self);
+    int f = 1 << k;
+    int nl = (self->nl + f - 1) / f;
+    int ns = (self->ns + f - 1) / f;
+    int i, j;
+    unsigned char *data;
+
+    // closest finer level we have
+    int fk = k-1;
+    while (fk > 1 && !self->levels[fk])
+        --fk;
+
+    if (self->levels[fk]) {
+        unsigned char *finer = self->levels[fk];
+        int finer_ns = self->level_ns[fk];
+        int step = 1 << (k - fk);
+        data = MALLOC(ds*nl*ns);
+        for (i=0; i<nl; ++i)
+            for (j=0; j<ns; ++j)
+                memcpy(data + (i*ns + j)*ds,
+                       finer + (i*step*finer_ns + j*step)*ds, ds);
+    }
+    else if (self->loader && self->rendering) {
+        if (!self->level_pending[k] && !self->level_failed[k])
+            request_load(self, -1, k);
+        return FALSE;
+    }
+    else {
+        while (self->level_pending[k])
+            install_loaded(self, TRUE);
+        if (self->levels[k])
+            return TRUE;
+        asfPrintStatus("Building 1:%d overview of the image...\n", f);
+        data = read_level(self, k);
+        if (!data)
+            return FALSE;
+    }
+
+    self->levels[k] = data;
+    self->level_nl[k] = nl;
+    self->level_ns[k] = ns;
+    return TRUE;
+}
+
+// Like cached_image_get_rgb(), for displaying the image reduced by the
+// given factor (every reduction'th line and sample is shown).  When the
+// whole image is not in memory, the pixel comes from the coarsest
+// overview that is at least as fine as the display, so zoomed out views
+// do not have to page the full image through the cache.
+void cached_image_get_rgb_reduced(CachedImage *self, int reduction,
+                                  int line, int samp, unsigned char *r,
+                                  unsigned char *g, unsigned char *b)
+{
+    int k = 0;
+
+    if (!self->entire_image_fits && !self->client->require_full_load)
+        while (k+1 < CACHE_MAX_LEVELS && (2 << k) <= reduction)
+            ++k;
+
+    // overviews get built the first time they are needed; when a level
+    // is too big we fall back to a finer one, and finally to the image
+    while (k > 1 && !level_fits(self, k))
+        --k;
+    if (k > 1 && !self->levels[k] && !build_level(self, k)) {
+        // still being read in the background, show the thumbnail for now
+        if (self->loader && self->rendering && self->preview) {
+            int pl = line * self->preview_nl / self->nl;
+            int ps = samp * self->preview_ns / self->ns;
+            pixel_to_rgb(self, self->preview +
+                (pl*self->preview_ns + ps)*data_size(self), r, g, b);
+            return;
+        }
+        k = 0;
+    }
+    if (k <= 1 || line<0 || samp<0 || line>=self->nl || samp>=self->ns) {
+        cached_image_get_rgb(self, line, samp, r, g, b);
+        return;
+    }
+
+    int ll = line >> k, ss = samp >> k;
+    pixel_to_rgb(self,
+        self->levels[k] + (ll*self->level_ns[k] + ss)*data_size(self),
+        r, g, b);
+}
+
 void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
                                 float *r, float *g, float *b)
 {
@@ -399,9 +749,117 @@ void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
     }
 }
 
+// Starts loading tiles in a background thread.  From then on, while
+// drawing (between cached_image_begin_render() and _end_render()) the
+// cache never waits for the disk: tiles that aren't loaded yet are
+// requested from the loader and shown from the thumbnail in the meantime.
+// loaded_fn, if given, is called from the loader thread every time it has
+// read something, so it must do no more than schedule a redraw.
+void cached_image_enable_prefetch(CachedImage *self,
+                                  CachedLoadedFn *loaded_fn,
+                                  void *loaded_data)
+{
+    int i;
+
+    if (self->loader)
+        return;
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+
+    self->loaded_fn = loaded_fn;
+    self->loaded_data = loaded_data;
+    self->read_lock = g_mutex_new();
+    self->requests = g_async_queue_new();
+    self->loaded = g_async_queue_new();
+    self->tile_pending = MALLOC(sizeof(char)*self->n_tiles_required);
+    self->tile_failed = MALLOC(sizeof(char)*self->n_tiles_required);
+    for (i=0; i<self->n_tiles_required; ++i)
+        self->tile_pending[i] = self->tile_failed[i] = FALSE;
+
+    self->loader = g_thread_create(loader_thread, self, TRUE, NULL);
+    if (!self->loader)
+        asfPrintError("Failed to start the tile loader thread.\n");
+}
+
+// Called before drawing the lines first_line..last_line of the image.
+// Puts the tiles that have been loaded into the cache, and asks for the
+// ones we are about to need: those in view, and the next one in the
+// direction we are panning.
+void cached_image_begin_render(CachedImage *self, int first_line,
+                               int last_line)
+{
+    int t;
+
+    if (!self->loader)
+        return;
+
+    install_loaded(self, FALSE);
+
+    if (first_line < 0) first_line = 0;
+    if (last_line > self->nl - 1) last_line = self->nl - 1;
+
+    if (first_line <= last_line) {
+        int first_tile = first_line / self->rows_per_tile;
+        int last_tile = last_line / self->rows_per_tile;
+        for (t=first_tile; t<=last_tile; ++t)
+            request_tile(self, t);
+
+        if (self->view_first >= 0) {
+            if (first_line > self->view_first)
+                request_tile(self, last_tile + 1);
+            else if (first_line < self->view_first)
+                request_tile(self, first_tile - 1);
+        }
+    }
+
+    self->view_first = first_line;
+    self->view_last = last_line;
+    self->rendering = TRUE;
+}
+
+void cached_image_end_render(CachedImage *self)
+{
+    self->rendering = FALSE;
+}
+
+// Number of tiles and overviews requested from the background loader
+// that are not in the cache yet.  With wait set, first waits for all
+// of them.
+int cached_image_pending(CachedImage *self, int wait)
+{
+    install_loaded(self, wait);
+    return self->n_pending;
+}
+
 void cached_image_free (CachedImage *self)
 {
     int i;
+
+    if (self->loader) {
+        // tell the loader to quit, once it is done with what's queued
+        LoadRequest *r = MALLOC(sizeof(LoadRequest));
+        r->tile = r->level = -1;
+        r->data = NULL;
+        g_async_queue_push(self->requests, r);
+        g_thread_join(self->loader);
+        self->loader = NULL;
+
+        // anything it read never made it into the cache
+        while (self->n_pending > 0) {
+            r = g_async_queue_pop(self->loaded);
+            FREE(r->data);
+            FREE(r);
+            --self->n_pending;
+        }
+        g_async_queue_unref(self->requests);
+        g_async_queue_unref(self->loaded);
+        g_mutex_free(self->read_lock);
+        FREE(self->tile_pending);
+        FREE(self->tile_failed);
+    }
+    FREE(self->preview);
+
     for (i=0; i<self->n_tiles; ++i) {
         if (self->cache[i])
             free(self->cache[i]);
@@ -410,7 +868,11 @@ void cached_image_free (CachedImage *self)
     if (self->client->free_fn)
       self->client->free_fn(self->client->read_client_info);
 
+    for (i=0; i<CACHE_MAX_LEVELS; ++i)
+        FREE(self->levels[i]);
+
     free(self->rowstarts);
+    free(self->tile_spots);
     free(self->access_counts);
     free(self->cache);
     free(self->client);
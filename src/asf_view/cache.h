@@ -91,6 +91,12 @@ typedef struct {
 } ClientInterface;
 
 
+// Called from the background loader thread whenever it has read a tile.
+typedef void CachedLoadedFn(void *loaded_data);
+
+// Overview levels: level k has every 2^k'th line and sample of the image.
+#define CACHE_MAX_LEVELS 16
+
 //---------------------------------------------------------------------------
 // Here is the ImageCache stuff.  The global ImageCache that holds the
 // loaded image is "data_ci".  This is all private data.
@@ -105,12 +111,34 @@ typedef struct {
   unsigned char **cache;    // Cached values (floats, unsigned chars ...)
   int *access_counts;       // Updated when a tile is accessed
   int n_access;             // used to find oldest tile
+  int n_tiles_required;     // Number of tiles covering the whole image
+  int *tile_spots;          // Cache spot of each tile, -1 if not loaded
+  unsigned char *levels[CACHE_MAX_LEVELS]; // Overviews, see above
+  int level_nl[CACHE_MAX_LEVELS];
+  int level_ns[CACHE_MAX_LEVELS];
   ssv_data_type_t data_type;// type of data we have
   meta_parameters *meta;    // metadata -- don't own this pointer
   ImageStats *stats;        // not owned by us, not populated by us
   ImageStatsRGB *stats_r;   // not owned by us, not populated by us
   ImageStatsRGB *stats_g;   // not owned by us, not populated by us
   ImageStatsRGB *stats_b;   // not owned by us, not populated by us
+
+  // Background loading -- see cached_image_enable_prefetch()
+  GThread *loader;          // NULL if tiles are loaded as needed
+  GAsyncQueue *requests;    // tiles/overviews for the loader to read
+  GAsyncQueue *loaded;      // what the loader has read
+  GMutex *read_lock;        // the client is used by one thread at a time
+  char *tile_pending;       // TRUE for tiles requested from the loader
+  int level_pending[CACHE_MAX_LEVELS];
+  char *tile_failed;        // TRUE if the loader couldn't read the tile
+  int level_failed[CACHE_MAX_LEVELS];
+  int n_pending;            // requests not yet back from the loader
+  int rendering;            // TRUE while drawing: don't wait for the disk
+  int view_first, view_last;// lines drawn last time, to see where we pan
+  CachedLoadedFn *loaded_fn;// called by the loader when it read something
+  void *loaded_data;
+  unsigned char *preview;   // thumbnail, shown until the tiles arrive
+  int preview_nl, preview_ns;
 } CachedImage;
 
 CachedImage * cached_image_new_from_file(
@@ -122,12 +150,23 @@ float cached_image_get_pixel (CachedImage *self, int line, int samp);
 void cached_image_get_rgb(CachedImage *self, int line, int samp,
                           unsigned char *r, unsigned char *g,
                           unsigned char *b);
+void cached_image_get_rgb_reduced(CachedImage *self, int reduction,
+                                  int line, int samp, unsigned char *r,
+                                  unsigned char *g, unsigned char *b);
 void cached_image_get_rgb_float(CachedImage *self, int line, int samp,
                                 float *r, float *g, float *b);
 
 void load_thumbnail_data(CachedImage *self, int thumb_size_x, int thumb_size_y,
                          void *dest);
 
+void cached_image_enable_prefetch(CachedImage *self,
+                                  CachedLoadedFn *loaded_fn,
+                                  void *loaded_data);
+void cached_image_begin_render(CachedImage *self, int first_line,
+                               int last_line);
+void cached_image_end_render(CachedImage *self);
+int cached_image_pending(CachedImage *self, int wait);
+
 void cached_image_free (CachedImage *self);
 
 #endif
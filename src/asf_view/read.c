@@ -242,6 +242,12 @@ int read_file(const char *filename, const char *band, int multilook,
                         &(curr->stats_b));
     assert(curr->data_ci);
 
+    // images that don't fit in memory are loaded in the background, so
+    // that panning around them doesn't hang the display
+    if (!curr->data_ci->entire_image_fits)
+        cached_image_enable_prefetch(curr->data_ci, big_image_tile_loaded,
+                                     NULL);
+
     int nl = meta->general->line_count;
     curr->nl = nl;
 
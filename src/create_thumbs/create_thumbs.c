@@ -24,6 +24,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#ifndef win32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 #define MIN_ARGS (1)
 #define MAX_ARGS (30)
@@ -67,6 +71,16 @@ long optimize_na_valid(struct INPUT_ARDOP_PARAMS *params_in);
 int is_jpeg(const char *file);
 int is_tiff(const char *file);
 int is_polsarpro(const char *file);
+static int start_thumbnail(const char *file, int level, int verbose,
+                           output_format_t output_format, char *out_dir,
+                           int browseFlag);
+static void end_thumbnail(void);
+static void finish_thumbnails(void);
+
+// Products thumbnailed at once (-jobs), each by its own worker process,
+// and whether to skip products whose thumbnail is up to date (-update)
+static int max_jobs = 1;
+static int update_flag = FALSE;
 
 int main(int argc, char *argv[])
 {
@@ -200,6 +214,27 @@ int main(int argc, char *argv[])
     else if (strmatches(key,"--save-metadata","-save-metadata","-sm",NULL)) {
         saveMetadataFlag=TRUE;
     }
+    else if (strmatches(key,"--jobs","-jobs","-j",NULL)) {
+        CHECK_ARG(1);
+        max_jobs = atoi(GET_ARG(1));
+        if (max_jobs < 1) {
+            if (!quietflag) {
+              fprintf(stderr,"\n**Invalid number of jobs for -jobs option."
+                  "  Number of jobs must be 1 or greater.\n");
+              usage();
+            }
+            exit(1);
+        }
+#ifdef win32
+        if (max_jobs > 1)
+            asfPrintWarning("The -jobs option is not supported on Windows.  "
+                            "Thumbnails will be created one at a time.\n");
+        max_jobs = 1;
+#endif
+    }
+    else if (strmatches(key,"--update","-update","-u",NULL)) {
+        update_flag = TRUE;
+    }
     else if (strmatches(key,"--patches","-patches","-p",NULL)) {
         CHECK_ARG(1);
         nPatchesFlag=TRUE;
@@ -283,6 +318,7 @@ int main(int argc, char *argv[])
               nPatchesFlag, nPatches,
               output_format, out_dir);
   }
+  finish_thumbnails();
 
   if (fLog) fclose(fLog);
   FREE(out_dir);
@@ -727,11 +763,15 @@ void process_file(const char *file, int level, int size, int verbose,
     }
     if (L0Flag == stf && is_stf_level0(file)) {
         if (get_stf_data_name(file, &inDataName)) {
-            if (strcmp(file, inDataName) == 0) {
+            if (strcmp(file, inDataName) == 0 &&
+                start_thumbnail(inDataName, level, verbose,
+                                output_format, out_dir, browseFlag))
+            {
                 asfPrintStatus("%s%s\n", spaces(level), base);
                 generate_level0_thumbnail(inDataName, size, verbose, L0Flag, scale_factor, browseFlag,
                                           saveMetadataFlag, nPatchesFlag, nPatches,
                                           output_format, out_dir);
+                end_thumbnail();
             }
         }
         else {
@@ -745,17 +785,27 @@ void process_file(const char *file, int level, int size, int verbose,
         int nBands;
         /*ceos_data_ext_t data_ext = */get_ceos_data_name(file, baseName, &dataName, &nBands);
         FREE(baseName);
-        asfPrintStatus("%s%s\n", spaces(level), base);
-        generate_level0_thumbnail(*dataName, size, verbose, L0Flag, scale_factor, browseFlag,
-                                  saveMetadataFlag, nPatchesFlag, nPatches,
-                                  output_format, out_dir);
+        if (start_thumbnail(*dataName, level, verbose,
+                            output_format, out_dir, browseFlag))
+        {
+            asfPrintStatus("%s%s\n", spaces(level), base);
+            generate_level0_thumbnail(*dataName, size, verbose, L0Flag, scale_factor, browseFlag,
+                                      saveMetadataFlag, nPatchesFlag, nPatches,
+                                      output_format, out_dir);
+            end_thumbnail();
+        }
     }
 #ifdef JL0_GO
     else if (L0Flag == jaxa_l0) {
         if (is_JL0_basename(file)) {
-            generate_level0_thumbnail(file, size, verbose, L0Flag, scale_factor, browseFlag,
-                                      saveMetadataFlag, nPatchesFlag, nPatches,
-                                      output_format, out_dir);
+            if (start_thumbnail(file, level, verbose,
+                                output_format, out_dir, browseFlag))
+            {
+                generate_level0_thumbnail(file, size, verbose, L0Flag, scale_factor, browseFlag,
+                                          saveMetadataFlag, nPatchesFlag, nPatches,
+                                          output_format, out_dir);
+                end_thumbnail();
+            }
         }
         else {
             if (verbose) {
@@ -765,8 +815,13 @@ void process_file(const char *file, int level, int size, int verbose,
     }
 #endif
     else if (!is_ceos_level0(file)) {
-      generate_ceos_thumbnail(file, size, output_format, out_dir,
+      if (start_thumbnail(file, level, verbose,
+                          output_format, out_dir, browseFlag))
+      {
+        generate_ceos_thumbnail(file, size, output_format, out_dir,
                                 saveMetadataFlag, scale_factor, browseFlag);
+        end_thumbnail();
+      }
     }
     else {
         // Should never reach here
@@ -851,7 +906,13 @@ void generate_level0_thumbnail(const char *file, int size, int verbose, level_0_
     char t_stamp[32];
     t = time(NULL);
     strftime(t_stamp, 22, "%d%b%Y-%Hh_%Mm_%Ss", localtime(&t));
+#ifdef win32
     sprintf(tmp_folder, "./create_thumbs_tmp_dir_%s_%s", get_basename(file), t_stamp);
+#else
+    // Several workers (-jobs) may start a product with this name at once
+    sprintf(tmp_folder, "./create_thumbs_tmp_dir_%s_%s_%d", get_basename(file), t_stamp,
+            (int)getpid());
+#endif
     if (!is_dir(tmp_folder)) {
         create_dir(tmp_folder);
         if (!is_dir(tmp_folder)) {
@@ -1898,3 +1959,116 @@ int is_polsarpro(const char * infile)
   return (int)(found_bin && found_bin_hdr);
 }
 
+// Name of the thumbnail (or browse image) made for this input file
+static char *thumbnail_name(const char *file, output_format_t output_format,
+                            char *out_dir, int browseFlag)
+{
+    char *base = get_basename(file);
+    char *name = MALLOC(sizeof(char)*(strlen(out_dir)+strlen(base)+16));
+    sprintf(name, "%s%c%s%s.%s", out_dir, DIR_SEPARATOR, base,
+            browseFlag ? "" : "_thumb", output_format == TIF ? "tif" : "jpg");
+    FREE(base);
+    return name;
+}
+
+// TRUE if this input's thumbnail exists and is newer than the input
+static int thumbnail_is_current(const char *file, output_format_t output_format,
+                                char *out_dir, int browseFlag)
+{
+    struct stat in_stat, out_stat;
+    char *out_file = thumbnail_name(file, output_format, out_dir, browseFlag);
+    int current = stat(file, &in_stat) == 0 &&
+                  stat(out_file, &out_stat) == 0 &&
+                  out_stat.st_mtime >= in_stat.st_mtime;
+    FREE(out_file);
+    return current;
+}
+
+#ifndef win32
+static int running_jobs = 0;
+static int failed_jobs = 0;
+static int in_worker = FALSE;
+
+// Wait for one worker process to finish
+static void wait_for_job(void)
+{
+    int status;
+    if (waitpid(-1, &status, 0) > 0) {
+        running_jobs--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            failed_jobs++;
+    }
+    else {
+        running_jobs = 0; // no children left -- shouldn't happen
+    }
+}
+#endif
+
+// Called before making the thumbnail for this file.  Returns FALSE if
+// the caller should skip it: with -update, because the thumbnail is up
+// to date, and with -jobs, because a worker process is now making it.
+// Otherwise the caller makes the thumbnail, then calls end_thumbnail().
+static int start_thumbnail(const char *file, int level, int verbose,
+                           output_format_t output_format, char *out_dir,
+                           int browseFlag)
+{
+    if (update_flag &&
+        thumbnail_is_current(file, output_format, out_dir, browseFlag))
+    {
+        if (verbose) {
+            char *base = get_filename(file);
+            asfPrintStatus("%s%s (up to date)\n", spaces(level), base);
+            FREE(base);
+        }
+        return FALSE;
+    }
+
+#ifndef win32
+    if (max_jobs > 1) {
+        pid_t pid;
+        while (running_jobs >= max_jobs)
+            wait_for_job();
+
+        // Otherwise the worker would write out our buffered output again
+        fflush(stdout);
+        fflush(stderr);
+        if (fLog) fflush(fLog);
+
+        pid = fork();
+        if (pid == 0) {
+            in_worker = TRUE;
+            return TRUE;
+        }
+        if (pid > 0) {
+            running_jobs++;
+            return FALSE;
+        }
+        asfPrintWarning("Could not start a worker process.  "
+                        "Making this thumbnail here instead.\n");
+    }
+#endif
+    return TRUE;
+}
+
+// Called after making a thumbnail: a worker process is done
+static void end_thumbnail(void)
+{
+#ifndef win32
+    if (in_worker) {
+        if (fLog) fclose(fLog);
+        exit(EXIT_SUCCESS);
+    }
+#endif
+}
+
+// Wait for the worker processes that are still making thumbnails
+static void finish_thumbnails(void)
+{
+#ifndef win32
+    while (running_jobs > 0)
+        wait_for_job();
+    if (failed_jobs > 0)
+        asfPrintWarning("%d thumbnail%s could not be created.\n",
+                        failed_jobs, failed_jobs == 1 ? "" : "s");
+#endif
+}
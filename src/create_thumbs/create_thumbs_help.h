@@ -32,14 +32,16 @@
         TOOL_NAME" [-log <logfile>] [-quiet] [-verbose] [-size <size>]\n"\
 "                 [-recursive] [-out-dir <dir>]\n"\
 "                 [-L0 <stf|ceos|jaxa_L0>] [-output-format <tiff|jpeg>]\n"\
-"                 [-scale <scale_factor>] [-browse] [-save-metadata] [-help]\n"\
+"                 [-scale <scale_factor>] [-browse] [-save-metadata]\n"\
+"                 [-jobs <n>] [-update] [-help]\n"\
 "                 <files>"
 #else
 #define TOOL_USAGE \
         TOOL_NAME" [-log <logfile>] [-quiet] [-verbose] [-size <size>]\n"\
 "                 [-recursive] [-out-dir <dir>]\n"\
 "                 [-L0 <stf|ceos>] [-output-format <tiff|jpeg>]\n"\
-"                 [-scale <scale_factor>] [-browse] [-save-metadata] [-help]\n"\
+"                 [-scale <scale_factor>] [-browse] [-save-metadata]\n"\
+"                 [-jobs <n>] [-update] [-help]\n"\
 "                 <files>"
 #endif
 
@@ -145,6 +147,16 @@
 "          Results in all metadata files (intermediate and final) to be saved\n"\
 "          in the output directory.\n"\
 "\n"\
+"     -jobs <n> (-j)\n"\
+"          Create up to n thumbnails at the same time, each in its own process.\n"\
+"          Useful for processing a whole directory (or archive, with -R) on a\n"\
+"          machine with several processors.  Not available on Windows.\n"\
+"\n"\
+"     -update (-u)\n"\
+"          Skip input files whose thumbnail already exists and is newer than\n"\
+"          the input file, so re-running over an archive only processes new or\n"\
+"          changed products.\n"\
+"\n"\
 "     -help\n"\
 "          Print a help page and exit."
 #else
@@ -208,6 +220,16 @@
 "          Results in all metadata files (intermediate and final) to be saved\n"\
 "          in the output directory.\n"\
 "\n"\
+"     -jobs <n> (-j)\n"\
+"          Create up to n thumbnails at the same time, each in its own process.\n"\
+"          Useful for processing a whole directory (or archive, with -R) on a\n"\
+"          machine with several processors.  Not available on Windows.\n"\
+"\n"\
+"     -update (-u)\n"\
+"          Skip input files whose thumbnail already exists and is newer than\n"\
+"          the input file, so re-running over an archive only processes new or\n"\
+"          changed products.\n"\
+"\n"\
 "     -help\n"\
 "          Print a help page and exit."
 #endif
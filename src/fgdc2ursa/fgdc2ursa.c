@@ -476,7 +476,7 @@ int main(int argc, char *argv[])
     //printf("Far end latitude: %.4f\n", data->far_end_lat);
     //printf("Far end longitude: %.4f\n", data->far_end_lon);
   }
-  xmlFreeDoc(xmlBoundary);
+  xml_free_doc(xmlBoundary);
 
   xmlDoc *xmlCenter = xmlReadFile(centerFile, NULL, 0);
   if (!xmlCenter)
@@ -488,7 +488,7 @@ int main(int argc, char *argv[])
     //printf("Center latitude: %.4f\n", data->center_lat);
     //printf("Center longitude: %.4f\n", data->center_lon);
   }
-  xmlFreeDoc(xmlCenter);
+  xml_free_doc(xmlCenter);
 
   // Processing level
   strcpy(string, xml_get_string_value(doc, 
@@ -865,7 +865,7 @@ int main(int argc, char *argv[])
   if (error)
     asfPrintError("%s", errorMessage);
 
-  xmlFreeDoc(doc);
+  xml_free_doc(doc);
   xmlCleanupParser();
 
   FREE(configFile);
@@ -2785,6 +2785,9 @@ static int asf_convert_file(char *configFileName, int saveDEM)
   // global variable-- if set, tells meta_write to also dump .hdr (ENVI) files
   dump_envi_header = cfg->general->dump_envi;
 
+  // number of threads used by the parallel raster operations
+  set_number_of_threads(cfg->general->threads);
+
   char *first_pre_export = NULL;
 
   // Let's import some files!
@@ -41,6 +41,8 @@ typedef struct
   int thumbnail;          // if true, a 48x48 jpeg thumbnail of the output
                           // image is generated in the intermediates directory
   int testdata;           // testdata flag - for internal use only
+  int threads;            // number of threads for parallel raster processing
+                          // (0 for one per processor)
 } s_general;
 
 typedef struct
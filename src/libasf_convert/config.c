@@ -502,6 +502,7 @@ convert_config *init_fill_convert_config(char *configFile)
   strcpy(cfg->general->tmp_dir, "");
   cfg->general->thumbnail = 0;
   cfg->general->testdata = 0;
+  cfg->general->threads = 0;
 
   cfg->project->short_name = (char *)MALLOC(sizeof(char)*50);
   strcpy(cfg->project->short_name, "");
@@ -740,6 +741,8 @@ convert_config *init_fill_convert_config(char *configFile)
           strcpy(cfg->general->suffix, read_str(line, "suffix"));
         if (strncmp(test, "thumbnail", 9)==0)
           cfg->general->thumbnail = read_int(line, "thumbnail");
+        if (strncmp(test, "threads", 7)==0)
+          cfg->general->threads = read_int(line, "threads");
         if (strncmp(test, "testdata", 8)==0)
 	  cfg->general->testdata = read_int(line, "testdata");
 
@@ -1055,6 +1058,8 @@ convert_config *init_fill_convert_config(char *configFile)
             strcpy(cfg->general->suffix, read_str(line, "suffix"));
         if (strncmp(test, "thumbnail", 9)==0)
             cfg->general->thumbnail = read_int(line, "thumbnail");
+        if (strncmp(test, "threads", 7)==0)
+            cfg->general->threads = read_int(line, "threads");
         FREE(test);
         }
     }
@@ -1137,6 +1142,8 @@ convert_config *read_convert_config(char *configFile)
         strcpy(cfg->general->suffix, read_str(line, "suffix"));
       if (strncmp(test, "thumbnail", 9)==0)
         cfg->general->thumbnail = read_int(line, "thumbnail");
+      if (strncmp(test, "threads", 7)==0)
+        cfg->general->threads = read_int(line, "threads");
       if (strncmp(test, "testdata", 8)==0)
 	cfg->general->testdata = read_int(line, "testdata");
       FREE(test);
@@ -1657,6 +1664,11 @@ int write_convert_config(char *configFile, convert_config *cfg)
               "# be kept until processing is completed. Then the entire directory and its\n"
               "# contents will be deleted.\n\n");
     fprintf(fConfig, "tmp dir = %s\n", cfg->general->tmp_dir);
+    if (!shortFlag)
+      fprintf(fConfig, "\n# The threads parameter sets the number of threads used by the\n"
+              "# processing steps that can work on several image lines in parallel\n"
+              "# (0 for one thread per processor).\n\n");
+    fprintf(fConfig, "threads = %i\n", cfg->general->threads);
     // Test data generation flag - for internal use only
     if (cfg->general->testdata)
       fprintf(fConfig, "testdata = %d\n", cfg->general->testdata);
@@ -70,6 +70,11 @@ typedef enum {
   USER_DEFINED                  /* Some unknown user defined ellipsoid.  */
 } asf_export_ellipsoid_t;
 
+// Chunk shape of the image and geolocation layers in HDF5 and netCDF
+// files.  These layers are written one row of chunks at a time.
+#define EXPORT_CHUNK_LINES 256
+#define EXPORT_CHUNK_SAMPLES 256
+
 // netCDF pointer structure
 typedef struct {
   int ncid;                     // Pointer to the netCDF file
@@ -146,6 +151,8 @@ unsigned char pixel_float2byte (float paf, scale_t sample_mapping, float omin,\
                                 float no_data_value);
 spheroid_type_t axis2spheroid (double semimajor,
                                double semiminor);
+void get_latlon_lines(const latlon_grid_t *grid, int first_line,
+                      int line_count, float *lats, float *lons);
 
 void export_as_envi (const char *metadata_file_name,
                      const char *image_data_file_name,
@@ -25,9 +25,40 @@
 #include <spheroids.h>
 #include <typlim.h>
 #include <hdf5.h>
-
-#define RES 16
-#define MAX_PTS 256
+#include <zlib.h>
+
+#define H5_DEFLATE_LEVEL 6
+
+// Chunks that are compressed by us can be handed to the library directly
+// since HDF5 1.8.11 (H5DOwrite_chunk, part of the core library as
+// H5Dwrite_chunk since 1.10.3).  With older libraries we fall back to
+// hyperslab writes and let HDF5 do the compression.
+#if H5_VERS_MAJOR > 1 || \
+    (H5_VERS_MAJOR == 1 && (H5_VERS_MINOR > 10 || \
+    (H5_VERS_MINOR == 10 && H5_VERS_RELEASE >= 3)))
+#define H5_WRITE_CHUNK H5Dwrite_chunk
+#elif H5_VERS_MAJOR == 1 && (H5_VERS_MINOR > 8 || \
+    (H5_VERS_MINOR == 8 && H5_VERS_RELEASE >= 11))
+#include <hdf5_hl.h>
+#define H5_WRITE_CHUNK H5DOwrite_chunk
+#endif
+
+// The image bands and the extra layers are written one row of chunks at
+// a time.  With direct chunk writes, the chunks of a row are compressed
+// in parallel before they are written.
+typedef struct {
+  int samples;                  // Width of the layers
+  int chunk_lines;              // Chunk shape
+  int chunk_samples;
+  int chunk_count;              // Number of chunks in a chunk row
+  float *tile;                  // Uncompressed chunks of a chunk row
+  unsigned char *packed;        // Compressed chunks of a chunk row
+  uLong packed_max;             // Space for each compressed chunk
+  uLongf *packed_size;          // Size of each compressed chunk
+  const float *rows;            // Lines of the chunk row being written
+  int row_lines;                // Number of lines in that chunk row
+  int failed;
+} h5_chunk_writer_t;
 
 void h5_att_double(hid_t data, hid_t space, char *name, double value)
 {
@@ -136,6 +167,116 @@ void h5_value_str(hid_t file, char *group, char *name,
   H5Sclose(h5_space);
 }
 
+static void h5_chunk_dims(int lines, int samples, hsize_t *cdims)
+{
+  cdims[0] = lines < EXPORT_CHUNK_LINES ? lines : EXPORT_CHUNK_LINES;
+  cdims[1] = samples < EXPORT_CHUNK_SAMPLES ? samples : EXPORT_CHUNK_SAMPLES;
+}
+
+static h5_chunk_writer_t *h5_chunk_writer_new(int lines, int samples)
+{
+  h5_chunk_writer_t *w = (h5_chunk_writer_t *) MALLOC(sizeof(h5_chunk_writer_t));
+  hsize_t cdims[2];
+
+  h5_chunk_dims(lines, samples, cdims);
+  w->samples = samples;
+  w->chunk_lines = cdims[0];
+  w->chunk_samples = cdims[1];
+  w->chunk_count = (samples + w->chunk_samples - 1) / w->chunk_samples;
+#ifdef H5_WRITE_CHUNK
+  uLong chunk_bytes = sizeof(float)*w->chunk_lines*w->chunk_samples;
+  w->packed_max = compressBound(chunk_bytes);
+  w->tile = (float *) MALLOC(chunk_bytes*w->chunk_count);
+  w->packed = (unsigned char *) MALLOC(w->packed_max*w->chunk_count);
+  w->packed_size = (uLongf *) MALLOC(sizeof(uLongf)*w->chunk_count);
+#else
+  w->tile = NULL;
+  w->packed = NULL;
+  w->packed_size = NULL;
+#endif
+
+  return w;
+}
+
+static void h5_chunk_writer_free(h5_chunk_writer_t *w)
+{
+  FREE(w->tile);
+  FREE(w->packed);
+  FREE(w->packed_size);
+  FREE(w);
+}
+
+#ifdef H5_WRITE_CHUNK
+// Copies chunks first..last of the current chunk row out of the lines,
+// padding the edge chunks with zeros, and deflates them
+static void compress_chunks(void *data, int first, int last)
+{
+  h5_chunk_writer_t *w = (h5_chunk_writer_t *) data;
+  int cl = w->chunk_lines;
+  int cs = w->chunk_samples;
+  int ii, jj, kk;
+
+  for (kk=first; kk<=last; kk++) {
+    float *tile = w->tile + (long)kk*cl*cs;
+    int first_sample = kk*cs;
+    int ns = w->samples - first_sample < cs ? w->samples - first_sample : cs;
+    for (ii=0; ii<cl; ii++) {
+      float *out = tile + ii*cs;
+      jj = 0;
+      if (ii < w->row_lines) {
+        memcpy(out, w->rows + (long)ii*w->samples + first_sample, 
+               sizeof(float)*ns);
+        jj = ns;
+      }
+      for (; jj<cs; jj++)
+        out[jj] = 0.0;
+    }
+    w->packed_size[kk] = w->packed_max;
+    if (compress2(w->packed + kk*w->packed_max, &w->packed_size[kk], 
+                  (Bytef *) tile, sizeof(float)*cl*cs, 
+                  H5_DEFLATE_LEVEL) != Z_OK)
+      w->failed = TRUE;
+  }
+}
+#endif
+
+// Writes 'lines' lines, starting at the beginning of a chunk row
+static void h5_write_chunk_row(h5_chunk_writer_t *w, hid_t h5_data, 
+                               int first_line, int lines, const float *rows)
+{
+#ifdef H5_WRITE_CHUNK
+  hsize_t offset[2];
+  int kk;
+
+  w->rows = rows;
+  w->row_lines = lines;
+  w->failed = FALSE;
+  parallel_rows(w->chunk_count, compress_chunks, w);
+  if (w->failed)
+    asfPrintError("Could not compress HDF5 data chunk.\n");
+
+  offset[0] = first_line;
+  for (kk=0; kk<w->chunk_count; kk++) {
+    offset[1] = kk*w->chunk_samples;
+    if (H5_WRITE_CHUNK(h5_data, H5P_DEFAULT, 0, offset, w->packed_size[kk],
+                       w->packed + kk*w->packed_max) < 0)
+      asfPrintError("Could not write HDF5 data chunk.\n");
+  }
+#else
+  hsize_t start[2] = { first_line, 0 };
+  hsize_t count[2] = { lines, w->samples };
+  hid_t h5_file_space = H5Dget_space(h5_data);
+  hid_t h5_mem_space = H5Screate_simple(2, count, NULL);
+  H5Sselect_hyperslab(h5_file_space, H5S_SELECT_SET, start, NULL, count, 
+                      NULL);
+  if (H5Dwrite(h5_data, H5T_NATIVE_FLOAT, h5_mem_space, h5_file_space,
+               H5P_DEFAULT, rows) < 0)
+    asfPrintError("Could not write HDF5 data.\n");
+  H5Sclose(h5_mem_space);
+  H5Sclose(h5_file_space);
+#endif
+}
+
 h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
 {
   hid_t h5_file, h5_datagroup, h5_metagroup, h5_data, h5_proj;
@@ -175,7 +316,7 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   int samples = mg->sample_count;
   int lines = mg->line_count;
   hsize_t dims[2] = { lines, samples };
-  hsize_t cdims[2] = { 100, samples };
+  hsize_t cdims[2];
   hsize_t rdims[2] = { 1, 2 };
   h5_array = H5Screate_simple(2, dims, NULL);
   h5->space = h5_array;
@@ -186,8 +327,9 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   // Create data structure
   char **band_name = extract_band_names(mg->bands, band_count);
   hid_t h5_plist = H5Pcreate(H5P_DATASET_CREATE);
+  h5_chunk_dims(lines, samples, cdims);
   H5Pset_chunk(h5_plist, 2, cdims);
-  H5Pset_deflate(h5_plist, 6);
+  H5Pset_deflate(h5_plist, H5_DEFLATE_LEVEL);
   
   // Create a data group
   sprintf(group, "/data");
@@ -497,51 +639,22 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   // Extra bands - Longitude
   int nl = mg->line_count;
   int ns = mg->sample_count;
-  long pixel_count = mg->line_count * mg->sample_count;
-  double *value = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *l = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *s = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double line, sample, lat, lon, first_value;
-  float *lons = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'longitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  if (lon < 0.0)
-    first_value = lon + 360.0;
-  else
-    first_value = lon;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      if (lon < 0.0)
-	value[ii*RES+kk] = lon + 360.0;
-      else
-	value[ii*RES+kk] = lon;
-    }
-    asfLineMeter(ii, nl);
-  }
-  quadratic_2d q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      lons[ii*ns+kk] = (float)
-	(q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	 q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	 q.K*kk*kk*kk) - 360.0;
-      if (lons[ii*ns+kk] < -180.0)
-	lons[ii*ns+kk] += 360.0;
-    }
-    asfLineMeter(ii, nl);
-  }
+  int jj, rows;
+  h5_chunk_writer_t *w = h5_chunk_writer_new(nl, ns);
+  float *buf = (float *) MALLOC(sizeof(float)*w->chunk_lines*ns);
+  asfPrintStatus("Calculating geolocation grid ...\n");
+  latlon_grid_t *grid = latlon_grid_new(md, 0.0, 0.0);
   asfPrintStatus("Storing band 'longitude' ...\n");
   sprintf(dataset, "/data/longitude");
   h5_lon = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 		     H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-  H5Dwrite(h5_lon, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, lons);
+  for (ii=0; ii<nl; ii+=rows) {
+    rows = nl - ii < w->chunk_lines ? nl - ii : w->chunk_lines;
+    get_latlon_lines(grid, ii, rows, NULL, buf);
+    h5_write_chunk_row(w, h5_lon, ii, rows, buf);
+    for (jj=ii; jj<ii+rows; jj++)
+      asfLineMeter(jj, nl);
+  }
   h5_att_str(h5_lon, h5_string, "units", "degrees_east");
   h5_att_str(h5_lon, h5_string, "long_name", "longitude");
   h5_att_str(h5_lon, h5_string, "standard_name", "longitude");
@@ -549,47 +662,19 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   h5_att_float2(h5_lon, h5_range, "valid_range", valid_range);
   h5_att_float(h5_lon, h5_string, "_FillValue", -999);
   H5Dclose(h5_lon);
-  FREE(lons);
 
   // Extra bands - Latitude
-  float *lats = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'latitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  first_value = lat + 180.0;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      value[ii*RES+kk] = lat + 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
-  q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      if (mg->orbit_direction == 'A')
-	lats[(nl-ii-1)*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-      else
-	lats[ii*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
   asfPrintStatus("Storing band 'latitude' ...\n");
   sprintf(dataset, "/data/latitude");
   h5_lat = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 		     H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-  H5Dwrite(h5_lat, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, lats);
+  for (ii=0; ii<nl; ii+=rows) {
+    rows = nl - ii < w->chunk_lines ? nl - ii : w->chunk_lines;
+    get_latlon_lines(grid, ii, rows, buf, NULL);
+    h5_write_chunk_row(w, h5_lat, ii, rows, buf);
+    for (jj=ii; jj<ii+rows; jj++)
+      asfLineMeter(jj, nl);
+  }
   h5_att_str(h5_lat, h5_string, "units", "degrees_north");
   h5_att_str(h5_lat, h5_string, "long_name", "latitude");
   h5_att_str(h5_lat, h5_string, "standard_name", "latitude");
@@ -598,21 +683,22 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
   h5_att_float2(h5_lat, h5_range, "valid_range", valid_range);
   h5_att_float(h5_lat, h5_string, "_FillValue", -999);
   H5Dclose(h5_lat);
-  FREE(lats);
 
   if (projected) {
     // Extra bands - ygrid
-    float *ygrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++)
-	ygrids[ii*ns+kk] = mp->startY + kk*mp->perY;
-      asfLineMeter(ii, nl);
-    }
     asfPrintStatus("Storing band 'ygrid' ...\n");
     sprintf(dataset, "/data/ygrid");
     h5_ygrid = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 			 H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-    H5Dwrite(h5_ygrid, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, ygrids);
+    for (ii=0; ii<nl; ii+=rows) {
+      rows = nl - ii < w->chunk_lines ? nl - ii : w->chunk_lines;
+      for (jj=0; jj<rows; jj++) {
+	for (kk=0; kk<ns; kk++)
+	  buf[jj*ns+kk] = mp->startY + (ii+jj)*mp->perY;
+	asfLineMeter(ii + jj, nl);
+      }
+      h5_write_chunk_row(w, h5_ygrid, ii, rows, buf);
+    }
     h5_att_str(h5_ygrid, h5_string, "units", "meters");
     h5_att_str(h5_ygrid, h5_string, "long_name", 
 	       "projection_grid_y_coordinates");
@@ -620,20 +706,21 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
 	       "projection_y_coordinates");
     h5_att_str(h5_ygrid, h5_string, "axis", "Y");
     H5Dclose(h5_ygrid);
-    FREE(ygrids);
     
     // Extra bands - xgrid
-    float *xgrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++) 
-	xgrids[ii*ns+kk] = mp->startX + kk*mp->perX;
-      asfLineMeter(ii, nl);
-    }
     asfPrintStatus("Storing band 'xgrid' ...\n");
     sprintf(dataset, "/data/xgrid");
     h5_xgrid = H5Dcreate(h5_file, dataset, H5T_NATIVE_FLOAT, h5_array,
 			 H5P_DEFAULT, h5_plist, H5P_DEFAULT);
-    H5Dwrite(h5_xgrid, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, xgrids);
+    for (ii=0; ii<nl; ii+=rows) {
+      rows = nl - ii < w->chunk_lines ? nl - ii : w->chunk_lines;
+      for (jj=0; jj<rows; jj++) {
+	for (kk=0; kk<ns; kk++) 
+	  buf[jj*ns+kk] = mp->startX + kk*mp->perX;
+	asfLineMeter(ii + jj, nl);
+      }
+      h5_write_chunk_row(w, h5_xgrid, ii, rows, buf);
+    }
     h5_att_str(h5_xgrid, h5_string, "units", "meters");
     h5_att_str(h5_xgrid, h5_string, "long_name", 
 	       "projection_grid_x_coordinates");
@@ -641,9 +728,11 @@ h5_t *initialize_h5_file(const char *output_file_name, meta_parameters *md)
 	       "projection_x_coordinates");
     h5_att_str(h5_xgrid, h5_string, "axis", "X");
     H5Dclose(h5_xgrid);
-    FREE(xgrids);
   }
-
+  h5_chunk_writer_free(w);
+  latlon_grid_free(grid);
+  FREE(buf);
+  H5Pclose(h5_plist);
   H5Gclose(h5_datagroup);
 
   // Adding global attributes
@@ -889,7 +978,7 @@ void export_hdf(const char *metadata_file_name,
 		char *output_file_name, char **band_name,
 		int *noutputs,char ***output_names)
 {
-  int ii, jj, kk, channel;
+  int ii, jj, kk, channel, lines;
 
   meta_parameters *md = meta_read (metadata_file_name); 
   append_ext_if_needed(output_file_name, ".h5", NULL);
@@ -897,29 +986,31 @@ void export_hdf(const char *metadata_file_name,
   int band_count = md->general->band_count;
   int sample_count = md->general->sample_count;
   int line_count = md->general->line_count;
-  float *hdf = (float *) MALLOC(sizeof(float)*line_count*sample_count);
+  h5_chunk_writer_t *w = h5_chunk_writer_new(line_count, sample_count);
+  float *hdf = (float *) MALLOC(sizeof(float)*w->chunk_lines*sample_count);
   FILE *fp = FOPEN(image_data_file_name, "rb");
-  float *float_line = (float *) MALLOC(sizeof(float)*sample_count);
 
   for (kk=0; kk<band_count; kk++) {
-    for (ii=0; ii<line_count; ii++ ) {
-      channel = get_band_number(md->general->bands, band_count, band_name[kk]);
-      get_float_line(fp, md, ii+channel*line_count, float_line);
-      for (jj=0; jj<sample_count; jj++)
-	hdf[ii*sample_count+jj] = float_line[jj];
-      asfLineMeter(ii, line_count);
-    }
     asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
+    channel = get_band_number(md->general->bands, band_count, band_name[kk]);
     char dataset[50];
     sprintf(dataset, "/data/%s", band_name[kk]);
     hid_t h5_data = H5Dopen(h5->file, dataset, H5P_DEFAULT);
-    H5Dwrite(h5_data, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT, hdf);
+    for (ii=0; ii<line_count; ii+=lines) {
+      lines = line_count - ii < w->chunk_lines ? 
+	line_count - ii : w->chunk_lines;
+      get_float_lines(fp, md, ii+channel*line_count, lines, hdf);
+      h5_write_chunk_row(w, h5_data, ii, lines, hdf);
+      for (jj=ii; jj<ii+lines; jj++)
+	asfLineMeter(jj, line_count);
+    }
     H5Dclose(h5_data);
   }
 
+  FCLOSE(fp);
   finalize_h5_file(h5);
+  h5_chunk_writer_free(w);
   FREE(hdf);
-  FREE(float_line);
   meta_free(md);
 
   *noutputs = 1;
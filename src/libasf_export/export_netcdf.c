@@ -26,8 +26,6 @@
 #include <typlim.h>
 #include <netcdf.h>
 
-#define RES 16
-#define MAX_PTS 256
 
 void nc_meta_double(int group_id, char *name, char *desc, char *units,
 		    double *value)
@@ -87,6 +85,29 @@ void nc_meta_str(int group_id, char *name, char *desc, char *units,
   nc_put_var_string(group_id, var_id, &str_value);
 }
 
+// Image and geolocation layers are stored in chunks, and written one row
+// of chunks at a time so that only those lines need to be in memory
+static void nc_def_chunks(int ncid, int var_id, size_t line_count, 
+			  size_t sample_count)
+{
+  size_t chunks[3];
+  chunks[0] = line_count < EXPORT_CHUNK_LINES ? line_count : EXPORT_CHUNK_LINES;
+  chunks[1] = 
+    sample_count < EXPORT_CHUNK_SAMPLES ? sample_count : EXPORT_CHUNK_SAMPLES;
+  chunks[2] = 1;
+  nc_def_var_chunking(ncid, var_id, NC_CHUNKED, chunks);
+}
+
+static void nc_put_lines(int ncid, int var_id, int first_line, int lines,
+			 int sample_count, const float *buf)
+{
+  size_t start[3] = { first_line, 0, 0 };
+  size_t count[3] = { lines, sample_count, 1 };
+  int status = nc_put_vara_float(ncid, var_id, start, count, buf);
+  if (status != NC_NOERR)
+    asfPrintError("Could not write netCDF data (%s).\n", nc_strerror(status));
+}
+
 netcdf_t *initialize_netcdf_file(const char *output_file, 
 				 meta_parameters *meta)
 {
@@ -462,8 +483,8 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     dims_bands[1] = dim_xgrid_id;
   }
   else {
-    dims_bands[0] = dim_lon_id;
-    dims_bands[1] = dim_lat_id;
+    dims_bands[0] = dim_lat_id;
+    dims_bands[1] = dim_lon_id;
   }
 
   for (ii=0; ii<band_count; ii++) {
@@ -472,6 +493,7 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, str, datatype, 3, dims_bands, &var_id);
     netcdf->var_id[ii] = var_id;
     nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
+    nc_def_chunks(ncid, var_id, line_count, sample_count);
     fValue = -999.0;
     nc_put_att_double(ncid, var_id, "FillValue", NC_DOUBLE, 1, &fValue);
     sprintf(str, "%s", mg->sensor);
@@ -526,11 +548,12 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, "longitude", NC_FLOAT, 2, dims_lon, &var_id);
   }
   else {
-    int dims_lon[2] = { dim_lon_id, dim_lat_id };
+    int dims_lon[2] = { dim_lat_id, dim_lon_id };
     nc_def_var(ncid, "longitude", NC_FLOAT, 2, dims_lon, &var_id);
   }
   netcdf->var_id[ii] = var_id;
   nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
+  nc_def_chunks(ncid, var_id, line_count, sample_count);
   strcpy(str, "longitude");
   nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
   strcpy(str, "longitude");
@@ -557,6 +580,7 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
   }
   netcdf->var_id[ii] = var_id;
   nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
+  nc_def_chunks(ncid, var_id, line_count, sample_count);
   strcpy(str, "latitude");
   nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
   strcpy(str, "latitude");
@@ -579,6 +603,7 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, "ygrid", NC_FLOAT, 2, dims_ygrid, &var_id);
     netcdf->var_id[ii] = var_id;
     nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
+    nc_def_chunks(ncid, var_id, line_count, sample_count);
     strcpy(str, "projection_y_coordinates");
     nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
     strcpy(str, "projection_grid_y_centers");
@@ -594,6 +619,7 @@ netcdf_t *initialize_netcdf_file(const char *output_file,
     nc_def_var(ncid, "xgrid", NC_FLOAT, 2, dims_xgrid, &var_id);
     netcdf->var_id[ii] = var_id;
     nc_def_var_deflate(ncid, var_id, 0, 1, 6);    
+    nc_def_chunks(ncid, var_id, line_count, sample_count);
     strcpy(str, "projection_x_coordinates");
     nc_put_att_text(ncid, var_id, "standard_name", strlen(str), str);
     strcpy(str, "projection_grid_x_centers");
@@ -842,7 +868,6 @@ void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md)
   int n = md->general->band_count;
   int nl = md->general->line_count;
   int ns = md->general->sample_count;
-  long pixel_count = md->general->line_count * md->general->sample_count;
   int projected = FALSE;
   if (md->projection && md->projection->type != SCANSAR_PROJECTION)
     projected = TRUE;
@@ -854,117 +879,62 @@ void finalize_netcdf_file(netcdf_t *netcdf, meta_parameters *md)
 
   // Extra bands - longitude
   n++;
-  int ii, kk;
-  double *value = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *l = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double *s = (double *) MALLOC(sizeof(double)*MAX_PTS);
-  double line, sample, lat, lon, first_value;
-  float *lons = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'longitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  if (lon < 0.0)
-    first_value = lon + 360.0;
-  else
-    first_value = lon;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      if (lon < 0.0)
-	value[ii*RES+kk] = lon + 360.0;
-      else
-	value[ii*RES+kk] = lon;
-    }
-    asfLineMeter(ii, nl);
-  }
-  quadratic_2d q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      lons[ii*ns+kk] = (float)
-	(q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	 q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	 q.K*kk*kk*kk) - 360.0;
-      if (lons[ii*ns+kk] < -180.0)
-	lons[ii*ns+kk] += 360.0;
-    }
-    asfLineMeter(ii, nl);
-  }
+  int ii, jj, kk, rows;
+  int chunk_lines = nl < EXPORT_CHUNK_LINES ? nl : EXPORT_CHUNK_LINES;
+  float *buf = (float *) MALLOC(sizeof(float)*chunk_lines*ns);
+  asfPrintStatus("Calculating geolocation grid ...\n");
+  latlon_grid_t *grid = latlon_grid_new(md, 0.0, 0.0);
   asfPrintStatus("Storing band 'longitude' ...\n");
-  nc_put_var_float(ncid, netcdf->var_id[n], &lons[0]);
-  FREE(lons);
+  for (ii=0; ii<nl; ii+=rows) {
+    rows = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+    get_latlon_lines(grid, ii, rows, NULL, buf);
+    nc_put_lines(ncid, netcdf->var_id[n], ii, rows, ns, buf);
+    for (jj=ii; jj<ii+rows; jj++)
+      asfLineMeter(jj, nl);
+  }
 
   // Extra bands - Latitude
   n++;
-  float *lats = (float *) MALLOC(sizeof(float)*pixel_count);
-  asfPrintStatus("Generating band 'latitude' ...\n");
-  meta_get_latLon(md, 0, 0, 0.0, &lat, &lon);
-  first_value = lat + 180.0;
-  asfPrintStatus("Calculating grid for quadratic fit ...\n");
-  for (ii=0; ii<RES; ii++) {
-    for (kk=0; kk<RES; kk++) {
-      line = ii * nl / RES;
-      sample = kk * ns / RES;
-      meta_get_latLon(md, line, sample, 0.0, &lat, &lon);
-      l[ii*RES+kk] = line;
-      s[ii*RES+kk] = sample;
-      value[ii*RES+kk] = lat + 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
-  q = find_quadratic(value, l, s, MAX_PTS);
-  q.A = first_value;
-  for (ii=0; ii<nl; ii++) {
-    for (kk=0; kk<ns; kk++) {
-      if (md->general->orbit_direction == 'A')
-	lats[(nl-ii-1)*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-      else
-	lats[ii*ns+kk] = (float)
-	  (q.A + q.B*ii + q.C*kk + q.D*ii*ii + q.E*ii*kk + q.F*kk*kk +
-	   q.G*ii*ii*kk + q.H*ii*kk*kk + q.I*ii*ii*kk*kk + q.J*ii*ii*ii +
-	   q.K*kk*kk*kk) - 180.0;
-    }
-    asfLineMeter(ii, nl);
-  }
   asfPrintStatus("Storing band 'latitude' ...\n");
-  nc_put_var_float(ncid, netcdf->var_id[n], &lats[0]);
-  FREE(lats);
+  for (ii=0; ii<nl; ii+=rows) {
+    rows = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+    get_latlon_lines(grid, ii, rows, buf, NULL);
+    nc_put_lines(ncid, netcdf->var_id[n], ii, rows, ns, buf);
+    for (jj=ii; jj<ii+rows; jj++)
+      asfLineMeter(jj, nl);
+  }
+  latlon_grid_free(grid);
 
   if (projected) {
     // Extra bands - ygrid
     n++;
-    float *ygrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++)
-	ygrids[ii*ns+kk] = 
-	  md->projection->startY + kk*md->projection->perY;
-      asfLineMeter(ii, nl);
-    }
     asfPrintStatus("Storing band 'ygrid' ...\n");
-    nc_put_var_float(ncid, netcdf->var_id[n], &ygrids[0]);
-    FREE(ygrids);
+    for (ii=0; ii<nl; ii+=rows) {
+      rows = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+      for (jj=0; jj<rows; jj++) {
+	for (kk=0; kk<ns; kk++)
+	  buf[jj*ns+kk] = 
+	    md->projection->startY + (ii+jj)*md->projection->perY;
+	asfLineMeter(ii + jj, nl);
+      }
+      nc_put_lines(ncid, netcdf->var_id[n], ii, rows, ns, buf);
+    }
     
     // Extra bands - xgrid
     n++;
-    float *xgrids = (float *) MALLOC(sizeof(float)*pixel_count);
-    for (ii=0; ii<nl; ii++) {
-      for (kk=0; kk<ns; kk++) 
-	xgrids[ii*ns+kk] = 
-	  md->projection->startX + kk*md->projection->perX;
-      asfLineMeter(ii, nl);
-    }
     asfPrintStatus("Storing band 'xgrid' ...\n");
-    nc_put_var_float(ncid, netcdf->var_id[n], &xgrids[0]);
-    FREE(xgrids);
+    for (ii=0; ii<nl; ii+=rows) {
+      rows = nl - ii < chunk_lines ? nl - ii : chunk_lines;
+      for (jj=0; jj<rows; jj++) {
+	for (kk=0; kk<ns; kk++) 
+	  buf[jj*ns+kk] = 
+	    md->projection->startX + kk*md->projection->perX;
+	asfLineMeter(ii + jj, nl);
+      }
+      nc_put_lines(ncid, netcdf->var_id[n], ii, rows, ns, buf);
+    }
   }
-
+  FREE(buf);
   // Close file and clean up
   int status = nc_close(ncid);
   if (status != NC_NOERR)
@@ -978,7 +948,7 @@ void export_netcdf(const char *metadata_file_name,
 		   char *output_file_name, char **band_name,
 		   int *noutputs,char ***output_names)
 {
-  int ii, jj, kk, channel;
+  int ii, jj, kk, channel, lines;
 
   meta_parameters *md = meta_read (metadata_file_name); 
   append_ext_if_needed(output_file_name, ".nc", NULL);
@@ -986,25 +956,27 @@ void export_netcdf(const char *metadata_file_name,
   int band_count = md->general->band_count;
   int sample_count = md->general->sample_count;
   int line_count = md->general->line_count;
-  float *nc = (float *) MALLOC(sizeof(float)*line_count*sample_count);
+  int chunk_lines = 
+    line_count < EXPORT_CHUNK_LINES ? line_count : EXPORT_CHUNK_LINES;
+  float *nc = (float *) MALLOC(sizeof(float)*chunk_lines*sample_count);
   FILE *fp = FOPEN(image_data_file_name, "rb");
-  float *float_line = (float *) MALLOC(sizeof(float)*sample_count);
 
   for (kk=0; kk<band_count; kk++) {
-    for (ii=0; ii<line_count; ii++ ) {
-      channel = get_band_number(md->general->bands, band_count, band_name[kk]);
-      get_float_line(fp, md, ii+channel*line_count, float_line);
-      for (jj=0; jj<sample_count; jj++)
-	nc[ii*sample_count+jj] = float_line[jj];
-      asfLineMeter(ii, md->general->line_count);
-    }
     asfPrintStatus("Storing band '%s' ...\n", band_name[kk]);
-    nc_put_var_float(netcdf->ncid, netcdf->var_id[kk], &nc[0]);
+    channel = get_band_number(md->general->bands, band_count, band_name[kk]);
+    for (ii=0; ii<line_count; ii+=lines) {
+      lines = line_count - ii < chunk_lines ? line_count - ii : chunk_lines;
+      get_float_lines(fp, md, ii+channel*line_count, lines, nc);
+      nc_put_lines(netcdf->ncid, netcdf->var_id[kk], ii, lines, sample_count,
+		   nc);
+      for (jj=ii; jj<ii+lines; jj++)
+	asfLineMeter(jj, line_count);
+    }
   }
 
+  FCLOSE(fp);
   finalize_netcdf_file(netcdf, md);
   FREE(nc);
-  FREE(float_line);
   meta_free(md);
 
   *noutputs = 1;
@@ -415,3 +415,39 @@ pixel_float2byte(float paf, scale_t sample_mapping,
   }
   return pab;
 }
+
+typedef struct {
+  const latlon_grid_t *grid;
+  int first_line;
+  float *lats, *lons;
+} latlon_lines_t;
+
+static void latlon_rows(void *data, int first_row, int last_row)
+{
+  latlon_lines_t *d = (latlon_lines_t *) data;
+  int ns = d->grid->sample_count;
+  int ii;
+
+  for (ii=first_row; ii<=last_row; ii++)
+    latlon_grid_get_line(d->grid, d->first_line + ii,
+                         d->lats ? d->lats + (long)ii*ns : NULL,
+                         d->lons ? d->lons + (long)ii*ns : NULL);
+}
+
+/* Latitudes and/or longitudes of line_count lines, starting at
+   first_line.  The lines are interpolated in parallel unless the grid
+   falls back to exact geolocation.  */
+void get_latlon_lines(const latlon_grid_t *grid, int first_line,
+                      int line_count, float *lats, float *lons)
+{
+  latlon_lines_t d;
+
+  d.grid = grid;
+  d.first_line = first_line;
+  d.lats = lats;
+  d.lons = lons;
+  if (grid->exact)
+    latlon_rows(&d, 0, line_count-1);
+  else
+    parallel_rows(line_count, latlon_rows, &d);
+}
@@ -567,6 +567,76 @@ reverse_map_y (struct data_to_fit *dtf, double x, double y)
   return ret;
 }
 
+// Number of output pixels, in each direction, mapped back into the
+// input image to find the part of it that is needed
+#define INPUT_WINDOW_SAMPLES 256
+
+// Extra input pixels around the needed part, for the resampling kernels
+// and for the output pixels in between the ones we mapped
+#define INPUT_WINDOW_HALO 8
+
+// Finds the part of the input image that the output image needs, by
+// mapping a grid of output pixels (including all four edges) back into
+// the input image.  The window is only narrowed down from the full input
+// image if that saves at least a tenth of the reading.
+static void input_window(struct data_to_fit *dtf, meta_parameters *omd,
+                         size_t oix_max, size_t oiy_max,
+                         size_t ii_size_x, size_t ii_size_y,
+                         ssize_t *x0, ssize_t *y0,
+                         ssize_t *size_x, ssize_t *size_y)
+{
+  size_t x_step = oix_max / INPUT_WINDOW_SAMPLES + 1;
+  size_t y_step = oiy_max / INPUT_WINDOW_SAMPLES + 1;
+  double min_x = ii_size_x, max_x = -1, min_y = ii_size_y, max_y = -1;
+  size_t oix, oiy;
+
+  *x0 = *y0 = 0;
+  *size_x = ii_size_x;
+  *size_y = ii_size_y;
+
+  for (oiy = 0; oiy < oiy_max; oiy += y_step) {
+    // Rows are visited in order, reverse_map_x/y are slow when y changes
+    double oiy_pc = omd->projection->startY + oiy * omd->projection->perY;
+    for (oix = 0; oix < oix_max; oix += x_step) {
+      double oix_pc = omd->projection->startX + oix * omd->projection->perX;
+      double x = reverse_map_x (dtf, oix_pc, oiy_pc);
+      double y = reverse_map_y (dtf, oix_pc, oiy_pc);
+      if (x < min_x) min_x = x;
+      if (x > max_x) max_x = x;
+      if (y < min_y) min_y = y;
+      if (y > max_y) max_y = y;
+      if (oix + x_step >= oix_max && oix != oix_max - 1)
+        oix = oix_max - 1 - x_step;   // get the last column, too
+    }
+    if (oiy + y_step >= oiy_max && oiy != oiy_max - 1)
+      oiy = oiy_max - 1 - y_step;     // and the last row
+  }
+
+  ssize_t wx0 = floor (min_x) - INPUT_WINDOW_HALO;
+  ssize_t wy0 = floor (min_y) - INPUT_WINDOW_HALO;
+  ssize_t wx1 = ceil (max_x) + INPUT_WINDOW_HALO;
+  ssize_t wy1 = ceil (max_y) + INPUT_WINDOW_HALO;
+  if (wx0 < 0) wx0 = 0;
+  if (wy0 < 0) wy0 = 0;
+  if (wx1 > (ssize_t) ii_size_x - 1) wx1 = ii_size_x - 1;
+  if (wy1 > (ssize_t) ii_size_y - 1) wy1 = ii_size_y - 1;
+
+  // No overlap with the output image at all: nothing will be sampled,
+  // keep a token window
+  if (wx1 < wx0 || wy1 < wy0) {
+    *size_x = *size_y = 1;
+    return;
+  }
+
+  if ((double)(wx1 - wx0 + 1) * (wy1 - wy0 + 1) <
+      0.9 * (double) ii_size_x * ii_size_y) {
+    *x0 = wx0;
+    *y0 = wy0;
+    *size_x = wx1 - wx0 + 1;
+    *size_y = wy1 - wy0 + 1;
+  }
+}
+
 static void determine_projection_fns(int projection_type, project_t **project,
                                      project_arr_t **project_arr, unproject_t **unproject,
                                      unproject_arr_t **unproject_arr)
@@ -1732,8 +1802,8 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
   //--------------------------------------------------------------------------
   // Now working on generating the output images
 
-  double *projX = MALLOC(sizeof(double)*oix_max);
-  double *projY = MALLOC(sizeof(double)*oix_max);
+  geoid_grid_t *geoid = NULL;
+  float *geoid_line = MALLOC(sizeof(float)*oix_max);
 
   // When mosaicing -- use banded_float_image to store the output, write
   //                   it out after processing all inputs
@@ -2435,6 +2505,20 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
       // Note that we use this file's metadata band count -- if this is
       // less than the number of bands in the output image, that band
       // will mosaic with fewer bands.
+      // Often only part of the input image ends up in the output image
+      // (clipping to a lat/lon range, or a small area of interest), and
+      // then we only read that part
+      ssize_t win_x0 = 0, win_y0 = 0;
+      ssize_t win_size_x = ii_size_x, win_size_y = ii_size_y;
+      input_window(&dtf, omd, oix_max, oiy_max, ii_size_x, ii_size_y,
+		   &win_x0, &win_y0, &win_size_x, &win_size_y);
+      if (win_size_x < (ssize_t) ii_size_x ||
+	  win_size_y < (ssize_t) ii_size_y)
+	asfPrintStatus("Reading input image window: lines %ld-%ld, "
+		       "samples %ld-%ld\n", (long) win_y0,
+		       (long) (win_y0 + win_size_y - 1), (long) win_x0,
+		       (long) (win_x0 + win_size_x - 1));
+
       int kk;
       for (kk=0; kk<imd->general->band_count; kk++) {
 	if (multiband || kk == band_num) {
@@ -2492,9 +2576,11 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	  
 	  // open up the input image
 	  if (process_as_byte)
-	    iim_b = uint8_image_band_new_from_metadata(imd, kk, input_image);
+	    iim_b = uint8_image_band_new_from_metadata_window(imd, kk,
+		input_image, win_x0, win_y0, win_size_x, win_size_y);
 	  else
-	    iim = float_image_band_new_from_metadata(imd, kk, input_image);
+	    iim = float_image_band_new_from_metadata_window(imd, kk,
+		input_image, win_x0, win_y0, win_size_x, win_size_y);
 	  
 	  asfPrintStatus("Resampling input image into output image "
 			 "coordinate space...\n");
@@ -2525,9 +2611,6 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
               double oix_pc = omd->projection->startX + oix * omd->projection->perX;
               double oiy_pc = omd->projection->startY + oiy * omd->projection->perY;
 
-	      projX[oix] = oix_pc;
-	      projY[oix] = oiy_pc;
-	      
 	      // Determine pixel of interest in input image.  The fractional
 	      // part is desired, we will use some sampling method to
 	      // interpolate between pixel values.
@@ -2575,8 +2658,34 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 		}
 	      }
 	      // Otherwise, set to the value from the appropriate position in
-	      // the input image.
+	      // the input image.  The tiles only hold the window of the input
+	      // image we read.
 	      else {
+		// The window was worked out from a grid of output pixels, so
+		// a pixel in between can in principle map outside of it.  If
+		// that happens, go back to reading the whole band.
+		if (input_x_pixel < win_x0 ||
+		    input_x_pixel > (double) (win_x0 + win_size_x - 1) ||
+		    input_y_pixel < win_y0 ||
+		    input_y_pixel > (double) (win_y0 + win_size_y - 1)) {
+		  asfPrintStatus("\nInput pixel outside of the window, "
+				 "reading the full input image ...\n");
+		  win_x0 = win_y0 = 0;
+		  win_size_x = ii_size_x;
+		  win_size_y = ii_size_y;
+		  if (process_as_byte) {
+		    uint8_image_free(iim_b);
+		    iim_b = uint8_image_band_new_from_metadata_window(imd, kk,
+		      input_image, win_x0, win_y0, win_size_x, win_size_y);
+		  }
+		  else {
+		    float_image_free(iim);
+		    iim = float_image_band_new_from_metadata_window(imd, kk,
+		      input_image, win_x0, win_y0, win_size_x, win_size_y);
+		  }
+		}
+		input_x_pixel -= win_x0;
+		input_y_pixel -= win_y0;
 		if (process_as_byte) {
 		  value = 
 		    uint8_image_sample(iim_b, input_x_pixel, input_y_pixel,
@@ -2686,41 +2795,29 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
 	      // is even possible, really.
 	      g_assert(iim && !iim_b);
 	      
-	      double *lat, *lon;
-	      lat = lon = NULL; // => libproj will allocate for us
-	      
-	      // Need to get each pixel's location in lat/lon in order to get
-	      // the geoid height.  We saved each pixel's projection coordinates,
-	      // above, so we just to need to convert those, then use the
-	      // lat/lon values to get the required geoid height correction,
-	      // add it to the height at the pixel.
-	      
-	      // Doing it like this (instead of pixel-by-pixel) allows us to
-	      // use the array version of libproj, which is *much* faster.
-	      
-	      unproject_arr(pp, projX, projY, NULL, &lat, &lon, NULL,
-			    oix_max + 1, datum);
-	      
+	      // The geoid height only needs to be looked up exactly on a
+	      // sparse grid over the output image, and is interpolated in
+	      // between.  The grid is built once and used for all inputs.
+	      if (!geoid)
+		geoid = geoid_grid_new(omd);
+	      geoid_grid_get_line(geoid, oiy, geoid_line);
+
 	      // the outer if guards against the case where no valid pixels
 	      // were on this line (i.e., both are -1)
 	      if (oix_first_valid > 0 && oix_last_valid > 0) {
 		if (output_by_line) {
 		  for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
-		    output_line[oix] +=
-		      get_geoid_height(lat[oix]*R2D, lon[oix]*R2D);
+		    output_line[oix] += geoid_line[oix];
 		  }
 		}
 		else {
 		  for (oix = oix_first_valid; (int)oix <= oix_last_valid; ++oix) {
 		    float value = banded_float_image_get_pixel(output_bfi, kk, oix, oiy);
 		    banded_float_image_set_pixel(output_bfi, kk, oix, oiy,
-						 value + get_geoid_height(lat[oix]*R2D, lon[oix]*R2D));
+						 value + geoid_line[oix]);
 		  }
 		}
 	      }
-	      
-	      free(lat);
-	      free(lon);
 	    }
 	    
 	    // write the line, if we're doing line-by-line output
@@ -2828,8 +2925,8 @@ int asf_mosaic(project_parameters_t *pp, projection_type_t projection_type,
     FREE(band_name);
   }
 
-  free(projX);
-  free(projY);
+  geoid_grid_free(geoid);
+  FREE(geoid_line);
 
   if (output_by_line)
     free(output_line);
@@ -144,11 +144,27 @@ void sigsegv_handler (int signal_number);
 int geoid_adjust(const char *input, const char *output);
 void test_geoid(void);
 
-// Prototype from combine.c
+// Prototypes from combine.c
 int combine(char **infiles, int n_inputs, char *outfile);
+int combine_ext(char **infiles, int n_inputs, char *outfile,
+                overlap_method_t overlap);
 
 // Prototypes from geoid.c
 float get_geoid_height(double lat, double lon);
 
+// Geoid heights on a sparse grid of pixels of an image, see geoid.c
+typedef struct {
+  int line_count;       // size of the image
+  int sample_count;
+  int spacing;          // pixels between grid nodes
+  int grid_lines;       // size of the grid
+  int grid_samples;
+  float *height;        // geoid height at the nodes
+} geoid_grid_t;
+
+geoid_grid_t *geoid_grid_new(meta_parameters *meta);
+void geoid_grid_get_line(const geoid_grid_t *grid, int line, float *heights);
+void geoid_grid_free(geoid_grid_t *grid);
+
 // Prototypes from clip.c
 int clip(char *inFile, char *maskFile, char *outFile);
@@ -4,7 +4,6 @@
 #include "asf.h"
 #include "asf_meta.h"
 #include "asf_raster.h"
-#include "float_image.h"
 #include "asf_geocode.h"
 
 #include "asf_contact.h"
@@ -13,9 +12,6 @@
 
 #define ASF_NAME_STRING "mosaic"
 
-static const float_image_byte_order_t fibo_be =
-    FLOAT_IMAGE_BYTE_ORDER_BIG_ENDIAN;
-
 static void print_proj_info(meta_parameters *meta)
 {
     project_parameters_t pp = meta->projection->param;
@@ -255,68 +251,131 @@ static void determine_extents(char **infiles, int n_inputs,
     meta_free(meta0);
 }
 
-static void add_pixels(FloatImage *out, char *file,
-                       double start_x, double start_y,
-                       double per_x, double per_y)
+// Output blocks are sized to hold roughly this many pixels
+#define COMBINE_BLOCK_PIXELS (8*1024*1024)
+
+// Footprint of an input image in the combined image
+typedef struct {
+    char *file;
+    meta_parameters *meta;
+    int start_line;
+    int start_sample;
+} combine_input_t;
+
+// A block of output lines, and the input lines being added to it
+typedef struct {
+    overlap_method_t overlap;
+    int size_x;
+    int first_line;        // combined image line of the first block line
+    float *out;            // block of the combined image
+    int *count;            // number of values added to each output pixel
+    combine_input_t *in;   // input being added
+    float *in_lines;       // its lines covering the block
+    int in_first_line;     // input line of the first of those
+} combine_block_t;
+
+static void add_rows(void *data, int first_row, int last_row)
 {
-    meta_parameters *meta = meta_read(file);
-
-    if (!meta) {
-        asfPrintError("Couldn't read metadata for: %s!\n", file);
-    }
-
-    // figure out where in the giant image these pixels will go
-    int start_line, start_sample;
-
-    // this should work even if per_x / per_y are negative...
-    start_sample = (int) ((meta->projection->startX - start_x) / per_x + .5);
-    start_line = (int) ((meta->projection->startY - start_y) / per_y + .5);
-
+    combine_block_t *b = (combine_block_t *) data;
+    meta_parameters *meta = b->in->meta;
     int ns = meta->general->sample_count;
-    int nl = meta->general->line_count;
+    float no_data = meta->general->no_data;
+    int row, x;
 
-    asfPrintStatus("  Location in combined is S:%d-%d, L:%d-%d\n",
-        start_sample, start_sample + ns,
-        start_line, start_line + nl);
+    for (row=first_row; row<=last_row; ++row) {
+        int in_line = b->first_line + row - b->in->start_line;
+        const float *line = b->in_lines +
+            (long long)(in_line - b->in_first_line)*ns;
+        float *out = b->out + (long long)row*b->size_x + b->in->start_sample;
+        int *count = b->count + (long long)row*b->size_x + b->in->start_sample;
 
-    if (start_sample + ns > out->size_x || start_line + nl > out->size_y) {
-        asfPrintError("Image extents were not calculated correctly!\n");
-    }
+        for (x=0; x<ns; ++x) {
+            float v = line[x];
 
-    FILE *img = fopenImage(file, "rb");
-    if (!img) {
-        asfPrintError("Couldn't open image file: %s!\n", file);
+            // don't write out "no data" values
+            if (v == no_data)
+                continue;
+
+            if (count[x] == 0)
+                out[x] = v;
+            else if (b->overlap == MIN_OVERLAP && v < out[x])
+                out[x] = v;
+            else if (b->overlap == MAX_OVERLAP && v > out[x])
+                out[x] = v;
+            else if (b->overlap == AVG_OVERLAP)
+                out[x] += v;
+            // OVERLAY: the value already there came from an image listed
+            // earlier on the command line, and stays
+            ++count[x];
+        }
     }
+}
 
-    float *line = MALLOC(sizeof(float)*ns);
+static void average_rows(void *data, int first_row, int last_row)
+{
+    combine_block_t *b = (combine_block_t *) data;
+    long long ii;
 
-    int y;
-    for (y=0; y<nl; ++y) {
-        get_float_line(img, meta, y, line);
+    for (ii=(long long)first_row*b->size_x;
+         ii<(long long)(last_row+1)*b->size_x; ++ii)
+        if (b->count[ii] > 1)
+            b->out[ii] /= b->count[ii];
+}
 
-        int x;
-        for (x=0; x<ns; ++x) {
-            float v = line[x];
+// Adds the part of an input image that falls into the current block
+static void add_input(combine_block_t *b, combine_input_t *in, int lines)
+{
+    int ns = in->meta->general->sample_count;
+    int nl = in->meta->general->line_count;
+    int first = b->first_line > in->start_line ?
+        b->first_line : in->start_line;
+    int last = b->first_line + lines < in->start_line + nl ?
+        b->first_line + lines - 1 : in->start_line + nl - 1;
 
-            // don't write out "no data" values
-            if (v != meta->general->no_data)
-                float_image_set_pixel(out, x + start_sample, y + start_line, v);
-        }
+    if (last < first)
+        return;
 
-        asfLineMeter(y, nl);
+    FILE *img = fopenImage(in->file, "rb");
+    if (!img) {
+        asfPrintError("Couldn't open image file: %s!\n", in->file);
     }
 
+    b->in = in;
+    b->in_first_line = first - in->start_line;
+    b->in_lines = MALLOC(sizeof(float)*(last-first+1)*ns);
+    get_float_lines(img, in->meta, b->in_first_line, last-first+1,
+                    b->in_lines);
     fclose(img);
-    free(line);
-    meta_free(meta);
+
+    // Work only on the block lines this input covers
+    float *out = b->out;
+    int *count = b->count;
+    int first_line = b->first_line;
+    b->out += (long long)(first - first_line)*b->size_x;
+    b->count += (long long)(first - first_line)*b->size_x;
+    b->first_line = first;
+    parallel_rows(last-first+1, add_rows, b);
+    b->out = out;
+    b->count = count;
+    b->first_line = first_line;
+
+    FREE(b->in_lines);
 }
 
-int combine(char **infiles, int n_inputs, char *outfile)
+int combine_ext(char **infiles, int n_inputs, char *outfile,
+                overlap_method_t overlap)
 {
-  int ret, ii, size_x, size_y;
+  int ii, size_x, size_y, n_used, block_lines, line, lines;
   double start_x, start_y;
   double per_x, per_y;
 
+  if (overlap == NEAR_RANGE_OVERLAP) {
+      asfPrintWarning("Overlap method 'NEAR RANGE' is not supported when "
+                      "combining geocoded images.\nDefaulting to OVERLAY and "
+                      "continuing...\n");
+      overlap = OVERLAY_OVERLAP;
+  }
+
   // Determine image parameters
   determine_extents(infiles, n_inputs, &size_x, &size_y, &start_x, &start_y,
 		    &per_x, &per_y);
@@ -324,19 +383,40 @@ int combine(char **infiles, int n_inputs, char *outfile)
   asfPrintStatus("\nCombined image size: %dx%d LxS\n", size_y, size_x);
   asfPrintStatus("  Start X,Y: %f,%f\n", start_x, start_y);
   asfPrintStatus("    Per X,Y: %lg,%lg\n", per_x, per_y);
-  
-  // float_image will handle cacheing of the large output image
-  FloatImage *out = float_image_new(size_x, size_y);
-  
-  // loop over the input images, last to first, so that the files listed
-  // first have their pixels overwrite files listed later on the command line
-  for (ii=n_inputs-1; ii>=0; ii--) {
-    asfPrintStatus("\nProcessing %s... \n", infiles[ii]);
-      
-    // Add this image's pixels
-    add_pixels(out, infiles[ii], start_x, start_y, per_x, per_y);
+
+  // Figure out where in the combined image each input goes.  Images that
+  // determine_extents() rejected have been set to NULL.
+  combine_input_t *in = MALLOC(sizeof(combine_input_t)*n_inputs);
+  for (ii=0, n_used=0; ii<n_inputs; ii++) {
+    if (!infiles[ii])
+      continue;
+    meta_parameters *meta = meta_read(infiles[ii]);
+    if (!meta) {
+        asfPrintError("Couldn't read metadata for: %s!\n", infiles[ii]);
+    }
+
+    // this should work even if per_x / per_y are negative...
+    in[n_used].file = infiles[ii];
+    in[n_used].meta = meta;
+    in[n_used].start_sample =
+        (int) ((meta->projection->startX - start_x) / per_x + .5);
+    in[n_used].start_line =
+        (int) ((meta->projection->startY - start_y) / per_y + .5);
+
+    asfPrintStatus("  %s: location in combined is S:%d-%d, L:%d-%d\n",
+        infiles[ii], in[n_used].start_sample,
+        in[n_used].start_sample + meta->general->sample_count,
+        in[n_used].start_line,
+        in[n_used].start_line + meta->general->line_count);
+
+    if (in[n_used].start_sample < 0 || in[n_used].start_line < 0 ||
+        in[n_used].start_sample + meta->general->sample_count > size_x ||
+        in[n_used].start_line + meta->general->line_count > size_y) {
+        asfPrintError("Image extents were not calculated correctly!\n");
+    }
+    n_used++;
   }
-  
+
   asfPrintStatus("Writing metadata.\n");
   
   meta_parameters *meta_out = meta_read(infiles[0]);
@@ -345,17 +425,58 @@ int combine(char **infiles, int n_inputs, char *outfile)
   meta_out->projection->startY = start_y;
   meta_out->general->line_count = size_y;
   meta_out->general->sample_count = size_x;
+  meta_out->general->band_count = 1;
+  meta_out->general->data_type = REAL32;
   
   meta_write(meta_out, outfile);
-  meta_free(meta_out);
+
+  // The combined image is built one block of lines at a time, adding the
+  // inputs that overlap the block in command line order.  Pixels no input
+  // covers are left at zero.
+  block_lines = COMBINE_BLOCK_PIXELS / size_x;
+  if (block_lines < 1) block_lines = 1;
+  if (block_lines > size_y) block_lines = size_y;
+
+  combine_block_t b;
+  b.overlap = overlap;
+  b.size_x = size_x;
+  b.out = MALLOC(sizeof(float)*block_lines*size_x);
+  b.count = MALLOC(sizeof(int)*block_lines*size_x);
 
   char *outfile_full = appendExt(outfile, ".img");
   asfPrintStatus("Saving image (%s).\n", outfile_full);
-  ret = float_image_store(out, outfile_full, fibo_be);
-  if (ret!=0) 
-    asfPrintError("Error storing output image!\n");
-  float_image_free(out);
+  FILE *fp = FOPEN(outfile_full, "wb");
+  for (line=0; line<size_y; line+=lines) {
+    lines = size_y - line < block_lines ? size_y - line : block_lines;
+
+    memset(b.out, 0, sizeof(float)*lines*size_x);
+    memset(b.count, 0, sizeof(int)*lines*size_x);
+    b.first_line = line;
+    for (ii=0; ii<n_used; ii++)
+      add_input(&b, &in[ii], lines);
+    if (overlap == AVG_OVERLAP)
+      parallel_rows(lines, average_rows, &b);
+
+    put_float_lines(fp, meta_out, line, lines, b.out);
+    for (ii=line; ii<line+lines; ii++)
+      asfLineMeter(ii, size_y);
+  }
+  FCLOSE(fp);
+
+  for (ii=0; ii<n_used; ii++)
+    meta_free(in[ii].meta);
+  FREE(in);
+  FREE(b.out);
+  FREE(b.count);
+  meta_free(meta_out);
   free(outfile_full);
   
-  return ret;
+  return 0;
+}
+
+int combine(char **infiles, int n_inputs, char *outfile)
+{
+  // files listed first have their pixels overwrite files listed later on
+  // the command line
+  return combine_ext(infiles, n_inputs, outfile, OVERLAY_OVERLAP);
 }
@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <glib.h>
 
 //#define geoid_height_at(x,y) *(geoid_heights + y*w + x)
 static const int w=1440;
@@ -20,27 +21,49 @@ static float geoid_height_at(int x, int y)
     return *(geoid_heights + y*w + x);
 }
 
-static int read_geoid(void)
+// The heights are stored as big-endian 16 bit integers, in centimeters
+static float *read_geoid(void)
 {
-    int x,y;
+    float *heights = MALLOC(sizeof(float)*w*h);
+    unsigned char *buf = MALLOC(2*w*h);
+    int ii;
+
     FILE *f=fopen_share_file("WW15MGH.DAC","rb");
-    for (y=0;y<h;y++)
-	for (x=0;x<w;x++) {
-            signed char hi=fgetc(f);
-            unsigned char lo=fgetc(f);
-            float height=((hi<<8)+lo)*(1.0/100);
-            *(geoid_heights + y*w + x) = height;
-	}
+    if (!f)
+        asfPrintError("Couldn't open the geoid file (WW15MGH.DAC)\n");
+    FREAD(buf, 2, w*h, f);
     fclose(f);
-    return 0;
+
+    for (ii=0; ii<w*h; ii++) {
+        signed char hi=buf[2*ii];
+        unsigned char lo=buf[2*ii+1];
+        heights[ii]=(hi*256+lo)*(1.0/100);
+    }
+    FREE(buf);
+
+    return heights;
+}
+
+// The geoid is read once, by whichever thread gets here first.  The
+// heights pointer is only published (atomically) once it is filled in,
+// so threads that find it set don't need the lock.
+static void load_geoid(void)
+{
+    static GStaticMutex geoid_mutex = G_STATIC_MUTEX_INIT;
+
+    if (g_atomic_pointer_get((gpointer *) &geoid_heights))
+        return;
+
+    g_static_mutex_lock(&geoid_mutex);
+    if (!g_atomic_pointer_get((gpointer *) &geoid_heights))
+        g_atomic_pointer_compare_and_exchange((gpointer *) &geoid_heights,
+                                              NULL, read_geoid());
+    g_static_mutex_unlock(&geoid_mutex);
 }
 
 float get_geoid_height(double lat, double lon)
 {
-    if (!geoid_heights) {
-        geoid_heights = MALLOC(sizeof(float)*w*h);
-        read_geoid();
-    }
+    load_geoid();
 
     if (lon < 0) lon += 360;
 
@@ -66,6 +89,9 @@ float get_geoid_height(double lat, double lon)
     int x1 = x0 + 1;
     double xf = x-x0;
 
+    // between 359.75 and 360 degrees East we interpolate towards 0 East
+    if (x1 >= w) x1 -= w;
+
     return
          xf     * yf     * geoid_height_at(x1,y1) +
          (1-xf) * yf     * geoid_height_at(x0,y1) +
@@ -73,8 +99,154 @@ float get_geoid_height(double lat, double lon)
          (1-xf) * (1-yf) * geoid_height_at(x0,y0);
 }
 
+/****************************************************************
+   Geoid heights for every pixel of an image.
+
+   The geoid is smooth, so the geoid height only needs to be looked
+   up exactly on a sparse grid of nodes, and can be interpolated
+   bilinearly in between.  Before the grid is used, it is checked
+   against the exact geoid height in the middle of every grid cell,
+   and made denser if it is off by more than GEOID_GRID_TOLERANCE.
+
+   Once built, geoid_grid_get_line() only reads the grid, so it may
+   be called from several threads at once.
+****************************************************************/
+
+// Spacing of the first grid tried, in pixels, and the largest error
+// (in meters) allowed
+#define GEOID_GRID_SPACING 32
+#define GEOID_GRID_TOLERANCE 0.01
+
+static float exact_geoid_height(meta_parameters *meta, double line,
+                                double sample)
+{
+    double lat, lon;
+
+    if (meta_get_latLon(meta, line, sample, 0.0, &lat, &lon))
+        return 0.0;
+    return get_geoid_height(lat, lon);
+}
+
+// Position of grid node ii (the last node is on the last pixel)
+static int node_pos(int ii, int spacing, int count)
+{
+    return ii*spacing < count - 1 ? ii*spacing : count - 1;
+}
+
+// Grid node before the pixel, and the offset towards the next one
+static int grid_cell(int pos, int spacing, int count, int nodes, float *t)
+{
+    int ii = pos / spacing;
+    if (ii > nodes - 2) ii = nodes - 2;
+    if (ii < 0) ii = 0;
+    int p0 = node_pos(ii, spacing, count);
+    int p1 = node_pos(ii + 1, spacing, count);
+    *t = p1 > p0 ? (float)(pos - p0) / (p1 - p0) : 0.0;
+    return ii;
+}
+
+static double build_geoid_grid(geoid_grid_t *grid, meta_parameters *meta,
+                               int spacing)
+{
+    int nl = grid->line_count, ns = grid->sample_count;
+    int ii, kk;
+    double max_error = 0.0;
+
+    grid->spacing = spacing;
+    grid->grid_lines = (nl - 1 + spacing - 1) / spacing + 1;
+    grid->grid_samples = (ns - 1 + spacing - 1) / spacing + 1;
+    if (grid->grid_lines < 2) grid->grid_lines = 2;
+    if (grid->grid_samples < 2) grid->grid_samples = 2;
+
+    FREE(grid->height);
+    grid->height =
+        MALLOC(sizeof(float)*grid->grid_lines*grid->grid_samples);
+    for (ii=0; ii<grid->grid_lines; ii++)
+        for (kk=0; kk<grid->grid_samples; kk++)
+            grid->height[ii*grid->grid_samples + kk] =
+                exact_geoid_height(meta, node_pos(ii, spacing, nl),
+                                   node_pos(kk, spacing, ns));
+
+    if (spacing == 1)
+        return 0.0;
+
+    // Check the interpolation in the middle of the cells
+    float *row = MALLOC(sizeof(float)*ns);
+    for (ii=0; ii<grid->grid_lines-1; ii++) {
+        int line = (node_pos(ii, spacing, nl) + node_pos(ii+1, spacing, nl))/2;
+        geoid_grid_get_line(grid, line, row);
+        for (kk=0; kk<grid->grid_samples-1; kk++) {
+            int sample =
+                (node_pos(kk, spacing, ns) + node_pos(kk+1, spacing, ns))/2;
+            double error = fabs(row[sample] -
+                                exact_geoid_height(meta, line, sample));
+            if (error > max_error)
+                max_error = error;
+        }
+    }
+    FREE(row);
+
+    return max_error;
+}
+
+geoid_grid_t *geoid_grid_new(meta_parameters *meta)
+{
+    geoid_grid_t *grid = MALLOC(sizeof(geoid_grid_t));
+    int spacing;
+
+    grid->line_count = meta->general->line_count;
+    grid->sample_count = meta->general->sample_count;
+    grid->height = NULL;
+
+    for (spacing=GEOID_GRID_SPACING; spacing>1; spacing/=2) {
+        double error = build_geoid_grid(grid, meta, spacing);
+        if (error <= GEOID_GRID_TOLERANCE)
+            return grid;
+        asfPrintStatus("Geoid grid with %d pixel spacing is off by up to "
+                       "%.3f m, refining ...\n", spacing, error);
+    }
+    build_geoid_grid(grid, meta, 1);
+
+    return grid;
+}
+
+void geoid_grid_free(geoid_grid_t *grid)
+{
+    if (grid) {
+        FREE(grid->height);
+        FREE(grid);
+    }
+}
+
+void geoid_grid_get_line(const geoid_grid_t *grid, int line, float *heights)
+{
+    int nc = grid->grid_samples;
+    int spacing = grid->spacing;
+    int ns = grid->sample_count;
+    float tl;
+    int r, c, kk;
+
+    r = grid_cell(line, spacing, grid->line_count, grid->grid_lines, &tl);
+    const float *h0 = grid->height + r*nc;
+    const float *h1 = h0 + nc;
+
+    for (c=0; c<nc-1; c++) {
+        int first = node_pos(c, spacing, ns);
+        int last = node_pos(c+1, spacing, ns);
+        float a = h0[c] + tl*(h1[c] - h0[c]);
+        float b = h0[c+1] + tl*(h1[c+1] - h0[c+1]);
+        float step = last > first ? (b - a) / (last - first) : 0.0;
+        for (kk=first; kk<last; kk++)
+            heights[kk] = a + (kk - first)*step;
+    }
+    // the last node sits on the last pixel
+    heights[ns-1] = h0[nc-1] + tl*(h1[nc-1] - h0[nc-1]);
+}
+
 void test_geoid(void)
 {
+    load_geoid();
+
     float f = get_geoid_height(0,0);
     if (fabs(f - 17.16) > .0001)
       asfPrintWarning("Unexpected value at 0,0 should be 17.15: %f\n", f);
@@ -218,7 +218,9 @@ int asf_import(radiometry_t radiometry, int db_flag, int complex_flag,
       asfPrintError("Calibration currently does not support BETA values!\n");
     else if (radiometry == r_SIGMA || radiometry == r_SIGMA_DB)
       asfPrintError("Calibration currently does not support SIGMA values!\n");
-    import_uavsar(inBaseName, line, sample, width, height, 
+    import_uavsar(inBaseName, line, sample, width, height,
+		  multilook_flag ? azimuth_look_count : 1,
+		  multilook_flag ? range_look_count : 1,
 		  update(radiometry, db_flag), uavsar_type, outBaseName);
   }
   else if (format_type == VP) {
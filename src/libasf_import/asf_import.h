@@ -103,10 +103,12 @@ meta_parameters *import_airsar_meta(const char *dataName,
 				    const char *inBaseName, int force);
 void read_meta_airsar(char *inBaseName, char *outBaseName);
 void import_uavsar(const char *inFileName, int line, int sample, int width,
-		   int height, radiometry_t radiometry,
-		   const char *data_type, const char *outBaseName);
+		   int height, int azimuth_looks, int range_looks,
+		   radiometry_t radiometry, const char *data_type,
+		   const char *outBaseName);
 void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
-		       int height, radiometry_t radiometry, int firstBandOnly,
+		       int height, int azimuth_looks, int range_looks,
+		       radiometry_t radiometry, int firstBandOnly,
 		       const char *data_type, const char *outBaseName);
 
 void import_gamma_isp(const char *inDataName, const char *inMetaName,
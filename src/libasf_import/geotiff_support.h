@@ -27,6 +27,39 @@ typedef struct {
   short samples_per_pixel;
 } tiff_data_config_t;
 
+// Decodes a TIFF image in blocks of whole strips or tile rows (see
+// tiff_block_reader.c).  data[band] holds rows x width floats starting
+// at image row first_row.
+typedef struct {
+  TIFF **handle;          // handle[0] is the caller's, one per worker
+  int handle_count;
+  unsigned char **unit_buf;
+  tiff_type_t info;
+  uint32 width;
+  uint32 height;
+  int num_bands;
+  int samples_per_pixel;
+  short bits_per_sample;
+  short sample_format;
+  short planar_config;
+  int unit_rows;          // rows per strip or tile
+  int block_rows;         // rows per block, a multiple of unit_rows
+  int unit_count;         // strips or tiles in the current block
+  int first_row;
+  int rows;
+  float **data;
+  int error;
+} tiff_block_reader_t;
+
+// Running statistics of one band
+typedef struct {
+  double min;
+  double max;
+  double mean;
+  double s;
+  long long count;
+} tiff_stats_t;
+
 #include "asf_meta.h"
 
 int PCS_2_UTM (short  pcs, char *hem, datum_type_t *datum,  unsigned long *zone);
@@ -48,5 +81,21 @@ void ReadScanline_from_TIFF_TileRow(TIFF *tif, tdata_t buf, unsigned long row, i
 meta_parameters * read_generic_geotiff_metadata(const char *inFileName,
                              int *ignore, ...);
 int isGeotiff(const char *file);
+void tiff_image_statistics(TIFF *tif, meta_stats *stats, int *invalid,
+                           int is_dem, int num_bands,
+                           short bits_per_sample, short sample_format,
+                           short planar_config,
+                           int use_mask_value, double mask_value);
+
+tiff_block_reader_t *tiff_block_reader_new(TIFF *tif, int num_bands,
+                                           short bits_per_sample,
+                                           short sample_format,
+                                           short planar_config);
+int tiff_block_reader_read(tiff_block_reader_t *r, int first_row);
+void tiff_block_reader_free(tiff_block_reader_t *r);
+void tiff_stats_init(tiff_stats_t *acc);
+void tiff_block_stats_add(tiff_block_reader_t *r, int band, int is_dem,
+                          int use_mask, double mask, tiff_stats_t *acc);
+int tiff_stats_finish(const tiff_stats_t *acc, meta_stats *stats);
 
 #endif
@@ -7,6 +7,7 @@
 #include "dateUtil.h"
 #include <ctype.h>
 #include <assert.h>
+#include <glib.h>
 
 #define MAX_tableRes 512
 #define MAX_IMG_SIZE 100000
@@ -1248,6 +1249,377 @@ static float apply_ers2_gain_fix(radiometry_t radiometry, float correction,
 }
 
 // Import all flavors of detected data
+// Input records are read in blocks of about this many lines.  While one
+// block is being converted (by several threads) and written, the next
+// one is read by a separate thread.
+#define CEOS_BLOCK_LINES 256
+
+typedef struct {
+  FILE *fp;
+  long long offset;       // file offset of the sample data of line 0
+  int reclen;             // record length, i.e. line to line distance
+  int line_bytes;         // bytes of sample data in a record
+  int first_line;         // first line held in raw
+  int lines;              // number of lines held in raw
+  unsigned char *raw;     // records as read, line ll at raw + ll*reclen
+  size_t bytes_read;      // what read_ceos_block got
+} ceos_block_t;
+
+static size_t ceos_block_bytes(const ceos_block_t *b)
+{
+  return (size_t)(b->lines-1)*b->reclen + b->line_bytes;
+}
+
+// One pass over a block reads all its records at once, the record
+// headers and trailers are skipped when the lines are decoded.  The
+// seek is done on the main thread, where FSEEK64 may report errors; the
+// read may run on the reader thread, so it uses plain fread and leaves
+// the checking to check_ceos_block.
+static void seek_ceos_block(ceos_block_t *b)
+{
+  FSEEK64(b->fp, b->offset + (long long)b->first_line*b->reclen, SEEK_SET);
+}
+
+static void read_ceos_block(ceos_block_t *b)
+{
+  b->bytes_read = fread(b->raw, 1, ceos_block_bytes(b), b->fp);
+}
+
+static gpointer read_ceos_block_thread(gpointer data)
+{
+  read_ceos_block((ceos_block_t *) data);
+  return NULL;
+}
+
+static void check_ceos_block(const ceos_block_t *b, const char *inDataName)
+{
+  if (b->bytes_read != ceos_block_bytes(b))
+    asfPrintError("Could not read lines %d to %d of %s (got %ld of %ld "
+                  "bytes)\n", b->first_line+1, b->first_line+b->lines,
+                  inDataName, (long) b->bytes_read,
+                  (long) ceos_block_bytes(b));
+}
+
+// Everything the conversion of a block of lines needs
+typedef struct {
+  meta_parameters *meta;
+  data_type_t data_type;
+  radiometry_t radiometry;
+  char *bandExt;
+  int ns;                 // samples per input line
+  int out_ns;             // samples per output line
+  int flip, projected, db_flag;
+  int calibrate;          // radiometry is one of the calibrated ones
+  int alos_optical, leftFill;
+  int multilook;          // complex data that is multilooked
+  int complex_flag;
+  int nAzimuthLooks, nRangeLooks;
+  int ers2_fix;           // apply the ERS2 gain fix
+  float gain_adj;
+  float *incid;
+  double *cal_a, *cal_b;  // per-sample calibration, NULL if not tabulated
+  int use_lut, lut_min, lut_max;
+  double *incid_table, *scale_table;
+  ceos_block_t *block;
+  int first_out_line;     // output line of the first chunk in the block
+  float *amp, *phase;     // output lines of the block
+  complexFloat *cpx;
+  // First calibration failure in a worker (a CAL_* code), and its
+  // sample.  The workers can't report it themselves (see parallel.c),
+  // the main thread does once the block is done.
+  gint cal_status;
+  int cal_sample;
+} ceos_convert_t;
+
+static int ceos_sample_size(data_type_t data_type)
+{
+  switch (data_type) {
+    case ASF_BYTE:          return 1;
+    case INTEGER16:         return 2;
+    case INTEGER32:         return 4;
+    case REAL32:            return 4;
+    case REAL64:            return 8;
+    case COMPLEX_BYTE:      return 2;
+    case COMPLEX_INTEGER16: return 4;
+    case COMPLEX_INTEGER32: return 8;
+    case COMPLEX_REAL32:    return 8;
+    case COMPLEX_REAL64:    return 16;
+  }
+  return 0;
+}
+
+// Decodes the big endian samples of an input line, flipping it if needed.
+// For complex data the imaginary parts go into im.
+static void decode_ceos_line(ceos_convert_t *c, int line, double *re,
+                             double *im)
+{
+  const unsigned char *p = c->block->raw +
+    (long long)(line - c->block->first_line)*c->block->reclen;
+  int kk, ns = c->ns;
+
+  for (kk=0; kk<ns; kk++) {
+    int src = c->flip ? ns-kk-1 : kk;
+    switch (c->data_type) {
+      case ASF_BYTE:
+        re[kk] = p[src];
+        break;
+      case INTEGER16: {
+        unsigned short v;
+        memcpy(&v, p + 2*src, 2);
+        big16(v);
+        re[kk] = v;
+        break;
+      }
+      case INTEGER32: {
+        int v;
+        memcpy(&v, p + 4*src, 4);
+        big32(v);
+        re[kk] = v;
+        break;
+      }
+      case REAL32: {
+        float v;
+        memcpy(&v, p + 4*src, 4);
+        big32(v);
+        re[kk] = v;
+        break;
+      }
+      case REAL64: {
+        double v;
+        memcpy(&v, p + 8*src, 8);
+        big64(v);
+        re[kk] = v;
+        break;
+      }
+      case COMPLEX_BYTE:
+        re[kk] = p[2*src];
+        im[kk] = p[2*src+1];
+        break;
+      case COMPLEX_INTEGER16: {
+        short v[2];
+        memcpy(v, p + 4*src, 4);
+        big16(v[0]);
+        big16(v[1]);
+        re[kk] = v[0];
+        im[kk] = v[1];
+        break;
+      }
+      case COMPLEX_INTEGER32: {
+        int v[2];
+        memcpy(v, p + 8*src, 8);
+        big32(v[0]);
+        big32(v[1]);
+        re[kk] = v[0];
+        im[kk] = v[1];
+        break;
+      }
+      case COMPLEX_REAL32: {
+        float v[2];
+        memcpy(v, p + 8*src, 8);
+        big32(v[0]);
+        big32(v[1]);
+        re[kk] = v[0];
+        im[kk] = v[1];
+        break;
+      }
+      case COMPLEX_REAL64: {
+        double v[2];
+        memcpy(v, p + 16*src, 16);
+        big64(v[0]);
+        big64(v[1]);
+        re[kk] = v[0];
+        im[kk] = v[1];
+        break;
+      }
+    }
+  }
+}
+
+static double ceos_incidence(ceos_convert_t *c, int line, int sample)
+{
+  if (c->projected)
+    return quadratic_2_incidence_angle(line, sample, c->incid);
+  else
+    return c->incid[sample];
+}
+
+// Calibrated value of an amplitude, using the per-sample table if we have
+// one (this is what get_cal_dn computes, without redoing the calibration
+// lookups for every pixel).  Runs in the workers, so failures are
+// recorded for the main thread rather than reported.
+static float ceos_cal_value(ceos_convert_t *c, int line, int sample,
+                            int incid_sample, float dn)
+{
+  float value;
+  int status;
+
+  if (c->cal_a) {
+    double scaledPower = c->cal_a[sample]*dn*dn + c->cal_b[sample];
+    return c->db_flag ? 10.0 * log10(scaledPower) : scaledPower;
+  }
+  status = cal_dn(c->meta, ceos_incidence(c, line, incid_sample), sample,
+                  dn, c->bandExt, c->db_flag, &value);
+  if (status != CAL_OK &&
+      g_atomic_int_compare_and_exchange(&c->cal_status, CAL_OK, status))
+    c->cal_sample = sample;
+  return value;
+}
+
+static void convert_detected_line(ceos_convert_t *c, int line,
+                                  const double *v, float *amp)
+{
+  int kk, mm;
+
+  for (kk=0; kk<c->out_ns; kk++) {
+    if (c->use_lut) {
+      double *incid_table = c->incid_table, *scale_table = c->scale_table;
+      double incidence_angle = ceos_incidence(c, line, kk);
+      amp[kk] = 0.0;
+      for (mm = c->lut_min; mm <= c->lut_max; mm++) {
+        if (incidence_angle < incid_table[mm])
+          break;
+        amp[kk] = (float) v[kk] *
+          (((scale_table[mm]-scale_table[mm]) /
+            (incid_table[mm]-incid_table[mm])) *
+           (incidence_angle - incid_table[mm-1]) * scale_table[mm-1]);
+      }
+    }
+    else if (c->calibrate)
+      amp[kk] = ceos_cal_value(c, line, kk, kk, (float) v[kk]);
+    else if (c->radiometry == r_POWER)
+      amp[kk] = (float) (v[kk]*v[kk]);
+    else if (c->alos_optical)
+      amp[kk] = kk+c->leftFill >= c->ns ? 0.0 : (float) v[kk+c->leftFill];
+    else
+      amp[kk] = (float) v[kk];
+
+    if (c->ers2_fix)
+      amp[kk] = apply_ers2_gain_fix(c->radiometry, c->gain_adj, amp[kk]);
+  }
+}
+
+static void convert_complex_line(ceos_convert_t *c, int line,
+                                 const double *re, const double *im,
+                                 float *amp, float *phase, complexFloat *cpx)
+{
+  int kk;
+
+  for (kk=0; kk<c->out_ns; kk++) {
+    complexFloat z;
+    z.real = (float) re[kk];
+    z.imag = (float) im[kk];
+    if (c->complex_flag) {
+      if (c->ers2_fix) {
+        // we need to convert back to polar, apply the correction to the
+        // amplitude, then convert back to cartesian
+        double a = hypot(z.real, z.imag);
+        double p = atan2(z.imag, z.real);
+        a = apply_ers2_gain_fix(c->radiometry, c->gain_adj, a);
+        z.real = a*cos(p);
+        z.imag = a*sin(p);
+      }
+      cpx[kk] = z;
+    }
+    else if (c->calibrate) {
+      float fValue = sqrt(z.real*z.real + z.imag*z.imag);
+      amp[kk] = ceos_cal_value(c, line, kk, kk, fValue);
+      phase[kk] = atan2(z.imag, z.real);
+    }
+    else if (z.real != 0.0 || z.imag != 0.0) {
+      amp[kk] = sqrt(z.real*z.real + z.imag*z.imag);
+      phase[kk] = atan2(z.imag, z.real);
+    }
+    else {
+      amp[kk] = 0.0;
+      phase[kk] = 0.0;
+    }
+    if (!c->complex_flag && c->ers2_fix)
+      amp[kk] = apply_ers2_gain_fix(c->radiometry, c->gain_adj, amp[kk]);
+  }
+}
+
+// Multilooks nAzimuthLooks complex lines (in re/im, ns apart) into one
+// output line
+static void multilook_complex_lines(ceos_convert_t *c, int line,
+                                    const double *re, const double *im,
+                                    float *amp, float *phase,
+                                    complexFloat *cpx)
+{
+  int alc = c->nAzimuthLooks, ns = c->ns;
+  int idx, mm, nn;
+
+  for (idx=0; idx<c->out_ns; idx++) {
+    int kk = idx*c->nRangeLooks;
+    int rlc = c->nRangeLooks;
+    if (kk + rlc > ns)
+      rlc = ns - kk;
+    float sum = 0.0;
+    complexFloat z;
+    z.real = z.imag = 0;
+    for (mm = 0; mm < alc; mm++) {
+      for (nn = 0; nn < rlc; nn++) {
+        float r = (float) re[mm*ns + kk + nn];
+        float i = (float) im[mm*ns + kk + nn];
+        z.real += r;
+        z.imag += i;
+        sum += r*r + i*i;
+      }
+    }
+    sum /= (float)(alc*rlc); // Average of the squares
+    z.real /= (float)(alc*rlc);
+    z.imag /= (float)(alc*rlc);
+    if (c->complex_flag && c->ers2_fix) {
+      double a = hypot(z.real, z.imag);
+      double p = atan2(z.imag, z.real);
+      a = apply_ers2_gain_fix(c->radiometry, c->gain_adj, a);
+      z.real = a*cos(p);
+      z.imag = a*sin(p);
+    }
+    cpx[idx] = z;
+    if (c->calibrate)
+      amp[idx] = ceos_cal_value(c, line + alc/2, kk + rlc/2,
+                                c->projected ? kk + rlc/2 : kk, sqrt(sum));
+    else
+      amp[idx] = sqrt(sum);
+    if (!c->complex_flag && c->ers2_fix)
+      amp[idx] = apply_ers2_gain_fix(c->radiometry, c->gain_adj, amp[idx]);
+    phase[idx] = atan2(z.imag, z.real);
+  }
+}
+
+// Converts the chunks (output lines) first..last of the current block
+static void convert_ceos_chunks(void *data, int first, int last)
+{
+  ceos_convert_t *c = (ceos_convert_t *) data;
+  int chunk_lines = c->multilook ? c->nAzimuthLooks : 1;
+  int is_complex = c->data_type >= COMPLEX_BYTE;
+  double *re = (double *) MALLOC(sizeof(double)*chunk_lines*c->ns);
+  double *im = is_complex ?
+    (double *) MALLOC(sizeof(double)*chunk_lines*c->ns) : NULL;
+  int chunk, ll;
+
+  for (chunk=first; chunk<=last; chunk++) {
+    int out_line = c->first_out_line + chunk;
+    int line = out_line*chunk_lines;
+    long long off = (long long)chunk*c->out_ns;
+    for (ll=0; ll<chunk_lines; ll++)
+      decode_ceos_line(c, line+ll, re + (long long)ll*c->ns,
+                       is_complex ? im + (long long)ll*c->ns : NULL);
+    if (!is_complex)
+      convert_detected_line(c, line, re, c->amp + off);
+    else if (c->multilook)
+      multilook_complex_lines(c, line, re, im, c->amp + off,
+                              c->phase + off, c->cpx + off);
+    else
+      convert_complex_line(c, line, re, im, c->amp + off,
+                           c->phase + off, c->cpx + off);
+  }
+
+  FREE(re);
+  if (im)
+    FREE(im);
+}
+
 void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                       char *outMetaName, char *bandExt, int band, int nBands,
                       int nBandsOut, radiometry_t radiometry,
@@ -1258,32 +1630,16 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
                       int apply_ers2_gain_fix_flag)
 {
   FILE *fpIn=NULL;
-  int nl, ns, alc, rlc, nAzimuthLooks, nRangeLooks, flip=FALSE;
+  int nl, ns, nAzimuthLooks, nRangeLooks, flip=FALSE;
   int leftFill, rightFill, headerBytes;
-  int out = 0;
   int min, max;
   int projected = 0; // Set to true if data is geocoded
-  long long ii, kk, ll, mm, nn, offset;
-  float fValue;
+  long long ii, kk;
   double *incid_table, *scale_table;
   struct IOF_VFDR image_fdr;
   meta_parameters *meta;
   data_type_t data_type;
-
-  // input buffers
-  unsigned char *byte_buf=NULL, *cpx_byte_buf=NULL, *tmp_byte_buf=NULL;
-  unsigned short *short_buf=NULL, *tmp_short_buf=NULL;
-  short *cpx_short_buf=NULL, *tmp_cpx_short_buf=NULL;
-  int *int_buf=NULL, *cpx_int_buf=NULL, *tmp_int_buf=NULL;
-  float *float_buf=NULL, *cpx_float_buf=NULL, *tmp_float_buf=NULL;
-  double *double_buf=NULL, *cpx_double_buf=NULL, *tmp_double_buf=NULL;
-
-  // output buffers
-  unsigned char *amp_byte_buf=NULL;
-  float *amp_float_buf=NULL;
-  float *phase_float_buf=NULL;
   float *incid=NULL;
-  complexFloat cpx, *cpxFloat_buf=NULL, *cpx_float_ml_buf=NULL;
 
   // Output file will stay open through multiple calls to this function.
   // We open it on first call, try to close it on the last call.
@@ -1375,20 +1731,20 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   nl = meta->general->line_count;
   ns = meta->general->sample_count;
   if (azimuth_look_count > 0)
-    alc = nAzimuthLooks = azimuth_look_count;
+    nAzimuthLooks = azimuth_look_count;
   else {
     if (meta->sar)
-      alc = nAzimuthLooks = meta->sar->azimuth_look_count;
+      nAzimuthLooks = meta->sar->azimuth_look_count;
     else
-      alc = nAzimuthLooks = 1;
+      nAzimuthLooks = 1;
   }
   if (range_look_count > 0)
-    rlc = nRangeLooks = range_look_count;
+    nRangeLooks = range_look_count;
   else {
     if (meta->sar)
-      rlc = nRangeLooks = meta->sar->range_look_count;
+      nRangeLooks = meta->sar->range_look_count;
     else
-      rlc = nRangeLooks = 1;
+      nRangeLooks = 1;
   }
 
   // PP Earth Radius Kludge
@@ -1495,88 +1851,39 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     fpOut = fopenImage(outDataName, "wb");
   }
 
-  // Allocate memory for input buffers
   switch (data_type) {
     case ASF_BYTE:
-      byte_buf = (unsigned char *) CALLOC(ns, sizeof(unsigned char));
-      tmp_byte_buf = (unsigned char *) CALLOC(ns, sizeof(unsigned char));
       asfPrintStatus("   Data type: BYTE\n");
       break;
     case INTEGER16:
-      short_buf = (unsigned short *) CALLOC(ns, sizeof(unsigned short));
-      tmp_short_buf = (unsigned short *) CALLOC(ns, sizeof(unsigned short));
       asfPrintStatus("   Data type: INTEGER16\n");
       break;
     case INTEGER32:
-      int_buf = (int *) CALLOC(ns, sizeof(int));
-      tmp_int_buf = (int *) CALLOC(ns, sizeof(int));
       asfPrintStatus("   Data type: INTEGER32\n");
       break;
     case REAL32:
-      float_buf = (float *) CALLOC(ns, sizeof(float));
-      tmp_float_buf = (float *) CALLOC(ns, sizeof(float));
       asfPrintStatus("   Data type: REAL32\n");
       break;
     case REAL64:
-      double_buf = (double *) CALLOC(ns, sizeof(double));
-      tmp_double_buf = (double *) CALLOC(ns, sizeof(double));
       asfPrintStatus("   Data type: REAL64\n");
       break;
     case COMPLEX_BYTE:
-      cpx_byte_buf = (unsigned char *) CALLOC(2*ns*alc, sizeof(unsigned char));
-      tmp_byte_buf =  (unsigned char *) CALLOC(2*ns*alc, sizeof(unsigned char));
       asfPrintStatus("   Data type: COMPLEX_BYTE\n");
       break;
     case COMPLEX_INTEGER16:
-      cpx_short_buf = (short *) CALLOC(2*ns*alc, sizeof(short));
-      tmp_cpx_short_buf = (short *) CALLOC(2*ns*alc, sizeof(short));
       asfPrintStatus("   Data type: COMPLEX_INTEGER16\n");
       break;
     case COMPLEX_INTEGER32:
-      cpx_int_buf = (int *) CALLOC(2*ns*alc, sizeof(int));
-      tmp_int_buf = (int *) CALLOC(2*ns*alc, sizeof(int));
       asfPrintStatus("   Data type: COMPLEX_INTEGER32\n");
       break;
     case COMPLEX_REAL32:
-      cpx_float_buf = (float *) CALLOC(2*ns*alc, sizeof(float));
-      tmp_float_buf = (float *) CALLOC(2*ns*alc, sizeof(float));
       asfPrintStatus("   Data type: COMPLEX_REAL32\n");
       break;
     case COMPLEX_REAL64:
-      cpx_double_buf = (double *) CALLOC(2*ns*alc, sizeof(float));
-      tmp_double_buf = (double *) CALLOC(2*ns*alc, sizeof(float));
       asfPrintStatus("   Data type: COMPLEX_REAL64\n");
       break;
   }
 
-  // Allocate memory for output buffers
-  switch (data_type) {
-    case ASF_BYTE:
-        amp_float_buf = (float *) CALLOC(ns*alc, sizeof(float));
-        break;
-    case INTEGER16:
-    case INTEGER32:
-    case REAL32:
-    case REAL64:
-        amp_float_buf = (float *) CALLOC(ns*alc, sizeof(float));
-        break;
-    case COMPLEX_BYTE:
-    case COMPLEX_INTEGER16:
-    case COMPLEX_INTEGER32:
-    case COMPLEX_REAL32:
-        if (complex_flag && !multilook_flag) {
-	  cpxFloat_buf = (complexFloat *) CALLOC(ns*alc, sizeof(complexFloat));
-        }
-        else {
-            cpx_float_ml_buf = (complexFloat *) CALLOC(2*ns*alc, sizeof(float));
-            amp_float_buf = (float *) CALLOC(ns*alc, sizeof(float));
-            phase_float_buf = (float *) CALLOC(ns*alc, sizeof(float));
-        }
-        break;
-    case COMPLEX_REAL64:
-        break;
-  }
-
   // Figure out left fill and right fill
   if ((strcmp(meta->general->sensor, "ALOS") == 0 && meta->optical) ||
       strncmp_case(meta->general->processor, "CSTARS", 6) == 0) {
@@ -1644,574 +1951,191 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
     flip = TRUE;
   }
 
-  if (data_type >= COMPLEX_BYTE) {
-    float gain_adj = 0.0;
-    if (apply_ers2_gain_fix_flag)
-        gain_adj = get_ers2_gain_adj(meta,radiometry);
-
-    // Go through complex imagery in chunks
-    for (ii = 0; ii < nl; ii += nAzimuthLooks) {
-      alc = nAzimuthLooks;
-      if (ii + alc > nl) {
-        if (multilook_flag)
-          break;
-        alc = nl - ii;
-      }
-
-      for (ll = 0; ll < alc; ll++) {
-        int line = ii+ll;
-        asfLineMeter(line, nl);
-        offset = (long long)headerBytes+ (ii+ll)*(long long)image_fdr.reclen;
-        FSEEK64(fpIn, offset, SEEK_SET);
-
-        // Read the data according to their data type
-        switch (data_type) {
-          case COMPLEX_BYTE:
-            FREAD(cpx_byte_buf+2*ll*ns, sizeof(unsigned char), 2*ns, fpIn);
-            break;
-          case COMPLEX_INTEGER16:
-            FREAD(cpx_short_buf+2*ll*ns, sizeof(short), 2*ns, fpIn);
-            break;
-          case COMPLEX_INTEGER32:
-            FREAD(cpx_int_buf+2*ll*ns, sizeof(int), 2*ns, fpIn);
-            break;
-          case COMPLEX_REAL64:
-            FREAD(cpx_double_buf+2*ll*ns, sizeof(double), 2*ns, fpIn);
-            break;
-          case COMPLEX_REAL32:
-            FREAD(cpx_float_buf+2*ll*ns, sizeof(float), 2*ns, fpIn);
-            break;
-          case ASF_BYTE:
-          case INTEGER16:
-          case INTEGER32:
-          case REAL32:
-          case REAL64:
-            break;
-        }
-
-        // Put read in data in proper endian format
-        for (kk=0; kk<ns; kk++) {
-          switch (data_type) {
-            case COMPLEX_BYTE:
-              break;
-            case COMPLEX_INTEGER16:
-              big16(cpx_short_buf[ll*ns*2 + kk*2]);
-              big16(cpx_short_buf[ll*ns*2 + kk*2+1]);
-              if (flip) {
-                tmp_cpx_short_buf[ll*ns*2 + kk*2] = 
-		  cpx_short_buf[ll*ns*2 + kk*2];
-                tmp_cpx_short_buf[ll*ns*2 + kk*2+1] = 
-		  cpx_short_buf[ll*ns*2 * kk*2+1];
-              }
-              break;
-            case COMPLEX_INTEGER32:
-              big32(cpx_int_buf[ll*ns*2 + kk*2]);
-              big32(cpx_int_buf[ll*ns*2 + kk*2+1]);
-              if (flip) {
-                tmp_int_buf[ll*ns*2 + kk*2] = cpx_int_buf[ll*ns*2 + kk*2];
-                tmp_int_buf[ll*ns*2 + kk*2+1] = cpx_int_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_REAL32:
-              big32(cpx_float_buf[ll*ns*2 + kk*2]);
-              big32(cpx_float_buf[ll*ns*2 + kk*2+1]);
-              if (flip) {
-                tmp_float_buf[ll*ns*2 + kk*2] = 
-		  cpx_float_buf[ll*ns*2 + kk*2];
-                tmp_float_buf[ll*ns*2 + kk*2+1] = 
-		  cpx_float_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_REAL64:
-              big64(cpx_double_buf[ll*ns*2 + kk*2]);
-              big64(cpx_double_buf[ll*ns*2 + kk*2+1]);
-              if (flip) {
-                tmp_double_buf[ll*ns*2 + kk*2] = 
-		  cpx_double_buf[ll*ns*2 + kk*2];
-                tmp_double_buf[ll*ns*2 + kk*2+1] = 
-		  cpx_double_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case ASF_BYTE:
-            case INTEGER16:
-            case INTEGER32:
-            case REAL32:
-            case REAL64:
-              break;
-          }
-        }
-
-        // Flip the line if necessary and assign output value
-        for (kk=0; kk<ns; kk++) {
-          cpx.real = cpx.imag = 0.0;
-          switch (data_type)
-          {
-            case ASF_BYTE:
-            case INTEGER16:
-            case INTEGER32:
-            case REAL32:
-            case REAL64:
-              // should not happen
-              break;
-            case COMPLEX_BYTE:
-              if (flip) {
-                cpx.real = (float) cpx_byte_buf[ll*ns*2 + (ns-kk-1)*2];
-                cpx.imag = (float) cpx_byte_buf[ll*ns*2 + (ns-kk-1)*2+1];
-              }
-              else {
-                cpx.real = (float) cpx_byte_buf[ll*ns*2 + kk*2];
-                cpx.imag = (float) cpx_byte_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_INTEGER16:
-              if (flip) {
-                cpx.real = (float) cpx_short_buf[ll*ns*2 + (ns-kk-1)*2];
-                cpx.imag = (float) cpx_short_buf[ll*ns*2 + (ns-kk-1)*2+1];
-              }
-              else {
-                cpx.real = (float) cpx_short_buf[ll*ns*2 + kk*2];
-                cpx.imag = (float) cpx_short_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_INTEGER32:
-              if (flip) {
-                cpx.real = (float) cpx_int_buf[ll*ns*2 + (ns-kk-1)*2];
-                cpx.imag = (float) cpx_int_buf[ll*ns*2 + (ns-kk-1)*2+1];
-              }
-              else {
-                cpx.real = (float) cpx_int_buf[ll*ns*2 + kk*2];
-                cpx.imag = (float) cpx_int_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_REAL32:
-              if (flip) {
-                cpx.real = cpx_float_buf[ll*ns*2 + (ns-kk-1)*2];
-                cpx.imag = cpx_float_buf[ll*ns*2 + (ns-kk-1)*2+1];
-              }
-              else {
-                cpx.real = cpx_float_buf[ll*ns*2 + kk*2];
-                cpx.imag = cpx_float_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-            case COMPLEX_REAL64:
-              if (flip) {
-                cpx.real = (float) cpx_double_buf[ll*ns*2 + (ns-kk-1)*2];
-                cpx.imag = (float) cpx_double_buf[ll*ns*2 + (ns-kk-1)*2+1];
-              }
-              else {
-                cpx.real = (float) cpx_double_buf[ll*ns*2 + kk*2];
-                cpx.imag = (float) cpx_double_buf[ll*ns*2 + kk*2+1];
-              }
-              break;
-          }
-
-          if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-            fValue = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-            if (multilook_flag) {
-              cpx_float_ml_buf[ll*ns + kk].real = cpx.real;
-              cpx_float_ml_buf[ll*ns + kk].imag = cpx.imag;
-            }
-            else {
-                double incidence_angle;
-                if (projected) {
-		  incidence_angle = quadratic_2_incidence_angle(ll, kk, incid);
-                }
-                else {
-		  incidence_angle = incid[kk];
-                }
-                amp_float_buf[ll*ns + kk] = 
-		  get_cal_dn(meta, incidence_angle, kk, fValue, bandExt, 
-			     db_flag);
-                phase_float_buf[ll*ns + kk] =  atan2(cpx.imag, cpx.real);
-            }
-          }
-          else if (complex_flag && !multilook_flag) {
-            cpxFloat_buf[ll*ns + kk] = cpx;
-          }
-          else if (cpx.real != 0.0 || cpx.imag != 0.0) {
-            if (multilook_flag) {
-              cpx_float_ml_buf[ll*ns + kk].real = cpx.real;
-              cpx_float_ml_buf[ll*ns + kk].imag = cpx.imag;
-            }
-            else {
-              amp_float_buf[ll*ns + kk] = sqrt(cpx.real*cpx.real + cpx.imag*cpx.imag);
-              phase_float_buf[ll*ns + kk] =  atan2(cpx.imag, cpx.real);
-            }
-          }
-          else {
-            if (multilook_flag) {
-              cpx_float_ml_buf[ll*ns + kk].real = 0.0;
-              cpx_float_ml_buf[ll*ns + kk].imag = 0.0;
-            }
-            else {
-              amp_float_buf[ll*ns + kk] = 0.0;
-              phase_float_buf[ll*ns + kk] = 0.0;
-            }
-          }
-        }
-      }
-
-      // Multilook if requested
-      if (multilook_flag) {
-	for (kk = 0; kk < ns; kk += nRangeLooks) {
-	  int idx = kk/rlc;
-	  rlc = nRangeLooks;
-	  if (kk + rlc > ns) {
-	    rlc = ns - kk;
-	  }
-	  float amp = 0.0;
-	  cpx.real = cpx.imag = 0;
-	  for (mm = 0; mm < alc; mm ++) {
-	    for (nn = 0; nn < rlc; nn++) {
-	      float re = cpx_float_ml_buf[mm*ns + kk + nn].real;
-	      float im = cpx_float_ml_buf[mm*ns + kk + nn].imag;
-	      cpx.real += re;
-	      cpx.imag += im;
-	      amp += re*re + im*im;
-	    }
-	  }
-	  amp /= (float)(alc*rlc); // Average of the squares
-	  cpx.real /= (float)(alc*rlc);
-	  cpx.imag /= (float)(alc*rlc);
-	  cpx_float_ml_buf[idx] = cpx;
-	  if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-	    double incidence_angle;
-	    if (projected)
-	      incidence_angle = quadratic_2_incidence_angle(ll, kk+nn/2, incid);
-	    else
-	      incidence_angle = incid[kk];
-	    amp_float_buf[idx] = 
-	      get_cal_dn(meta, incidence_angle, kk+nn/2, sqrt(amp), bandExt, 
-			 db_flag);
-	  }
-	  else 
-	    amp_float_buf[idx] = sqrt(amp);
-	  phase_float_buf[idx] = atan2(cpx.imag, cpx.real);
-	}
-      }
-      
-      int out_band = import_single_band ? 0 : (band - 1) * 2;
-
-      if (apply_ers2_gain_fix_flag && strcmp(meta->general->sensor,"ERS2") == 0)
-      {
-        if (radiometry != r_AMP) {
-          if (complex_flag) {
-            // in the complex case, we need to convert back to polar, apply
-            // the correction to the amplitude, then convert back to cartesian
-            for (kk=0; kk<ns*alc; ++kk) {
-              complexFloat cpx = cpxFloat_buf[kk];
-              double amp = hypot(cpx.real, cpx.imag);
-              double phase = atan2(cpx.imag, cpx.real);
-              amp = apply_ers2_gain_fix(radiometry, gain_adj, amp);
-              cpxFloat_buf[kk].real = amp*cos(phase);
-              cpxFloat_buf[kk].imag = amp*sin(phase);
-            }
-          }
-          else {
-            int array_len = multilook_flag ? ns : ns*alc;
-            for (kk=0; kk<array_len; ++kk)
-              amp_float_buf[kk] =
-                apply_ers2_gain_fix(radiometry, gain_adj, amp_float_buf[kk]);
-          }
-        }
-      }
+  // Set up the conversion of the data
+  ceos_convert_t c;
+  c.meta = meta;
+  c.data_type = data_type;
+  c.radiometry = radiometry;
+  c.bandExt = bandExt;
+  c.ns = ns;
+  c.out_ns = meta->general->sample_count;
+  c.flip = flip;
+  c.projected = projected;
+  c.db_flag = db_flag;
+  c.calibrate = radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB;
+  c.alos_optical = data_type == ASF_BYTE &&
+    strcmp(meta->general->sensor, "ALOS") == 0 && meta->optical;
+  c.leftFill = leftFill;
+  c.multilook = data_type >= COMPLEX_BYTE && multilook_flag;
+  c.complex_flag = complex_flag;
+  c.nAzimuthLooks = nAzimuthLooks;
+  c.nRangeLooks = nRangeLooks;
+  c.gain_adj = 0.0;
+  if (apply_ers2_gain_fix_flag)
+    c.gain_adj = get_ers2_gain_adj(meta,radiometry);
+  c.ers2_fix = apply_ers2_gain_fix_flag &&
+    strcmp(meta->general->sensor,"ERS2") == 0 &&
+    (data_type < COMPLEX_BYTE || radiometry != r_AMP);
+  c.incid = incid;
+  c.use_lut = lutName != NULL;
+  c.lut_min = min;
+  c.lut_max = max;
+  c.incid_table = lutName ? incid_table : NULL;
+  c.scale_table = lutName ? scale_table : NULL;
+  if (lutName && data_type != ASF_BYTE && data_type != INTEGER16)
+    asfPrintStatus("LUT not implemented for this data type!\n");
+
+  // Outside of map projected data, the calibration of a pixel only depends
+  // on its sample, so we work out the coefficients once
+  c.cal_a = c.cal_b = NULL;
+  if (c.calibrate && !c.use_lut && !c.multilook && !projected && meta->sar) {
+    double a, b;
+    if (get_cal_coefficients(meta, incid[0], 0, bandExt, &a, &b)) {
+      c.cal_a = (double *) MALLOC(sizeof(double)*c.out_ns);
+      c.cal_b = (double *) MALLOC(sizeof(double)*c.out_ns);
+      for (kk=0; kk<c.out_ns; kk++)
+        get_cal_coefficients(meta, incid[kk], kk, bandExt,
+                             &c.cal_a[kk], &c.cal_b[kk]);
+    }
+  }
 
-      if (multilook_flag) {
-	if (complex_flag) {
-	  put_band_complexFloat_line(fpOut, meta, out_band, out, 
-				     cpx_float_ml_buf);
-	  out++;
-	}
-	else {
-	  put_band_float_line(fpOut, meta, out_band+0, out, amp_float_buf);
-	  if (!(amp0_flag && out_band==0))
-	    put_band_float_line(fpOut, meta, out_band+1, out, phase_float_buf);
-	  out++;
-	}
-      }
+  // The workers can't report calibration problems, so look for them
+  // now.  Whether a sample can be calibrated doesn't depend on its
+  // value or line, so checking the first and last sample used will do.
+  c.cal_status = CAL_OK;
+  c.cal_sample = 0;
+  if (c.calibrate && !c.use_lut && !c.cal_a) {
+    int last_sample = c.out_ns - 1, status;
+    float value;
+    if (!incid)
+      asfPrintError("Cannot calibrate %s: no SAR metadata!\n", inDataName);
+    if (c.multilook) {
+      int rlc = nRangeLooks;
+      last_sample = (c.out_ns - 1)*nRangeLooks;
+      if (last_sample + rlc > ns)
+        rlc = ns - last_sample;
+      last_sample += rlc/2;
+    }
+    status = cal_dn(meta, ceos_incidence(&c, 0, 0), 0, 1.0, bandExt,
+                    db_flag, &value);
+    if (status == CAL_OK)
+      status = cal_dn(meta, ceos_incidence(&c, 0, 0), last_sample, 1.0,
+                      bandExt, db_flag, &value);
+    if (status != CAL_OK)
+      asfPrintError("Cannot calibrate %s: %s!\n", inDataName,
+                    cal_status_message(status));
+  }
+
+  // Each chunk of input lines turns into one output line
+  int chunk_lines = c.multilook ? nAzimuthLooks : 1;
+  int chunk_count = c.multilook ? nl / nAzimuthLooks : nl;
+  int block_chunks = CEOS_BLOCK_LINES / chunk_lines;
+  if (block_chunks < 1) block_chunks = 1;
+  if (block_chunks > chunk_count) block_chunks = chunk_count;
+  int max_lines = block_chunks*chunk_lines;
+
+  // Two input blocks: one being converted, one being read
+  ceos_block_t blocks[2];
+  for (ii=0; ii<2; ii++) {
+    blocks[ii].fp = fpIn;
+    blocks[ii].offset = headerBytes;
+    blocks[ii].reclen = image_fdr.reclen;
+    blocks[ii].line_bytes = ns*ceos_sample_size(data_type);
+    blocks[ii].raw = (unsigned char *)
+      MALLOC((size_t)(max_lines-1)*image_fdr.reclen + blocks[ii].line_bytes);
+  }
+  long long out_size = (long long)block_chunks*c.out_ns;
+  c.amp = (float *) MALLOC(sizeof(float)*out_size);
+  c.phase = (float *) MALLOC(sizeof(float)*out_size);
+  c.cpx = (complexFloat *) MALLOC(sizeof(complexFloat)*out_size);
+
+  int out_band;
+  if (data_type >= COMPLEX_BYTE)
+    out_band = import_single_band ? 0 : (band - 1) * 2;
+  else
+    // This only works if the bands start with number 1
+    // Not necessarily the case
+    out_band = import_single_band ? 0 : band - 1;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  int cur = 0, chunk, chunks;
+  if (chunk_count > 0) {
+    blocks[cur].first_line = 0;
+    blocks[cur].lines = max_lines;
+    seek_ceos_block(&blocks[cur]);
+    read_ceos_block(&blocks[cur]);
+    check_ceos_block(&blocks[cur], inDataName);
+  }
+  for (chunk=0; chunk<chunk_count; chunk+=chunks) {
+    GThread *reader = NULL;
+    chunks = chunk_count - chunk < block_chunks ?
+      chunk_count - chunk : block_chunks;
+
+    // Start reading the next block
+    if (chunk + chunks < chunk_count) {
+      ceos_block_t *next = &blocks[1-cur];
+      int next_chunks = chunk_count - chunk - chunks < block_chunks ?
+        chunk_count - chunk - chunks : block_chunks;
+      next->first_line = (chunk + chunks)*chunk_lines;
+      next->lines = next_chunks*chunk_lines;
+      seek_ceos_block(next);
+      reader = g_thread_create(read_ceos_block_thread, next, TRUE, NULL);
+      if (reader)
+        asfJobEnterThreads();
       else {
-        for (mm=0; mm<alc; mm++) {
-          if (complex_flag) {
-            put_band_complexFloat_line(fpOut, meta, out_band, ii+mm, 
-				       cpxFloat_buf+mm*ns);
-          }
-          else {
-            put_band_float_line(fpOut, meta, out_band+0, ii+mm,
-                                amp_float_buf+mm*ns);
-            if (!(amp0_flag && out_band==0)) {
-              put_band_float_line(fpOut, meta, out_band+1, ii+mm,
-                                  phase_float_buf+mm*ns);
-            }
-          }
-        }
+        read_ceos_block(next);
+        check_ceos_block(next, inDataName);
       }
     }
-  }
-  else {
-    // Go through detected imagery line by line
-    float gain_adj = 0.0;
-    if (apply_ers2_gain_fix_flag)
-        gain_adj = get_ers2_gain_adj(meta,radiometry);
-
-    for (ii=0; ii<nl; ii++) {
-      asfLineMeter(ii, nl);
 
-      offset = (long long)headerBytes+ ii*(long long)image_fdr.reclen;
-      FSEEK64(fpIn, offset, SEEK_SET);
-
-      // Read the data according to their data type
-      switch (data_type) {
-        case REAL32:
-            FREAD(float_buf, sizeof(float), ns, fpIn);
-            break;
-        case ASF_BYTE:
-            FREAD(byte_buf, sizeof(unsigned char), ns, fpIn);
-            break;
-        case INTEGER16:
-            FREAD(short_buf, sizeof(short), ns, fpIn);
-            break;
-        case INTEGER32:
-            FREAD(int_buf, sizeof(int), ns, fpIn);
-            break;
-        case REAL64:
-            FREAD(double_buf, sizeof(double), ns, fpIn);
-            break;
-        case COMPLEX_BYTE:
-            FREAD(cpx_byte_buf, sizeof(unsigned char), 2*ns, fpIn);
-            break;
-        case COMPLEX_INTEGER16:
-        case COMPLEX_INTEGER32:
-        case COMPLEX_REAL32:
-        case COMPLEX_REAL64:
-            break;
+    // Convert this one
+    c.block = &blocks[cur];
+    c.first_out_line = chunk;
+    parallel_rows(chunks, convert_ceos_chunks, &c);
+    if (c.cal_status != CAL_OK) {
+      if (reader) {
+        g_thread_join(reader);
+        asfJobLeaveThreads();
       }
+      asfPrintError("Cannot calibrate %s: %s (%d)!\n", inDataName,
+                    cal_status_message(c.cal_status), c.cal_sample);
+    }
 
-      // Put read in data in proper endian format
-      for (kk=0; kk<ns; kk++) {
-          switch (data_type) {
-            case REAL32:
-                big32(float_buf[kk]);
-                if (flip) {
-                    tmp_float_buf[kk] = float_buf[kk];
-                }
-                break;
-            case ASF_BYTE:
-                if (flip) {
-                    tmp_byte_buf[kk] = byte_buf[kk];
-                }
-                break;
-            case INTEGER16:
-                big16(short_buf[kk]);
-                if (flip) {
-                    tmp_short_buf[kk] = short_buf[kk];
-                }
-                break;
-            case INTEGER32:
-                big32(int_buf[kk]);
-                if (flip) {
-                    tmp_int_buf[kk] = int_buf[kk];
-                }
-                break;
-            case REAL64:
-                big64(double_buf[kk]);
-                if (flip) {
-                    tmp_double_buf[kk] = double_buf[kk];
-                }
-                break;
-            case COMPLEX_BYTE:
-            case COMPLEX_INTEGER16:
-            case COMPLEX_INTEGER32:
-            case COMPLEX_REAL32:
-            case COMPLEX_REAL64:
-                break;
-        }
-      }
+    // ... and write it out
+    if (data_type < COMPLEX_BYTE) {
+      put_band_float_lines(fpOut, meta, out_band, chunk, chunks, c.amp);
+    }
+    else if (complex_flag) {
+      for (ii=0; ii<chunks; ii++)
+        put_band_complexFloat_line(fpOut, meta, out_band, chunk+ii,
+                                   (float *) (c.cpx + ii*c.out_ns));
+    }
+    else {
+      put_band_float_lines(fpOut, meta, out_band+0, chunk, chunks, c.amp);
+      if (!(amp0_flag && out_band==0))
+        put_band_float_lines(fpOut, meta, out_band+1, chunk, chunks, c.phase);
+    }
+    for (ii=chunk*chunk_lines; ii<(chunk+chunks)*chunk_lines; ii++)
+      asfLineMeter(ii, nl);
 
-      // Flip the line if necessary and assign output value
-      for (kk = 0; kk < ns; kk++) {
-        if (lutName) {
-            double incidence_angle;
-            int x = ii, y = kk;
-            if (projected) {
-                incidence_angle = quadratic_2_incidence_angle(x, y, incid);
-            }
-            else {
-                incidence_angle = incid[kk]; //meta_incid(meta, x, y);
-            }
-            for (mm = min; mm <= max; mm++) {
-                if (incidence_angle < incid_table[mm]) {
-                    break;
-                }
-                if (data_type == ASF_BYTE) {
-                    if (flip) {
-                        byte_buf[kk] = tmp_byte_buf[ns-kk-1];
-                    }
-                    amp_float_buf[kk] = (float) byte_buf[kk] *
-                                        (((scale_table[mm]-scale_table[mm]) /
-                                        (incid_table[mm]-incid_table[mm])) *
-                                        (incidence_angle - incid_table[mm-1]) * scale_table[mm-1]);
-                }
-                else if (data_type == INTEGER16) {
-                    if (flip) {
-                        short_buf[kk] = tmp_short_buf[ns-kk-1];
-                    }
-                    amp_float_buf[kk] = (float) short_buf[kk] *
-                                        (((scale_table[mm]-scale_table[mm]) /
-                                        (incid_table[mm]-incid_table[mm])) *
-                                        (incidence_angle - incid_table[mm-1]) * scale_table[mm-1]);
-                }
-                else {
-                    asfPrintStatus("LUT not implemented for this data type!\n");
-                }
-            }
-        }
-        else {
-            switch (data_type) {
-                case ASF_BYTE:
-                    if (flip) {
-                        byte_buf[kk] = tmp_byte_buf[ns-kk-1];
-                    }
-                    if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)byte_buf[kk], bandExt, db_flag);
-                    }
-                    else if (radiometry == r_POWER) {
-                        amp_float_buf[kk] = (float) byte_buf[kk]*byte_buf[kk];
-                    }
-                    else if (strcmp(meta->general->sensor, "ALOS") == 0 &&
-                             meta->optical)
-                    {
-                        if (kk+leftFill>=ns) {
-                            amp_float_buf[kk] = 0.0;
-                        } else {
-                            amp_float_buf[kk] = (float) byte_buf[kk+leftFill];
-                        }
-                    }
-                    else {
-                        amp_float_buf[kk] = (float) byte_buf[kk];
-                    }
-                    break;
-                case INTEGER16:
-                    if (flip) {
-                        short_buf[kk] = tmp_short_buf[ns-kk-1];
-                    }
-                    if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)short_buf[kk], bandExt, db_flag);
-                    }
-                    else if (radiometry == r_POWER) {
-                        amp_float_buf[kk] = (float) short_buf[kk]*short_buf[kk];
-                    }
-                    else {
-                        amp_float_buf[kk] = (float) short_buf[kk];
-                    }
-                    break;
-                case INTEGER32:
-                    if (flip) {
-                        int_buf[kk] = tmp_int_buf[ns-kk-1];
-                    }
-                    if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)int_buf[kk], bandExt, db_flag);
-                    }
-                    else if (radiometry == r_POWER) {
-                        amp_float_buf[ns+kk] = (float) int_buf[kk]*int_buf[kk];
-                    }
-                    else {
-                        amp_float_buf[ns+kk] = (float) int_buf[kk];
-                    }
-                    break;
-                case REAL32:
-                    if (flip) {
-                        float_buf[kk] = tmp_float_buf[ns-kk-1];
-                    }
-                    if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, float_buf[kk], 
-				     bandExt, db_flag);
-                    }
-                    else if (radiometry == r_POWER) {
-                        amp_float_buf[kk] = float_buf[kk]*float_buf[kk];
-                    }
-                    else {
-                        amp_float_buf[kk] = float_buf[kk];
-                    }
-                    break;
-                case REAL64:
-                    if (flip) {
-                        double_buf[kk] = tmp_double_buf[ns-kk-1];
-                    }
-                    if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB) {
-                        double incidence_angle;
-                        if (projected) {
-                            incidence_angle = quadratic_2_incidence_angle(ii, kk, incid);
-                        }
-                        else {
-                            incidence_angle = incid[kk];
-                        }
-                        amp_float_buf[kk] = 
-			  get_cal_dn(meta, incidence_angle, kk, 
-				     (float)double_buf[kk], bandExt, db_flag);
-                    }
-                    else if (radiometry == r_POWER) {
-                        amp_float_buf[kk] = (float) double_buf[kk]*double_buf[kk];
-                    }
-                    else {
-                        amp_float_buf[kk] = (float) double_buf[kk];
-                    }
-                    break;
-                case COMPLEX_BYTE:
-                case COMPLEX_INTEGER16:
-                case COMPLEX_INTEGER32:
-                case COMPLEX_REAL32:
-                case COMPLEX_REAL64:
-                    break;
-            }
-        }
-            if (strcmp(meta->general->sensor,"ERS2") == 0 && apply_ers2_gain_fix_flag)
-            amp_float_buf[kk] =
-                apply_ers2_gain_fix(radiometry, gain_adj, amp_float_buf[kk]);
-      }
-      if (import_single_band) {
-          put_band_float_line(fpOut, meta, 0, ii, amp_float_buf);
-      }
-      else {
-          // This only works if the bands start with number 1
-          // Not necessarily the case
-          put_band_float_line(fpOut, meta, band-1, ii, amp_float_buf);
-      }
+    if (reader) {
+      g_thread_join(reader);
+      asfJobLeaveThreads();
+      check_ceos_block(&blocks[1-cur], inDataName);
     }
+    cur = 1-cur;
+  }
+
+  for (ii=0; ii<2; ii++)
+    FREE(blocks[ii].raw);
+  FREE(c.amp);
+  FREE(c.phase);
+  FREE(c.cpx);
+  if (c.cal_a) {
+    FREE(c.cal_a);
+    FREE(c.cal_b);
   }
 
   if (import_single_band || band == nBandsOut) {
@@ -2242,61 +2166,6 @@ void import_ceos_data(char *inDataName, char *inMetaName, char *outDataName,
   // Clean up
   if (incid)
     FREE(incid);
-  if (byte_buf) {
-    FREE(byte_buf);
-    FREE(tmp_byte_buf);
-  }
-  if (short_buf) {
-    FREE(short_buf);
-    FREE(tmp_short_buf);
-  }
-  if (int_buf) {
-    FREE(int_buf);
-    FREE(tmp_int_buf);
-  }
-  if (float_buf) {
-    FREE(float_buf);
-    FREE(tmp_float_buf);
-  }
-  if (double_buf) {
-    FREE(double_buf);
-    FREE(tmp_double_buf);
-  }
-  if (cpx_byte_buf) {
-    FREE(cpx_byte_buf);
-    FREE(tmp_byte_buf);
-  }
-  if (cpx_short_buf) {
-    FREE(cpx_short_buf);
-    FREE(tmp_cpx_short_buf);
-  }
-  if (cpx_int_buf) {
-    FREE(cpx_int_buf);
-    FREE(tmp_int_buf);
-  }
-  if (cpx_float_buf) {
-    FREE(cpx_float_buf);
-    FREE(tmp_float_buf);
-  }
-  if (cpx_double_buf) {
-    FREE(cpx_double_buf);
-    FREE(tmp_double_buf);
-  }
-  if (amp_byte_buf) {
-    FREE(amp_byte_buf);
-  }
-  if (cpxFloat_buf) {
-    FREE(cpxFloat_buf);
-  }
-  if (amp_float_buf) {
-    FREE(amp_float_buf);
-  }
-  if (phase_float_buf) {
-    FREE(phase_float_buf);
-  }
-  if (cpx_float_ml_buf) {
-    FREE(cpx_float_ml_buf);
-  }
 
   meta_free(meta);
 
@@ -218,9 +218,6 @@ void import_generic_geotiff (const char *inFileName, const char *outBaseName, ..
     meta = read_generic_geotiff_metadata(inFileName, ignore, NULL);
   }
 
-  // Write the Metadata file
-  meta_write(meta, outBaseName);
-
   // Write the binary file
   input_tiff = XTIFFOpen (inFileName, "r");
   if (input_tiff == NULL)
@@ -234,6 +231,10 @@ void import_generic_geotiff (const char *inFileName, const char *outBaseName, ..
     asfPrintError("Unable to write binary image...\n    %s\n", outBaseName);
   }
   XTIFFClose(input_tiff);
+
+  // Write the Metadata file ...after the binary, since the band statistics
+  // are gathered while writing it
+  meta_write(meta, outBaseName);
   if (meta) meta_free(meta);
 }
 
@@ -1700,14 +1701,12 @@ meta_parameters * read_generic_geotiff_metadata(const char *inFileName, int *ign
       int is_dem = (mg->image_data_type == DEM) ? 1 : 0;
       if(!stats) asfPrintError("Out of memory.  Cannot allocate statistics struct.\n");
       int ii, nb;
+      int *invalid = (int *) MALLOC(sizeof(int)*num_bands);
+      tiff_image_statistics(input_tiff, stats->band_stats, invalid, is_dem,
+                            num_bands, bits_per_sample, sample_format,
+                            planar_config, 0, mask_value);
       for (ii=0, nb=num_bands; ii<num_bands; ii++) {
-        int ret;
-        ret = tiff_image_band_statistics(input_tiff, meta_out,
-                                      &stats->band_stats[ii], is_dem,
-                                      num_bands, ii,
-                                      bits_per_sample, sample_format,
-                                      planar_config, 0, mask_value);
-        if (ret != 0 ||
+        if (invalid[ii] ||
             (stats->band_stats[ii].mean == stats->band_stats[ii].min &&
              stats->band_stats[ii].mean == stats->band_stats[ii].max &&
              stats->band_stats[ii].mean == stats->band_stats[ii].std_deviation)) {
@@ -1737,6 +1736,7 @@ meta_parameters * read_generic_geotiff_metadata(const char *inFileName, int *ign
             stats->band_stats[ii].std_deviation);
         }
       }
+      FREE(invalid);
     }
   }
 
@@ -1751,13 +1751,11 @@ meta_parameters * read_generic_geotiff_metadata(const char *inFileName, int *ign
     int is_dem = (mg->image_data_type == DEM) ? 1 : 0;
     if(!stats) asfPrintError("Out of memory.  Cannot allocate statistics struct.\n");
     int ii, nb;
-    int ret = 0;
+    int *invalid = (int *) MALLOC(sizeof(int)*num_bands);
+    tiff_image_statistics(input_tiff, stats->band_stats, invalid, is_dem,
+                          num_bands, bits_per_sample, sample_format,
+                          planar_config, 0, mask_value);
     for (ii=0, nb=num_bands; ii<num_bands; ii++) {
-      ret = tiff_image_band_statistics(input_tiff, meta_out,
-                                       &stats->band_stats[ii], is_dem,
-                                       num_bands, ii,
-                                       bits_per_sample, sample_format,
-                                       planar_config, 0, mask_value);
       asfPrintStatus("\nBand Statistics:\n"
                      "   min = %f\n"
                      "   max = %f\n"
@@ -1768,7 +1766,7 @@ meta_parameters * read_generic_geotiff_metadata(const char *inFileName, int *ign
                      stats->band_stats[ii].mean,
                      stats->band_stats[ii].std_deviation);
       // Empty band?
-      if (ret != 0) {
+      if (invalid[ii]) {
           asfPrintWarning("USGS Seamless (NED, SRTM, etc) or DTED DEM band %d appears to have no data.\n"
                   "Setting the average height to 0.0m and continuing...\n", ii+1);
           mp->height = 0.0;
@@ -1779,6 +1777,7 @@ meta_parameters * read_generic_geotiff_metadata(const char *inFileName, int *ign
           ignore[ii] = 0;
       }
     }
+    FREE(invalid);
   }
 
   if ( num_found_bands > 0 && strlen(band_str) > 0) {
@@ -2229,400 +2228,95 @@ int  band_byte_image_write(UInt8Image *oim_b, meta_parameters *omd,
   return 0;
 }
 
-int tiff_image_band_statistics (TIFF *tif, meta_parameters *omd,
-                                meta_stats *stats, int is_dem,
-                                int num_bands, int band_no,
-                                short bits_per_sample, short sample_format,
-                                short planar_config,
-                                int use_mask_value, double mask_value)
+// Statistics of all bands of the first image in the TIFF, gathered in a
+// single pass over the file.  invalid[band] is set to non-zero for bands
+// without any valid statistics.
+void tiff_image_statistics(TIFF *tif, meta_stats *stats, int *invalid,
+                           int is_dem, int num_bands,
+                           short bits_per_sample, short sample_format,
+                           short planar_config,
+                           int use_mask_value, double mask_value)
 {
-  tiff_type_t tiffInfo;
+  tiff_block_reader_t *r;
+  tiff_stats_t *acc;
+  int row, band;
 
-  // Determine what type of TIFF this is (scanline/strip/tiled)
-  get_tiff_type(tif, &tiffInfo);
-  if (tiffInfo.imageCount > 1) {
-    asfPrintWarning("Found multi-image TIFF file.  Statistics will only be\n"
-        "calculated from the bands in the first image in the file\n");
-  }
-  if (tiffInfo.imageCount < 1) {
-    asfPrintError ("TIFF file contains zero images\n");
-  }
-  if (tiffInfo.format != SCANLINE_TIFF &&
-      tiffInfo.format != STRIP_TIFF    &&
-      tiffInfo.format != TILED_TIFF)
-  {
-    asfPrintError("Unrecognized TIFF type\n");
-  }
-  if (tiffInfo.volume_tiff) {
-    asfPrintError("Multi-dimensional TIFF found ...only 2D TIFFs are supported.\n");
-  }
-
-  // Minimum and maximum sample values as integers.
-  double fmin = FLT_MAX;
-  double fmax = -FLT_MAX;
-  double cs=0.0; // Current sample value
-
-  stats->mean = 0.0;
-  double s = 0.0;
-  uint32 scanlineSize = 0;
-  uint32 sample_count = 0;      // Samples considered so far.
-  uint32 ii, jj;
-  scanlineSize = TIFFScanlineSize(tif);
-  if (scanlineSize <= 0) {
-    return 1;
-  }
   if (num_bands > 1 &&
       planar_config != PLANARCONFIG_CONTIG &&
       planar_config != PLANARCONFIG_SEPARATE)
   {
-    return 1;
+    for (band=0; band<num_bands; band++)
+      invalid[band] = 1;
+    return;
   }
-  tdata_t *buf = _TIFFmalloc(scanlineSize);
 
-  // If there is a mask value we are supposed to ignore,
-  if ( use_mask_value ) {
-    // iterate over all rows in the TIFF
-    for ( ii = 0; ii < omd->general->line_count; ii++ )
-    {
-      asfPercentMeter((double)ii/(double)omd->general->line_count);
-      // Get a data line from the TIFF
-      switch (tiffInfo.format) {
-        case SCANLINE_TIFF:
-          if (planar_config == PLANARCONFIG_CONTIG || num_bands == 1) {
-            TIFFReadScanline(tif, buf, ii, 0);
-          }
-          else {
-            // Planar configuration is band-sequential
-            TIFFReadScanline(tif, buf, ii, band_no);
-          }
-          break;
-        case STRIP_TIFF:
-          ReadScanline_from_TIFF_Strip(tif, buf, ii, band_no);
-          break;
-        case TILED_TIFF:
-//          if (planar_config == PLANARCONFIG_CONTIG || num_bands == 1) {
-//            ReadScanline_from_TIFF_TileRow(tif, buf, ii, 0);
-//          }
-//          else {
-            // Planar configuration is band-sequential
-          ReadScanline_from_TIFF_TileRow(tif, buf, ii, band_no);
-//          }
-          break;
-        default:
-          asfPrintError("Invalid TIFF format found.\n");
-          break;
-      }
-      for (jj = 0 ; jj < omd->general->sample_count; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        switch(bits_per_sample) {
-          case 8:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint8*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint8*)(buf))[jj]);
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((int8*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((int8*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              default:
-                // There is no such thing as an IEEE 8-bit floating point
-                asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            if ( !isnan(mask_value) && (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-              continue;
-            }
-            break;
-          case 16:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint16*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint16*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((int16*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint16*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              default:
-                // There is no such thing as an IEEE 16-bit floating point
-                asfPrintError("Unexpected data type in TIFF/GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            if ( !isnan(mask_value) && (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-              continue;
-            }
-            break;
-          case 32:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint32*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint32*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((long*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((long*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_IEEEFP:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((float*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((float*)(buf))[jj]);   // Current sample.
-                }
-                if (is_dem && cs < -10e10) {
-                  // Bad value removal for DEMs (really an adjustment, not a removal)
-                  // -> This only applies to USGS Seamless DEMs and REAL32 data type <-
-                  cs = -999.0;
-                }
-                break;
-              default:
-                asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            if ( !isnan(mask_value) && (gsl_fcmp (cs, mask_value, 0.00000000001) == 0 ) ) {
-              continue;
-            }
-            break;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = stats->mean;
-        stats->mean += (cs - stats->mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - stats->mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
+  r = tiff_block_reader_new(tif, num_bands, bits_per_sample, sample_format,
+                            planar_config);
+  if (r->info.imageCount > 1) {
+    asfPrintWarning("Found multi-image TIFF file.  Statistics will only be\n"
+        "calculated from the bands in the first image in the file\n");
   }
-  else {
-    // There is no mask value to ignore, so we do the same as the
-    // above loop, but without the possible continue statement.
-    for ( ii = 0; ii < omd->general->line_count; ii++ )
-    {
-      asfPercentMeter((double)ii/(double)omd->general->line_count);
-      // Get a data line from the TIFF
-      switch (tiffInfo.format) {
-        case SCANLINE_TIFF:
-          if (planar_config == PLANARCONFIG_CONTIG || num_bands == 1) {
-            TIFFReadScanline(tif, buf, ii, 0);
-          }
-          else {
-            // Planar configuration is band-sequential
-            TIFFReadScanline(tif, buf, ii, band_no);
-          }
-          break;
-        case STRIP_TIFF:
-          ReadScanline_from_TIFF_Strip(tif, buf, ii, band_no);
-          break;
-        case TILED_TIFF:
-            // Planar configuration is band-sequential
-          ReadScanline_from_TIFF_TileRow(tif, buf, ii, band_no);
-          break;
-        default:
-          asfPrintError("Invalid TIFF format found.\n");
-          break;
-      }
-      for (jj = 0 ; jj < omd->general->sample_count; jj++ ) {
-        // iterate over each pixel sample in the scanline
-        switch(bits_per_sample) {
-          case 8:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint8*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint8*)(buf))[jj]);
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((int8*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((int8*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              default:
-                // There is no such thing as an IEEE 8-bit floating point
-                asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            break;
-          case 16:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint16*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint16*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((int16*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint16*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              default:
-                // There is no such thing as an IEEE 16-bit floating point
-                asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            break;
-          case 32:
-            switch(sample_format) {
-              case SAMPLEFORMAT_UINT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((uint32*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((uint32*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_INT:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((long*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((long*)(buf))[jj]);   // Current sample.
-                }
-                break;
-              case SAMPLEFORMAT_IEEEFP:
-                if (planar_config == PLANARCONFIG_CONTIG && num_bands > 1) {
-                  cs = (double)(((float*)(buf))[(jj*num_bands)+band_no]);   // Current sample.
-                }
-                else {
-                  // Planar configuration is band-sequential or single-banded
-                  cs = (double)(((float*)(buf))[jj]);   // Current sample.
-                }
-                if (is_dem && cs < -10e10) {
-                  // Bad value removal for DEMs (really an adjustment, not a removal)
-                  // -> This only applies to USGS Seamless DEMs and REAL32 data type <-
-                  cs = -999.0;
-                }
-                break;
-              default:
-                asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-                return 1;
-                break;
-            }
-            break;
-          default:
-            asfPrintError("Unexpected data type in GeoTIFF ...Cannot calculate statistics.\n");
-            return 1;
-            break;
-        }
-        if ( G_UNLIKELY (cs < fmin) ) { fmin = cs; }
-        if ( G_UNLIKELY (cs > fmax) ) { fmax = cs; }
-        double old_mean = stats->mean;
-        stats->mean += (cs - stats->mean) / (sample_count + 1);
-        s += (cs - old_mean) * (cs - stats->mean);
-        sample_count++;
-      }
-    }
-    asfPercentMeter(1.0);
+  acc = (tiff_stats_t *) MALLOC(sizeof(tiff_stats_t)*num_bands);
+  for (band=0; band<num_bands; band++)
+    tiff_stats_init(&acc[band]);
+
+  for (row=0; row<r->height; row+=r->rows) {
+    asfPercentMeter((double)row/(double)r->height);
+    if (tiff_block_reader_read(r, row))
+      asfPrintWarning("Error reading TIFF data at line %d\n", row);
+    for (band=0; band<num_bands; band++)
+      tiff_block_stats_add(r, band, is_dem, use_mask_value, mask_value,
+                           &acc[band]);
   }
-  if (buf) _TIFFfree(buf);
+  asfPercentMeter(1.0);
 
-  // Verify the new extrema have been found.
-  //if (fmin == FLT_MAX || fmax == -FLT_MAX)
-  if (gsl_fcmp (fmin, FLT_MAX, 0.00000000001) == 0 ||
-      gsl_fcmp (fmax, -FLT_MAX, 0.00000000001) == 0)
-    return 1;
+  for (band=0; band<num_bands; band++)
+    invalid[band] = tiff_stats_finish(&acc[band], &stats[band]);
 
-  stats->min = fmin;
-  stats->max = fmax;
-  stats->std_deviation = sqrt (s / (sample_count - 1));
+  FREE(acc);
+  tiff_block_reader_free(r);
+}
 
-  // The new extrema had better be in the range supported range
-  if (fabs(stats->mean) > FLT_MAX || fabs(stats->std_deviation) > FLT_MAX)
-    return 1;
+int tiff_image_band_statistics (TIFF *tif, meta_parameters *omd,
+                                meta_stats *stats, int is_dem,
+                                int num_bands, int band_no,
+                                short bits_per_sample, short sample_format,
+                                short planar_config,
+                                int use_mask_value, double mask_value)
+{
+  meta_stats *all = (meta_stats *) MALLOC(sizeof(meta_stats)*num_bands);
+  int *invalid = (int *) MALLOC(sizeof(int)*num_bands);
+  int ret;
 
-  return 0;
+  tiff_image_statistics(tif, all, invalid, is_dem, num_bands,
+                        bits_per_sample, sample_format, planar_config,
+                        use_mask_value, mask_value);
+  *stats = all[band_no];
+  ret = invalid[band_no];
+
+  FREE(all);
+  FREE(invalid);
+
+  return ret;
 }
 
+// Writes the bands of the TIFF that are not ignored to the .img file.
+// The TIFF is decoded block by block, and if the metadata does not carry
+// statistics yet they are gathered on the way and added to it.
 int  geotiff_band_image_write(TIFF *tif, meta_parameters *omd,
                               const char *outBaseName, int num_bands,
                               int *ignore, short bits_per_sample,
                               short sample_format, short planar_config)
 {
+  meta_general *mg = omd->general;
+  tiff_block_reader_t *r;
+  tiff_stats_t *acc = NULL;
   char *outName;
-  int num_ignored;
-  uint32 row, col, band;
-  float *buf;
-  tsize_t scanlineSize;
-
-  // Determine what type of TIFF this is (scanline/strip/tiled)
-  tiff_type_t tiffInfo;
-  get_tiff_type(tif, &tiffInfo);
-  if (tiffInfo.imageCount > 1) {
-    asfPrintWarning("Found multi-image TIFF file.  Only the first image in the file\n"
-                   "will be exported.\n");
-  }
-  if (tiffInfo.imageCount < 1) {
-    asfPrintError ("TIFF file contains zero images\n");
-  }
-  if (tiffInfo.format != SCANLINE_TIFF &&
-      tiffInfo.format != STRIP_TIFF    &&
-      tiffInfo.format != TILED_TIFF)
-  {
-    asfPrintError("Unrecognized TIFF type\n");
-  }
-  if (tiffInfo.volume_tiff) {
-    asfPrintError("Multi-dimensional TIFF found ...only 2D TIFFs are supported.\n");
-  }
+  int row, band, out_band, ii;
+  int is_dem = mg->image_data_type == DEM;
+  int use_mask = meta_is_valid_double(mg->no_data);
+  int ret = 0;
 
-  buf = (float*)MALLOC(sizeof(float)*omd->general->sample_count);
-  outName = (char*)MALLOC(sizeof(char)*strlen(outBaseName) + 5);
-  strcpy(outName, outBaseName);
-  append_ext_if_needed(outName, ".img", ".img");
   if (num_bands > 1 &&
       planar_config != PLANARCONFIG_CONTIG &&
       planar_config != PLANARCONFIG_SEPARATE)
@@ -2630,118 +2324,80 @@ int  geotiff_band_image_write(TIFF *tif, meta_parameters *omd,
     asfPrintError("Unexpected planar configuration found in TIFF file\n");
   }
 
-  scanlineSize = TIFFScanlineSize(tif);
-  if (scanlineSize <= 0) {
-    return 1;
+  outName = (char*)MALLOC(sizeof(char)*strlen(outBaseName) + 5);
+  strcpy(outName, outBaseName);
+  append_ext_if_needed(outName, ".img", ".img");
+
+  for (band=0; band<num_bands; band++)
+    if (ignore[band])
+      asfPrintStatus("  Band %02d is empty ...ignored\n", band+1);
+  asfPrintStatus(num_bands > 1 ? "\nWriting bands...\n" :
+                 "\nWriting binary image...\n");
+
+  r = tiff_block_reader_new(tif, num_bands, bits_per_sample, sample_format,
+                            planar_config);
+  if (r->info.imageCount > 1) {
+    asfPrintWarning("Found multi-image TIFF file.  Only the first image in the file\n"
+                   "will be exported.\n");
   }
-  tdata_t *tif_buf = _TIFFmalloc(scanlineSize);
-  if (!tif_buf) {
-    asfPrintError("Cannot allocate buffer for reading TIFF lines\n");
+  if (!omd->stats) {
+    acc = (tiff_stats_t *) MALLOC(sizeof(tiff_stats_t)*num_bands);
+    for (band=0; band<num_bands; band++)
+      tiff_stats_init(&acc[band]);
   }
 
-  for (band=0, num_ignored=0; band < num_bands; band++) {
-    if (num_bands > 1) {
-      asfPrintStatus("\nWriting band %02d...\n", band+1);
+  FILE *fp = (FILE*)FOPEN(outName, "wb");
+  for (row=0; row<mg->line_count && !ret; row+=r->rows) {
+    if (tiff_block_reader_read(r, row)) {
+      asfPrintWarning("Error reading TIFF data at line %d\n", row);
+      ret = 1;
+      break;
     }
-    else
-    {
-      asfPrintStatus("\nWriting binary image...\n");
+    for (band=0, out_band=0; band<num_bands; band++) {
+      if (ignore[band])
+        continue;
+      put_band_float_lines(fp, omd, out_band, row, r->rows, r->data[band]);
+      if (acc)
+        tiff_block_stats_add(r, band, is_dem, use_mask, mg->no_data,
+                             &acc[band]);
+      out_band++;
     }
-    FILE *fp=(FILE*)FOPEN(outName, band > 0 ? "ab" : "wb");
-    if (fp == NULL) return 1;
-    if (!ignore[band]) {
-      for (row=0; row < omd->general->line_count; row++) {
-        asfLineMeter(row, omd->general->line_count);
-        switch (tiffInfo.format) {
-          case SCANLINE_TIFF:
-            if (planar_config == PLANARCONFIG_CONTIG || num_bands == 1) {
-              TIFFReadScanline(tif, tif_buf, row, 0);
-            }
-            else {
-            // Planar configuration is band-sequential
-              TIFFReadScanline(tif, tif_buf, row, band);
-            }
-            break;
-          case STRIP_TIFF:
-            ReadScanline_from_TIFF_Strip(tif, tif_buf, row, band);
-            break;
-          case TILED_TIFF:
-            // Planar configuration is band-sequential
-            ReadScanline_from_TIFF_TileRow(tif, tif_buf, row, band);
-            break;
-          default:
-            asfPrintError("Invalid TIFF format found.\n");
-            break;
-        }
-        for (col=0; col < omd->general->sample_count; col++) {
-          switch (bits_per_sample) {
-            case 8:
-              switch(sample_format) {
-                case SAMPLEFORMAT_UINT:
-                  ((float*)buf)[col] = (float)(((uint8*)tif_buf)[col]);
-                  break;
-                case SAMPLEFORMAT_INT:
-                  ((float*)buf)[col] = (float)(((int8*)tif_buf)[col]);
-                  break;
-                default:
-                  // No such thing as an 8-bit IEEE float
-                  asfPrintError("Unexpected data type in TIFF file ...cannot write ASF-internal\n"
-                      "format file.\n");
-                  break;
-              }
-              break;
-            case 16:
-              switch(sample_format) {
-                case SAMPLEFORMAT_UINT:
-                  ((float*)buf)[col] = (float)(((uint16*)tif_buf)[col]);
-                  break;
-                case SAMPLEFORMAT_INT:
-                  ((float*)buf)[col] = (float)(((int16*)tif_buf)[col]);
-                  break;
-                default:
-                  // No such thing as an 16-bit IEEE float
-                  asfPrintError("Unexpected data type in TIFF file ...cannot write ASF-internal\n"
-                      "format file.\n");
-                  break;
-              }
-              break;
-            case 32:
-              switch(sample_format) {
-                case SAMPLEFORMAT_UINT:
-                  ((float*)buf)[col] = (float)(((uint32*)tif_buf)[col]);
-                  break;
-                case SAMPLEFORMAT_INT:
-                  ((float*)buf)[col] = (float)(((long*)tif_buf)[col]);
-                  break;
-                case SAMPLEFORMAT_IEEEFP:
-                  ((float*)buf)[col] = (float)(((float*)tif_buf)[col]);
-                  break;
-                default:
-                  asfPrintError("Unexpected data type in TIFF file ...cannot write ASF-internal\n"
-                      "format file.\n");
-                  break;
-              }
-              break;
-            default:
-              asfPrintError("Unexpected data type in TIFF file ...cannot write ASF-internal\n"
-                  "format file.\n");
-              break;
-          }
-        }
-        put_band_float_line(fp, omd, band - num_ignored, (int)row, buf);
-      }
+    for (ii=row; ii<row+r->rows; ii++)
+      asfLineMeter(ii, mg->line_count);
+  }
+  FCLOSE(fp);
+
+  if (acc && !ret) {
+    char **band_names = NULL;
+    if (strlen(mg->bands) &&
+        strncmp(mg->bands, MAGIC_UNSET_STRING, strlen(MAGIC_UNSET_STRING)) != 0)
+      band_names = extract_band_names(mg->bands, mg->band_count);
+    omd->stats = meta_statistics_init(mg->band_count);
+    for (band=0, out_band=0; band<num_bands; band++) {
+      if (ignore[band])
+        continue;
+      meta_stats *ms = &omd->stats->band_stats[out_band];
+      tiff_stats_finish(&acc[band], ms);
+      if (band_names && band_names[out_band] != NULL)
+        strcpy(ms->band_id, band_names[out_band]);
+      else
+        sprintf(ms->band_id, "%02d", out_band + 1);
+      ms->rmse = ms->std_deviation;
+      ms->mask = use_mask ? mg->no_data : MAGIC_UNSET_DOUBLE;
+      out_band++;
     }
-    else {
-      asfPrintStatus("  Empty band found ...ignored\n");
-      num_ignored++;
+    if (band_names) {
+      for (ii=0; ii<mg->band_count; ii++)
+        FREE(band_names[ii]);
+      FREE(band_names);
     }
-    FCLOSE(fp);
   }
-  FREE(buf);
+
+  FREE(acc);
   FREE(outName);
-  if (tif_buf) _TIFFfree(tif_buf);
+  tiff_block_reader_free(r);
 
-  return 0;
+  return ret;
 }
 
 void ReadScanline_from_TIFF_Strip(TIFF *tif, tdata_t buf, unsigned long row, int band)
@@ -675,11 +675,11 @@ static void ingest_uavsar_polsar_amp(char *inFile, char *outFile,
   }
   if (do_resample) {
     sprintf(unscaleBaseName, "%s_unscale", outFile);
-    import_uavsar_ext(inFile, -99, -99, -99, -99, r_AMP, TRUE, data_type, 
+    import_uavsar_ext(inFile, -99, -99, -99, -99, 1, 1, r_AMP, TRUE, data_type,
 		      unscaleBaseName);
   }
   else
-    import_uavsar_ext(inFile, -99, -99, -99, -99, r_AMP, TRUE, data_type, 
+    import_uavsar_ext(inFile, -99, -99, -99, -99, 1, 1, r_AMP, TRUE, data_type,
 		      outFile);
  
   if (do_resample) {
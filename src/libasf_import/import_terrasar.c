@@ -414,7 +414,7 @@ void import_terrasar(const char *inBaseName, radiometry_t radiometry,
   FREE(terrasar);
   meta_free(meta);
   FREE(inMetaName);
-  xmlFreeDoc(doc);
+  xml_free_doc(doc);
   xmlCleanupParser();
 }
 
@@ -2,11 +2,17 @@
 #include "airsar.h"
 #include "asf_meta.h"
 #include "asf_endian.h"
+#include "asf_raster.h"
+#include "asf_import.h"
+#ifndef win32
+#include <sys/mman.h>
+#endif
 
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_multiroots.h>
+#include <glib.h>
 
 #define SQR(x) (x*x)
 #define FLOAT_COMPARE_TOLERANCE(a, b, t) (fabs (a - b) <= t ? 1: 0)
@@ -499,15 +505,338 @@ char *check_data_type(const char *inFileName)
   return type;
 }
 
+// The raw UAVSAR products are little endian 32-bit floats (complex ones as
+// real/imaginary pairs), one file per element.  They are converted in
+// blocks of output lines: every source file is mapped into memory (or read
+// a block at a time where mmap is not available), the lines of the block
+// are converted and optionally multilooked by several threads, and all
+// output bands of the block are written before moving on.
+
+// Output blocks are sized to roughly this many output pixels over all bands
+#define UAVSAR_BLOCK_PIXELS (8*1024*1024)
+
+typedef enum {
+  UAVSAR_COPY,          // real samples, as is
+  UAVSAR_AMPLITUDE,     // real power samples, as amplitude
+  UAVSAR_CALIBRATE,     // real power samples, calibrated
+  UAVSAR_REAL,          // complex samples, real part
+  UAVSAR_IMAG,          // complex samples, imaginary part
+  UAVSAR_AMP,           // complex samples, amplitude
+  UAVSAR_PHASE          // complex samples, phase
+} uavsar_conversion_t;
+
+typedef struct {
+  int source;           // index of the file the band comes from
+  uavsar_conversion_t conversion;
+  char *element;        // polarization element, for the calibration
+} uavsar_band_t;
+
+typedef struct {
+  int is_complex;
+  long long line_bytes;
+  FILE *fp;
+  unsigned char *map;   // whole file, NULL if it could not be mapped
+  size_t map_size;
+  unsigned char *buf;   // input lines of the block if not mapped
+  const unsigned char *lines; // first input line of the current block
+} uavsar_source_t;
+
+typedef struct {
+  uavsar_source_t *source;
+  uavsar_band_t *band;
+  int band_count;
+  meta_parameters *meta;
+  int in_ns, out_ns;
+  int azimuth_looks, range_looks;
+  int db_flag;
+  float **out;          // output lines of the block, one per band
+  float *re, *im;       // looks of the block's lines, one line per row
+  // First calibration failure in a worker (a CAL_* code), and its
+  // sample.  The workers can't report it themselves (see parallel.c),
+  // the main thread does once the block is done.
+  gint cal_status;
+  int cal_sample;
+} uavsar_ingest_t;
+
+static float lil_float(const unsigned char *p)
+{
+  float f;
+  memcpy(&f, p, sizeof(float));
+  ieee_lil32(f);
+  return f;
+}
+
+static void uavsar_open_source(uavsar_source_t *s, const char *name,
+                               int is_complex, int ns, int nl, int max_lines)
+{
+  long long size = 0;
+
+  s->is_complex = is_complex;
+  s->line_bytes = (long long)ns*(is_complex ? 8 : 4);
+  s->fp = FOPEN(name, "rb");
+  s->map = NULL;
+  s->buf = NULL;
+  FSEEK64(s->fp, 0, SEEK_END);
+  size = FTELL64(s->fp);
+  if (size < s->line_bytes*nl)
+    asfPrintError("%s is too short for %d lines of %d samples.\n",
+                  name, nl, ns);
+  s->map_size = (size_t) (s->line_bytes*nl);
+#ifndef win32
+  void *map = mmap(NULL, s->map_size, PROT_READ, MAP_PRIVATE, fileno(s->fp), 0);
+  if (map != MAP_FAILED) {
+    s->map = (unsigned char *) map;
+    madvise(map, s->map_size, MADV_SEQUENTIAL);
+  }
+#endif
+  if (!s->map)
+    s->buf = (unsigned char *) MALLOC((size_t)(s->line_bytes*max_lines));
+}
+
+static void uavsar_read_source(uavsar_source_t *s, int first_line, int lines)
+{
+  if (s->map)
+    s->lines = s->map + s->line_bytes*first_line;
+  else {
+    FSEEK64(s->fp, s->line_bytes*first_line, SEEK_SET);
+    FREAD(s->buf, s->line_bytes, lines, s->fp);
+    s->lines = s->buf;
+  }
+}
+
+static void uavsar_close_source(uavsar_source_t *s)
+{
+#ifndef win32
+  if (s->map)
+    munmap(s->map, s->map_size);
+#endif
+  if (s->buf)
+    FREE(s->buf);
+  FCLOSE(s->fp);
+}
+
+// Averages the looks of one output line from the (azimuth_looks) input
+// lines at p.  Complex samples are averaged as complex numbers.
+static void uavsar_looks(const uavsar_ingest_t *u, const uavsar_source_t *s,
+                         const unsigned char *p, float *re, float *im)
+{
+  int alc = u->azimuth_looks, rlc = u->range_looks;
+  int size = s->is_complex ? 8 : 4;
+  float scale = 1.0/(alc*rlc);
+  int ii, mm, nn;
+
+  if (alc == 1 && rlc == 1) {
+    for (ii=0; ii<u->out_ns; ii++) {
+      re[ii] = lil_float(p + ii*size);
+      if (im)
+        im[ii] = lil_float(p + ii*size + 4);
+    }
+    return;
+  }
+
+  for (ii=0; ii<u->out_ns; ii++)
+    re[ii] = 0.0;
+  if (im)
+    for (ii=0; ii<u->out_ns; ii++)
+      im[ii] = 0.0;
+  for (mm=0; mm<alc; mm++) {
+    const unsigned char *line = p + mm*s->line_bytes;
+    for (ii=0; ii<u->out_ns; ii++) {
+      const unsigned char *q = line + (long long)ii*rlc*size;
+      for (nn=0; nn<rlc; nn++) {
+        re[ii] += lil_float(q + nn*size);
+        if (im)
+          im[ii] += lil_float(q + nn*size + 4);
+      }
+    }
+  }
+  for (ii=0; ii<u->out_ns; ii++)
+    re[ii] *= scale;
+  if (im)
+    for (ii=0; ii<u->out_ns; ii++)
+      im[ii] *= scale;
+}
+
+static void uavsar_ingest_rows(void *data, int first_row, int last_row)
+{
+  uavsar_ingest_t *u = (uavsar_ingest_t *) data;
+  int ns = u->out_ns, rlc = u->range_looks;
+  int row, band, ii, status;
+  float *re, *im;
+
+  for (row=first_row; row<=last_row; row++) {
+    re = u->re + (long long)row*ns;
+    im = u->im ? u->im + (long long)row*ns : NULL;
+    for (band=0; band<u->band_count; band++) {
+      uavsar_band_t *b = &u->band[band];
+      uavsar_source_t *s = &u->source[b->source];
+      float *out = u->out[band] + (long long)row*ns;
+      uavsar_looks(u, s, s->lines + row*u->azimuth_looks*s->line_bytes,
+                   re, s->is_complex ? im : NULL);
+      switch (b->conversion) {
+        case UAVSAR_COPY:
+        case UAVSAR_REAL:
+          memcpy(out, re, sizeof(float)*ns);
+          break;
+        case UAVSAR_IMAG:
+          memcpy(out, im, sizeof(float)*ns);
+          break;
+        case UAVSAR_AMPLITUDE:
+          for (ii=0; ii<ns; ii++)
+            out[ii] = sqrt(re[ii]);
+          break;
+        case UAVSAR_CALIBRATE:
+          for (ii=0; ii<ns; ii++) {
+            status = cal_dn(u->meta, 0.0, ii*rlc + rlc/2, re[ii],
+                            b->element, u->db_flag, &out[ii]);
+            if (status != CAL_OK &&
+                g_atomic_int_compare_and_exchange(&u->cal_status, CAL_OK,
+                                                  status))
+              u->cal_sample = ii*rlc + rlc/2;
+          }
+          break;
+        case UAVSAR_AMP:
+          for (ii=0; ii<ns; ii++)
+            out[ii] = sqrt(re[ii]*re[ii] + im[ii]*im[ii]);
+          break;
+        case UAVSAR_PHASE:
+          for (ii=0; ii<ns; ii++)
+            out[ii] = atan2_check(im[ii], re[ii]);
+          break;
+      }
+    }
+  }
+}
+
+// Converts the UAVSAR files dataName into the bands of the output image in
+// a single pass.  metaIn describes the input files, metaOut the output
+// image, with its final band count and size.
+static void uavsar_ingest(char **dataName, uavsar_band_t *band, int band_count,
+                          meta_parameters *metaIn, meta_parameters *metaOut,
+                          FILE *fpOut, int azimuth_looks, int range_looks,
+                          int db_flag)
+{
+  int in_nl = metaIn->general->line_count;
+  int out_nl = metaOut->general->line_count;
+  int out_ns = metaOut->general->sample_count;
+  int source_count = 0, block_lines, line, lines, ii, kk, status;
+  int any_complex = FALSE;
+  uavsar_ingest_t u;
+
+  for (ii=0; ii<band_count; ii++)
+    if (band[ii].source + 1 > source_count)
+      source_count = band[ii].source + 1;
+
+  block_lines = UAVSAR_BLOCK_PIXELS / ((long long)out_ns*band_count);
+  if (block_lines < 1) block_lines = 1;
+  if (block_lines > out_nl) block_lines = out_nl;
+
+  u.source = (uavsar_source_t *) MALLOC(sizeof(uavsar_source_t)*source_count);
+  for (kk=0; kk<source_count; kk++) {
+    int is_complex = FALSE;
+    for (ii=0; ii<band_count; ii++)
+      if (band[ii].source == kk && band[ii].conversion >= UAVSAR_REAL)
+        is_complex = any_complex = TRUE;
+    uavsar_open_source(&u.source[kk], dataName[kk], is_complex,
+                       metaIn->general->sample_count, in_nl,
+                       block_lines*azimuth_looks);
+  }
+  u.band = band;
+  u.band_count = band_count;
+  u.meta = metaOut;
+  u.in_ns = metaIn->general->sample_count;
+  u.out_ns = out_ns;
+  u.azimuth_looks = azimuth_looks;
+  u.range_looks = range_looks;
+  u.db_flag = db_flag;
+  u.out = (float **) MALLOC(sizeof(float *)*band_count);
+  u.re = (float *) MALLOC(sizeof(float)*block_lines*out_ns);
+  u.im = any_complex ?
+    (float *) MALLOC(sizeof(float)*block_lines*out_ns) : NULL;
+  u.cal_status = CAL_OK;
+  u.cal_sample = 0;
+  for (ii=0; ii<band_count; ii++) {
+    u.out[ii] = (float *) MALLOC(sizeof(float)*block_lines*out_ns);
+    // The workers can't report calibration problems, so look for them
+    // now; they only depend on the band, not on the sample
+    if (band[ii].conversion == UAVSAR_CALIBRATE) {
+      float value;
+      status = cal_dn(metaOut, 0.0, 0, 1.0, band[ii].element, db_flag,
+                      &value);
+      if (status != CAL_OK)
+        asfPrintError("Cannot calibrate band %s: %s!\n", band[ii].element,
+                      cal_status_message(status));
+    }
+  }
+
+  for (line=0; line<out_nl; line+=lines) {
+    lines = out_nl - line < block_lines ? out_nl - line : block_lines;
+    for (kk=0; kk<source_count; kk++)
+      uavsar_read_source(&u.source[kk], line*azimuth_looks,
+                         lines*azimuth_looks);
+    parallel_rows(lines, uavsar_ingest_rows, &u);
+    if (u.cal_status != CAL_OK)
+      asfPrintError("Cannot calibrate %s: %s (%d)!\n", dataName[0],
+                    cal_status_message(u.cal_status), u.cal_sample);
+    for (ii=0; ii<band_count; ii++)
+      put_band_float_lines(fpOut, metaOut, ii, line, lines, u.out[ii]);
+    for (ii=line; ii<line+lines; ii++)
+      asfLineMeter(ii, out_nl);
+  }
+
+  for (kk=0; kk<source_count; kk++)
+    uavsar_close_source(&u.source[kk]);
+  for (ii=0; ii<band_count; ii++)
+    FREE(u.out[ii]);
+  FREE(u.out);
+  FREE(u.re);
+  FREE(u.im);
+  FREE(u.source);
+}
+
+static int add_band(uavsar_band_t *band, int band_count, int source,
+                    uavsar_conversion_t conversion, char *element)
+{
+  band[band_count].source = source;
+  band[band_count].conversion = conversion;
+  band[band_count].element = element;
+  return band_count + 1;
+}
+
+// Output image size and pixel spacing for multilooked imports
+static void uavsar_multilook_meta(meta_parameters *meta, int azimuth_looks,
+                                  int range_looks)
+{
+  if (azimuth_looks == 1 && range_looks == 1)
+    return;
+  meta->general->line_count /= azimuth_looks;
+  meta->general->sample_count /= range_looks;
+  meta->general->y_pixel_size *= azimuth_looks;
+  meta->general->x_pixel_size *= range_looks;
+  if (meta->sar) {
+    meta->sar->azimuth_time_per_pixel *= azimuth_looks;
+    meta->sar->range_time_per_pixel *= range_looks;
+    meta->sar->line_increment *= azimuth_looks;
+    meta->sar->sample_increment *= range_looks;
+    meta->sar->multilook = 1;
+  }
+  if (meta->projection) {
+    meta->projection->perY *= azimuth_looks;
+    meta->projection->perX *= range_looks;
+  }
+}
+
 void import_uavsar(const char *inFileName, int line, int sample, int width,
-		   int height, radiometry_t radiometry,
-		   const char *data_type, const char *outBaseName) {
-  import_uavsar_ext(inFileName, line, sample, width, height, radiometry,
-		    FALSE, data_type, outBaseName);
+		   int height, int azimuth_looks, int range_looks,
+		   radiometry_t radiometry, const char *data_type,
+		   const char *outBaseName) {
+  import_uavsar_ext(inFileName, line, sample, width, height, azimuth_looks,
+		    range_looks, radiometry, FALSE, data_type, outBaseName);
 }
 
 void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
-		       int height, radiometry_t radiometry, int firstBandOnly,
+		       int height, int azimuth_looks, int range_looks,
+		       radiometry_t radiometry, int firstBandOnly,
 		       const char *data_type, const char *outBaseName) {
 
   // UAVSAR comes in two flavors: InSAR and PolSAR
@@ -542,11 +871,9 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
   // hgt_grd - Digital elevation model in ground projection
 
   FILE *fpIn, *fpOut;
-  int ii, kk, ll, nn, pp, nBands, ns, *dataType, product_count;
+  int ii, kk, nn, pp, nBands, *dataType, product_count, band_count;
   int multi = FALSE;
-  float *floatAmp, *floatPhase, *floatAmpBuf, re, im;
-  float *floatComplexReal, *floatComplexImag;
-  float *floatComplexBuf;
+  uavsar_band_t band[12];
   char **dataName, **element, **product, tmp[50];
   char *type;
   char *outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
@@ -556,6 +883,13 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 
   type = check_data_type(inFileName);
   asfPrintStatus("   Data type: %s\n", type);
+  if (azimuth_looks < 1)
+    azimuth_looks = 1;
+  if (range_looks < 1)
+    range_looks = 1;
+  if (azimuth_looks > 1 || range_looks > 1)
+    asfPrintStatus("   Multilooking: %d azimuth x %d range looks\n",
+		   azimuth_looks, range_looks);
   product = get_uavsar_products(data_type, type, &product_count);
   if (product_count > 1)
     multi = TRUE;
@@ -577,11 +911,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_INT_GRD);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaIn->general->sample_count;
       nn = 0;
-      floatAmp = (float *) CALLOC(ns, sizeof(float));
-      floatPhase = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       metaOut->general->band_count = 2;
       if (multi)
@@ -593,29 +923,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       sprintf(metaOut->general->bands, "INTERFEROGRAM_AMP,INTERFEROGRAM_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	metaIn->general->sample_count = 2*ns;
-	get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	for (kk=0; kk<ns; kk++) {
-	  re = floatComplexBuf[kk*2];
-	  im = floatComplexBuf[kk*2+1];
-	  ieee_big32(re);
-	  ieee_big32(im);
-	  floatAmp[kk] = hypot(re,im);
-	  floatPhase[kk] = atan2_check(im,re);
-	}
-	put_band_float_line(fpOut, metaOut, 0, ii, floatAmp);
-	put_band_float_line(fpOut, metaOut, 1, ii, floatPhase);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_AMP, NULL);
+      band_count = add_band(band, band_count, 0, UAVSAR_PHASE, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmp);
-      FREE(floatPhase);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -636,9 +951,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_UNW_GRD);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_unw_grd.img");
@@ -648,20 +961,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-      asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_COPY, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -682,9 +989,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_COR_GRD);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       if (multi)
 	outName = appendToBasename(outBaseName, "_cor_grd.img");
       else
@@ -693,20 +998,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "COHERENCE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_COPY, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -728,9 +1027,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
       metaOut->general->band_count = 2;
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_amp_grd.img");
@@ -739,23 +1036,17 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "AMP1,AMP2");
       asfPrintStatus("\nGround range amplitude images:\n");
-      for (nn=0; nn<nBands; nn++) {
+      for (nn=band_count=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	band_count = add_band(band, band_count, nn, UAVSAR_COPY, NULL);
       }
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -776,9 +1067,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_HGT_GRD);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_hgt_grd.img");
@@ -787,23 +1076,17 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "HEIGHT");
       asfPrintStatus("\nGround range digital elevation model:\n");
-      for (nn=0; nn<nBands; nn++) {
+      for (nn=band_count=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	band_count = add_band(band, band_count, nn, UAVSAR_COPY, NULL);
       }
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -824,11 +1107,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_INT);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaIn->general->sample_count;
       nn = 0;
-      floatAmp = (float *) CALLOC(ns, sizeof(float));
-      floatPhase = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_int.img");
@@ -844,29 +1123,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       sprintf(metaOut->general->bands, "INTERFEROGRAM_AMP,INTERFEROGRAM_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	metaIn->general->sample_count = 2*ns;
-	get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	for (kk=0; kk<ns; kk++) {
-	  re = floatComplexBuf[kk*2];
-	  im = floatComplexBuf[kk*2+1];
-	  ieee_big32(re);
-	  ieee_big32(im);
-	  floatAmp[kk] = hypot(re,im);
-	  floatPhase[kk] = atan2_check(im,re);
-	}
-	put_band_float_line(fpOut, metaOut, 0, ii, floatAmp);
-	put_band_float_line(fpOut, metaOut, 1, ii, floatPhase);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_AMP, NULL);
+      band_count = add_band(band, band_count, 0, UAVSAR_PHASE, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmp);
-      FREE(floatPhase);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -887,9 +1151,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_UNW);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_unw.img");
@@ -899,20 +1161,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "UNWRAPPED_PHASE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_COPY, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -933,9 +1189,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_insar_params(inFileName, INSAR_COR);
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_cor.img");
@@ -945,20 +1199,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "COHERENCE");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_COPY, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -980,9 +1228,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       metaIn = uavsar_insar2meta(insar_params);
       metaOut = uavsar_insar2meta(insar_params);
       metaOut->general->band_count = 2;
-      ns = metaOut->general->sample_count;
       nn = 0;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_amp.img");
@@ -991,23 +1237,17 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "AMP1,AMP2");
       asfPrintStatus("\nSlant range amplitude images:\n");
-      for (nn=0; nn<nBands; nn++) {
+      for (nn=band_count=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
-	fpIn = FOPEN(dataName[nn], "rb");
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	  for (kk=0; kk<metaIn->general->sample_count; kk++)
-	    ieee_big32(floatAmpBuf[kk]);
-	  put_band_float_line(fpOut, metaOut, nn, ii, floatAmpBuf);
-	  asfLineMeter(ii, metaIn->general->line_count);
-	}
-	FCLOSE(fpIn);
+	band_count = add_band(band, band_count, nn, UAVSAR_COPY, NULL);
       }
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1058,14 +1298,9 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       int dbFlag = 
 	(radiometry >= r_SIGMA_DB && radiometry <= r_GAMMA_DB) ? 1 : 0;
       metaOut->general->radiometry = radiometry;
-      ns = metaIn->general->sample_count;
-      floatAmp = (float *) MALLOC(sizeof(float)*ns);
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexReal = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexImag = (float *) MALLOC(sizeof(float)*ns);
-      floatComplexBuf = (float *) MALLOC(sizeof(float)*2*ns);
+      int calibrate = radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB;
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
-      metaOut->general->band_count = ll = 0;
+      metaOut->general->band_count = 0;
       create_cal_params(inFileName, metaOut, REPORT_LEVEL_NONE);
       if (multi)
 	outName = appendToBasename(outBaseName, "_mlc.img");
@@ -1073,7 +1308,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nMultilooked data:\n");
       fpOut = FOPEN(outName, "wb");
-      for (nn=0; nn<nBands; nn++) {
+      for (nn=band_count=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
@@ -1081,7 +1316,6 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	  metaOut->general->band_count += 1;
 	else
 	  metaOut->general->band_count += 2;
-	fpIn = FOPEN(dataName[nn], "rb");
 	if (firstBandOnly)
 	  strcpy(metaOut->general->bands, "AMP");
 	else if (nn == 0)
@@ -1093,59 +1327,23 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	    sprintf(tmp, ",%s", element[nn]);
 	  strcat(metaOut->general->bands, tmp);
 	}
-	for (ii=0; ii<metaIn->general->line_count; ii++) {
-	  if (dataType[nn]) {
-	    metaIn->general->sample_count = 2*ns;
-	    get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	    for (kk=0; kk<ns; kk++) {
-	      floatComplexReal[kk] = floatComplexBuf[kk*2];
-	      floatComplexImag[kk] = floatComplexBuf[kk*2+1];
-	      ieee_big32(floatComplexReal[kk]);
-	      ieee_big32(floatComplexImag[kk]);
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatComplexReal);
-	    put_band_float_line(fpOut, metaOut, ll+1, ii, floatComplexImag);
-	  }
-	  else {
-	    metaIn->general->sample_count = ns;
-	    get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	    if (nn == 0) {
-	      for (kk=0; kk<ns; kk++) {
-		ieee_big32(floatAmpBuf[kk]);
-		if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB)
-		  floatAmpBuf[kk] = get_cal_dn(metaOut, 0.0, kk, 
-					       floatAmpBuf[kk], 
-					       element[nn], dbFlag);
-		else
-		  floatAmpBuf[kk] = sqrt(floatAmpBuf[kk]);
-	      }
-	    }
-	    else {
-	      for (kk=0; kk<ns; kk++) {
-		ieee_big32(floatAmpBuf[kk]);
-		if (radiometry >= r_SIGMA && radiometry <= r_GAMMA_DB)
-		  floatAmpBuf[kk] = get_cal_dn(metaOut, 0.0, kk, 
-					       floatAmpBuf[kk], element[nn], 
-					       dbFlag);
-	      }
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatAmpBuf);
-	  }
-	  asfLineMeter(ii, metaIn->general->line_count);      
+	if (dataType[nn]) {
+	  band_count = add_band(band, band_count, nn, UAVSAR_REAL, NULL);
+	  band_count = add_band(band, band_count, nn, UAVSAR_IMAG, NULL);
 	}
-	if (dataType[nn])
-	  ll += 2;
+	else if (calibrate)
+	  band_count = add_band(band, band_count, nn, UAVSAR_CALIBRATE,
+				element[nn]);
+	else if (nn == 0)
+	  band_count = add_band(band, band_count, nn, UAVSAR_AMPLITUDE, NULL);
 	else
-	  ll++;
-	FCLOSE(fpIn);
+	  band_count = add_band(band, band_count, nn, UAVSAR_COPY, NULL);
       }
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, dbFlag);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmp);
-      FREE(floatAmpBuf);
-      FREE(floatComplexReal);
-      FREE(floatComplexImag);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1173,6 +1371,9 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	outName = appendExt(outBaseName, ".img");
       metaOut->general->band_count = 9;
       asfPrintStatus("\nCompressed Stokes matrix:\n");
+      if (azimuth_looks > 1 || range_looks > 1)
+	asfPrintWarning("Multilooking is not supported for the Stokes matrix."
+			" Will ingest it at full resolution.\n");
       char *filename = get_filename(dataName[0]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
@@ -1191,7 +1392,8 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       float *svh_phase = (float *) MALLOC(sizeof(float)*ns);
       float *svv_amp = (float *) MALLOC(sizeof(float)*ns);
       float *svv_phase = (float *) MALLOC(sizeof(float)*ns);
-      char *byteBuf = (char *) MALLOC(sizeof(char)*10);
+      char *byteLine = (char *) MALLOC(sizeof(char)*10*ns);
+      char *byteBuf;
 
       /* DAT files start with an airsar header that mostly contains metadata we
        * already have from the annotation file. So find the start offset of the image
@@ -1204,8 +1406,9 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       FREE(header);
 
       for (ii=0; ii<metaOut->general->line_count; ii++) {
+	FREAD(byteLine, sizeof(char), 10*ns, fpIn);
 	for (kk=0; kk<metaOut->general->sample_count; kk++) {
-	  FREAD(byteBuf, sizeof(char), 10, fpIn);
+	  byteBuf = byteLine + kk*10;
           //float m11, m12, m13, m14, m22, m23, m24, m33, m34, m44;
 	  // Scale is always 1.0 according to Bruce Chapman
 	  //m11 = ((float)byteBuf[1]/254.0 + 1.5) * pow(2, byteBuf[0]);
@@ -1269,6 +1472,7 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       FREE(svh_phase);
       FREE(svv_amp);
       FREE(svv_phase);
+      FREE(byteLine);
       meta_write(metaOut, outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1292,20 +1496,15 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_polsar_params(inFileName, POLSAR_GRD);
       metaIn = uavsar_polsar2meta(polsar_params);
       metaOut = uavsar_polsar2meta(polsar_params);
-      ns = metaIn->general->sample_count;
-      floatAmpBuf = (float *) CALLOC(ns, sizeof(float));
-      floatComplexReal = (float *) CALLOC(ns, sizeof(float));
-      floatComplexImag = (float *) CALLOC(ns, sizeof(float));
-      floatComplexBuf = (float *) CALLOC(2*ns, sizeof(float));
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
-      metaOut->general->band_count = ll = 0;
+      metaOut->general->band_count = 0;
       if (multi)
 	outName = appendToBasename(outBaseName, "_grd.img");
       else
 	outName = appendExt(outBaseName, ".img");
       asfPrintStatus("\nGround range projected data:\n");
       fpOut = FOPEN(outName, "wb");
-      for (nn=0; nn<nBands; nn++) {
+      for (nn=band_count=0; nn<nBands; nn++) {
         char *filename = get_filename(dataName[nn]);
         asfPrintStatus("Ingesting %s ...\n", filename);
         FREE(filename);
@@ -1313,7 +1512,6 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	  metaOut->general->band_count += 2;
 	else
 	  metaOut->general->band_count += 1;
-	fpIn = FOPEN(dataName[nn], "rb");
 	if (firstBandOnly)
 	  strcpy(metaOut->general->bands, "AMP");
 	else if (nn == 0)
@@ -1326,43 +1524,18 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	  strcat(metaOut->general->bands, tmp);
 	}
 	if (dataType[nn]) {
-	  for (ii=0; ii<metaIn->general->line_count; ii++) {
-	    metaIn->general->sample_count = 2*ns;
-	    get_float_line(fpIn, metaIn, ii, floatComplexBuf);
-	    for (kk=0; kk<ns; kk++) {
-	      floatComplexReal[kk] = floatComplexBuf[kk*2];
-	      floatComplexImag[kk] = floatComplexBuf[kk*2+1];
-	      ieee_big32(floatComplexReal[kk]);
-	      ieee_big32(floatComplexImag[kk]);
-	    }
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatComplexReal);
-	    put_band_float_line(fpOut, metaOut, ll+1, ii, floatComplexImag);
-	    asfLineMeter(ii, metaIn->general->line_count);
-	  }
+	  band_count = add_band(band, band_count, nn, UAVSAR_REAL, NULL);
+	  band_count = add_band(band, band_count, nn, UAVSAR_IMAG, NULL);
 	}
-	else {
-	  for (ii=0; ii<metaIn->general->line_count; ii++) {
-	    metaIn->general->sample_count = ns;
-	    get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	    for (kk=0; kk<ns; kk++)
-	      ieee_big32(floatAmpBuf[kk]);
-	    put_band_float_line(fpOut, metaOut, ll, ii, floatAmpBuf);
-	    asfLineMeter(ii, metaIn->general->line_count);      
-	  }
-	}
-	FCLOSE(fpIn);
-	if (dataType[nn])
-	  ll += 2;
 	else
-	  ll++;
+	  band_count = add_band(band, band_count, nn, UAVSAR_COPY, NULL);
       }
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       create_cal_params(inFileName, metaOut, REPORT_LEVEL_NONE);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
-      FREE(floatComplexReal);
-      FREE(floatComplexImag);
-      FREE(floatComplexBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
@@ -1383,8 +1556,6 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
 	read_uavsar_polsar_params(inFileName, POLSAR_HGT);
       metaIn = uavsar_polsar2meta(polsar_params);
       metaOut = uavsar_polsar2meta(polsar_params);
-      ns = metaOut->general->sample_count;
-      floatAmpBuf = (float *) MALLOC(sizeof(float)*ns);
       outName = (char *) MALLOC(sizeof(char)*(strlen(outBaseName)+15));
       if (multi)
 	outName = appendToBasename(outBaseName, "_hgt.img");
@@ -1395,20 +1566,14 @@ void import_uavsar_ext(const char *inFileName, int line, int sample, int width,
       char *filename = get_filename(dataName[nn]);
       asfPrintStatus("Ingesting %s ...\n", filename);
       FREE(filename);
-      fpIn = FOPEN(dataName[nn], "rb");
       fpOut = FOPEN(outName, "wb");
       strcpy(metaOut->general->bands, "HEIGHT");
-      for (ii=0; ii<metaIn->general->line_count; ii++) {
-	get_float_line(fpIn, metaIn, ii, floatAmpBuf);
-	for (kk=0; kk<metaIn->general->sample_count; kk++)
-	  ieee_big32(floatAmpBuf[kk]);
-	put_float_line(fpOut, metaOut, ii, floatAmpBuf);
-	asfLineMeter(ii, metaIn->general->line_count);
-      }
-      FCLOSE(fpIn);
+      band_count = add_band(band, 0, 0, UAVSAR_COPY, NULL);
+      uavsar_multilook_meta(metaOut, azimuth_looks, range_looks);
+      uavsar_ingest(dataName, band, band_count, metaIn, metaOut, fpOut,
+		    azimuth_looks, range_looks, FALSE);
       FCLOSE(fpOut);
       meta_write(metaOut, outName);
-      FREE(floatAmpBuf);
       FREE(outName);
       meta_free(metaIn);
       meta_free(metaOut);
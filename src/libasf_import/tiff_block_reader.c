@@ -0,0 +1,341 @@
+/*******************************************************************
+   Block-wise decoding of TIFF images.
+
+   ReadScanline_from_TIFF_Strip() and ReadScanline_from_TIFF_TileRow()
+   decode a whole strip, or a whole row of tiles, for every scanline
+   (and band) they return.  The block reader decodes the image in
+   blocks of whole strips or tile rows instead, so every strip or tile
+   is decoded exactly once, and converts the samples of all bands to
+   floats.
+
+   The strips or tiles of a block are decoded in parallel.  A TIFF
+   handle cannot be shared between threads, so every worker gets its
+   own handle on the file.
+*******************************************************************/
+#include <float.h>
+#include <gsl/gsl_math.h>
+
+#include "asf.h"
+#include "asf_meta.h"
+#include "asf_raster.h"
+#include "asf_tiff.h"
+#include "geotiff_support.h"
+
+// Blocks are sized to hold roughly this many samples over all bands
+#define TIFF_BLOCK_SAMPLES (4*1024*1024)
+
+static int tiff_bytes_per_sample(short bits_per_sample)
+{
+  return bits_per_sample / 8;
+}
+
+// Converts count samples, stride samples apart, to floats
+static void tiff_samples_to_float(const unsigned char *src, int stride,
+                                  int count, short bits_per_sample,
+                                  short sample_format, float *dst)
+{
+  int ii;
+
+  switch (bits_per_sample) {
+    case 8:
+      if (sample_format == SAMPLEFORMAT_INT)
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const int8 *) src)[ii*stride];
+      else
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const uint8 *) src)[ii*stride];
+      break;
+    case 16:
+      if (sample_format == SAMPLEFORMAT_INT)
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const int16 *) src)[ii*stride];
+      else
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const uint16 *) src)[ii*stride];
+      break;
+    case 32:
+      if (sample_format == SAMPLEFORMAT_IEEEFP)
+        for (ii=0; ii<count; ii++)
+          dst[ii] = ((const float *) src)[ii*stride];
+      else if (sample_format == SAMPLEFORMAT_INT)
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const int32 *) src)[ii*stride];
+      else
+        for (ii=0; ii<count; ii++)
+          dst[ii] = (float) ((const uint32 *) src)[ii*stride];
+      break;
+  }
+}
+
+// Copies a decoded strip or tile (unit_width samples per row, starting at
+// column x and row y of the image) into the block
+static void tiff_unit_to_block(tiff_block_reader_t *r, const unsigned char *buf,
+                               int plane, int x, int y, int unit_width,
+                               int unit_rows)
+{
+  int bytes = tiff_bytes_per_sample(r->bits_per_sample);
+  int contig = r->planar_config == PLANARCONFIG_CONTIG;
+  int spp = contig ? r->samples_per_pixel : 1;
+  int width = unit_width, row, band;
+
+  if (x + width > (int) r->width)
+    width = r->width - x;
+  if (y + unit_rows > r->first_row + r->rows)
+    unit_rows = r->first_row + r->rows - y;
+
+  for (row=0; row<unit_rows; row++) {
+    const unsigned char *src = buf + (long long)row*unit_width*spp*bytes;
+    for (band=0; band<r->num_bands; band++) {
+      if (!contig && band != plane)
+        continue;
+      float *dst = r->data[band] +
+        (long long)(y - r->first_row + row)*r->width + x;
+      tiff_samples_to_float(src + (contig ? band*bytes : 0), spp, width,
+                            r->bits_per_sample, r->sample_format, dst);
+    }
+  }
+}
+
+// Decodes unit number u of the current block with the given handle
+static int tiff_decode_unit(tiff_block_reader_t *r, TIFF *tif,
+                            unsigned char *buf, int u)
+{
+  int planes = r->planar_config == PLANARCONFIG_CONTIG ? 1 : r->num_bands;
+  int per_plane = r->unit_count / planes;
+  int plane = u / per_plane;
+  int k = u % per_plane;
+
+  if (r->info.format == TILED_TIFF) {
+    int tiles_across = (r->width + r->info.tileWidth - 1) / r->info.tileWidth;
+    int x = (k % tiles_across)*r->info.tileWidth;
+    int y = r->first_row + (k / tiles_across)*r->info.tileLength;
+    ttile_t tile = TIFFComputeTile(tif, x, y, 0, plane);
+    if (TIFFReadEncodedTile(tif, tile, buf, (tsize_t) -1) < 0)
+      return 1;
+    tiff_unit_to_block(r, buf, plane, x, y, r->info.tileWidth,
+                       r->info.tileLength);
+  }
+  else {
+    int y = r->first_row + k*r->unit_rows;
+    tstrip_t strip = TIFFComputeStrip(tif, y, plane);
+    if (TIFFReadEncodedStrip(tif, strip, buf, (tsize_t) -1) < 0)
+      return 1;
+    tiff_unit_to_block(r, buf, plane, 0, y, r->width, r->unit_rows);
+  }
+
+  return 0;
+}
+
+static void tiff_decode_units(void *data, int first, int last)
+{
+  tiff_block_reader_t *r = (tiff_block_reader_t *) data;
+  int h, u;
+
+  // Worker h decodes every handle_count'th unit with handle h
+  for (h=first; h<=last; h++)
+    for (u=h; u<r->unit_count; u+=r->handle_count)
+      if (tiff_decode_unit(r, r->handle[h], r->unit_buf[h], u))
+        r->error = TRUE;
+}
+
+tiff_block_reader_t *tiff_block_reader_new(TIFF *tif, int num_bands,
+                                           short bits_per_sample,
+                                           short sample_format,
+                                           short planar_config)
+{
+  tiff_block_reader_t *r =
+    (tiff_block_reader_t *) MALLOC(sizeof(tiff_block_reader_t));
+  short spp = 1;
+  int ii, units;
+
+  get_tiff_type(tif, &r->info);
+  // get_tiff_type() leaves the last image of the file current
+  TIFFSetDirectory(tif, 0);
+  if (r->info.imageCount < 1)
+    asfPrintError("TIFF file contains zero images\n");
+  if (r->info.format != SCANLINE_TIFF &&
+      r->info.format != STRIP_TIFF &&
+      r->info.format != TILED_TIFF)
+    asfPrintError("Unrecognized TIFF type\n");
+  if (r->info.volume_tiff)
+    asfPrintError("Multi-dimensional TIFF found ...only 2D TIFFs are "
+                  "supported.\n");
+  if (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 32)
+    asfPrintError("Unsupported bits per sample (%d) found in TIFF file\n",
+                  bits_per_sample);
+
+  TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &r->width);
+  TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &r->height);
+  TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+  r->samples_per_pixel = spp;
+  r->num_bands = num_bands;
+  if (planar_config != PLANARCONFIG_SEPARATE || num_bands == 1)
+    planar_config = PLANARCONFIG_CONTIG;
+  if (planar_config == PLANARCONFIG_CONTIG && spp < num_bands)
+    asfPrintError("TIFF file has %d samples per pixel, expected %d bands\n",
+                  spp, num_bands);
+  r->bits_per_sample = bits_per_sample;
+  r->sample_format = sample_format;
+  r->planar_config = planar_config;
+
+  switch (r->info.format) {
+    case TILED_TIFF:
+      r->unit_rows = r->info.tileLength;
+      break;
+    case STRIP_TIFF:
+      r->unit_rows = r->info.rowsPerStrip < r->height ?
+        r->info.rowsPerStrip : r->height;
+      break;
+    default:
+      r->unit_rows = 1;
+      break;
+  }
+  ii = TIFF_BLOCK_SAMPLES / ((long long)r->unit_rows*r->width*num_bands);
+  if (ii < 1) ii = 1;
+  r->block_rows = ii*r->unit_rows;
+  if (r->block_rows > (int) r->height)
+    r->block_rows = ((r->height + r->unit_rows - 1)/r->unit_rows)*r->unit_rows;
+
+  r->data = (float **) MALLOC(sizeof(float *)*num_bands);
+  for (ii=0; ii<num_bands; ii++)
+    r->data[ii] = (float *) MALLOC(sizeof(float)*r->block_rows*r->width);
+  r->first_row = r->rows = 0;
+  r->unit_count = 0;
+  r->error = FALSE;
+
+  // Scanline TIFFs can only be read sequentially, so they get a single
+  // handle.  Otherwise there is one handle per worker, but no more than
+  // the units in a block.
+  units = r->block_rows / r->unit_rows;
+  if (r->info.format == TILED_TIFF)
+    units *= (r->width + r->info.tileWidth - 1) / r->info.tileWidth;
+  if (planar_config == PLANARCONFIG_SEPARATE)
+    units *= num_bands;
+  r->handle_count = r->info.format == SCANLINE_TIFF ? 1 :
+    get_number_of_threads();
+  if (r->handle_count > units)
+    r->handle_count = units;
+  r->handle = (TIFF **) MALLOC(sizeof(TIFF *)*r->handle_count);
+  r->unit_buf = (unsigned char **)
+    MALLOC(sizeof(unsigned char *)*r->handle_count);
+  r->handle[0] = tif;
+  for (ii=1; ii<r->handle_count; ii++) {
+    r->handle[ii] = XTIFFOpen(TIFFFileName(tif), "r");
+    if (!r->handle[ii])
+      asfPrintError("Error opening input TIFF file:\n    %s\n",
+                    TIFFFileName(tif));
+  }
+  for (ii=0; ii<r->handle_count; ii++) {
+    tsize_t size = r->info.format == TILED_TIFF ? TIFFTileSize(tif) :
+      r->info.format == STRIP_TIFF ? TIFFStripSize(tif) : TIFFScanlineSize(tif);
+    r->unit_buf[ii] = (unsigned char *) _TIFFmalloc(size);
+    if (!r->unit_buf[ii])
+      asfPrintError("Cannot allocate buffer for reading TIFF data\n");
+  }
+
+  return r;
+}
+
+void tiff_block_reader_free(tiff_block_reader_t *r)
+{
+  int ii;
+
+  if (!r)
+    return;
+  for (ii=0; ii<r->handle_count; ii++) {
+    _TIFFfree(r->unit_buf[ii]);
+    if (ii > 0)
+      XTIFFClose(r->handle[ii]);
+  }
+  for (ii=0; ii<r->num_bands; ii++)
+    FREE(r->data[ii]);
+  FREE(r->data);
+  FREE(r->handle);
+  FREE(r->unit_buf);
+  FREE(r);
+}
+
+int tiff_block_reader_read(tiff_block_reader_t *r, int first_row)
+{
+  int planes = r->planar_config == PLANARCONFIG_CONTIG ? 1 : r->num_bands;
+  int row, band;
+
+  r->first_row = first_row;
+  r->rows = r->height - first_row < r->block_rows ?
+    r->height - first_row : r->block_rows;
+  r->error = FALSE;
+
+  if (r->info.format == SCANLINE_TIFF) {
+    for (row=first_row; row<first_row+r->rows; row++)
+      for (band=0; band<planes; band++) {
+        if (TIFFReadScanline(r->handle[0], r->unit_buf[0], row, band) < 0)
+          r->error = TRUE;
+        tiff_unit_to_block(r, r->unit_buf[0], band, 0, row, r->width, 1);
+      }
+    return r->error;
+  }
+
+  r->unit_count = (r->rows + r->unit_rows - 1) / r->unit_rows;
+  if (r->info.format == TILED_TIFF)
+    r->unit_count *= (r->width + r->info.tileWidth - 1) / r->info.tileWidth;
+  r->unit_count *= planes;
+  parallel_rows(r->handle_count, tiff_decode_units, r);
+
+  return r->error;
+}
+
+// Adds the samples of one band of the current block to the running
+// statistics.  Samples equal to the mask value are skipped if use_mask is
+// set, and for DEMs huge negative floats are counted as -999.
+void tiff_block_stats_add(tiff_block_reader_t *r, int band, int is_dem,
+                          int use_mask, double mask, tiff_stats_t *acc)
+{
+  const float *data = r->data[band];
+  long long ii, n = (long long)r->rows*r->width;
+  int fix_dem = is_dem && r->sample_format == SAMPLEFORMAT_IEEEFP;
+
+  if (use_mask && isnan(mask))
+    use_mask = FALSE;
+  for (ii=0; ii<n; ii++) {
+    double cs = data[ii];
+    if (fix_dem && cs < -10e10)
+      cs = -999.0;
+    if (use_mask && gsl_fcmp(cs, mask, 0.00000000001) == 0)
+      continue;
+    if (cs < acc->min) acc->min = cs;
+    if (cs > acc->max) acc->max = cs;
+    double old_mean = acc->mean;
+    acc->mean += (cs - acc->mean) / (acc->count + 1);
+    acc->s += (cs - old_mean) * (cs - acc->mean);
+    acc->count++;
+  }
+}
+
+void tiff_stats_init(tiff_stats_t *acc)
+{
+  acc->min = FLT_MAX;
+  acc->max = -FLT_MAX;
+  acc->mean = 0.0;
+  acc->s = 0.0;
+  acc->count = 0;
+}
+
+// Returns non-zero if no valid statistics could be found
+int tiff_stats_finish(const tiff_stats_t *acc, meta_stats *stats)
+{
+  stats->mean = acc->mean;
+  if (gsl_fcmp(acc->min, FLT_MAX, 0.00000000001) == 0 ||
+      gsl_fcmp(acc->max, -FLT_MAX, 0.00000000001) == 0)
+    return 1;
+
+  stats->min = acc->min;
+  stats->max = acc->max;
+  if (acc->count > 1)
+    stats->std_deviation = sqrt(acc->s / (acc->count - 1));
+  else
+    stats->std_deviation = 0.0;
+  if (fabs(stats->mean) > FLT_MAX || fabs(stats->std_deviation) > FLT_MAX)
+    return 1;
+
+  return 0;
+}
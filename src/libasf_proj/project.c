@@ -126,21 +126,28 @@ int test_nad27(double lat, double lon)
     return ret;
 }
 
+// Inside a job (see job.c) the average height is the job's
 static double sHeight = DEFAULT_AVERAGE_HEIGHT;
+static double *avg_height()
+{
+    asf_job_t *job = asfCurrentJob();
+    return job ? &job->proj_avg_height : &sHeight;
+}
+
 void project_set_avg_height(double h)
 {
-    sHeight = h;
+    *avg_height() = h;
 }
 
 static int height_was_set()
 {
-    return !ISNAN(sHeight);
+    return !ISNAN(*avg_height());
 }
 
 static double get_avg_height()
 {
     if (height_was_set())
-  return sHeight;
+  return *avg_height();
     else
   return DEFAULT_AVERAGE_HEIGHT;
 }
@@ -151,6 +158,7 @@ static int project_worker_arr(const char * projection_description,
                               double **projected_z, long length)
 {
   projPJ geographic_projection, output_projection;
+  asf_profile_timer_t proj_timer;
   int i, ok = TRUE;
 
   // This section is a bit confusing.  The interfaces to the single
@@ -246,6 +254,11 @@ static int project_worker_arr(const char * projection_description,
   //printf("proj: +from %s +to %s\n",
   //       latlon_description, projection_description);
 
+  // The time includes setting up the projections, which is most of the
+  // cost for the single point calls
+  asfProfileTimerStart(&proj_timer, "libproj");
+  asfProfileCount(PROFILE_PROJ_CALLS, 1);
+  asfProfileCount(PROFILE_PROJ_POINTS, length);
   geographic_projection = pj_init_plus (latlon_description);
 
   if (pj_errno != 0)
@@ -288,6 +301,7 @@ static int project_worker_arr(const char * projection_description,
 
       pj_free(geographic_projection);
   }
+  asfProfileTimerStop(&proj_timer);
 
   // Free memory temporarily allocated for height values that we don't
   // really care about.
@@ -308,6 +322,7 @@ project_worker_arr_inv(const char * projection_description,
                        long length)
 {
   projPJ geographic_projection, output_projection;
+  asf_profile_timer_t proj_timer;
   int i, ok = TRUE;
 
   // Same issue here as above.  Because both single and array
@@ -396,6 +411,9 @@ project_worker_arr_inv(const char * projection_description,
   //printf("proj: +from %s +to %s\n",
   //       projection_description, latlon_description);
 
+  asfProfileTimerStart(&proj_timer, "libproj inverse");
+  asfProfileCount(PROFILE_PROJ_CALLS, 1);
+  asfProfileCount(PROFILE_PROJ_POINTS, length);
   geographic_projection = pj_init_plus ( latlon_description );
 
   if (pj_errno != 0)
@@ -437,6 +455,7 @@ project_worker_arr_inv(const char * projection_description,
 
       pj_free(geographic_projection);
   }
+  asfProfileTimerStop(&proj_timer);
 
   // Free memory temporarily allocated for height values that we don't
   // really care about.
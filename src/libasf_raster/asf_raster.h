@@ -76,6 +76,22 @@ typedef struct {
 
 typedef double calc_stats_formula_t(double band_values[], double no_data_value);
 
+// Number of bins in the fine histogram of band_stats_t
+#define BAND_STATS_HIST_BINS (1 << 18)
+
+typedef struct {
+  long long count;              // number of valid pixels
+  double min;
+  double max;
+  double mean;
+  double std_dev;
+  // Fine histogram, see band_stats.c: hist[ii] counts the pixels in
+  // fine bin hist_first+ii.  Only the bins the data reaches are kept.
+  long long *hist;
+  unsigned int hist_first;
+  unsigned int hist_count;
+} band_stats_t;
+
 // Prototypes from arithmetic.c
 int arithmetic(char *refFile, char *targetFile, char *operation, char *outFile);
 
@@ -118,9 +134,22 @@ void calc_minmax_median(const char *inFile, char *band, double mask,
 			double *min, double *max);
 
 
+/* Prototypes from band_stats.c **********************************************/
+band_stats_t *band_stats_from_file(const char *inFile, double mask,
+                                   int *band_count);
+void band_stats_free(band_stats_t *stats, int band_count);
+double band_stats_quantile(const band_stats_t *stats, double q);
+gsl_histogram *band_stats_histogram(const band_stats_t *stats, int num_bins);
+
+/* Prototypes from parallel.c ************************************************/
+typedef void parallel_rows_fn(void *data, int first_row, int last_row);
+void set_number_of_threads(int thread_count);
+int get_number_of_threads(void);
+void parallel_rows(int row_count, parallel_rows_fn *fn, void *data);
+
 /* Prototypes from kernel.c **************************************************/
 float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
-	     int xLine, int xSample, int kernel_size, float damping_factor,
+	     int yLine, int xSample, int kernel_size, float damping_factor,
 	     int nLooks);
 void kernel_filter(char *inFile, char *outFile, filter_type_t filter, 
 		   int kernel_size, float damping, int nLooks);
@@ -0,0 +1,519 @@
+/*******************************************************************
+   Streaming band statistics.
+
+   band_stats_from_file() reads every band of an image exactly once,
+   in blocks of lines that are scanned in parallel, and gathers for
+   each band the number of valid pixels, the minimum, maximum, mean
+   and standard deviation, and a fine histogram of the pixel values.
+   Coarser histograms over [min,max] and approximate quantiles (the
+   median, the robust min/max used by MINMAX_MEDIAN scaling, ...)
+   are derived from the fine histogram, so no second pass or sorting
+   of the data is needed.
+
+   The fine histogram bins on the leading bits of the IEEE float
+   representation, so its bins have a constant relative width of
+   2^-(BAND_STATS_MANTISSA_BITS) over the whole float range and no
+   prior knowledge of the data range is needed.  Only the span of bins
+   the data actually reaches is allocated, growing as new values turn
+   up.
+
+   The results are cached in a sidecar file next to the image
+   (<basename>.band_stats).  The cache is reused as long as the image
+   file has the same size, modification time (to the nanosecond where
+   the file system keeps it) and a checksum of its first and last
+   BAND_STATS_CHECK_BYTES, and the same mask value is requested.  If
+   the sidecar cannot be written the statistics are simply recomputed
+   the next time.
+
+   NaN and infinite values, and pixels equivalent to the mask value
+   (unless the mask is NaN) are ignored.
+*******************************************************************/
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "asf.h"
+#include "asf_nan.h"
+#include "asf_raster.h"
+
+#include <glib.h>
+
+#define BAND_STATS_MANTISSA_BITS 9
+#define BAND_STATS_SHIFT (23 - BAND_STATS_MANTISSA_BITS)
+// Lines per block are chosen so a block holds about this many pixels
+#define BAND_STATS_BLOCK_PIXELS (4*1024*1024)
+// Bytes at each end of the image checksummed for the sidecar cache key
+#define BAND_STATS_CHECK_BYTES (64*1024)
+
+typedef struct {
+  float *data;                  // block of lines of the current band
+  int sample_count;
+  double mask;
+  band_stats_t *stats;          // band being accumulated
+  GMutex *mutex;                // protects stats
+} stats_block_t;
+
+/* Maps a float to an unsigned int with the same ordering. */
+static unsigned int float_key(float value)
+{
+  union { float f; unsigned int u; } x;
+  x.f = value;
+  return (x.u & 0x80000000) ? ~x.u : (x.u | 0x80000000);
+}
+
+static float key_value(unsigned int key)
+{
+  union { float f; unsigned int u; } x;
+  x.u = (key & 0x80000000) ? (key & 0x7fffffff) : ~key;
+  return x.f;
+}
+
+/* Value range [lo,hi] covered by a fine histogram bin, clipped to the
+   range of the data */
+static void bin_range(const band_stats_t *stats, int bin, double *lo,
+                      double *hi)
+{
+  unsigned int first = (unsigned int) bin << BAND_STATS_SHIFT;
+  unsigned int last = first + ((1u << BAND_STATS_SHIFT) - 1);
+
+  *lo = key_value(first);
+  *hi = key_value(last);
+  if (!(*lo >= stats->min)) *lo = stats->min;
+  if (!(*hi <= stats->max)) *hi = stats->max;
+  if (*hi < *lo) *hi = *lo;
+}
+
+/* Grows the histogram *hist, which covers fine bins *first to
+   *first + *count - 1, so it also covers bins lo to hi.  New bins are
+   zero.  slack is how many bins beyond lo..hi to add as well, so a
+   histogram that keeps growing isn't copied for every new bin. */
+static void hist_cover(long long **hist, unsigned int *first,
+                       unsigned int *count, unsigned int lo,
+                       unsigned int hi, unsigned int slack)
+{
+  unsigned int new_first, new_last, old_last;
+  long long *more;
+
+  if (*count > 0) {
+    old_last = *first + *count - 1;
+    if (lo >= *first && hi <= old_last)
+      return;
+    if (*first < lo) lo = *first;
+    if (old_last > hi) hi = old_last;
+  }
+  // Compared in 64 bits: slack can exceed the number of bins
+  new_first = lo > slack ? lo - slack : 0;
+  new_last = (unsigned long long)hi + slack < BAND_STATS_HIST_BINS - 1 ?
+    hi + slack : BAND_STATS_HIST_BINS - 1;
+
+  more = (long long *) CALLOC(new_last - new_first + 1, sizeof(long long));
+  if (*count > 0)
+    memcpy(more + (*first - new_first), *hist, *count*sizeof(long long));
+  FREE(*hist);
+  *hist = more;
+  *first = new_first;
+  *count = new_last - new_first + 1;
+}
+
+static band_stats_t *band_stats_new(int band_count)
+{
+  int ii;
+  band_stats_t *stats = (band_stats_t *) MALLOC(band_count*sizeof(band_stats_t));
+
+  for (ii=0; ii<band_count; ii++) {
+    stats[ii].count = 0;
+    stats[ii].min = stats[ii].max = stats[ii].mean = NAN;
+    stats[ii].std_dev = NAN;
+    stats[ii].hist = NULL;
+    stats[ii].hist_first = stats[ii].hist_count = 0;
+  }
+
+  return stats;
+}
+
+void band_stats_free(band_stats_t *stats, int band_count)
+{
+  int ii;
+
+  if (!stats)
+    return;
+  for (ii=0; ii<band_count; ii++)
+    FREE(stats[ii].hist);
+  FREE(stats);
+}
+
+/* Accumulates a range of lines of the block.  Mean and variance are
+   combined with those of the other lines using the pairwise update
+   of Chan et al, which is stable for large pixel counts. */
+static void stats_rows(void *data, int first_row, int last_row)
+{
+  stats_block_t *b = (stats_block_t *) data;
+  band_stats_t *s = b->stats;
+  long long *hist = NULL;
+  unsigned int hist_first = 0, hist_count = 0;
+  long long count = 0;
+  double min = 0, max = 0, mean = 0.0, m2 = 0.0, delta;
+  unsigned int bin, bin_min = BAND_STATS_HIST_BINS, bin_max = 0;
+  int use_mask = !ISNAN(b->mask);
+  long long ii;
+
+  for (ii = (long long)first_row*b->sample_count;
+       ii < (long long)(last_row+1)*b->sample_count; ii++) {
+    float v = b->data[ii];
+    if (!meta_is_valid_double(v))
+      continue;
+    if (use_mask && FLOAT_EQUIVALENT(v, b->mask))
+      continue;
+    if (count == 0)
+      min = max = v;
+    else if (v < min)
+      min = v;
+    else if (v > max)
+      max = v;
+    ++count;
+    delta = v - mean;
+    mean += delta/count;
+    m2 += delta*(v - mean);
+    bin = float_key(v) >> BAND_STATS_SHIFT;
+    if (bin < hist_first || bin >= hist_first + hist_count)
+      hist_cover(&hist, &hist_first, &hist_count, bin, bin,
+                 hist_count + (1 << BAND_STATS_MANTISSA_BITS));
+    hist[bin - hist_first]++;
+    if (bin < bin_min) bin_min = bin;
+    if (bin > bin_max) bin_max = bin;
+  }
+
+  if (count > 0) {
+    g_mutex_lock(b->mutex);
+    if (s->count == 0) {
+      s->min = min;
+      s->max = max;
+      s->mean = mean;
+      s->std_dev = m2;          // sum of squared deviations until done
+    }
+    else {
+      long long n = s->count + count;
+      delta = mean - s->mean;
+      if (min < s->min) s->min = min;
+      if (max > s->max) s->max = max;
+      s->mean += delta*count/n;
+      s->std_dev += m2 + delta*delta*((double)s->count*count/n);
+    }
+    s->count += count;
+    hist_cover(&s->hist, &s->hist_first, &s->hist_count, bin_min, bin_max, 0);
+    for (bin=bin_min; bin<=bin_max; bin++)
+      s->hist[bin - s->hist_first] += hist[bin - hist_first];
+    g_mutex_unlock(b->mutex);
+  }
+
+  FREE(hist);
+}
+
+static char *stats_file_name(const char *inFile)
+{
+  return appendExt(inFile, ".band_stats");
+}
+
+/* FNV-1a hash of up to len bytes of fp at offset */
+static unsigned int checksum_bytes(FILE *fp, long long offset, int len,
+                                   unsigned int hash)
+{
+  unsigned char buf[4096];
+  size_t ii, n;
+
+  FSEEK64(fp, offset, SEEK_SET);
+  while (len > 0 && (n = fread(buf, 1, len < (int) sizeof(buf) ?
+                               len : (int) sizeof(buf), fp)) > 0) {
+    for (ii=0; ii<n; ii++)
+      hash = (hash ^ buf[ii]) * 16777619u;
+    len -= n;
+  }
+  return hash;
+}
+
+/* What the sidecar cache is keyed on: the image size, modification
+   time and a checksum of its ends.  Whole second time stamps alone
+   miss an image rewritten at the same size within a second, which
+   the tools writing .img files do all the time. */
+typedef struct {
+  long long size;
+  long long mtime;
+  long long mtime_nsec;
+  unsigned int check;
+} image_signature_t;
+
+static int image_signature(const char *inFile, image_signature_t *sig)
+{
+  struct stat st;
+  FILE *fp;
+  long long tail;
+
+  if (stat(inFile, &st) != 0)
+    return FALSE;
+  sig->size = (long long) st.st_size;
+  sig->mtime = (long long) st.st_mtime;
+#if defined(win32)
+  sig->mtime_nsec = 0;
+#elif defined(darwin) || defined(__APPLE__)
+  sig->mtime_nsec = (long long) st.st_mtimespec.tv_nsec;
+#else
+  sig->mtime_nsec = (long long) st.st_mtim.tv_nsec;
+#endif
+
+  fp = fopen(inFile, "rb");
+  if (!fp)
+    return FALSE;
+  sig->check = checksum_bytes(fp, 0, BAND_STATS_CHECK_BYTES, 2166136261u);
+  tail = sig->size - BAND_STATS_CHECK_BYTES;
+  if (tail > BAND_STATS_CHECK_BYTES)
+    sig->check = checksum_bytes(fp, tail, BAND_STATS_CHECK_BYTES, sig->check);
+  fclose(fp);
+
+  return TRUE;
+}
+
+static int same_mask(double a, double b)
+{
+  if (ISNAN(a) || ISNAN(b))
+    return ISNAN(a) && ISNAN(b);
+  return a == b;
+}
+
+static band_stats_t *read_stats_file(const char *inFile, double mask,
+                                     int band_count)
+{
+  char *statsFile = stats_file_name(inFile);
+  FILE *fp = fopen(statsFile, "r");
+  band_stats_t *stats = NULL;
+  image_signature_t sig, file_sig;
+  char mask_str[64];
+  double file_mask;
+  int ii, kk, bins, bin, n, ok;
+
+  FREE(statsFile);
+  if (!fp)
+    return NULL;
+
+  ok = image_signature(inFile, &sig) &&
+    fscanf(fp, "# Band statistics for image file of the same base name\n") == 0 &&
+    fscanf(fp, "image size: %lld\n", &file_sig.size) == 1 &&
+    fscanf(fp, "image time: %lld %lld\n", &file_sig.mtime,
+           &file_sig.mtime_nsec) == 2 &&
+    fscanf(fp, "image check: %x\n", &file_sig.check) == 1 &&
+    fscanf(fp, "mask: %63s\n", mask_str) == 1 &&
+    fscanf(fp, "band count: %d\n", &n) == 1 &&
+    file_sig.size == sig.size && file_sig.mtime == sig.mtime &&
+    file_sig.mtime_nsec == sig.mtime_nsec && file_sig.check == sig.check &&
+    n == band_count;
+  if (ok) {
+    file_mask = strcmp(mask_str, "nan") == 0 ? NAN : atof(mask_str);
+    ok = same_mask(file_mask, mask);
+  }
+
+  if (ok) {
+    stats = band_stats_new(band_count);
+    for (kk=0; kk<band_count && ok; kk++) {
+      band_stats_t *s = &stats[kk];
+      ok = fscanf(fp, "band: %d\n", &n) == 1 && n == kk &&
+        fscanf(fp, "count: %lld\n", &s->count) == 1 &&
+        fscanf(fp, "minimum: %lf\n", &s->min) == 1 &&
+        fscanf(fp, "maximum: %lf\n", &s->max) == 1 &&
+        fscanf(fp, "mean: %lf\n", &s->mean) == 1 &&
+        fscanf(fp, "standard deviation: %lf\n", &s->std_dev) == 1 &&
+        fscanf(fp, "histogram bins: %d\n", &bins) == 1;
+      for (ii=0; ii<bins && ok; ii++) {
+        long long count;
+        ok = fscanf(fp, "%d %lld\n", &bin, &count) == 2 &&
+          bin >= 0 && bin < BAND_STATS_HIST_BINS;
+        if (ok) {
+          // Bins are listed in order, so this only grows at the end
+          hist_cover(&s->hist, &s->hist_first, &s->hist_count, bin, bin,
+                     s->hist_count);
+          s->hist[bin - s->hist_first] = count;
+        }
+      }
+    }
+    if (!ok) {
+      band_stats_free(stats, band_count);
+      stats = NULL;
+    }
+  }
+
+  fclose(fp);
+  return stats;
+}
+
+static void write_stats_file(const char *inFile, double mask,
+                             band_stats_t *stats, int band_count)
+{
+  char *statsFile = stats_file_name(inFile);
+  image_signature_t sig;
+  unsigned int ii;
+  int kk, bins;
+  FILE *fp;
+
+  if (!image_signature(inFile, &sig) ||
+      !(fp = fopen(statsFile, "w"))) {
+    FREE(statsFile);
+    return;
+  }
+
+  fprintf(fp, "# Band statistics for image file of the same base name\n");
+  fprintf(fp, "image size: %lld\n", sig.size);
+  fprintf(fp, "image time: %lld %lld\n", sig.mtime, sig.mtime_nsec);
+  fprintf(fp, "image check: %08x\n", sig.check);
+  if (ISNAN(mask))
+    fprintf(fp, "mask: nan\n");
+  else
+    fprintf(fp, "mask: %.17g\n", mask);
+  fprintf(fp, "band count: %d\n", band_count);
+  for (kk=0; kk<band_count; kk++) {
+    band_stats_t *s = &stats[kk];
+    for (bins=0, ii=0; ii<s->hist_count; ii++)
+      if (s->hist[ii]) bins++;
+    fprintf(fp, "band: %d\n", kk);
+    fprintf(fp, "count: %lld\n", s->count);
+    fprintf(fp, "minimum: %.17g\n", s->min);
+    fprintf(fp, "maximum: %.17g\n", s->max);
+    fprintf(fp, "mean: %.17g\n", s->mean);
+    fprintf(fp, "standard deviation: %.17g\n", s->std_dev);
+    fprintf(fp, "histogram bins: %d\n", bins);
+    for (ii=0; ii<s->hist_count; ii++)
+      if (s->hist[ii])
+        fprintf(fp, "%u %lld\n", s->hist_first + ii, s->hist[ii]);
+  }
+
+  FCLOSE(fp);
+  FREE(statsFile);
+}
+
+/* Returns an array of band_count statistics, one for each band of the
+   image, from the sidecar cache if it is current, otherwise from a
+   single pass over the image (which then updates the cache). */
+band_stats_t *band_stats_from_file(const char *inFile, double mask,
+                                   int *band_count)
+{
+  stats_block_t b;
+  band_stats_t *stats;
+  int ii, kk, lines;
+
+  meta_parameters *meta = meta_read(inFile);
+  int line_count = meta->general->line_count;
+  int sample_count = meta->general->sample_count;
+  *band_count = meta->general->band_count;
+
+  stats = read_stats_file(inFile, mask, *band_count);
+  if (stats) {
+    asfPrintStatus("\nUsing cached image statistics.\n");
+    meta_free(meta);
+    return stats;
+  }
+
+  stats = band_stats_new(*band_count);
+
+  int block_lines = BAND_STATS_BLOCK_PIXELS / sample_count;
+  if (block_lines < 1) block_lines = 1;
+  if (block_lines > line_count) block_lines = line_count;
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  b.data = (float *) MALLOC(sizeof(float)*block_lines*sample_count);
+  b.sample_count = sample_count;
+  b.mask = mask;
+  b.mutex = g_mutex_new ();
+
+  FILE *fp = FOPEN(inFile, "rb");
+  asfPrintStatus("\nCalculating statistics...\n");
+  for (kk=0; kk<*band_count; kk++) {
+    b.stats = &stats[kk];
+    for (ii=0; ii<line_count; ii+=lines) {
+      asfPercentMeter(((double)(kk*line_count + ii) /
+                       (double)(*band_count*line_count)));
+      lines = line_count - ii < block_lines ? line_count - ii : block_lines;
+      get_band_float_lines(fp, meta, kk, ii, lines, b.data);
+      parallel_rows(lines, stats_rows, &b);
+    }
+    if (stats[kk].count > 1)
+      stats[kk].std_dev = sqrt(stats[kk].std_dev/(stats[kk].count - 1));
+    else
+      stats[kk].std_dev = 0.0;
+  }
+  asfPercentMeter(1.0);
+  FCLOSE(fp);
+
+  g_mutex_free(b.mutex);
+  FREE(b.data);
+  meta_free(meta);
+
+  write_stats_file(inFile, mask, stats, *band_count);
+
+  return stats;
+}
+
+/* Approximate q-quantile (0 <= q <= 1) of the valid pixel values,
+   interpolating linearly within the fine histogram bin it falls in. */
+double band_stats_quantile(const band_stats_t *stats, double q)
+{
+  double target, cum = 0.0, lo, hi, value;
+  unsigned int ii;
+
+  if (stats->count == 0)
+    return NAN;
+  if (q <= 0.0) return stats->min;
+  if (q >= 1.0) return stats->max;
+
+  target = q * stats->count;
+  for (ii=0; ii<stats->hist_count; ii++) {
+    if (stats->hist[ii] && cum + stats->hist[ii] >= target) {
+      bin_range(stats, stats->hist_first + ii, &lo, &hi);
+      value = lo + (hi - lo)*(target - cum)/stats->hist[ii];
+      return value;
+    }
+    cum += stats->hist[ii];
+  }
+
+  return stats->max;
+}
+
+/* Histogram with num_bins uniform bins over [min,max] (the last bin
+   includes max), derived from the fine histogram by splitting each
+   fine bin's count over the bins it overlaps. */
+gsl_histogram *band_stats_histogram(const band_stats_t *stats, int num_bins)
+{
+  double min = stats->count ? stats->min : 0.0;
+  double max = stats->count ? stats->max : 1.0;
+  double lo, hi, width, a, b;
+  unsigned int ii;
+  int jj, first, last;
+
+  // Guard against weird data
+  if (!(min < max)) max = min + 1;
+
+  gsl_histogram *hist = gsl_histogram_alloc (num_bins);
+  gsl_histogram_set_ranges_uniform (hist, min, max);
+  width = (max - min) / num_bins;
+
+  for (ii=0; ii<stats->hist_count; ii++) {
+    if (!stats->hist[ii])
+      continue;
+    bin_range(stats, stats->hist_first + ii, &lo, &hi);
+    first = (int) ((lo - min) / width);
+    last = (int) ((hi - min) / width);
+    if (first >= num_bins) first = num_bins-1;
+    if (last >= num_bins) last = num_bins-1;
+    if (first == last || hi <= lo) {
+      hist->bin[first] += stats->hist[ii];
+      continue;
+    }
+    for (jj=first; jj<=last; jj++) {
+      a = min + jj*width;
+      b = a + width;
+      if (a < lo) a = lo;
+      if (b > hi || jj == num_bins-1) b = hi;
+      if (b > a)
+        hist->bin[jj] += stats->hist[ii] * (b - a) / (hi - lo);
+    }
+  }
+
+  return hist;
+}
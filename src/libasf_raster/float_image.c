@@ -1115,28 +1115,54 @@ float_image_new_from_metadata(meta_parameters *meta, const char *file)
 FloatImage *
 float_image_band_new_from_metadata(meta_parameters *meta,
            int band, const char *file)
+{
+    return float_image_band_new_from_metadata_window(meta, band, file, 0, 0,
+        meta->general->sample_count, meta->general->line_count);
+}
+
+// Returns a new FloatImage holding only the size_x by size_y window of
+// the image band whose upper left corner is at (x0, y0).  Pixel (x, y)
+// of the new image is pixel (x0 + x, y0 + y) of the band.  Only the
+// lines and samples within the window are read from the file.
+FloatImage *
+float_image_band_new_from_metadata_window(meta_parameters *meta,
+           int band, const char *file, ssize_t x0, ssize_t y0,
+           ssize_t size_x, ssize_t size_y)
 {
     int nl = meta->general->line_count;
     int ns = meta->general->sample_count;
 
+    if (x0 < 0 || y0 < 0 || size_x <= 0 || size_y <= 0 ||
+        x0 + size_x > ns || y0 + size_y > nl)
+      asfPrintError("Window (%ld,%ld) %ldx%ld is not within the %dx%d "
+                    "image %s\n", (long)x0, (long)y0, (long)size_x,
+                    (long)size_y, ns, nl, file);
+
     FILE * fp = FOPEN(file, "rb");
-    FloatImage * fi = float_image_new(ns, nl);
-
-    int i,j;
-    float *buf = MALLOC(sizeof(float)*ns);
-    for (i = 0; i < nl; ++i) {
-        get_float_line(fp, meta, i+band*nl, buf);
-        for (j = 0; j < ns; ++j)
-	  if (meta->general->radiometry >= r_SIGMA_DB &&
-	      meta->general->radiometry <= r_GAMMA_DB)
-            float_image_set_pixel(fi, j, i, pow(10, buf[j]/10.0));
-	  else
-            float_image_set_pixel(fi, j, i, buf[j]);
-        asfPercentMeter((float)i/(float)(nl-1));
+    FloatImage * fi = float_image_new(size_x, size_y);
+
+    // Read a few lines at a time, to keep the number of reads down
+    const int block = 64;
+    int take_power = meta->general->radiometry >= r_SIGMA_DB &&
+                     meta->general->radiometry <= r_GAMMA_DB;
+    float *buf = MALLOC(sizeof(float)*size_x*block);
+    int i,j,k;
+    for (i = 0; i < size_y; i += block) {
+        int n = size_y - i < block ? size_y - i : block;
+        get_partial_float_lines(fp, meta, y0+i+band*nl, n, x0, size_x, buf);
+        for (k = 0; k < n; ++k) {
+            float *row = buf + k*size_x;
+            for (j = 0; j < size_x; ++j)
+                if (take_power)
+                    float_image_set_pixel(fi, j, i+k, pow(10, row[j]/10.0));
+                else
+                    float_image_set_pixel(fi, j, i+k, row[j]);
+        }
+        asfPercentMeter((float)(i+n-1)/(float)(size_y > 1 ? size_y-1 : 1));
     }
 
-    free(buf);
-    fclose(fp);
+    FREE(buf);
+    FCLOSE(fp);
 
     return fi;
 }
@@ -1208,6 +1234,7 @@ load_tile (FloatImage *self, ssize_t x, ssize_t y)
     cached_tile_to_disk (self, oldest_tile);
     tile_address = self->tile_addresses[oldest_tile];
     self->tile_addresses[oldest_tile] = NULL;
+    asfProfileCount (PROFILE_TILE_EVICTIONS, 1);
   }
   else {
     // Load tile into first free slot.
@@ -1223,6 +1250,7 @@ load_tile (FloatImage *self, ssize_t x, ssize_t y)
                      GINT_TO_POINTER ((int) tile_offset));
 
   // Load the tile data.
+  asfProfileCount (PROFILE_TILE_MISSES, 1);
   int return_code
     = FSEEK64 (self->tile_file,
               (off_t) tile_offset * self->tile_area * sizeof (float),
@@ -1276,6 +1304,9 @@ float_image_get_pixel (FloatImage *self, ssize_t x, ssize_t y)
   if ( G_UNLIKELY (tile_address == NULL) ) {
     tile_address = load_tile (self, pc_x.quot, pc_y.quot);
   }
+  else {
+    asfProfileCount (PROFILE_TILE_HITS, 1);
+  }
 
   // Return pixel of interest.
   return tile_address[self->tile_size * pc_y.rem + pc_x.rem];
@@ -1303,6 +1334,9 @@ float_image_set_pixel (FloatImage *self, ssize_t x, ssize_t y, float value)
   if ( G_UNLIKELY (tile_address == NULL) ) {
     tile_address = load_tile (self, pc_x.quot, pc_y.quot);
   }
+  else {
+    asfProfileCount (PROFILE_TILE_HITS, 1);
+  }
 
   // Set pixel of interest.
   tile_address[self->tile_size * pc_y.rem + pc_x.rem] = value;
@@ -1710,6 +1744,9 @@ float_image_sample (FloatImage *self, float x, float y,
         if ( G_UNLIKELY (tile_address == NULL) ) {
           tile_address = load_tile (self, tx, ty);
         }
+        else {
+          asfProfileCount (PROFILE_TILE_HITS, 1);
+        }
         ul = tile_address[ybto * self->tile_size + xbto];
         ur = tile_address[ybto * self->tile_size + xato];
         ll = tile_address[yato * self->tile_size + xbto];
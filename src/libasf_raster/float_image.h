@@ -157,6 +157,13 @@ FloatImage *
 float_image_band_new_from_metadata(meta_parameters *meta,
                    int band, const char *file);
 
+// Only a window of a band: pixel (x, y) of the new image is pixel
+// (x0 + x, y0 + y) of the band, and only the window is read from disk.
+FloatImage *
+float_image_band_new_from_metadata_window(meta_parameters *meta,
+                   int band, const char *file, ssize_t x0, ssize_t y0,
+                   ssize_t size_x, ssize_t size_y);
+
 // Sample type of an image that is to be used to create a float_image
 // instance.  For example, floating point image can be created from
 // signed sixteen bit integer data.
@@ -5,125 +5,248 @@ FUNCTION NAME:   kernel - performs the kernel operation of the
 INPUT: inbuf          - input image buffer
        nLines         - number of lines (image buffer)
        nSamples       - number of samples per line (image buffer)
-       yLine          - line of interest
+       yLine          - line of interest (kernel center, within inbuf)
        xSample        - sample position within line
        kernel_size    - number of samples in kernel
        damping_factor - exponential damping factor
        nLooks         - number of looks in radar image
+
+kernel() evaluates a single output pixel directly from the window
+around it.  kernel_filter() produces the same results for a whole
+image, but keeps running column and window sums so that the mean and
+variance based filters cost O(1) per pixel, keeps the median window
+as a Fenwick tree of value ranks while it slides along a line, holds the input in a rolling
+block of lines instead of re-reading the window for every output
+line, and filters the lines of each block in parallel.
 *******************************************************************/
 #include <assert.h>
 
 #include "asf.h"
+#include "asf_nan.h"
 #include "asf_raster.h"
 
 #define SQR(X) ((X)*(X))
 
-int compare_values(const float *valueA, const float *valueB)
+// Number of output lines that kernel_filter() filters per block
+#define KERNEL_BLOCK_LINES 256
+
+typedef struct {
+  filter_type_t filter;
+  float *inbuf;        // input lines, line 0 is the top of row 0's window
+  float *outbuf;       // output lines, one per row
+  int nSamples;
+  int kernel_size;
+  float damping;
+  int nLooks;
+} kernel_rows_t;
+
+static int compare_values(const void *a, const void *b)
 {
-  if (*valueA <  *valueB) return -1;
-  if (*valueA == *valueB) return  0;
-  if (*valueA >  *valueB) return  1;
-  
+  float valueA = *(const float *) a;
+  float valueB = *(const float *) b;
+
+  if (valueA <  valueB) return -1;
+  if (valueA == valueB) return  0;
+  if (valueA >  valueB) return  1;
+
   assert (FALSE);		/* Shouldn't be here.  */
   return 0;
 }
 
-double calc_sum(float *inbuf, int nSamples, int xSample, int kernel_size)
+// The enhanced Frost filter works on intensities, all others on the
+// pixel values as they are.
+static double window_value(filter_type_t filter_type, float value)
 {
-  register int i,j;
-  double sum=0.0;
-  int half = (kernel_size-1)/2, base;
-
-  for (i=0; i<kernel_size; i++) {
-    base = (xSample-half);
-    for (j=0; j<kernel_size; j++) { 
-      sum += inbuf[base+j*nSamples];
-      base++;
-    }
-  }
-
-  return sum;
+  return filter_type == ENHANCED_FROST ? SQR((double)value) : value;
 }
 
-double calc_mean(float *inbuf, int nSamples, int xSample, int kernel_size)
+// Frost style weighted mean of the window.  The weights fall off
+// exponentially with the distance from the center column and are
+// applied to the column sums of the window (left to right).
+static double frost_mean(const double *colsum, int kernel_size, double a)
 {
-  register int i,j;
-  double sum=0.0, mean;
-  int half = (kernel_size-1)/2, base;
+  int half = (kernel_size-1)/2;
+  double sum = 0.0, weights = 0.0, m;
+  int j;
 
-  for (i=0; i<kernel_size; i++) {
-    base = (xSample-half);
-    for (j=0; j<kernel_size; j++) {
-      sum += inbuf[base+j*nSamples];
-      base++;
-    }
+  for (j=0; j<kernel_size; j++) {
+    m = exp(-a * abs(j-half));
+    sum += m * colsum[j];
+    weights += m;
   }
-  mean = sum / (SQR(kernel_size));
 
-  return mean;
+  return sum / (weights*kernel_size);
 }
 
-double calc_std_dev(float *inbuf, int nSamples, int xSample, int kernel_size,
-		    double mean)
+// Applies the mean/variance based filters.  center, mean and
+// standard_deviation are in the domain given by window_value(),
+// colsum points to the kernel_size column sums of the window.
+static float window_filter(filter_type_t filter_type, double center,
+                           double mean, double standard_deviation,
+                           const double *colsum, int kernel_size,
+                           float damping_factor, int nLooks)
 {
-  register int i,j;
-  double sum_vv=0.0, standard_deviation;
-  int half = (kernel_size-1)/2, base;
+  double weight, value = 0.0, ci, cu, cmax, a, b, d, rf;
 
-  for (i=0; i<kernel_size; i++) {
-    base = (xSample-half);
-    for (j=0; j<kernel_size; j++) {
-      sum_vv += SQR(inbuf[base+j+nSamples] - mean);
-      base++;
+  switch(filter_type)
+    {
+    case AVERAGE:
+      value = mean;
+      break;
+
+    case EDGE:
+      value = center - mean;
+      break;
+
+    case LEE:
+      if (mean == 0.0 || standard_deviation == 0.0) return mean;
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      weight = 1 - SQR(cu)/SQR(ci);
+      value = center*weight + mean*(1-weight);
+      break;
+
+    case ENHANCED_LEE:
+      if (mean == 0.0) return mean;
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      cmax = sqrt(1+2.0/(double)nLooks);
+      if (ci <= cu) value = mean;
+      else if (ci < cmax) {
+        weight = exp(-damping_factor*(ci-cu)/(cmax-ci));
+        value = mean*weight + center*(1-weight);
+      }
+      else value = center;
+      break;
+
+    case FROST:
+      if (mean == 0.0) return mean;
+      ci = standard_deviation/mean;
+      a = damping_factor * SQR(ci);
+      value = frost_mean(colsum, kernel_size, a);
+      break;
+
+    case ENHANCED_FROST:
+      if (mean == 0.0) return mean;
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      cmax = sqrt(1+2.0/(double)nLooks);
+      if (ci < cu) value = sqrt(mean);
+      else if (ci <= cmax) {
+        a = damping_factor * (ci-cu) / (cmax-ci);
+        value = sqrt(frost_mean(colsum, kernel_size, a));
+      }
+      else value = sqrt(center);
+      break;
+
+    case GAMMA_MAP:
+      if (mean == 0.0) return mean;
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      cmax = sqrt(2.0)*cu;
+      if (ci <= cu) value = mean;
+      else if (ci < cmax) {
+        a = (1+SQR(cu)) / (SQR(ci)-SQR(cu));
+        b = a - nLooks - 1;
+        d = SQR(mean)*SQR(b) + 4*a*nLooks*mean*center;
+        rf = (b*mean + sqrt(d)) / (2*a);
+        value = rf;
+      }
+      else value = center;
+      break;
+
+    case KUAN:
+      if (mean == 0.0 || standard_deviation == 0.0) return mean;
+      ci = standard_deviation/mean;
+      cu = sqrt(1/(double)nLooks);
+      weight = (1 - SQR(cu)/SQR(ci))/(1 + SQR(cu));
+      value = center*weight + mean*(1-weight);
+      break;
+
+    default:
+      assert (FALSE);
+      break;
     }
-  }
-  standard_deviation = sqrt(sum_vv / (SQR(kernel_size)-1));
 
-  return standard_deviation;
+  return value;
+}
+
+static int is_window_filter(filter_type_t filter_type)
+{
+  switch(filter_type)
+    {
+    case AVERAGE:
+    case EDGE:
+    case LEE:
+    case ENHANCED_LEE:
+    case FROST:
+    case ENHANCED_FROST:
+    case GAMMA_MAP:
+    case KUAN:
+      return TRUE;
+    default:
+      return FALSE;
+    }
 }
 
-float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples, 
-	     int yLine, int xSample, int kernel_size, float damping_factor, 
+float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
+	     int yLine, int xSample, int kernel_size, float damping_factor,
 	     int nLooks)
-{                    
-  double sum = 0.0, mean, standard_deviation, weight, value = 0.0;         
+{
+  double sum = 0.0, sumsq = 0.0, mean, standard_deviation, value = 0.0;
+  double weight, x, y, v, *colsum;
   int half = (kernel_size-1)/2;
-  int base = xSample-half+(nLines-half)*nSamples;
-  int total = 0, sigmsq=4;
-  double ci, cu, cmax, center, a, b, d, rf = 0.0, x, y, m;
+  int base = (yLine-half)*nSamples + xSample-half;  // top left of the kernel
+  int b3 = (yLine-1)*nSamples + xSample-1;          // top left of 3x3 center
+  int n = kernel_size*kernel_size, total = 0, sigmsq=4;
   float *pix;
   register int i, j;
-  
+
+  assert (yLine-half >= 0 && yLine+half < nLines);
+
+  if (is_window_filter(filter_type)) {
+    colsum = (double *) MALLOC(kernel_size*sizeof(double));
+    for (j=0; j<kernel_size; j++) {
+      colsum[j] = 0.0;
+      for (i=0; i<kernel_size; i++) {
+        v = window_value(filter_type, inbuf[base + i*nSamples + j]);
+        colsum[j] += v;
+        sumsq += v*v;
+      }
+      sum += colsum[j];
+    }
+    mean = sum/n;
+    standard_deviation = (sumsq - sum*sum/n) / (n-1);
+    standard_deviation = standard_deviation > 0.0 ? sqrt(standard_deviation) : 0.0;
+    value = window_filter(filter_type,
+                          window_value(filter_type,
+                                       inbuf[yLine*nSamples + xSample]),
+                          mean, standard_deviation, colsum, kernel_size,
+                          damping_factor, nLooks);
+    FREE(colsum);
+    return value;
+  }
+
   switch(filter_type)
     {
-    case AVERAGE:
-      for (i=yLine-half; i<=yLine-half; i++)
-	for (j=xSample-half; j<=xSample+half; j++)
-	  sum += inbuf[i*nSamples+j];
-      total = kernel_size * kernel_size;
-      value = sum/total;
-      break;
-
     case GAUSSIAN:
-      sum = calc_sum(inbuf, nSamples, xSample, kernel_size);
-      for (i=yLine-half; i<=yLine-half; i++) {
-        for (j=xSample-half; j<=xSample+half; j++) {
-          value += exp(- (SQR(i-half)+SQR(j-xSample)) / (2*sigmsq)) 
-                   * inbuf[base] / sum;
-          base++;
+      for (i=-half; i<=half; i++) {
+        for (j=-half; j<=half; j++) {
+          weight = exp(- (SQR(i)+SQR(j)) / (2.0*sigmsq));
+          value += weight * inbuf[base + (i+half)*nSamples + j+half];
+          sum += weight;
         }
-        base += nSamples;
-        base -= kernel_size;
       }
+      value /= sum;
       break;
 
     case LAPLACE1:
       /* Kernel:  0  1  0
                   1 -4  1
-                  0  1  0 */      
+                  0  1  0 */
 
-      value = inbuf[base+1] + inbuf[base+nSamples] - 4*inbuf[base+1+nSamples] 
-        + inbuf[base+2+nSamples] + inbuf[base+1+2*nSamples];
+      value = inbuf[b3+1] + inbuf[b3+nSamples] - 4*inbuf[b3+1+nSamples]
+        + inbuf[b3+2+nSamples] + inbuf[b3+1+2*nSamples];
       break;
 
     case LAPLACE2:
@@ -131,10 +254,10 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
                  -1  8 -1
                  -1 -1 -1 */
 
-      value = -inbuf[base] - inbuf[base+1] - inbuf[base+2]
-        - inbuf[base+nSamples] + 8*inbuf[base+1+nSamples] 
-        - inbuf[base+2+nSamples] - inbuf[base+2*nSamples]
-        - inbuf[base+1+2*nSamples] - inbuf[base+2+2*nSamples];
+      value = -inbuf[b3] - inbuf[b3+1] - inbuf[b3+2]
+        - inbuf[b3+nSamples] + 8*inbuf[b3+1+nSamples]
+        - inbuf[b3+2+nSamples] - inbuf[b3+2*nSamples]
+        - inbuf[b3+1+2*nSamples] - inbuf[b3+2+2*nSamples];
       break;
 
     case LAPLACE3:
@@ -142,10 +265,10 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
                  -2  4 -2
                   1 -2  1 */
 
-      value = inbuf[base] - 2*inbuf[base+1] + inbuf[base+2]
-        - 2*inbuf[base+nSamples] + 4*inbuf[base+1+nSamples] 
-        - 2*inbuf[base+2+nSamples] + inbuf[base+2*nSamples]
-        - 2*inbuf[base+1+2*nSamples] + inbuf[base+2+2*nSamples];
+      value = inbuf[b3] - 2*inbuf[b3+1] + inbuf[b3+2]
+        - 2*inbuf[b3+nSamples] + 4*inbuf[b3+1+nSamples]
+        - 2*inbuf[b3+2+nSamples] + inbuf[b3+2*nSamples]
+        - 2*inbuf[b3+1+2*nSamples] + inbuf[b3+2+2*nSamples];
       break;
 
     case SOBEL:
@@ -155,25 +278,25 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
 
                       x            y      */
 
-      x = -inbuf[base] + inbuf[base+2] - 2*inbuf[base+nSamples] 
-        + 2*inbuf[base+2+nSamples] - inbuf[base+2*nSamples]
-        + inbuf[base+2+2*nSamples];
-      y = inbuf[base] + 2*inbuf[base+1] + inbuf[base+2]
-        - inbuf[base+2*nSamples] - 2*inbuf[base+1+2*nSamples] 
-        - inbuf[base+2+2*nSamples];
+      x = -inbuf[b3] + inbuf[b3+2] - 2*inbuf[b3+nSamples]
+        + 2*inbuf[b3+2+nSamples] - inbuf[b3+2*nSamples]
+        + inbuf[b3+2+2*nSamples];
+      y = inbuf[b3] + 2*inbuf[b3+1] + inbuf[b3+2]
+        - inbuf[b3+2*nSamples] - 2*inbuf[b3+1+2*nSamples]
+        - inbuf[b3+2+2*nSamples];
       value = sqrt(SQR(x) + SQR(y));
       break;
 
     case SOBEL_X:
-      value = -inbuf[base] + inbuf[base+2] - 2*inbuf[base+nSamples] 
-        + 2*inbuf[base+2+nSamples] - inbuf[base+2*nSamples]
-        + inbuf[base+2+2*nSamples];
+      value = -inbuf[b3] + inbuf[b3+2] - 2*inbuf[b3+nSamples]
+        + 2*inbuf[b3+2+nSamples] - inbuf[b3+2*nSamples]
+        + inbuf[b3+2+2*nSamples];
       break;
 
     case SOBEL_Y:
-      value = inbuf[base] + 2*inbuf[base+1] + inbuf[base+2]
-        - inbuf[base+2*nSamples] - 2*inbuf[base+1+2*nSamples] 
-        - inbuf[base+2+2*nSamples];
+      value = inbuf[b3] + 2*inbuf[b3+1] + inbuf[b3+2]
+        - inbuf[b3+2*nSamples] - 2*inbuf[b3+1+2*nSamples]
+        - inbuf[b3+2+2*nSamples];
       break;
 
     case PREWITT:
@@ -183,231 +306,332 @@ float kernel(filter_type_t filter_type, float *inbuf, int nLines, int nSamples,
 
                       x            y      */
 
-      x = -inbuf[base] + inbuf[base+2] - inbuf[base+nSamples] 
-        + inbuf[base+2+nSamples] - inbuf[base+2*nSamples]
-        + inbuf[base+2+2*nSamples];
-      y = inbuf[base] + inbuf[base+1] + inbuf[base+2]
-        - inbuf[base+2*nSamples] - inbuf[base+1+2*nSamples] 
-        - inbuf[base+2+2*nSamples];
+      x = -inbuf[b3] + inbuf[b3+2] - inbuf[b3+nSamples]
+        + inbuf[b3+2+nSamples] - inbuf[b3+2*nSamples]
+        + inbuf[b3+2+2*nSamples];
+      y = inbuf[b3] + inbuf[b3+1] + inbuf[b3+2]
+        - inbuf[b3+2*nSamples] - inbuf[b3+1+2*nSamples]
+        - inbuf[b3+2+2*nSamples];
       value = sqrt(SQR(x) + SQR(y));
       break;
 
     case PREWITT_X:
-      value = -inbuf[base] + inbuf[base+2] - inbuf[base+nSamples] 
-        + inbuf[base+2+nSamples] - inbuf[base+2*nSamples]
-        + inbuf[base+2+2*nSamples];
+      value = -inbuf[b3] + inbuf[b3+2] - inbuf[b3+nSamples]
+        + inbuf[b3+2+nSamples] - inbuf[b3+2*nSamples]
+        + inbuf[b3+2+2*nSamples];
       break;
 
     case PREWITT_Y:
-      value = inbuf[base] + inbuf[base+1] + inbuf[base+2]
-        - inbuf[base+2*nSamples] - inbuf[base+1+2*nSamples] 
-        - inbuf[base+2+2*nSamples];
-      break;
-
-    case EDGE:
-      value = inbuf[base + half + half*nSamples] - kernel(AVERAGE,inbuf,nLines,
-        nSamples,yLine,xSample,kernel_size,damping_factor,nLooks);
+      value = inbuf[b3] + inbuf[b3+1] + inbuf[b3+2]
+        - inbuf[b3+2*nSamples] - inbuf[b3+1+2*nSamples]
+        - inbuf[b3+2+2*nSamples];
       break;
 
     case MEDIAN:
-      pix = (float*) MALLOC(kernel_size*kernel_size*sizeof(float));
-      for (i=yLine-half; i<=yLine+half; i++) {
-        for (j=xSample-half; j<=xSample+half; j++) 
-          pix[total++] = inbuf[base++];
-        base += nSamples;
-        base -= kernel_size;
-      }
-      qsort(pix, kernel_size*kernel_size, sizeof(float), (void*)compare_values);
-      value = pix[kernel_size*kernel_size/2 + 1];
+      pix = (float*) MALLOC(n*sizeof(float));
+      for (i=0; i<kernel_size; i++)
+        for (j=0; j<kernel_size; j++)
+          pix[total++] = inbuf[base + i*nSamples + j];
+      qsort(pix, n, sizeof(float), compare_values);
+      value = pix[n/2];
       FREE(pix);
       break;
 
-    case LEE:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      weight = 1 - SQR(cu)/SQR(ci);
-      value = center*weight + mean*(1-weight);
+    default:
+      assert (FALSE);
       break;
+    }
 
-    case ENHANCED_LEE:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      cmax = sqrt(1+2.0/(double)nLooks);
-      weight = exp(-damping_factor*(ci-cu)/(cmax-ci));
-      rf = center*weight + center*(1-weight);
-      if (ci <= cu) value = mean;
-      else if ((cu < ci) && (ci < cmax)) value = rf;
-      else if (ci >= cmax) value = center;
-      break;
+  return value;
+}
 
-    case FROST:
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      a = damping_factor * SQR(ci);
-      for (i=yLine-half; i<=yLine+half; i++) {
-	for (j=xSample-half; j<=xSample+half; j++) {
-          m = exp(-a * abs(j-half));
-          rf += m * inbuf[base];
-          sum += m;
-          base++;
-        }
-	base += nSamples;
-	base -= kernel_size;
-      }
-      value = rf / sum;
-      break;
+// A window value together with its position in the strip of lines
+// covered by the windows of one output row.
+typedef struct {
+  float value;
+  int pos;
+} ranked_value_t;
 
-    case ENHANCED_FROST:
-      for (i=yLine-half; i<=yLine+half; i++) {
-        for (j=xSample-half; j<=xSample+half; j++) {
-          inbuf[base] = SQR(inbuf[base]);
-          base++;
-        }
-        base += nSamples;
-        base -= kernel_size;
+// Orders by value, NaNs last, and by position among equal values so
+// that every value in the strip gets a distinct rank.
+static int compare_ranked(const void *a, const void *b)
+{
+  const ranked_value_t *rA = (const ranked_value_t *) a;
+  const ranked_value_t *rB = (const ranked_value_t *) b;
+  int nanA = ISNAN(rA->value), nanB = ISNAN(rB->value);
+
+  if (nanA != nanB) return nanA - nanB;
+  if (!nanA && rA->value < rB->value) return -1;
+  if (!nanA && rA->value > rB->value) return  1;
+  return rA->pos - rB->pos;
+}
+
+// Fenwick tree over the ranks: count[] holds how many values of each
+// rank are in the window.
+static void rank_add(int *count, int m, int rank, int delta)
+{
+  for (rank++; rank<=m; rank += rank & -rank)
+    count[rank] += delta;
+}
+
+// Returns the rank of the (kth+1)-smallest value in the window.
+static int rank_select(const int *count, int m, int top_bit, int kth)
+{
+  int pos = 0, bit;
+
+  for (bit=top_bit; bit>0; bit >>= 1)
+    if (pos+bit <= m && count[pos+bit] <= kth) {
+      pos += bit;
+      kth -= count[pos];
+    }
+
+  return pos;
+}
+
+// Sliding median: the values of the kernel_size lines under a row of
+// windows are ranked once, the window is kept as a Fenwick tree of
+// ranks and updated by one column per sample, so that every output
+// pixel costs O(kernel_size * log) instead of sorting the window.
+static void median_rows(void *data, int first_row, int last_row)
+{
+  const kernel_rows_t *k = (const kernel_rows_t *) data;
+  int ns = k->nSamples, ks = k->kernel_size, half = (ks-1)/2;
+  int n = ks*ks, m = ks*ns, top_bit = 1, row, i, j;
+  ranked_value_t *sorted =
+    (ranked_value_t *) MALLOC(m*sizeof(ranked_value_t));
+  int *rank = (int *) MALLOC(m*sizeof(int));
+  int *count = (int *) MALLOC((m+1)*sizeof(int));
+
+  while (top_bit*2 <= m)
+    top_bit *= 2;
+
+  for (row=first_row; row<=last_row; row++) {
+    // The kernel_size input lines of this row are contiguous
+    const float *strip = k->inbuf + row*ns;
+    float *out = k->outbuf + row*ns;
+
+    for (i=0; i<m; i++) {
+      sorted[i].value = strip[i];
+      sorted[i].pos = i;
+    }
+    qsort(sorted, m, sizeof(ranked_value_t), compare_ranked);
+    for (i=0; i<m; i++)
+      rank[sorted[i].pos] = i;
+
+    memset(count, 0, (m+1)*sizeof(int));
+    for (i=0; i<ks; i++)
+      for (j=0; j<ks; j++)
+        rank_add(count, m, rank[i*ns + j], 1);
+    out[half] = sorted[rank_select(count, m, top_bit, n/2)].value;
+
+    for (j=half+1; j<ns-half; j++) {
+      for (i=0; i<ks; i++) {
+        rank_add(count, m, rank[i*ns + j-half-1], -1);
+        rank_add(count, m, rank[i*ns + j+half], 1);
       }
-      base = xSample- half;
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      cu = sqrt(1/(double)nLooks);
-      cmax = sqrt(1+2.0/(double)nLooks);
-      for (i=0; i<nLines; i++) {
-	for (j=xSample-half; j<=xSample+half; j++) {
-          ci = sqrt(SQR(inbuf[base]-mean))/mean;
-          m = exp(-damping_factor * (ci-cu) / (cmax-ci) * abs(j-half));
-          rf += m * inbuf[base];
-          sum += m;
-          base++;
-        }
-	base += nSamples;
-	base -= kernel_size;
+      out[j] = sorted[rank_select(count, m, top_bit, n/2)].value;
+    }
+  }
+
+  FREE(sorted);
+  FREE(rank);
+  FREE(count);
+}
+
+// Mean/variance based filters from running sums: column sums are
+// updated by one line per row, window sums by one column per sample.
+static void window_rows(void *data, int first_row, int last_row)
+{
+  const kernel_rows_t *k = (const kernel_rows_t *) data;
+  filter_type_t filter = k->filter;
+  int ns = k->nSamples, ks = k->kernel_size, half = (ks-1)/2;
+  int n = ks*ks, row, i, j;
+  double sum, sumsq, mean, var, v, w;
+  double *colsum = (double *) MALLOC(ns*sizeof(double));
+  double *colsq = (double *) MALLOC(ns*sizeof(double));
+
+  for (j=0; j<ns; j++) {
+    colsum[j] = colsq[j] = 0.0;
+    for (i=0; i<ks; i++) {
+      v = window_value(filter, k->inbuf[(first_row+i)*ns + j]);
+      colsum[j] += v;
+      colsq[j] += v*v;
+    }
+  }
+
+  for (row=first_row; row<=last_row; row++) {
+    float *out = k->outbuf + row*ns;
+
+    if (row > first_row) {
+      const float *top = k->inbuf + (row-1)*ns;
+      const float *bottom = k->inbuf + (row+ks-1)*ns;
+      for (j=0; j<ns; j++) {
+        v = window_value(filter, top[j]);
+        w = window_value(filter, bottom[j]);
+        colsum[j] += w - v;
+        colsq[j] += w*w - v*v;
       }
-      rf /= sum;
-      if (ci < cu) value = sqrt(mean);
-      else if ((cu <= ci) && (ci <= cmax)) value = sqrt(rf);
-      else if (ci > cmax) value = sqrt(center);
-      break;
+    }
 
-    case GAMMA_MAP:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      cmax = sqrt(2.0)*cu;
-      a = (1+SQR(cu)) / (SQR(ci)-SQR(cu));
-      b = a - nLooks - 1;
-      d = SQR(mean)*SQR(b) + 4*a*nLooks*mean*center;
-      rf = (b*mean + sqrt(d)) / (2*a);
-      if (ci <= cu) value = mean;
-      else if ((cu < ci) && (ci < cmax)) value = rf;
-      else if (ci >= cmax) value = center;
-      break;
-     
-    case KUAN:
-      center = inbuf[base + half + half*nSamples];
-      mean = calc_mean(inbuf, nSamples, xSample, kernel_size);
-      standard_deviation = 
-	calc_std_dev(inbuf, nSamples, xSample, kernel_size, mean);
-      ci = standard_deviation/mean;
-      cu = sqrt(1/(double)nLooks);
-      weight = (1 - SQR(cu)/SQR(ci))/(1 + SQR(cu));
-      value = center*weight + mean*(1-weight);
-      break;
+    sum = sumsq = 0.0;
+    for (j=0; j<ks; j++) {
+      sum += colsum[j];
+      sumsq += colsq[j];
     }
+    for (j=half; j<ns-half; j++) {
+      if (j > half) {
+        sum += colsum[j+half] - colsum[j-half-1];
+        sumsq += colsq[j+half] - colsq[j-half-1];
+      }
+      mean = sum/n;
+      var = (sumsq - sum*sum/n) / (n-1);
+      out[j] = window_filter(filter,
+                  window_value(filter, k->inbuf[(row+half)*ns + j]),
+                  mean, var > 0.0 ? sqrt(var) : 0.0, colsum + j-half, ks,
+                  k->damping, k->nLooks);
+    }
+  }
 
-  return value;
+  FREE(colsum);
+  FREE(colsq);
+}
+
+// Everything else is cheap enough (3x3 or separable) to be done
+// directly with kernel().
+static void direct_rows(void *data, int first_row, int last_row)
+{
+  const kernel_rows_t *k = (const kernel_rows_t *) data;
+  int ns = k->nSamples, ks = k->kernel_size, half = (ks-1)/2;
+  int row, j;
+
+  for (row=first_row; row<=last_row; row++)
+    for (j=half; j<ns-half; j++)
+      k->outbuf[row*ns + j] =
+        kernel(k->filter, k->inbuf + row*ns, ks, ns, half, j, ks,
+               k->damping, k->nLooks);
 }
 
-void kernel_filter(char *inFile, char *outFile, filter_type_t filter, 
+static void filter_rows(void *data, int first_row, int last_row)
+{
+  const kernel_rows_t *k = (const kernel_rows_t *) data;
+  int ns = k->nSamples, half = (k->kernel_size-1)/2;
+  int row, j;
+
+  // Left and right margins are set to zero
+  for (row=first_row; row<=last_row; row++) {
+    for (j=0; j<half && j<ns; j++)
+      k->outbuf[row*ns + j] = 0.0;
+    for (j=ns-half>half ? ns-half : half; j<ns; j++)
+      k->outbuf[row*ns + j] = 0.0;
+  }
+
+  // An image narrower than the kernel is all margin; the sliding
+  // window code below assumes at least one full window per row
+  if (ns < k->kernel_size)
+    return;
+
+  if (k->filter == MEDIAN)
+    median_rows(data, first_row, last_row);
+  else if (is_window_filter(k->filter))
+    window_rows(data, first_row, last_row);
+  else
+    direct_rows(data, first_row, last_row);
+}
+
+void kernel_filter(char *inFile, char *outFile, filter_type_t filter,
 		   int kernel_size, float damping, int nLooks)
 {
-  int ii, jj, kk;
+  int ii, kk, first, rows, have;
   char **band_names=NULL;
+  kernel_rows_t k;
+
+  if (kernel_size < 3 || kernel_size%2 == 0)
+    asfPrintError("Kernel size must be odd and >= 3 (got %d).\n",
+                  kernel_size);
 
   // Create metadata
   meta_parameters *inMeta = meta_read(inFile);
   meta_parameters *outMeta = meta_read(inFile);
   outMeta->general->data_type = REAL32;
-  
+
   int inLines = inMeta->general->line_count;
   int inSamples = inMeta->general->sample_count;
   int half = (kernel_size - 1) / 2;
-  int numLines = kernel_size;
-  
+
   // Open output files
   FILE *fpIn = fopenImage(inFile,"rb");
   FILE *fpOut = fopenImage(outFile,"wb");
-    
-  // Allocate memory for input and output file
-  float *inbuf= (float*) MALLOC (kernel_size*inSamples*sizeof(float));
-  float *outbuf = (float*) MALLOC (inSamples*sizeof(float));
+
+  // Allocate memory for a block of lines (plus the kernel margins) of
+  // the input file, and the corresponding block of output lines
+  float *inbuf = (float*)
+    MALLOC ((KERNEL_BLOCK_LINES+2*half)*inSamples*sizeof(float));
+  float *outbuf = (float*)
+    MALLOC (KERNEL_BLOCK_LINES*inSamples*sizeof(float));
+
+  k.filter = filter;
+  k.inbuf = inbuf;
+  k.outbuf = outbuf;
+  k.nSamples = inSamples;
+  k.kernel_size = kernel_size;
+  k.damping = damping;
+  k.nLooks = nLooks;
 
   // Go through all bands
   int band_count = inMeta->general->band_count;
   band_names = extract_band_names(inMeta->general->bands, band_count);
   for (kk=0; kk<band_count; kk++) {
-  
+
     asfPrintStatus("\nFiltering %s ...\n", band_names[kk]);
 
-    // Set upper margin of image to input pixel values
-    for (ii=0; ii<half; ii++) {
-      for (jj=0; jj<inSamples; jj++) outbuf[jj] = 0.0;
+    // Set upper margin of image to zero
+    for (ii=0; ii<inSamples; ii++) outbuf[ii] = 0.0;
+    for (ii=0; ii<half && ii<inLines; ii++) {
       put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
       asfLineMeter(ii, inLines);
     }
-  
-    int startLine;
-    
-    // Filtering the 'regular' lines
-    for (ii=half; ii<inLines-half; ii++) {
-      
-      // Read next set of lines for kernel
-      startLine = ii - half;
-      if (startLine<0) startLine = 0;
-      if (inLines < (kernel_size+startLine)) numLines = inLines - startLine;
-      get_band_float_lines(fpIn, inMeta, kk, startLine, numLines, inbuf); 
-      
-      // Calculate the usual output line
-      for (jj=0; jj<half; jj++) outbuf[jj] = 0.0;
-      for (jj=half; jj<inSamples-half; jj++) {
-	outbuf[jj] = kernel(filter, inbuf, numLines, inSamples, ii, jj,
-			    kernel_size, damping, nLooks);
+
+    // Filtering the 'regular' lines, a block at a time.  The last
+    // 2*half input lines of a block are the first ones of the next.
+    have = 0;
+    for (first=half; first<inLines-half; first+=rows) {
+      rows = inLines-half-first;
+      if (rows > KERNEL_BLOCK_LINES) rows = KERNEL_BLOCK_LINES;
+
+      if (have > 0) {
+        memmove(inbuf, inbuf + (have-2*half)*inSamples,
+                2*half*inSamples*sizeof(float));
+        have = 2*half;
       }
-      for (jj=inSamples-half; jj<inSamples; jj++) outbuf[jj] = 0.0;
-      
-      // Write line to disk
-      put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
-      asfLineMeter(ii, inLines);
+      get_band_float_lines(fpIn, inMeta, kk, first-half+have,
+                           rows+2*half-have, inbuf + have*inSamples);
+      have = rows+2*half;
+
+      parallel_rows(rows, filter_rows, &k);
+
+      // Write block to disk
+      put_band_float_lines(fpOut, outMeta, kk, first, rows, outbuf);
+      for (ii=first; ii<first+rows; ii++)
+        asfLineMeter(ii, inLines);
     }
-    
-    // Set lower margin of image to input pixel values
-    for (ii=inLines-half; ii<inLines; ii++) {
-      for (jj=0; jj<inSamples; jj++) outbuf[jj] = 0.0;
+
+    // Set lower margin of image to zero
+    for (ii=0; ii<inSamples; ii++) outbuf[ii] = 0.0;
+    for (ii=inLines-half>half ? inLines-half : half; ii<inLines; ii++) {
       put_band_float_line(fpOut, outMeta, kk, ii, outbuf);
       asfLineMeter(ii, inLines);
-    }  
+    }
   }
 
   // Clean up
+  for (kk=0; kk<band_count; kk++)
+    FREE(band_names[kk]);
+  FREE(band_names);
   FREE(inbuf);
   FREE(outbuf);
   FCLOSE(fpOut);
   FCLOSE(fpIn);
-  
+
   // Write metadata
   meta_write(outMeta, outFile);
   meta_free(inMeta);
@@ -0,0 +1,116 @@
+/*******************************************************************
+   Simple row-parallel execution helpers.
+
+   Many of the raster operations in this library produce each output
+   line independently of the others once the input lines they need
+   are in memory.  parallel_rows() splits such a block of rows into
+   contiguous chunks and hands each chunk to its own thread, so the
+   caller only needs to write a function that processes a range of
+   rows.  The worker function must not do any file I/O or call the
+   asfPrint* routines, since those are not thread safe.  While the
+   threads run, an error on the calling thread exits the program even
+   inside a job (see job.c), as unwinding would pull the rows out from
+   under the other threads.
+
+   The number of threads defaults to the number of online processors
+   and can be overridden with set_number_of_threads() (asf_mapready
+   does this from its configuration file).
+
+   The threads use the GLib 2.4 thread API (g_thread_create), since
+   that is the oldest GLib we support; configure adds gthread-2.0 to
+   GLIB_LIBS so every tool linking this library gets it.
+*******************************************************************/
+#include "asf.h"
+#include "asf_raster.h"
+
+#include <glib.h>
+#ifndef win32
+#include <unistd.h>
+#endif
+
+// Number of threads requested by the user, zero means "use all processors"
+static int requested_thread_count = 0;
+
+typedef struct {
+  parallel_rows_fn *fn;
+  void *data;
+  int first_row;
+  int last_row;
+} row_chunk_t;
+
+static int processor_count(void)
+{
+  int n = 1;
+#ifdef win32
+  const char *s = getenv("NUMBER_OF_PROCESSORS");
+  if (s) n = atoi(s);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return n > 0 ? n : 1;
+}
+
+void set_number_of_threads(int thread_count)
+{
+  requested_thread_count = thread_count > 0 ? thread_count : 0;
+}
+
+int get_number_of_threads(void)
+{
+  if (requested_thread_count > 0)
+    return requested_thread_count;
+  return processor_count();
+}
+
+static gpointer row_chunk_thread(gpointer arg)
+{
+  row_chunk_t *chunk = (row_chunk_t *) arg;
+  chunk->fn(chunk->data, chunk->first_row, chunk->last_row);
+  return NULL;
+}
+
+// Calls fn(data, first, last) on disjoint, contiguous, inclusive row
+// ranges covering 0..row_count-1.  Returns once all rows are done.
+void parallel_rows(int row_count, parallel_rows_fn *fn, void *data)
+{
+  int ii;
+  int thread_count = get_number_of_threads();
+
+  if (row_count <= 0)
+    return;
+  if (thread_count > row_count)
+    thread_count = row_count;
+
+  if (thread_count <= 1) {
+    fn(data, 0, row_count-1);
+    return;
+  }
+
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  row_chunk_t *chunks = MALLOC(sizeof(row_chunk_t)*thread_count);
+  GThread **threads = MALLOC(sizeof(GThread *)*thread_count);
+
+  for (ii=0; ii<thread_count; ++ii) {
+    chunks[ii].fn = fn;
+    chunks[ii].data = data;
+    chunks[ii].first_row = (int)((long long)row_count*ii/thread_count);
+    chunks[ii].last_row = (int)((long long)row_count*(ii+1)/thread_count) - 1;
+  }
+
+  // The calling thread takes the last chunk itself
+  asfJobEnterThreads();
+  for (ii=0; ii<thread_count-1; ++ii) {
+    threads[ii] = g_thread_create(row_chunk_thread, &chunks[ii], TRUE, NULL);
+    if (!threads[ii])
+      asfPrintError("parallel_rows: could not create worker thread.\n");
+  }
+  row_chunk_thread(&chunks[thread_count-1]);
+  for (ii=0; ii<thread_count-1; ++ii)
+    g_thread_join(threads[ii]);
+  asfJobLeaveThreads();
+
+  FREE(threads);
+  FREE(chunks);
+}
@@ -30,68 +30,132 @@ DESCRIPTION:
 
 ALGORITHM DESCRIPTION:
     Establish kernel processing parameters
+    Build tables of the input line/sample footprint of every output
+       line/sample (these only depend on the scale factors)
     copy input metadata to output metadata (with update)
     Open input and output files
-    for each output line
-       calculate file read position
-       read next kernel from input file
-       for each output pixel
-   apply kernel to input data at appropriate position to get output value
-       write output line to file
+    for each block of output lines
+       read the input lines that are not already buffered, for all bands
+       reduce each new input line to per-output-sample kernel sums
+       sum those over each output line's footprint (lines in parallel)
+       write the block of output lines for all bands
     Close input and output files
 
+    The box kernel is separable, so the horizontal sums are computed
+    once per input line from running sums, and the vertical sums are
+    computed once per output line from the buffered horizontal sums.
+
 *******************************************************************/
 #include "asf.h"
 #include "asf_endian.h"
 #include <asf_raster.h>
 
-static float filter(      /****************************************/
-    float *inbuf,         /* input image buffer                   */
-    int    nl,            /* number of lines for inbuf            */
-    int    ns,            /* number of samples per line for inbuf */
-    int    x,             /* sample in desired line               */
-    int    nsk,           /* number of samples in kernel          */
-    int    nn_flag)       /* true if we should just use nearest   */
-                          /* instead of interpolating b/w points  */
-{                         /****************************************/
-    float  kersum =0.0;                    /* sum of kernel       */
-    int    half   =(nsk-1)/2,              /* half size kernel    */
-           base   =(x-half),               /* index into inbuf    */
-           total  =0,                      /* valid kernel values */
-           i, j;                           /* loop counters       */
-                                           /***********************/
-                                           
-    if (nn_flag) {
-
-      if (base>=0 && base<nl*ns)
-        return inbuf[base];
-      else if (base<0)
-        return inbuf[0];
-      else if (base>=nl*ns)
-        return inbuf[ns*nl-1];
-      asfPrintError("Not reached.\n");
+// Rough upper limit on the input buffer used per block, in pixels
+#define RESAMPLE_BLOCK_PIXELS (16*1024*1024)
+// Maximum number of output lines per block
+#define RESAMPLE_BLOCK_LINES 128
+
+typedef struct {
+    int np, onp;              /* in/out number of samples             */
+    int *x_start, *x_end;     /* input sample footprint of out sample */
+    int *y_start, *y_end;     /* input line footprint of out line     */
+    float *inbuf;             /* new input lines of the current band  */
+    double *hsum;             /* per-line kernel sums, buffered lines */
+    int *hcnt;                /* per-line kernel valid value counts   */
+    int first_new;            /* row of the first new line in hsum    */
+    int h0;                   /* input line of the first hsum row     */
+    int first_out;            /* first output line of the block       */
+    float *outbuf;            /* block of output lines                */
+    int out_db;               /* output is in decibels                */
+} resample_block_t;
+
+/* Fills in the range [start,end) of input pixels that contribute to
+   each output pixel.  This is the kernel of nsk pixels around the
+   input pixel that is closest to the middle of the output pixel,
+   clipped to the image -- or just that pixel for nearest neighbor. */
+static void footprint_table(int n_in, int n_out, double rate, double base,
+                            int nsk, int nn_flag, int *start, int *end)
+{
+    int half = (nsk-1)/2;
+    int i, c;
 
+    for (i = 0; i < n_out; i++)
+    {
+        c = (int) (i * rate + base + 0.5);
+        if (nn_flag) {
+            if (c < 0) c = 0;
+            if (c >= n_in) c = n_in-1;
+            start[i] = c;
+            end[i] = c+1;
+        }
+        else {
+            start[i] = c-half < 0 ? 0 : c-half;
+            end[i] = c+half+1 > n_in ? n_in : c+half+1;
+            if (end[i] <= start[i]) {
+                start[i] = n_in-1;
+                end[i] = n_in;
+            }
+        }
     }
-    else {
-      for (i = 0; i < nl; i++)
-      {
-        for (j = x-half; j <= x+half; j++)
+}
+
+/* Reduces new input lines to the sum (and count) of the non-zero
+   values in each output sample's footprint, using running sums. */
+static void horizontal_rows(void *data, int first_row, int last_row)
+{
+    resample_block_t *b = (resample_block_t *) data;
+    double *psum = (double *) MALLOC((b->np+1)*sizeof(double));
+    int *pcnt = (int *) MALLOC((b->np+1)*sizeof(int));
+    int row, j;
+
+    for (row = first_row; row <= last_row; row++)
+    {
+        const float *in = b->inbuf + (long long)row*b->np;
+        double *hsum = b->hsum + (long long)(b->first_new+row)*b->onp;
+        int *hcnt = b->hcnt + (long long)(b->first_new+row)*b->onp;
+
+        psum[0] = 0.0;
+        pcnt[0] = 0;
+        for (j = 0; j < b->np; j++)
         {
-          if (base>=0 && base<nl*ns && inbuf[base] != 0 && j < ns)
-          {
-            kersum += inbuf[base];
-            total++;
-          }
-          base++;
+            psum[j+1] = psum[j] + in[j];
+            pcnt[j+1] = pcnt[j] + (in[j] != 0);
         }
-        base += ns;
-        base -= nsk;
-      }
+        for (j = 0; j < b->onp; j++)
+        {
+            hsum[j] = psum[b->x_end[j]] - psum[b->x_start[j]];
+            hcnt[j] = pcnt[b->x_end[j]] - pcnt[b->x_start[j]];
+        }
+    }
 
-      if (total != 0)
-        kersum /= (float) total;
+    FREE(psum);
+    FREE(pcnt);
+}
+
+/* Averages the horizontal sums over each output line's footprint */
+static void vertical_rows(void *data, int first_row, int last_row)
+{
+    resample_block_t *b = (resample_block_t *) data;
+    int row, r, j;
+
+    for (row = first_row; row <= last_row; row++)
+    {
+        int i = b->first_out + row;
+        float *out = b->outbuf + (long long)row*b->onp;
 
-      return (kersum);
+        for (j = 0; j < b->onp; j++)
+        {
+            double kersum = 0.0;
+            int total = 0;
+            for (r = b->y_start[i]; r < b->y_end[i]; r++)
+            {
+                kersum += b->hsum[(long long)(r-b->h0)*b->onp + j];
+                total += b->hcnt[(long long)(r-b->h0)*b->onp + j];
+            }
+            if (total != 0)
+                kersum /= (double) total;
+            out[j] = b->out_db ? 10.0 * log10(kersum) : kersum;
+        }
     }
 }
 
@@ -101,24 +165,23 @@ resample_impl(const char *infile, const char *outfile,
               int nn_flag)
 {
     FILE            *fpin, *fpout;  /* file pointer                   */
-    float           *inbuf,         /* stripped input buffer          */
-                    *outbuf;        /* stripped output buffer         */
     meta_parameters *metaIn, *metaOut;
+    resample_block_t b;
     int      np, nl,                /* in number of pixels,lines      */
              onp, onl,              /* out number of pixels,lines     */
              xnsk,                  /* kernel size in samples (x)     */
              ynsk,                  /* kernel size in samples (y)     */
-             xhalf,yhalf,           /* half of the kernel size        */
-             n_lines,               /* number of lines in this kernel */
-             s_line,                /* start line for input file      */
-             xi = 0,                /* inbuf int x sample #           */
-             yi = 0,                /* inbuf int y line #             */
-             i,j,k,l;               /* loop counters                  */
+             block_lines,           /* output lines per block         */
+             max_rows,              /* max input lines per block      */
+             h0, h1,                /* buffered input lines [h0,h1)   */
+             i0, i1,                /* output lines of block [i0,i1)  */
+             band_count,
+             i,k;                   /* loop counters                  */
+    long long l;
     float    xpixsiz,               /* range pixel size               */
-             ypixsiz,               /* azimuth pixel size             */
-             xbase,ybase,           /* base sample/line               */
-             xrate,yrate,           /* # input pixels/output pixel    */
-             tmp;
+             ypixsiz;               /* azimuth pixel size             */
+    double   xbase,ybase,           /* base sample/line               */
+             xrate,yrate;           /* # input pixels/output pixel    */
 
     //asfPrintStatus("\n\n\nResample: Performing filtering and subsampling..\n\n");
     //asfPrintStatus("  Input image is %s\n",infile);
@@ -128,6 +191,7 @@ resample_impl(const char *infile, const char *outfile,
     metaOut = meta_read(infile);
     nl = metaIn->general->line_count;
     np = metaIn->general->sample_count;
+    band_count = metaIn->general->band_count;
     xpixsiz = metaIn->general->x_pixel_size/xscalfact;
     ypixsiz = metaIn->general->y_pixel_size/yscalfact;
     xnsk = (int) (xpixsiz/metaIn->general->x_pixel_size + 0.5);
@@ -145,15 +209,40 @@ resample_impl(const char *infile, const char *outfile,
 
     xbase = 1.0 / (2.0 * xscalfact) - 0.5;
     xrate = 1.0 / xscalfact;
-    xhalf = (xnsk-1)/2;
 
     ybase = 1.0 / (2.0 * yscalfact) - 0.5;
     yrate = 1.0 / yscalfact;
-    yhalf = (ynsk-1)/2;
-    n_lines = ynsk;
 
-    inbuf= (float *) MALLOC (ynsk*np*sizeof(float));
-    outbuf = (float *) MALLOC (onp*sizeof(float));
+    /*----------  Build the footprint tables ------------------------*/
+    b.np = np;
+    b.onp = onp;
+    b.x_start = (int *) MALLOC(onp*sizeof(int));
+    b.x_end = (int *) MALLOC(onp*sizeof(int));
+    b.y_start = (int *) MALLOC(onl*sizeof(int));
+    b.y_end = (int *) MALLOC(onl*sizeof(int));
+    footprint_table(np, onp, xrate, xbase, xnsk, nn_flag, b.x_start, b.x_end);
+    footprint_table(nl, onl, yrate, ybase, ynsk, nn_flag, b.y_start, b.y_end);
+
+    block_lines = (int) ((RESAMPLE_BLOCK_PIXELS/np - ynsk) / (yrate + 1));
+    if (block_lines > RESAMPLE_BLOCK_LINES) block_lines = RESAMPLE_BLOCK_LINES;
+    if (block_lines < 1) block_lines = 1;
+
+    max_rows = 1;
+    for (i0 = 0; i0 < onl; i0 += block_lines)
+    {
+        i1 = i0 + block_lines < onl ? i0 + block_lines : onl;
+        if (b.y_end[i1-1] - b.y_start[i0] > max_rows)
+            max_rows = b.y_end[i1-1] - b.y_start[i0];
+    }
+
+    b.inbuf = (float *) MALLOC ((long long)max_rows*np*sizeof(float));
+    b.outbuf = (float *) MALLOC ((long long)block_lines*onp*sizeof(float));
+    double **hsum = (double **) MALLOC(band_count*sizeof(double *));
+    int **hcnt = (int **) MALLOC(band_count*sizeof(int *));
+    for (k=0; k < band_count; ++k) {
+        hsum[k] = (double *) MALLOC((long long)max_rows*onp*sizeof(double));
+        hcnt[k] = (int *) MALLOC((long long)max_rows*onp*sizeof(int));
+    }
 
    /*----------  Open the Input & Output Files ---------------------*/
     char *imgfile = MALLOC(sizeof(char) * (10 + strlen(outfile)));
@@ -208,69 +297,91 @@ resample_impl(const char *infile, const char *outfile,
       }
     }
 
-    char **band_name = extract_band_names(metaIn->general->bands,
-                                          metaIn->general->band_count);
+    int in_db = metaIn->general->radiometry >= r_SIGMA_DB &&
+                metaIn->general->radiometry <= r_GAMMA_DB;
+    b.out_db = metaOut->general->radiometry >= r_SIGMA_DB &&
+               metaOut->general->radiometry <= r_GAMMA_DB;
 
     char *metafile = appendExt(outfile, ".meta");
     meta_write(metaOut, metafile);
 
-    for (k=0; k < metaIn->general->band_count; ++k)
+    if (band_count != 1)
+        asfPrintStatus("Resampling %d bands\n", band_count);
+
+    fpout=fopenImage(imgfile, "wb");
+
+    /*--------  Process blocks of output lines, all bands at once --*/
+    h0 = h1 = 0;
+    for (i0 = 0; i0 < onl; i0 = i1)
     {
-        if (metaIn->general->band_count != 1)
-            asfPrintStatus("Resampling band: %s\n", band_name[k]);
+        i1 = i0 + block_lines < onl ? i0 + block_lines : onl;
+        int r0 = b.y_start[i0];
+        int r1 = b.y_end[i1-1];
 
-        fpout=fopenImage(imgfile, k==0 ? "wb" : "ab");
-        n_lines = ynsk;
-        /*--------  Process inbuf to give outbuf ------------------------*/
-        for (i = 0; i < onl; i++)
+        /*--------- Drop buffered lines this block does not need ----*/
+        if (h1 <= r0) {
+            h0 = h1 = r0;
+        }
+        else if (h0 < r0) {
+            for (k=0; k < band_count; ++k) {
+                memmove(hsum[k], hsum[k] + (long long)(r0-h0)*onp,
+                        (long long)(h1-r0)*onp*sizeof(double));
+                memmove(hcnt[k], hcnt[k] + (long long)(r0-h0)*onp,
+                        (long long)(h1-r0)*onp*sizeof(int));
+            }
+            h0 = r0;
+        }
+
+        b.h0 = h0;
+        b.first_new = h1-h0;
+        b.first_out = i0;
+
+        for (k=0; k < band_count; ++k)
         {
-            /*--------- Read next set of lines for kernel ---------------*/
-            yi = i * yrate + ybase + 0.5;
-            s_line = yi-yhalf;
-            if (s_line < 0) s_line = 0;
-            if (nl < ynsk+s_line) n_lines = nl-s_line;
-
-            s_line += k*nl;
-            get_float_lines(fpin, metaIn, s_line, n_lines, inbuf);
-	    if (metaIn->general->radiometry >= r_SIGMA_DB &&
-		metaIn->general->radiometry <= r_GAMMA_DB) {
-	      for (l=0; l<(np*n_lines); l++) {
-		tmp = inbuf[l];
-		inbuf[l] = pow(10.0, tmp/10.0);
-	      }
-	    }
-	    
-
-            /*--------- Produce the output line and write to disk -------*/
-            for (j = 0; j < onp; j++)
-            {
-                xi = j * xrate + xbase + 0.5;
-                outbuf[j] = filter(inbuf,n_lines,np,xi,xnsk,nn_flag);
-		if (metaOut->general->radiometry >= r_SIGMA_DB &&
-		    metaOut->general->radiometry <= r_GAMMA_DB) {
-		  tmp = outbuf[j];
-		  outbuf[j] = 10.0 * log10(tmp);
-		}
+            /*--------- Read and reduce the new input lines ---------*/
+            if (r1 > h1) {
+                get_band_float_lines(fpin, metaIn, k, h1, r1-h1, b.inbuf);
+                if (in_db) {
+                    for (l=0; l<(long long)np*(r1-h1); l++)
+                        b.inbuf[l] = pow(10.0, b.inbuf[l]/10.0);
+                }
+                b.hsum = hsum[k];
+                b.hcnt = hcnt[k];
+                parallel_rows(r1-h1, horizontal_rows, &b);
             }
 
-            put_float_line(fpout, metaOut, i, outbuf);
-            asfLineMeter(i, onl);
+            /*--------- Produce the output lines and write to disk --*/
+            b.hsum = hsum[k];
+            b.hcnt = hcnt[k];
+            parallel_rows(i1-i0, vertical_rows, &b);
+            put_band_float_lines(fpout, metaOut, k, i0, i1-i0, b.outbuf);
         }
+        if (r1 > h1) h1 = r1;
 
-        FCLOSE(fpout);
+        for (i = i0; i < i1; i++)
+            asfLineMeter(i, onl);
     }
 
-    for (i=0; i < metaIn->general->band_count; i++)
-        FREE(band_name[i]);
-    FREE(band_name);
+    FCLOSE(fpout);
+
+    for (k=0; k < band_count; ++k) {
+        FREE(hsum[k]);
+        FREE(hcnt[k]);
+    }
+    FREE(hsum);
+    FREE(hcnt);
 
     meta_free(metaOut);
     meta_free(metaIn);
 
     FCLOSE(fpin);
 
-    FREE(inbuf);
-    FREE(outbuf);
+    FREE(b.inbuf);
+    FREE(b.outbuf);
+    FREE(b.x_start);
+    FREE(b.x_end);
+    FREE(b.y_start);
+    FREE(b.y_end);
 
     FREE(imgfile);
     FREE(metafile);
@@ -6,10 +6,6 @@
 #include "asf_raster.h"
 #include "envi.h"
 
-#define SWAP(a,b) { register float t=(a); (a)=(b); (b)=t; }
-#define EPSILON 1.E-15
-#define INIT_MINMAX 1.E+30 
-
 /* Calculate minimum, maximum, mean and standard deviation for a floating point
    image. A mask value can be defined that is excluded from this calculation.
    If no mask value is supposed to be used, pass the mask value as NAN. */
@@ -288,88 +284,59 @@ calc_stats_from_file_with_formula(const char *inFile, char *bands,
     *histogram = hist;
 }
 
-void
-calc_stats_from_file(const char *inFile, char *band, double mask,
-                     double *min, double *max, double *mean,
-                     double *stdDev, gsl_histogram **histogram)
+// Statistics of the requested band, from the streaming engine in
+// band_stats.c (which caches the statistics of all bands)
+static band_stats_t *band_stats_for(const char *inFile, char *band, double mask,
+                                    int *band_count, int *band_number)
 {
-    int ii,jj;
-
-    *min = 999999;
-    *max = -999999;
-    *mean = 0.0;
+    band_stats_t *stats = band_stats_from_file(inFile, mask, band_count);
 
     meta_parameters *meta = meta_read(inFile);
-    int band_number;
     if (!band || strlen(band) == 0 || strcmp(band, "???") == 0 ||
         meta->general->band_count == 1) {
-      band_number = 0;
+      *band_number = 0;
     }
     else {
-      band_number = get_band_number(meta->general->bands,
-                                    meta->general->band_count, band);
+      *band_number = get_band_number(meta->general->bands,
+                                     meta->general->band_count, band);
     }
+    meta_free(meta);
 
-    long offset = meta->general->line_count * band_number;
-    float *data = MALLOC(sizeof(float) * meta->general->sample_count);
+    if (*band_number < 0 || *band_number >= *band_count)
+      asfPrintError("Band '%s' not found in %s\n", band, inFile);
 
-    // pass 1 -- calculate mean, min & max
-    FILE *fp = FOPEN(inFile, "rb");
-    long long pixel_count=0;
-    asfPrintStatus("\nCalculating min, max, and mean...\n");
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
+    return stats;
+}
 
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-          if (meta_is_valid_double(data[jj])) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                if (data[jj] < *min) *min = data[jj];
-                if (data[jj] > *max) *max = data[jj];
-                *mean += data[jj];
-                ++pixel_count;
-            }
-          }
-        }
+void
+calc_stats_from_file(const char *inFile, char *band, double mask,
+                     double *min, double *max, double *mean,
+                     double *stdDev, gsl_histogram **histogram)
+{
+    int band_count, band_number;
+    band_stats_t *stats =
+        band_stats_for(inFile, band, mask, &band_count, &band_number);
+    band_stats_t *s = &stats[band_number];
+
+    if (s->count > 0) {
+        *min = s->min;
+        *max = s->max;
+        *mean = s->mean;
+        *stdDev = s->std_dev;
+    }
+    else {
+        *min = 999999;
+        *max = -999999;
+        *mean = *stdDev = NAN;
     }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
-
-    *mean /= pixel_count;
 
     // Guard against weird data
     if(!(*min<*max)) *max = *min + 1;
 
-    // Initialize the histogram.
     const int num_bins = 256;
-    gsl_histogram *hist = gsl_histogram_alloc (num_bins);
-    gsl_histogram_set_ranges_uniform (hist, *min, *max);
-    *stdDev = 0.0;
-
-    // pass 2 -- update histogram, calculate standard deviation
-    fp = FOPEN(inFile, "rb");
-    asfPrintStatus("\nCalculating standard deviation and histogram...\n");
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
-
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-          if (meta_is_valid_double(data[jj])) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                *stdDev += (data[jj] - *mean) * (data[jj] - *mean);
-                gsl_histogram_increment (hist, data[jj]);
-            }
-          }
-        }
-    }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
-    *stdDev = sqrt(*stdDev/(pixel_count - 1));
-
-    FREE(data);
-    meta_free(meta);
+    *histogram = band_stats_histogram(s, num_bins);
 
-    *histogram = hist;
+    band_stats_free(stats, band_count);
 }
 
 void
@@ -378,75 +345,10 @@ calc_stats_rmse_from_file(const char *inFile, char *band, double mask,
                           double *stdDev, double *rmse,
                           gsl_histogram **histogram)
 {
-    double se;
-    int ii,jj;
-
-    *min = 999999;
-    *max = -999999;
-    *mean = 0.0;
-
-    meta_parameters *meta = meta_read(inFile);
-    int band_number =
-        (!band || strlen(band) == 0 || strcmp(band, "???") == 0) ? 0 :
-        get_band_number(meta->general->bands, meta->general->band_count, band);
-    long offset = meta->general->line_count * band_number;
-    float *data = MALLOC(sizeof(float) * meta->general->sample_count);
-
-    // pass 1 -- calculate mean, min & max
-    FILE *fp = FOPEN(inFile, "rb");
-    long long pixel_count=0;
-    asfPrintStatus("\nCalculating min, max, and mean...\n");
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
-
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                if (data[jj] < *min) *min = data[jj];
-                if (data[jj] > *max) *max = data[jj];
-                *mean += data[jj];
-                ++pixel_count;
-            }
-        }
-    }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
-
-    *mean /= pixel_count;
-
-    // Guard against weird data
-    if(!(*min<*max)) *max = *min + 1;
-
-    // Initialize the histogram.
-    const int num_bins = 256;
-    gsl_histogram *hist = gsl_histogram_alloc (num_bins);
-    gsl_histogram_set_ranges_uniform (hist, *min, *max);
-    *stdDev = 0.0;
-
-    // pass 2 -- update histogram, calculate standard deviation
-    fp = FOPEN(inFile, "rb");
-    asfPrintStatus("\nCalculating standard deviation, rmse, and histogram...\n");
-    se = 0.0;
-    for (ii=0; ii<meta->general->line_count; ++ii) {
-        asfPercentMeter(((double)ii/(double)meta->general->line_count));
-        get_float_line(fp, meta, ii + offset, data);
-
-        for (jj=0; jj<meta->general->sample_count; ++jj) {
-            if (ISNAN(mask) || !FLOAT_EQUIVALENT(data[jj], mask)) {
-                *stdDev += (data[jj] - *mean) * (data[jj] - *mean);
-                gsl_histogram_increment (hist, data[jj]);
-                se += (data[jj] - *mean) * (data[jj] - *mean);
-            }
-        }
-    }
-    asfPercentMeter(1.0);
-    FCLOSE(fp);
-    *stdDev = sqrt(*stdDev/(pixel_count - 1));
-    *rmse = sqrt(se/(pixel_count - 1));
-
-    FREE(data);
-
-    *histogram = hist;
+    // The rmse about the mean is the (sample) standard deviation
+    calc_stats_from_file(inFile, band, mask, min, max, mean, stdDev,
+                         histogram);
+    *rmse = *stdDev;
 }
 
 void calc_minmax_polsarpro(const char *inFile, double *min, double *max)
@@ -482,154 +384,19 @@ void calc_minmax_polsarpro(const char *inFile, double *min, double *max)
   FREE(enviName);
 }
 
-// Coming from "Numerical recipes in C" - Eric Pottier's implementation
-static float median_value(float *data, long n)
-{
-  int low = 0;
-  int high = n - 1;
-  int median = (low + high) / 2;
-  int middle, ll, hh;
-  
-  for (;;) {
-    if (high <= low)
-      return data[median];
-    if (high == low + 1) {
-      if (data[low] > data[high])
-	SWAP(data[low], data[high]);
-      return data[median];
-    }
-  
-    middle = (low + high) / 2;
-    if (data[middle] > data[high])
-      SWAP(data[middle], data[high]);
-    if (data[low] > data[high])
-      SWAP(data[low], data[high]);
-    if (data[middle] > data[low])
-      SWAP(data[middle], data[low]);
-
-    SWAP(data[middle], data[low+1]);
-
-    ll = low + 1;
-    hh = high;
-    for (;;) {
-      do ll++; while (data[low] > data[ll]);
-      do hh--; while (data[hh] > data[low]);
-      if (hh < ll)
-	break;
-      SWAP(data[ll], data[hh]);
-    }
-
-    SWAP(data[low], data[hh]);
-
-    if (hh <= median) 
-      low = ll;
-    if (hh >= median)
-      high = hh - 1;
-  }
-}
-
+// Determines a robust min and max for scaling.  This used to be done by
+// taking the median of the lower (upper) half of the data three times,
+// which amounts to the 1/16 (15/16) quantile of the data.
 void calc_minmax_median(const char *inFile, char *band, double mask, 
 			double *min, double *max)
 {
-  long long ii, jj;
-  float logeps = 10.0 * log10(EPSILON);
-  float median, median0;
-  
-  meta_parameters *meta = meta_read(inFile);
-  int band_number =
-    (!band || strlen(band) == 0 || strcmp(band, "???") == 0) ? 0 :
-    get_band_number(meta->general->bands, meta->general->band_count, band);
-  long sample_count = meta->general->sample_count;
-  long line_count = meta->general->line_count;
-  long pixel_count = sample_count*line_count;
-  long offset = line_count * band_number;
-  float *data_line = MALLOC(sizeof(float) * sample_count);
-  float *data = MALLOC(sizeof(float) * pixel_count);
-  float *data2 = MALLOC(sizeof(float) * pixel_count);
-			    
-  // Culling invalid pixels
-  FILE *fp = FOPEN(inFile, "rb");
-  long valid_pixel_count = 0;
-  asfPrintStatus("\nCalculating min and max using median...\n");
-  for (ii=0; ii<line_count; ++ii) {
-    get_float_line(fp, meta, ii + offset, data_line);
-    asfPercentMeter(((double)ii/(double)line_count));
-    for (jj=0; jj<sample_count; ++jj) {
-      if (!FLOAT_EQUIVALENT(data_line[jj], -9999.99) ||
-	  !FLOAT_EQUIVALENT(data_line[jj], logeps) ||
-	  ISNAN(mask)) {
-	data[valid_pixel_count] = data_line[jj];
-	valid_pixel_count++;
-      }
-    }
-  }
-  asfPercentMeter(1.0);
-  FCLOSE(fp);
-  FREE(data_line);
-  
-  // Determine initial min and max
-  *min = INIT_MINMAX;
-  *max = -INIT_MINMAX;
-  float minmin = INIT_MINMAX;
-  float maxmax = -INIT_MINMAX;
-  for (ii=0; ii<valid_pixel_count; ++ii) {
-    data2[ii] = data[ii];
-    if (data[ii] < minmin)
-      minmin = data[ii];
-    if (data[ii] > maxmax)
-      maxmax = data[ii];
-  }
-
-  median0 = median_value(data, valid_pixel_count);
-
-  // Determine minimum
-  median = median0;
-  *min = median0;
-  for (ii=0; ii<3; ii++) {
-    pixel_count = -1;
-    for (jj=0; jj<valid_pixel_count; ++jj)
-      if (median0 == minmin) {
-	if (data[jj] <= median) {
-	  pixel_count++;
-	  data2[pixel_count] = data[jj];
-	}
-      }
-      else {
-	if (data[jj] < median) {
-	  pixel_count++;
-	  data2[pixel_count] = data[jj];
-	}
-      }
-    median = median_value(data2, pixel_count);
-    if (median == minmin)
-      median = *min;
-    *min = median;
-  }
+  int band_count, band_number;
+  band_stats_t *stats =
+    band_stats_for(inFile, band, mask, &band_count, &band_number);
 
-  // Determine maximum
-  median = median0;
-  *max = median0;
-  for (ii=0; ii<3; ii++) {
-    pixel_count = -1;
-    for (jj=0; jj<valid_pixel_count; ++jj)
-      if (median0 == maxmax) {
-	if (data[jj] >= median) {
-	  pixel_count++;
-	  data2[pixel_count] = data[jj];
-	}
-      }
-      else {
-	if (data[jj] > median) {
-	  pixel_count++;
-	  data2[pixel_count] = data[jj];
-	}
-      }
-    median = median_value(data2, pixel_count);
-    if (median == maxmax)
-      median = *max;
-    *max = median;
-  }
+  asfPrintStatus("\nCalculating min and max using median...\n");
+  *min = band_stats_quantile(&stats[band_number], 0.0625);
+  *max = band_stats_quantile(&stats[band_number], 0.9375);
 
-  FREE(data);
-  FREE(data2);
+  band_stats_free(stats, band_count);
 }
@@ -1002,23 +1002,44 @@ uint8_image_new_from_metadata(meta_parameters *meta, const char *file)
 UInt8Image *
 uint8_image_band_new_from_metadata(meta_parameters *meta,
            int band, const char *file)
+{
+    return uint8_image_band_new_from_metadata_window(meta, band, file, 0, 0,
+        meta->general->sample_count, meta->general->line_count);
+}
+
+// Returns a new UInt8Image holding only the size_x by size_y window of
+// the image band whose upper left corner is at (x0, y0).  Pixel (x, y)
+// of the new image is pixel (x0 + x, y0 + y) of the band.
+UInt8Image *
+uint8_image_band_new_from_metadata_window(meta_parameters *meta,
+           int band, const char *file, ssize_t x0, ssize_t y0,
+           ssize_t size_x, ssize_t size_y)
 {
     int nl = meta->general->line_count;
     int ns = meta->general->sample_count;
 
+    if (x0 < 0 || y0 < 0 || size_x <= 0 || size_y <= 0 ||
+        x0 + size_x > ns || y0 + size_y > nl)
+      asfPrintError("Window (%ld,%ld) %ldx%ld is not within the %dx%d "
+                    "image %s\n", (long)x0, (long)y0, (long)size_x,
+                    (long)size_y, ns, nl, file);
+
     FILE * fp = FOPEN(file, "rb");
-    UInt8Image * bi = uint8_image_new(ns, nl);
-
-    int i,j;
-    unsigned char *buf = MALLOC(sizeof(unsigned char)*ns);
-    for (i = 0; i < nl; ++i) {
-        get_byte_line(fp, meta, i+band*nl, buf);
-        for (j = 0; j < ns; ++j)
-            uint8_image_set_pixel(bi, j, i, buf[j]);
+    UInt8Image * bi = uint8_image_new(size_x, size_y);
+
+    const int block = 64;
+    unsigned char *buf = MALLOC(sizeof(unsigned char)*size_x*block);
+    int i,j,k;
+    for (i = 0; i < size_y; i += block) {
+        int n = size_y - i < block ? size_y - i : block;
+        get_partial_byte_lines(fp, meta, y0+i+band*nl, n, x0, size_x, buf);
+        for (k = 0; k < n; ++k)
+            for (j = 0; j < size_x; ++j)
+                uint8_image_set_pixel(bi, j, i+k, buf[k*size_x+j]);
     }
 
-    free(buf);
-    fclose(fp);
+    FREE(buf);
+    FCLOSE(fp);
 
     return bi;
 }
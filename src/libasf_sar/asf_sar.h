@@ -48,6 +48,24 @@ typedef struct {
     int *greyscale_value;
 } classifier_t;
 
+/* Linear interpolation table used by sr2gr and gr2sr (see interp_table.c)
+   Not really for use outside of this library. */
+#define INTERP_STENCIL 2
+typedef struct {
+    int out_count;  /* number of output positions                      */
+    int in_count;   /* number of input samples (or lines)              */
+    int *index;     /* INTERP_STENCIL input indices per output position */
+    float *weight;  /* and their weights                               */
+} interp_table_t;
+
+/* Prototypes from interp_table.c */
+interp_table_t *interp_table_new(const float *pos, int out_count,
+                                 int in_count, int clamp);
+void interp_table_free(interp_table_t *table);
+int interp_table_resample(FILE *fpi, meta_parameters *in_meta,
+                          FILE *fpo, meta_parameters *out_meta,
+                          interp_table_t *range, interp_table_t *azimuth);
+
 /* Prototypes from gr2sr.c */
 int gr2sr(const char *infile, const char *outfile);
 int gr2sr_pixsiz(const char *infile, const char *outfile, float srPixSize);
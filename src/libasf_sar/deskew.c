@@ -47,6 +47,39 @@ static double calc_shift(meta_parameters *meta, double line, double samp)
   return fac;
 }
 
+// Output lines are produced in blocks of this many lines.  Only the
+// input lines a block needs (the block plus the skew) are kept in memory.
+#define DESKEW_BLOCK_LINES 256
+
+typedef struct {
+  const int *lower;   // shift of each column
+  int np, nl;
+  float *in;          // input lines first_in_line...
+  int first_in_line;
+  float *out;         // output lines first_out_line...
+  int first_out_line;
+  int lines;          // number of output lines in the block
+} deskew_block_t;
+
+// Fills in columns first_col..last_col of the output block
+static void deskew_cols(void *data, int first_col, int last_col)
+{
+  deskew_block_t *b = (deskew_block_t *) data;
+  int line, samp;
+
+  for (line=0; line<b->lines; ++line) {
+    int out_line = b->first_out_line + line;
+    float *out = b->out + (long long)line*b->np;
+    for (samp=first_col; samp<=last_col; ++samp) {
+      int in_line = out_line - b->lower[samp];
+      if (in_line >= 0 && in_line < b->nl)
+        out[samp] = b->in[(long long)(in_line - b->first_in_line)*b->np + samp];
+      else
+        out[samp] = 0.0;
+    }
+  }
+}
+
 void deskew(const char *infile, const char *outfile)
 {
   meta_parameters *meta = meta_read(infile);
@@ -62,16 +95,13 @@ void deskew(const char *infile, const char *outfile)
 
   char *tmp_outfile;
   int do_rename = FALSE;
-  if (strcmp(infile, outfile) == 0 && nb>1) {
+  if (strcmp(infile, outfile) == 0) {
     // user wants to deskew in-place
-    // we can't actually do that on multi-band data, too much to keep in memory
+    // the output is written while the input is still being read, so
     // use a temporary file, then clobber input file
     tmp_outfile = appendToBasename(outfile, "_tmp");
     do_rename = TRUE;
   } else {
-    // normal case: either
-    // 1) single-band in-place deskew
-    // 2) not in-place deskew (single or multi)
     tmp_outfile = STRDUP(outfile);
   }
 
@@ -96,37 +126,70 @@ void deskew(const char *infile, const char *outfile)
       asfPrintStatus("%d pixels up.\n", -lower[np-1]);
   }
 
-  float *ibuf = MALLOC(np * sizeof(float));
-  float *obuf = CALLOC(np*nl, sizeof(float));
+  // already deskewed data is just copied
+  int min_lower = 0, max_lower = 0;
+  for (samp=0; samp<np; ++samp) {
+    if (deskewed) lower[samp] = 0;
+    if (lower[samp] < min_lower) min_lower = lower[samp];
+    if (lower[samp] > max_lower) max_lower = lower[samp];
+  }
+
+  // Output lines L..L+n-1 need input lines L-max_lower..L+n-1-min_lower
+  int block_lines = DESKEW_BLOCK_LINES < nl ? DESKEW_BLOCK_LINES : nl;
+  int window_lines = block_lines + max_lower - min_lower;
+  if (window_lines > nl) window_lines = nl;
+  deskew_block_t b;
+  b.lower = lower;
+  b.np = np;
+  b.nl = nl;
+  b.in = MALLOC((long long)window_lines*np*sizeof(float));
+  b.out = MALLOC((long long)block_lines*np*sizeof(float));
 
   FILE *fpi = fopenImage(infile, "rb");
+  FILE *fpo = fopenImage(tmp_outfile, "wb");
 
   for (band=0; band<nb; ++band) {
     if (nb>1)
       asfPrintStatus("Deskewing band: %s\n", band_name[band]);
 
-    // apply deskewing to this band
-    for (line=0; line<nl; ++line) {
-      get_float_line(fpi, meta, line + nl*band, ibuf);
-
-      for (samp=0; samp<np; ++samp) {
-        int out_line = deskewed ? line : line + lower[samp];
-        if (out_line >= 0 && out_line < nl)
-          obuf[out_line*np+samp] = ibuf[samp];
+    // input lines [win_lo, win_hi) are in the window
+    int win_lo = 0, win_hi = 0;
+    for (line=0; line<nl; line+=block_lines) {
+      int lines = nl - line < block_lines ? nl - line : block_lines;
+      int lo = line - max_lower;
+      int hi = line + lines - min_lower;
+      if (lo < 0) lo = 0;
+      if (hi > nl) hi = nl;
+
+      // slide the window, keeping the lines we already have
+      if (lo < win_hi && lo > win_lo) {
+        memmove(b.in, b.in + (long long)(lo - win_lo)*np,
+                (long long)(win_hi - lo)*np*sizeof(float));
       }
-
-      asfLineMeter(line,nl);
+      else if (lo >= win_hi) {
+        win_hi = lo;
+      }
+      win_lo = lo;
+      if (hi > win_hi)
+        get_band_float_lines(fpi, meta, band, win_hi, hi - win_hi,
+                             b.in + (long long)(win_hi - win_lo)*np);
+      win_hi = hi;
+
+      b.first_in_line = win_lo;
+      b.first_out_line = line;
+      b.lines = lines;
+      parallel_rows(np, deskew_cols, &b);
+
+      put_band_float_lines(fpo, meta, band, line, lines, b.out);
+      for (samp=line; samp<line+lines; ++samp)
+        asfLineMeter(samp,nl);
     }
-
-    // write out this band
-    FILE *fpo = fopenImage(tmp_outfile, band>0 ? "ab" : "wb");
-    put_float_lines(fpo, meta, band*nl, nl, obuf);
-    FCLOSE(fpo);
   }
 
   FCLOSE(fpi);
-  FREE(obuf);
-  FREE(ibuf);
+  FCLOSE(fpo);
+  FREE(b.in);
+  FREE(b.out);
   FREE(lower);
 
   // if we output to a temporary file, clobber the input
@@ -29,8 +29,12 @@ BUGS:
 
 #define VERSION 0.1
 
-static void gr2sr_vec(meta_parameters *meta, float srinc, float *gr2sr,
-                      int apply_pp_earth_radius_fix)
+/* Fills in the ground range position of the slant range pixels, up to and
+   including the first one past the end of the np pixel wide ground range
+   image, and returns the number of slant range pixels before it.  If gr2sr
+   is NULL the positions are only counted. */
+static int gr2sr_vec(meta_parameters *meta, float srinc, float *gr2sr,
+                     int np, int apply_pp_earth_radius_fix)
 {
   int    i;             /* Counter                                       */
   float  r_sc;          /* radius from center of the earth for satellite */
@@ -62,12 +66,17 @@ static void gr2sr_vec(meta_parameters *meta, float srinc, float *gr2sr,
   rg0 = r_earth * acos((1.0 + x2 - y*y) / (2.0*x));
 
   /* begin loop */
-  for(i = 0; i<MAX_IMG_SIZE; i++) {
+  for(i = 0; ; i++) {
+    float pos;
     rslant = r_close + i *srinc;
     y = rslant/r_earth;
     rg = r_earth*acos((1.0+x2-y*y)/(2.0*x));
-    gr2sr[i] = (rg - rg0)/grinc;
+    pos = (rg - rg0)/grinc;
+    if (gr2sr) gr2sr[i] = pos;
+    if (!(pos < np)) break; /* gr input is off end of image-- stop */
   }
+
+  return i;
 }
 
 static char * replExt(const char *filename, const char *ext)
@@ -94,25 +103,13 @@ static int gr2sr_pixsiz_imp(const char *infile, const char *outfile,
   int   nBands;         /* number of bands in input/output */
   int   ii;
   float *gr2sr;    /* GR 2 SR resampling vector for Range  */
-  int   *lower;    /* floor of gr2sr vector                */
-  int   *upper;    /* ceiling of gr2sr vector              */
-  float *ufrac;    /* Upper fraction from gr2sr vector     */
-  float *lfrac;    /* Lower fraction from gr2sr vector     */
+  float *ml;       /* Azimuth vector (lines are unchanged) */
+  interp_table_t *range, *azimuth;
 
-  float *inBuf;          /* Input buffer                  */
-  float *outBuf;         /* Output buffer                 */
   FILE  *fpi, *fpo;      /* File pointers                 */
-  int   line;            /* Loop counter                  */
-  int   band;            /* Loop counter                  */
   char  *iimgfile;       /* .img input file               */
   char  *oimgfile;       /* .img output file              */
  
-  gr2sr = (float *) MALLOC(sizeof(float) * MAX_IMG_SIZE);
-  upper = (int *) MALLOC(sizeof(int) * MAX_IMG_SIZE);
-  lower = (int *) MALLOC(sizeof(int) * MAX_IMG_SIZE);
-  ufrac = (float *) MALLOC(sizeof(float) * MAX_IMG_SIZE);
-  lfrac = (float *) MALLOC(sizeof(float) * MAX_IMG_SIZE);
-
   inMeta = meta_read(infile);
 
   if (srPixSize < 0) {
@@ -135,27 +132,22 @@ static int gr2sr_pixsiz_imp(const char *infile, const char *outfile,
   np = inMeta->general->sample_count;
   nBands = inMeta->general->band_count;
 
-  char **band_name = extract_band_names(inMeta->general->bands, nBands);
-
   onl=nl;
-  gr2sr_vec(inMeta, srPixSize, gr2sr, apply_pp_earth_radius_fix);
-  
-  /* Determine the output image size */
-  onp = 0;
-  for (ii=0; ii<MAX_IMG_SIZE; ii++) {
-     if (gr2sr[ii]<np) onp=ii; /* gr input still in range-- keep output */
-     else break; /* gr input is off end of image-- stop sr output */
-  }
-  
-  /* Split gr2sr into resampling coefficients */
-  for (ii=0; ii<onp; ii++) {
-     lower[ii] = (int) gr2sr[ii];
-     upper[ii] = lower[ii] + 1;
-     ufrac[ii] = gr2sr[ii] - (float) lower[ii];
-     lfrac[ii] = 1.0 - ufrac[ii];
-     if (lower[ii]>=np) lower[ii]=np-1; /* range clip */
-     if (upper[ii]>=np) upper[ii]=np-1; /* range clip */
-  }
+
+  /* Determine the output image size (the last slant range pixel that is
+     still inside the ground range image is dropped, as it always was),
+     then the resampling vector.  Pixels off the end of the ground range
+     image repeat its last pixel. */
+  ii = gr2sr_vec(inMeta, srPixSize, NULL, np, apply_pp_earth_radius_fix);
+  onp = ii > 0 ? ii - 1 : 0;
+  gr2sr = (float *) MALLOC(sizeof(float) * (ii + 1));
+  gr2sr_vec(inMeta, srPixSize, gr2sr, np, apply_pp_earth_radius_fix);
+  range = interp_table_new(gr2sr, onp, np, TRUE);
+
+  ml = (float *) MALLOC(sizeof(float) * onl);
+  for (ii=0; ii<onl; ii++)
+     ml[ii] = ii;
+  azimuth = interp_table_new(ml, onl, nl, TRUE);
   
   outMeta = meta_read(infile);
   outMeta->sar->slant_shift += ((inMeta->general->start_sample)
@@ -171,38 +163,20 @@ static int gr2sr_pixsiz_imp(const char *infile, const char *outfile,
 
   fpi = FOPEN(iimgfile,"rb");
   fpo = FOPEN(oimgfile,"wb");
-  inBuf = (float *) MALLOC (np*sizeof(float));
-  outBuf = (float *) MALLOC (onp*sizeof(float));
-
-  for (band = 0; band < nBands; band++) {
-    if (inMeta->general->band_count != 1)
-      asfPrintStatus("Converting to slant range: band %s\n", band_name[band]);
-    for (line = 0; line < onl; line++) {
-      get_float_line(fpi, inMeta, line + band*onl, inBuf);
-      for (ii=0; ii<onp; ii++) { /* resample to slant range */
-         outBuf[ii] = inBuf[lower[ii]]*lfrac[ii]+inBuf[upper[ii]]*ufrac[ii];
-      }
-      put_float_line(fpo,outMeta,line + band*onl,outBuf);
-      asfLineMeter(line,onl);
-    }
-  }
 
-  for (ii=0; ii < inMeta->general->band_count; ii++)
-    FREE(band_name[ii]);
-  FREE(band_name);
+  if (nBands != 1)
+    asfPrintStatus("Converting %d bands to slant range\n", nBands);
+  interp_table_resample(fpi, inMeta, fpo, outMeta, range, azimuth);
 
   meta_write(outMeta, outfile);
   meta_free(inMeta);
   meta_free(outMeta);
 
-  FREE(ufrac);
-  FREE(lfrac);
+  interp_table_free(range);
+  interp_table_free(azimuth);
   FREE(gr2sr);
-  FREE(upper);
-  FREE(lower);
+  FREE(ml);
 
-  FREE(inBuf);
-  FREE(outBuf);
   FCLOSE(fpi);
   FCLOSE(fpo);
   FREE(iimgfile);
@@ -0,0 +1,193 @@
+/******************************************************************************
+NAME:  interp_table - table driven linear resampling of images
+
+DESCRIPTION:
+	The range (and azimuth) remapping done by sr2gr and gr2sr is
+	separable: every output sample is a linear interpolation between
+	two neighbouring input samples in range, and every output line is
+	a linear interpolation between two neighbouring input lines.  The
+	positions only depend on the geometry, so they are computed once
+	into an interp_table_t, which stores for each output position the
+	two input indices and their weights.  Indices that fall outside
+	the input are either clamped to the edge or given zero weight.
+
+	interp_table_resample() applies a range and an azimuth table to
+	all bands of an image.  It works on blocks of output lines: the
+	input lines a block needs are read for every band, the block is
+	interpolated with the lines split over several threads, and the
+	result is written for every band before moving on to the next
+	block.
+*/
+
+#include "asf.h"
+#include "asf_meta.h"
+#include "asf_sar.h"
+#include "asf_raster.h"
+
+/* Output blocks are sized so the input lines of all bands that a block
+   needs come to roughly this many pixels */
+#define INTERP_BLOCK_PIXELS (8*1024*1024)
+
+typedef struct {
+	interp_table_t *range;
+	interp_table_t *azimuth;
+	int band_count;
+	int first_in_line;   /* first input line held in the in buffers    */
+	int in_np;
+	int first_out_line;  /* output line of the first line of the block */
+	float **in;          /* input lines of the block, one per band     */
+	float **out;         /* output lines of the block, one per band    */
+} interp_block_t;
+
+interp_table_t *interp_table_new(const float *pos, int out_count,
+                                 int in_count, int clamp)
+{
+	interp_table_t *table = (interp_table_t *) MALLOC(sizeof(interp_table_t));
+	int ii, kk;
+
+	table->out_count = out_count;
+	table->in_count = in_count;
+	table->index = (int *) MALLOC(sizeof(int)*INTERP_STENCIL*out_count);
+	table->weight = (float *) MALLOC(sizeof(float)*INTERP_STENCIL*out_count);
+
+	for (ii=0; ii<out_count; ii++) {
+		int lower = (int) pos[ii];
+		int *index = &table->index[INTERP_STENCIL*ii];
+		float *weight = &table->weight[INTERP_STENCIL*ii];
+
+		index[0] = lower;
+		index[1] = lower + 1;
+		weight[1] = pos[ii] - (float) lower;
+		weight[0] = 1.0 - weight[1];
+
+		for (kk=0; kk<INTERP_STENCIL; kk++) {
+			if (index[kk] < 0 || index[kk] >= in_count) {
+				if (!clamp)
+					weight[kk] = 0.0;
+				index[kk] = index[kk] < 0 ? 0 : in_count - 1;
+			}
+		}
+	}
+
+	return table;
+}
+
+void interp_table_free(interp_table_t *table)
+{
+	if (table) {
+		FREE(table->index);
+		FREE(table->weight);
+		FREE(table);
+	}
+}
+
+/* Smallest and largest input index used by output positions first..last */
+static void input_span(interp_table_t *table, int first, int last,
+                       int *lo, int *hi)
+{
+	int ii;
+
+	*lo = table->in_count - 1;
+	*hi = 0;
+	for (ii=INTERP_STENCIL*first; ii<INTERP_STENCIL*(last+1); ii++) {
+		if (table->index[ii] < *lo) *lo = table->index[ii];
+		if (table->index[ii] > *hi) *hi = table->index[ii];
+	}
+	if (*hi < *lo) *hi = *lo;
+}
+
+static void interp_rows(void *data, int first_row, int last_row)
+{
+	interp_block_t *b = (interp_block_t *) data;
+	int out_np = b->range->out_count;
+	const int *rindex = b->range->index;
+	const float *rweight = b->range->weight;
+	int band, line, ii, kk;
+
+	for (band=0; band<b->band_count; band++) {
+		for (line=first_row; line<=last_row; line++) {
+			int out_line = b->first_out_line + line;
+			const int *aindex = &b->azimuth->index[INTERP_STENCIL*out_line];
+			const float *aweight = &b->azimuth->weight[INTERP_STENCIL*out_line];
+			float *out = b->out[band] + (long long)line*out_np;
+
+			for (ii=0; ii<out_np; ii++)
+				out[ii] = 0.0;
+			for (kk=0; kk<INTERP_STENCIL; kk++) {
+				const float *in;
+				if (aweight[kk] == 0.0)
+					continue;
+				in = b->in[band] +
+					(long long)(aindex[kk] - b->first_in_line)*b->in_np;
+				for (ii=0; ii<out_np; ii++) {
+					const int *ri = &rindex[INTERP_STENCIL*ii];
+					const float *rw = &rweight[INTERP_STENCIL*ii];
+					out[ii] += aweight[kk] * (in[ri[0]]*rw[0] + in[ri[1]]*rw[1]);
+				}
+			}
+		}
+	}
+}
+
+int interp_table_resample(FILE *fpi, meta_parameters *in_meta,
+                          FILE *fpo, meta_parameters *out_meta,
+                          interp_table_t *range, interp_table_t *azimuth)
+{
+	int in_np = range->in_count;
+	int out_np = range->out_count;
+	int out_nl = azimuth->out_count;
+	int bc = in_meta->general->band_count;
+	int block_lines, max_in_lines, line, lines, band, lo, hi, ii;
+	interp_block_t b;
+
+	/* Choose the block size, and find the most input lines any block
+	   needs */
+	int np = in_np > out_np ? in_np : out_np;
+	block_lines = INTERP_BLOCK_PIXELS / ((long long)np*bc);
+	if (block_lines < 1) block_lines = 1;
+	if (block_lines > out_nl) block_lines = out_nl;
+	max_in_lines = 1;
+	for (line=0; line<out_nl; line+=block_lines) {
+		lines = out_nl - line < block_lines ? out_nl - line : block_lines;
+		input_span(azimuth, line, line+lines-1, &lo, &hi);
+		if (hi - lo + 1 > max_in_lines)
+			max_in_lines = hi - lo + 1;
+	}
+
+	b.range = range;
+	b.azimuth = azimuth;
+	b.band_count = bc;
+	b.in_np = in_np;
+	b.in = (float **) MALLOC(sizeof(float *)*bc);
+	b.out = (float **) MALLOC(sizeof(float *)*bc);
+	for (band=0; band<bc; band++) {
+		b.in[band] = (float *) MALLOC(sizeof(float)*max_in_lines*in_np);
+		b.out[band] = (float *) MALLOC(sizeof(float)*block_lines*out_np);
+	}
+
+	for (line=0; line<out_nl; line+=lines) {
+		lines = out_nl - line < block_lines ? out_nl - line : block_lines;
+		input_span(azimuth, line, line+lines-1, &lo, &hi);
+
+		for (band=0; band<bc; band++)
+			get_band_float_lines(fpi, in_meta, band, lo, hi-lo+1, b.in[band]);
+
+		b.first_in_line = lo;
+		b.first_out_line = line;
+		parallel_rows(lines, interp_rows, &b);
+
+		for (band=0; band<bc; band++)
+			put_band_float_lines(fpo, out_meta, band, line, lines, b.out[band]);
+		for (ii=line; ii<line+lines; ii++)
+			asfLineMeter(ii, out_nl);
+	}
+
+	for (band=0; band<bc; band++) {
+		FREE(b.in[band]);
+		FREE(b.out[band]);
+	}
+	FREE(b.in);
+	FREE(b.out);
+
+	return TRUE;
+}
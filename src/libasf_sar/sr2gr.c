@@ -15,19 +15,22 @@ DESCRIPTION:
 #include "asf_sar.h"
 #include "asf_raster.h"
 
-#define FUDGE_FACTOR 2
-
-/*Create vector for multilooking.*/
-static void ml_vec(float oldSize, float newSize,float *ml)
+/*Create vector for multilooking: the input line (in fractional lines)
+  of every output line, up to the first one past the end of the image.*/
+static float *ml_vec(float oldSize, float newSize, int in_nl, int *out_nl)
 {
-	float  gr=0;
+	float *ml;
 	int    ii;
-	
-	for (ii=0; ii<MAX_IMG_SIZE; ii++)
-	{
-		ml[ii]=gr/oldSize;
-		gr+=newSize;
-	}
+
+	for (ii=1; (int)(ii*newSize/oldSize) <= in_nl; ii++)
+		;
+	*out_nl = ii;
+
+	ml = (float *) MALLOC(sizeof(float)*(*out_nl));
+	for (ii=0; ii<*out_nl; ii++)
+		ml[ii] = ii*newSize/oldSize;
+
+	return ml;
 }
 
 /*
@@ -46,8 +49,10 @@ static void ml_vec(float oldSize, float newSize,float *ml)
                  grinc = ground range increment in meters (real*4)
                          For ASF = 12.5meters
  
-        Output:    sr2gr = 8k (real*4) vector that contains the interpolation
-                          points for slant range to ground range conversion.
+        Output:    sr2gr = vector that contains the interpolation points
+                          for slant range to ground range conversion, up to
+                          the first one past the end of the slant range
+                          image (in_np samples); its length is out_np.
                           The first element is always 0, which means the first
                           interpolation point is at r_close.  This vector
                           is in units of slant range bins.
@@ -75,11 +80,19 @@ static void ml_vec(float oldSize, float newSize,float *ml)
     dividing by the slant range bin size, rsinc.
 */
 
-static void sr2gr_vec(meta_parameters *meta, float srinc, float newSize,
-                      float *sr2gr)
+/* Slant range bin of the point at ground range rg */
+static float slant_bin(double ht, double re, double sr, float srinc, double rg)
+{
+    double this_slant = sqrt(ht*ht+re*re-2.0*ht*re*cos(rg/re));
+    return (this_slant - sr) / srinc;
+}
+
+static float *sr2gr_vec(meta_parameters *meta, float srinc, float newSize,
+                        int in_np, int *out_np)
 {
-    double rg,rg0;/*Ground range distances from nadir, along curve of earth.*/
+    double rg0;/*Ground range distance from nadir, along curve of earth.*/
     double ht,re,sr;/*S/C height, earth radius, slant range [m]*/
+    float *sr2gr;
     int    ii;
     
     ht = meta_get_sat_height(meta, 0, 0);
@@ -89,14 +102,16 @@ static void sr2gr_vec(meta_parameters *meta, float srinc, float newSize,
     /* calculate ground range to first point */
     rg0 = re * acos((ht*ht+re*re-sr*sr) / (2*ht*re));
     
-    /* begin loop */
-    rg = rg0;
-    for (ii = 0; ii<MAX_IMG_SIZE; ii++)
-    {
-        double this_slant = sqrt(ht*ht+re*re-2.0*ht*re*cos(rg/re));
-        sr2gr[ii] = (this_slant - sr) / srinc;
-        rg += newSize;
-    }
+    /* count the points up to the first one past the end of the image */
+    for (ii=1; (int)slant_bin(ht,re,sr,srinc,rg0+ii*newSize) <= in_np; ii++)
+        ;
+    *out_np = ii;
+
+    sr2gr = (float *) MALLOC(sizeof(float)*(*out_np));
+    for (ii = 0; ii<*out_np; ii++)
+        sr2gr[ii] = slant_bin(ht,re,sr,srinc,rg0+ii*newSize);
+
+    return sr2gr;
 }
 
 int sr2gr(const char *infile, const char *outfile)
@@ -108,15 +123,9 @@ int sr2gr_pixsiz(const char *infile, const char *outfile, float grPixSize)
 {
 	int    in_np,  in_nl;               /* input number of pixels,lines  */
 	int    out_np, out_nl;              /* output number of pixels,lines */
-	int    ii,line,band;
 	float  oldX,oldY;
-	float  sr2gr[MAX_IMG_SIZE];
-	float  ml2gr[MAX_IMG_SIZE];
-	int    a_lower[MAX_IMG_SIZE];
-	int    lower[MAX_IMG_SIZE], upper[MAX_IMG_SIZE];
-	float  a_ufrac[MAX_IMG_SIZE], a_lfrac[MAX_IMG_SIZE];
-	float  ufrac[MAX_IMG_SIZE], lfrac[MAX_IMG_SIZE];
-	float *ibuf1,*ibuf2,*obuf;
+	float *sr2gr, *ml2gr;
+	interp_table_t *range, *azimuth;
 	char   infile_name[512],inmeta_name[512];
 	char   outfile_name[512],outmeta_name[512];
 	FILE  *fpi, *fpo;
@@ -164,17 +173,8 @@ int sr2gr_pixsiz(const char *infile, const char *outfile, float grPixSize)
 	out_meta->sar->image_type       = 'G'; 
 	out_meta->general->x_pixel_size = grPixSize;
 	out_meta->general->y_pixel_size = grPixSize;
-	sr2gr_vec(out_meta,oldX,grPixSize,sr2gr);
-	ml_vec(oldY,grPixSize,ml2gr);
-
-	out_np = MAX_IMG_SIZE;
-	out_nl = MAX_IMG_SIZE;
-	for (ii=MAX_IMG_SIZE-1; ii>0; ii--)
-		if ((int)sr2gr[ii] > in_np)
-			out_np = ii;
-	for (ii=MAX_IMG_SIZE-1; ii>0; ii--)
-		if ((int)ml2gr[ii] > in_nl)
-			out_nl = ii;
+	sr2gr = sr2gr_vec(out_meta,oldX,grPixSize,in_np,&out_np);
+	ml2gr = ml_vec(oldY,grPixSize,in_nl,&out_nl);
 	
 	out_meta->general->line_count   = out_nl;
         out_meta->general->line_scaling *= (double)in_nl/(double)out_nl;
@@ -190,62 +190,18 @@ int sr2gr_pixsiz(const char *infile, const char *outfile, float grPixSize)
 	fpi = fopenImage(infile_name,"rb");
 	fpo = fopenImage(outfile_name,"wb");
 	
-	for (ii=0; ii<MAX_IMG_SIZE; ii++)
-	{
-		lower[ii] = (int) sr2gr[ii];
-		upper[ii] = lower[ii] + 1;
-		ufrac[ii] = sr2gr[ii] - (float) lower[ii];
-		lfrac[ii] = 1.0 - ufrac[ii]; 
-		
-		a_lower[ii] = (int) ml2gr[ii];
-		a_ufrac[ii] = ml2gr[ii] - (float) a_lower[ii];
-		a_lfrac[ii] = 1.0 - a_ufrac[ii]; 
-	}
-
-	ibuf1 = (float *) MALLOC ((in_np+FUDGE_FACTOR)*sizeof(float));
-	ibuf2 = (float *) MALLOC ((in_np+FUDGE_FACTOR)*sizeof(float));
-	obuf = (float *) MALLOC (out_np*sizeof(float));
-
-	/* Initialize input arrays to 0 */
-	for (ii=0;ii<in_np+FUDGE_FACTOR;ii++) {
-		ibuf1[ii]=ibuf2[ii]=0.0;
-	}
-
-        /* Get the band info */
-        int bc = in_meta->general->band_count;
-        char **band_name = extract_band_names(in_meta->general->bands, bc);
+	/* Past the right edge the input is taken as zero, past the last
+	   line the last line is repeated */
+	range   = interp_table_new(sr2gr, out_np, in_np, FALSE);
+	azimuth = interp_table_new(ml2gr, out_nl, in_nl, TRUE);
 
 	/* Work dat magic! */
-        for (band=0; band<bc; ++band) {
-          asfPrintStatus("Working on band: %s\n", band_name[band]);
-          for (line=0; line<out_nl; line++)
-          {
-            if (a_lower[line]+1 < in_nl)
-            {
-              get_band_float_line(fpi,in_meta,band,a_lower[line],  ibuf1);
-              get_band_float_line(fpi,in_meta,band,a_lower[line]+1,ibuf2);
-            }
-            
-            for (ii=0; ii<out_np; ii++)
-            {
-              int val00,val01,val10,val11,tmp1,tmp2;
-              val00 = ibuf1[lower[ii]];
-              val01 = ibuf1[upper[ii]];
-              val10 = ibuf2[lower[ii]];
-              val11 = ibuf2[upper[ii]];
-              
-              tmp1 = val00*lfrac[ii] + val01*ufrac[ii];
-              tmp2 = val10*lfrac[ii] + val11*ufrac[ii];
-              
-              obuf[ii] = tmp1*a_lfrac[line] + tmp2*a_ufrac[line];
-            }
-            put_band_float_line(fpo,out_meta,band,line,obuf);
-            asfLineMeter(line, out_nl);
-          }
-        }
-        for (band=0; band<bc; ++band)
-          FREE(band_name[band]);
-        FREE(band_name);
+	interp_table_resample(fpi, in_meta, fpo, out_meta, range, azimuth);
+
+	interp_table_free(range);
+	interp_table_free(azimuth);
+	FREE(sr2gr);
+	FREE(ml2gr);
         meta_free(in_meta);
         meta_free(out_meta);
 	FCLOSE(fpi);
@@ -2,6 +2,8 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -54,260 +56,353 @@ form_base_layer (const char *base)
   return result;
 }
 
-// Form pyramid layers above base by creating FloatBlob or memory area
-// instances using PixMapsSpec pixmaps in directory path.  If
-// base_name is NULL, unique file names for any individual FloatBlob
-// instances used are automagicly generated, otherwise names of the
-// form "base_name_layer_number" are used (where the first
-// layer_number is "1").
-static GPtrArray *
-form_upper_layers (pyramid_layer *base, PixMapsSpec *pixmaps,
-		   GString *path, const char *base_name)
+// Form a new layer of size cw by ch to be layer number layer of a
+// pyramid, in memory if it is small enough or as a FloatBlob in
+// directory path otherwise (see form_upper_layers for the naming of
+// the FloatBlob files).
+static pyramid_layer *
+new_upper_layer (size_t cw, size_t ch, size_t layer, GString *path,
+		 const char *base_name)
 {
-  GPtrArray *result = g_ptr_array_new ();
+  pyramid_layer *cl = g_new (pyramid_layer, 1);
 
-  // When the smaller dimesion of the topmost layer of the pyramid is
-  // this size or smaller we consider the pyramid fully formed.
-  const size_t min_dimension = 1;
+  cl->size_x = cw;
+  cl->size_y = ch;
 
-  // Layer currently being worked on.
-  size_t layer = 0;
+  size_t layer_size = cw * ch;   // Size of current layer in pixels.
 
-  // Dimensions of current layer.
-  size_t cw = base->size_x, ch = base->size_y;
+  if ( layer_size * sizeof (float) <= PYRAMID_BIGGEST_LAYER_IN_MEMORY ) {
+    cl->is_float_blob = FALSE;
+    cl->data = g_new (float, layer_size);
+  }
+  else {
+    cl->is_float_blob = TRUE;
+    if ( base_name == NULL ) {
+      cl->data = float_blob_new (cw, ch, path->str, base_name);
+    }
+    else {
+      GString *name = my_g_string_new_printf ("%s_%llu", base_name,
+					      (long long unsigned) layer);
+      cl->data = float_blob_new (cw, ch, path->str, name->str);
+      my_g_string_free (name);
+    }
+  }
 
-  while ( cw > min_dimension && ch > min_dimension ) {
-    
-    // Previous layer (with respect to layer this iteration will add).
-    pyramid_layer *pl;
-    if ( layer == 0 ) {
-      pl = base;
+  return cl;
+}
+
+// Copy row_count rows starting at row start_row of layer into buffer,
+// or from buffer into layer if set is TRUE.
+static void
+layer_rows (pyramid_layer *layer, size_t start_row, size_t row_count,
+	    float *buffer, gboolean set)
+{
+  if ( layer->is_float_blob ) {
+    if ( set ) {
+      float_blob_set_region (layer->data, 0, start_row, layer->size_x,
+			     row_count, buffer);
+    }
+    else {
+      float_blob_get_region (layer->data, 0, start_row, layer->size_x,
+			     row_count, buffer);
+    }
+  }
+  else {
+    float *lrp = ((float *) layer->data) + start_row * layer->size_x;
+    size_t byte_count = row_count * layer->size_x * sizeof (float);
+    if ( set ) {
+      memcpy (lrp, buffer, byte_count);
     }
     else {
-      pl = g_ptr_array_index (result, layer - 1);
+      memcpy (buffer, lrp, byte_count);
     }
+  }
+}
+
+// Form row cr of width cw from rows ra and rb of width pw in the
+// layer below.  Pixels in cr are the averages of the four pixels
+// below them, except that if pw is odd the last pixel comes from only
+// the two pixels in the last column, and if rb is NULL (the layer
+// below had an odd number of rows and ra is its last row) only ra is
+// used.
+static void
+downsample_row (const float *ra, const float *rb, size_t pw, float *cr,
+		size_t cw)
+{
+  gboolean extra_column = (pw % 2 == 1);
+  size_t ii;
 
-    // If the previous layer has one or two odd dimensions, we will
-    // need to generate the rightmost and/or bottommost edges of the
-    // new layer without having four input pixels to use.
-    gboolean extra_column = FALSE, extra_row = FALSE;
-    if ( cw % 2 == 1 ) {
-      extra_column = TRUE;
+  if ( rb != NULL ) {
+    for ( ii = 0 ; ii < cw - (extra_column ? 1 : 0) ; ii++ ) {
+      cr[ii] = ((ra[ii * 2] + ra[ii * 2 + 1] + rb[ii * 2] + rb[ii * 2 + 1])
+		/ 4.0);
+    }
+    if ( extra_column ) {
+      cr[cw - 1] = (ra[pw - 1] + rb[pw - 1]) / 2.0;
+    }
+  }
+  else {
+    for ( ii = 0 ; ii < cw - (extra_column ? 1 : 0) ; ii++ ) {
+      cr[ii] = (ra[ii * 2] + ra[ii * 2 + 1]) / 2.0;
     }
-    if ( ch % 2 == 1 ) {
-      extra_row = TRUE;
+    if ( extra_column ) {
+      cr[cw - 1] = ra[pw - 1];
     }
+  }
+}
 
-    cw = ceil (cw / 2.0);
-    ch = ceil (ch / 2.0);
+// State of one upper layer while the pyramid is being streamed
+// together (see form_upper_layers).
+typedef struct {
+  pyramid_layer *layer;
+  size_t rows_formed;		// Rows of layer written so far.
+  // Width of the layer below, and a row from it that is waiting for
+  // the row below it to arrive, if have_pending is TRUE.
+  size_t below_size_x;
+  float *pending;
+  gboolean have_pending;
+  float *cr;			// Current row being formed.
+} layer_builder;
+
+// Add the row cr just formed to layer builders[ln], then feed it to
+// the layers above.
+static void
+emit_row (layer_builder *builders, size_t layer_count, size_t ln, float *cr);
+
+// Feed row, the next row of the layer below builders[ln], to
+// builders[ln], forming a new row there whenever a pair of rows is
+// complete.
+static void
+feed_row (layer_builder *builders, size_t layer_count, size_t ln,
+	  const float *row)
+{
+  if ( ln >= layer_count ) {
+    return;
+  }
 
-    layer++;
+  layer_builder *lb = builders + ln;
 
-    // Curent layer.
-    pyramid_layer *cl = g_new (pyramid_layer, 1);
+  if ( ! lb->have_pending ) {
+    memcpy (lb->pending, row, lb->below_size_x * sizeof (float));
+    lb->have_pending = TRUE;
+    return;
+  }
 
-    cl->size_x = cw;
-    cl->size_y = ch;
-    
-    size_t layer_size = cw * ch;   // Size of current layer in pixels.
+  downsample_row (lb->pending, row, lb->below_size_x, lb->cr,
+		  lb->layer->size_x);
+  lb->have_pending = FALSE;
+  emit_row (builders, layer_count, ln, lb->cr);
+}
 
-    if ( layer_size * sizeof (float) <= PYRAMID_BIGGEST_LAYER_IN_MEMORY ) {
-      cl->is_float_blob = FALSE;
-      cl->data = g_new (float, layer_size);
-    }
-    else {
-      cl->is_float_blob = TRUE;
-      if ( base_name == NULL ) {
-	cl->data = float_blob_new (cw, ch, path->str, base_name);
-      }
-      else {
-	GString *name = my_g_string_new_printf ("%s_%llu", base_name,
-						(long long unsigned) layer);
-	cl->data = float_blob_new (cw, ch, path->str, name->str);
-	my_g_string_free (name);
-      }
-    }
+static void
+emit_row (layer_builder *builders, size_t layer_count, size_t ln, float *cr)
+{
+  layer_builder *lb = builders + ln;
 
-    size_t ii, jj;		// Index variables.
+  g_assert (lb->rows_formed < lb->layer->size_y);
+  layer_rows (lb->layer, lb->rows_formed, 1, cr, TRUE);
+  lb->rows_formed++;
 
-    float *cr = g_new (float, cw); // Current row being formed.
+  feed_row (builders, layer_count, ln + 1, cr);
+}
 
-    if ( pl->is_float_blob ) {
+// A share of a batch of rows of layer 1 for one downsampling thread.
+typedef struct {
+  const float *below;		// Rows from the base layer.
+  size_t below_size_x, below_rows;
+  float *rows;			// Rows of layer 1 to form.
+  size_t size_x, first_row, row_count;
+} downsample_job;
 
-      float *ra = g_new (float, pl->size_x); // Row above.
-      float *rb = g_new (float, pl->size_x); // Row below.
+static gpointer
+downsample_thread (gpointer data)
+{
+  downsample_job *job = data;
+
+  size_t jj;
+  for ( jj = job->first_row ; jj < job->first_row + job->row_count ; jj++ ) {
+    const float *ra = job->below + jj * 2 * job->below_size_x;
+    const float *rb = NULL;
+    if ( jj * 2 + 1 < job->below_rows ) {
+      rb = ra + job->below_size_x;
+    }
+    downsample_row (ra, rb, job->below_size_x,
+		    job->rows + jj * job->size_x, job->size_x);
+  }
 
-      // First we do all the rows of the new layer which are truly
-      // averages of four other pixels.  We'll come back and fill in
-      // the extra row that we have to deal with if the previous layer
-      // had an odd number of rows later.
-      for ( jj = 0 ; jj < ch - (extra_row ? 1 : 0) ; jj++ ) {
+  return NULL;
+}
 
-	float_blob_get_region (pl->data, 0, jj * 2, pl->size_x, 1, ra);
-	float_blob_get_region (pl->data, 0, jj * 2 + 1, pl->size_x, 1, rb);
+// Number of threads to use for downsampling the base layer.
+static guint
+downsample_thread_count (void)
+{
+  long cpus = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if ( cpus < 1 ) {
+    cpus = 1;
+  }
 
-	// If this is the first layer above the base layer, we need to
-	// apply the maps to the inputs as advertised.
-	if ( layer == 1 ) {
-	  guint kk;
-	  for ( kk = 0 ; kk < pl->size_x ; kk++ ) {
-	    ra[kk] = pix_maps_spec_map (pixmaps, ra[kk]);
-	    rb[kk] = pix_maps_spec_map (pixmaps, rb[kk]);
-	  }
-	}
+  return MIN (cpus, PYRAMID_MAX_BUILD_THREADS);
+}
 
-	if ( cl->is_float_blob ) {
+// Form pyramid layers above base by creating FloatBlob or memory area
+// instances using PixMapsSpec pixmaps in directory path.  If
+// base_name is NULL, unique file names for any individual FloatBlob
+// instances used are automagicly generated, otherwise names of the
+// form "base_name_layer_number" are used (where the first
+// layer_number is "1").
+//
+// All the layers are formed in a single pass over the base layer:
+// each row of a layer is fed to the layer above as soon as it is
+// formed, so only a couple of rows of each upper layer are ever in
+// flight, and no layer is read back once it is written.  The base
+// layer is read a batch of rows at a time, and the rows of layer 1
+// (which is three quarters of the work) are formed from each batch by
+// several threads.
+static GPtrArray *
+form_upper_layers (pyramid_layer *base, PixMapsSpec *pixmaps,
+		   GString *path, const char *base_name)
+{
+  GPtrArray *result = g_ptr_array_new ();
 
-	  // We will deal with the extra column, if any, later (see
-	  // above comment).
-	  for ( ii = 0 ; ii < cw - (extra_column ? 1 : 0) ; ii++ ) {
-	    cr[ii] = ra[ii * 2] + ra[ii * 2 + 1] + rb[ii * 2] + rb[ii * 2 + 1];
-	    cr[ii] /= 4.0;
-	  }
+  // When the smaller dimesion of the topmost layer of the pyramid is
+  // this size or smaller we consider the pyramid fully formed.
+  const size_t min_dimension = 1;
 
-	  // Deal with the extra column (except possibly for the
-	  // bottom rightmost pixel, which is dealt with when the
-	  // bottom row is done if there is an extra row).
-	  if ( extra_column ) {
-	    size_t cind = cw - 1; // Column index.
-	    cr[cind] = (ra[cind * 2] + rb[cind * 2]) / 2.0;
-	  }
+  // Dimensions of current layer.
+  size_t cw = base->size_x, ch = base->size_y;
 
-	  float_blob_set_region (cl->data, 0, jj, cw, 1, cr);
-	}
+  while ( cw > min_dimension && ch > min_dimension ) {
+    cw = ceil (cw / 2.0);
+    ch = ceil (ch / 2.0);
+    g_ptr_array_add (result, new_upper_layer (cw, ch, result->len + 1, path,
+					      base_name));
+  }
 
-	else {
-	  // Current row pointer.
-	  float *crp = ((float *) cl->data) + jj * cw;
-
-	  for ( ii = 0 ; ii < cw - (extra_column ? 1 : 0) ; ii++ ) {
-	    crp[ii]
-	      = ((ra[ii * 2] + ra[ii * 2 + 1] + rb[ii * 2] + rb[ii * 2 + 1])
-		 / 4.0);
-	  }
-	  
-	  // Deal with potential extra column (see comment above).
-	  if ( extra_column ) {
-	    size_t cind = cw - 1; // Column index.
-	    crp[cind] = (ra[cind * 2] + rb[cind * 2]) / 2.0;
-	  }
-	}
-      }
+  size_t layer_count = result->len;
+  if ( layer_count == 0 ) {
+    return result;
+  }
 
-      g_free (ra);
-      g_free (rb);
-    }
+  // Builders for the layers above layer 1 (index 0 is layer 1, which
+  // is formed directly from batches of base layer rows below).
+  layer_builder *builders = g_new0 (layer_builder, layer_count);
+  size_t ii, jj;		// Index variables.
+  for ( ii = 0 ; ii < layer_count ; ii++ ) {
+    layer_builder *lb = builders + ii;
+    lb->layer = g_ptr_array_index (result, ii);
+    lb->below_size_x = (ii == 0 ? base->size_x
+			: builders[ii - 1].layer->size_x);
+    lb->pending = g_new (float, lb->below_size_x);
+    lb->cr = g_new (float, lb->layer->size_x);
+  }
 
-    else { // Previous layer is not a FloatBlob
-
-      for ( jj = 0 ; jj < ch - (extra_row ? 1 : 0) ; jj++ ) {
-
-	// Interpreted previous layer data pointer.
-	float *pld = ((float *) pl->data);
-
-	for ( ii = 0 ; ii < cw - (extra_column ? 1 : 0) ; ii++ ) {
-	  // Pixel values from which we will form the next pixel.
-	  float ul, ur, ll, lr;
-	  ul = pld[jj * 2 * pl->size_x + ii * 2];
-	  ur = pld[jj * 2 * pl->size_x + ii * 2 + 1];
-	  ll = pld[(jj * 2 + 1) * pl->size_x + ii * 2];
-	  lr = pld[(jj * 2 + 1) * pl->size_x + ii * 2 + 1];
-	  // If this is the first layer above the base layer, we need
-	  // to apply the maps to the inputs as advertised.
-	  if ( layer == 1 ) {
-	    guint kk;
-	    for ( kk = 0 ; kk < pl->size_x ; kk++ ) {
-	      ul = pix_maps_spec_map (pixmaps, ul);
-	      ur = pix_maps_spec_map (pixmaps, ul);
-	      ll = pix_maps_spec_map (pixmaps, ul);
-	      lr = pix_maps_spec_map (pixmaps, ul);
-	    }
-	  }
-	  
- 	  ((float *) cl->data)[jj * cw + ii] = (ul + ur + ll + lr) / 4.0;
-	}
+  pyramid_layer *l1 = builders[0].layer;
 
-	if ( extra_column ) {
-	  size_t cind = cw - 1;	// Column index.
-	  float up, lp;		// Upper pixel, lower pixel.
-	  up = pld[jj * 2 * pl->size_x + cind * 2];
-	  lp = pld[(jj * 2 + 1) * pl->size_x + cind * 2];
-	  // Here (and other such places) is where propagation should
-	  // be implemented: if we are "infecting" upper layers, we
-	  // need to do it every layer, not just the first, and the
-	  // calculation of the new value needs to be conditionalized
-	  // as well.
-	  if ( layer == 1 ) {
-	    up = pix_maps_spec_map (pixmaps, up);
-	    lp = pix_maps_spec_map (pixmaps, lp);
-	  }
-	  ((float *) cl->data)[jj * cw + cind] = (up + lp) / 2.0;
-	}
-      }
-    }
+  // Read enough base layer rows at a time to give every thread a
+  // decent share of work, without holding too much of a big base
+  // layer in memory.
+  guint thread_count = downsample_thread_count ();
+  size_t batch_rows = (PYRAMID_BUILD_BATCH_SIZE
+		       / (2 * base->size_x * sizeof (float)));
+  batch_rows = MAX (batch_rows, thread_count);
+  batch_rows = MIN (batch_rows, l1->size_y);
 
-    // Now take care of the extra row, if any.
-    if ( extra_row ) {
-      float *mr = g_new (float, pl->size_x); // Model row in layer below.
-      if ( pl->is_float_blob ) {
-	float_blob_get_region ((FloatBlob *) pl->data, 0, (ch - 1) * 2,
-			       pl->size_x, 1, mr);
-      }
-      else {
-	for ( ii = 0 ; ii < pl->size_x ; ii++ ) {
-	  mr[ii] = ((float *) pl->data)[(ch - 1) * 2 + ii];
-	}
-      }
+  float *below = g_new (float, 2 * batch_rows * base->size_x);
+  float *rows = g_new (float, batch_rows * l1->size_x);
 
-      if ( layer == 1 ) {
-	for ( ii = 0 ; ii < pl->size_x ; ii++ ) {
-	  mr[ii] = pix_maps_spec_map (pixmaps, mr[ii]);
-	}
-      }
+  if ( thread_count > 1 && !g_thread_supported () ) {
+    g_thread_init (NULL);
+  }
 
-      for ( ii = 0 ; ii < cl->size_x - (extra_column ? 1 : 0) ; ii++ ) {
-	cr[ii] = (mr[ii * 2] + mr[ii * 2 + 1]) / 2.0;
-      }
+  downsample_job *jobs = g_new (downsample_job, thread_count);
+  GThread **threads = g_new (GThread *, thread_count);
 
-      if ( extra_column ) {
-	cr[cl->size_x - 1] = mr[pl->size_x - 1];
-      }
+  for ( jj = 0 ; jj < l1->size_y ; jj += batch_rows ) {
+    size_t row_count = MIN (batch_rows, l1->size_y - jj);
+    size_t below_rows = MIN (row_count * 2, base->size_y - jj * 2);
 
-      if ( cl->is_float_blob ) {
-	float_blob_set_region ((FloatBlob *) cl->data, 0, ch - 1, cw, 1, cr);
+    layer_rows (base, jj * 2, below_rows, below, FALSE);
+
+    // The maps are applied to the inputs of layer 1 as advertised.
+    // This has to be done here in this thread, since PixMapsSpec
+    // instances reorder their maps as they are used.
+    if ( pix_maps_spec_map_count (pixmaps) != 0 ) {
+      for ( ii = 0 ; ii < below_rows * base->size_x ; ii++ ) {
+	below[ii] = pix_maps_spec_map (pixmaps, below[ii]);
       }
-      else {
-	for ( ii = 0 ; ii < cl->size_x ; ii++ ) {
-	  ((float *) cl->data)[ii] = cr[ii];
-	}
+    }
+
+    // Split the rows between the threads, with this thread doing the
+    // last share itself.
+    guint job_count = MIN (thread_count, row_count);
+    size_t share = row_count / job_count, extra = row_count % job_count;
+    size_t first_row = 0;
+    guint kk;
+    for ( kk = 0 ; kk < job_count ; kk++ ) {
+      downsample_job *job = jobs + kk;
+      job->below = below;
+      job->below_size_x = base->size_x;
+      job->below_rows = below_rows;
+      job->rows = rows;
+      job->size_x = l1->size_x;
+      job->first_row = first_row;
+      job->row_count = share + (kk < extra ? 1 : 0);
+      first_row += job->row_count;
+    }
+    for ( kk = 0 ; kk + 1 < job_count ; kk++ ) {
+      GError *err = NULL;
+      threads[kk] = g_thread_create (downsample_thread, jobs + kk, TRUE,
+				     &err);
+      if ( threads[kk] == NULL ) {
+	g_error ("failed to create pyramid downsampling thread: %s",
+		 err->message);
       }
+    }
+    downsample_thread (jobs + job_count - 1);
+    for ( kk = 0 ; kk + 1 < job_count ; kk++ ) {
+      g_thread_join (threads[kk]);
+    }
 
-      g_free (mr);
+    // Store the new rows of layer 1 and stream them up the pyramid.
+    layer_rows (l1, jj, row_count, rows, TRUE);
+    builders[0].rows_formed += row_count;
+    for ( ii = 0 ; ii < row_count ; ii++ ) {
+      feed_row (builders, layer_count, 1, rows + ii * l1->size_x);
     }
+  }
 
-    // Old functional (but weird in that it cloned a row above instead
-    // of using the bottom row of the model) extra_row code.
-    /*
-    if ( extra_row ) {
-      if ( cl->is_float_blob ) {
-	float_blob_get_region ((FloatBlob *) cl->data, 0, ch - 2, cw, 1, cr);
-	float_blob_set_region ((FloatBlob *) cl->data, 0, ch - 1, cw, 1, cr);
-      }
-      else {
-	float *cld = ((float *) cl->data); // Interpreted current layer data.
-	for ( ii = 0 ; ii < cw ; ii++ ) {
-	  cld[cw * (ch - 1) + ii] = cld[cw * (ch - 2) + ii];
-	}
-      }
+  g_free (threads);
+  g_free (jobs);
+  g_free (rows);
+  g_free (below);
+
+  // Any layer with a row still waiting for a partner had a layer
+  // below with an odd number of rows, so the waiting row forms the
+  // last row of the layer on its own.  This can feed the layer above
+  // its last row, so we go from the bottom up.
+  for ( ii = 1 ; ii < layer_count ; ii++ ) {
+    layer_builder *lb = builders + ii;
+    if ( lb->have_pending ) {
+      downsample_row (lb->pending, NULL, lb->below_size_x, lb->cr,
+		      lb->layer->size_x);
+      lb->have_pending = FALSE;
+      emit_row (builders, layer_count, ii, lb->cr);
     }
-    */
+  }
 
-    g_free (cr);
+  // Whew!
 
-    // Whew!
-    
-    g_ptr_array_add (result, cl);
+  for ( ii = 0 ; ii < layer_count ; ii++ ) {
+    layer_builder *lb = builders + ii;
+    g_assert (lb->rows_formed == lb->layer->size_y);
+    g_free (lb->pending);
+    g_free (lb->cr);
   }
+  g_free (builders);
 
   return result;
 }
@@ -45,6 +45,12 @@ typedef struct {
 // in a FloatBlob.
 #define PYRAMID_BIGGEST_LAYER_IN_MEMORY 4000000
 
+// Amount of the base layer, in bytes, read in at a time while the
+// upper layers are being formed, and the most threads used to
+// downsample each such batch of rows into layer 1.
+#define PYRAMID_BUILD_BATCH_SIZE 16000000
+#define PYRAMID_MAX_BUILD_THREADS 8
+
 // Form a new pyramid from base_name.meta and base_name.img, with
 // pixels for all layers above the first computed using base layer
 // pixels remapped according to pixmaps, using scratch_dir to store
@@ -4,6 +4,8 @@
 #include <math.h>
 #include <string.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <utime.h>
 
 #include <glib/gstdio.h>
 
@@ -12,6 +14,12 @@
 #include "pyramid_cache.h"
 #include "utilities.h"
 
+// Forward declarations.
+static gint64
+disk_usage (GString *dir);
+static void
+remove_least_recently_used (PyramidCache *self, gint64 target_size);
+
 PyramidCache *
 pyramid_cache_new (const char *path, gint64 max_size)
 {
@@ -42,6 +50,13 @@ pyramid_cache_new (const char *path, gint64 max_size)
 
   self->reference_count = 1;
 
+  // Entries are only ever added by pyramid_cache_add_entry, which
+  // can't safely remove old ones (see pyramid_cache_try_lease), so
+  // clean up after whoever last left the cache too big.
+  if ( disk_usage (self->dir) > self->max_size ) {
+    remove_least_recently_used (self, self->max_size / 2);
+  }
+
   return self;
 }
 
@@ -339,6 +354,51 @@ entry_get_date (GString *entry)
   }
 }
 
+// Return as a new GString the path of the layer 1 file of the cache
+// entry with key signature.  The modification time of this file is
+// the time the entry was last used.
+static GString *
+entry_layer_1_path (PyramidCache *self, GString *signature)
+{
+  GString *spaceless_signature = spaces_to_underscores (signature);
+  GString *result = my_g_string_new_printf ("%s%s_1", self->dir->str,
+					    spaceless_signature->str);
+  my_g_string_free (spaceless_signature);
+
+  return result;
+}
+
+// Record that the cache entry with key signature has just been used.
+// The entry date field can't be reset without a field writer lock,
+// which readers don't have, so we touch the layer 1 file instead.
+static void
+touch_entry (PyramidCache *self, GString *signature)
+{
+  GString *path = entry_layer_1_path (self, signature);
+  // If this fails the entry just looks older than it is, which is
+  // harmless.
+  utime (path->str, NULL);
+  my_g_string_free (path);
+}
+
+// Return the time the cache entry with key signature and value entry
+// was last used: the later of its date field (the time it was
+// created) and the time touch_entry was last called for it.
+static time_t
+entry_last_use (PyramidCache *self, GString *signature, GString *entry)
+{
+  time_t result = entry_get_date (entry);
+
+  GString *path = entry_layer_1_path (self, signature);
+  struct stat stat_buf;
+  if ( g_stat (path->str, &stat_buf) == 0 && stat_buf.st_mtime > result ) {
+    result = stat_buf.st_mtime;
+  }
+  my_g_string_free (path);
+
+  return result;
+}
+
 // Use find_field_value_offset to find the "date" field in entry, and
 // replace the existing value of this field with date.  If the field
 // isn't already present it is added.
@@ -381,6 +441,16 @@ pyramid_cache_try_lease (PyramidCache *self, GString *signature)
   // field so the add_entry method can be called, as described in the
   // interface.
   gboolean locked = FALSE;
+
+  // Make room for the entry we may be about to build.  This has to be
+  // done here rather than in add_entry, since we must not hold any
+  // field writer lock while waiting for the table writer lock: a
+  // thread in this method could be holding a table reader lock while
+  // it waits for that field.
+  if ( g_hash_table_size (self->writer_locks) == 0
+       && disk_usage (self->dir) > self->max_size ) {
+    remove_least_recently_used (self, self->max_size / 2);
+  }
   
   while ( !locked ) {
 
@@ -400,12 +470,7 @@ pyramid_cache_try_lease (PyramidCache *self, GString *signature)
 	size_t size_y = entry_get_size_field (fv, "size_y");
 	GString *spaceless_signature = spaces_to_underscores (signature);
 	result = load_layers (self->dir, spaceless_signature, size_x, size_y);
-	// IMPROVEME: Ideally we would update the date field here, in
-	// order to implement an LRU approach to unused cache entry
-	// removal.  But it requires more monkeying around with table
-	// locks (so that we can reset the date field value) and just
-	// removing the ones added longer ago first is probably a good
-	// enough heuristic for our purposes here.
+	touch_entry (self, signature);
 	my_g_string_free (spaceless_signature);
 	g_hash_table_insert (self->reader_locks,
 			     g_string_new (signature->str), NULL);
@@ -526,7 +591,7 @@ remove_entry (PyramidCache *self, GString *entry)
 
   // Now remove all the layer files we can the correspond to entry.
   GString *spaceless_signature = spaces_to_underscores (entry);
-  GString *rm_command = g_string_new ("rm ");
+  GString *rm_command = g_string_new ("rm -f ");
   g_string_append_printf (rm_command, "%s%s_*", self->dir->str,
 			  spaceless_signature->str);
   int exit_code = system (rm_command->str);
@@ -540,115 +605,94 @@ remove_entry (PyramidCache *self, GString *entry)
   table_file_remove_field (self->tf, entry->str);
 }
 
-void
-pyramid_cache_add_entry (PyramidCache *self, GString *signature,
-			 GPtrArray *layers)
+// A cache entry that remove_least_recently_used could remove.
+typedef struct {
+  GString *key;
+  time_t last_use;
+} eviction_candidate;
+
+// Comparator which orders eviction candidates least recently used
+// first.
+static gint
+compare_candidates_by_last_use (eviction_candidate **ap,
+				eviction_candidate **bp)
+{
+  eviction_candidate *a = *ap, *b = *bp;
+
+  if ( a->last_use < b->last_use ) {
+    return -1;
+  }
+  else if ( a->last_use > b->last_use ) {
+    return 1;
+  }
+  else {
+    return 0;
+  }
+}
+
+// Remove cache entries, least recently used first, until the cache
+// directory uses no more than target_size megabytes or there is
+// nothing left that can be removed.  Entries the caller has leased
+// and entries somebody else has locked (because they are using them
+// or building them) are left alone.  The caller must not hold any
+// field writer locks (see pyramid_cache_try_lease).  We go down to
+// well under max_size when we clean, so we don't end up having to
+// remove something every time and always being slow.
+static void
+remove_least_recently_used (PyramidCache *self, gint64 target_size)
 {
-  // Figure out how much bigger the new layers will make the cache, in
-  // megabytes.
-  gsize expected_cache_growth = 0;
+  g_assert (g_hash_table_size (self->writer_locks) == 0);
+
+  table_file_table_writer_lock (self->tf);
+
+  GPtrArray *cat = table_file_catalog (self->tf);
+  GPtrArray *candidates = g_ptr_array_new ();
   guint ii;
-  for ( ii = 0 ; ii < layers->len ; ii++ ) {
-    pyramid_layer *cl = g_ptr_array_index (layers, ii);
-    // The layers that use FloatBlob instances are required to have
-    // already created them in the cache directory, so we avoid
-    // counting them again here.
-    if ( ! cl->is_float_blob ) {
-      expected_cache_growth += sizeof (float) * cl->size_x * cl->size_y;
+  for ( ii = 0 ; ii < cat->len ; ii++ ) {
+    GString *ce = g_ptr_array_index (cat, ii);
+    if ( my_g_hash_table_entry_exists (self->reader_locks, ce) ) {
+      continue;
+    }
+    if ( table_file_field_writer_trylock (self->tf, ce->str, NULL) ) {
+      GString *entry = table_file_get_field_value (self->tf, ce->str);
+      eviction_candidate *cc = g_new (eviction_candidate, 1);
+      cc->key = ce;
+      cc->last_use = entry_last_use (self, ce, entry);
+      my_g_string_free (entry);
+      table_file_field_writer_unlock (self->tf, ce->str);
+      g_ptr_array_add (candidates, cc);
     }
   }
-  expected_cache_growth /= 1000000;
-
-  // If the cache directory looks too big, try to remove old entries
-  // until we've got it half free again (we go down to half so we
-  // don't end up having to remove something every time and always
-  // being slow).  IMPROVEME: its sloppy and potentially very slow to
-  // use disk_usage() to recompute the space the cache uses each time.
-  if ( disk_usage (self->dir) + expected_cache_growth > self->max_size ) {
-    // Ug, we only have trylock for fields, not yet for the entire
-    // table lock.  So even the cheap hack strategy outlined below in
-    // the non-running section doesn't work.  I'm out of time and
-    // inclination to add it, so instead of any actual cache cleaning,
-    // we'll just emit a message for the user to read saying that
-    // their cache is getting BIG.
-    g_print ("HEY, your image cache is getting BIIIIG.  You might want\n"
-	     "to go delete the contents of directory '%s'.\n", self->dir->str);
-  } else if ( FALSE ) {
-    // FIIXME: Well doing a table writer lock here can lead to deadlock
-    // with others that are just trying to innocently use the cache.
-    // Fixing this might well require implementing lock upgrading
-    // (reader-to-writer) or some other hideous backflip, so we just
-    // give up and don't clean the cache if the lock fails.  It will
-    // hopefully get cleaned out sometime when things arr running
-    // single-threaded.
-    //    trmsg ("Pre table_writer_trylock in %s,  %d", __func__, __LINE__);
-    //    gboolean lock_result = table_file_table_writer_trylock (self->tf);
-    //    trmsg ("Post table_writer_trylock in %s,  %d", __func__, __LINE__);
-    // We need to define a lock_result so this crud compiles.
-    gboolean lock_result = FALSE;
-    if ( lock_result ) {
-      while ( disk_usage (self->dir) + expected_cache_growth
-	      > self->max_size / 2.0 ) {
-	GPtrArray *cat = table_file_catalog (self->tf);
-	// We will hold a number of field locks for a while, this
-	// remembers which ones they are so we can unlock them again.
-	GPtrArray *fields_to_unlock = g_ptr_array_new ();
-	GString *oldest_entry = NULL;
-	// We're going to search for the oldest entry, so we
-	// initialize our notion of the oldest entry date to a time
-	// comfortably in the future :)
-	time_t oldest_entry_date = time (NULL) + 10000;
-	for ( ii = 0 ; ii < cat->len ; ii++ ) {
-	  GString *ce = g_ptr_array_index (cat, ii);
-	  // If we hold a writer lock on the field, we are presumably
-	  // in the process of adding, so we don't want to consider it
-	  // for removal.
-	  if ( my_g_hash_table_entry_exists (self->writer_locks, ce) ) {
-	    continue;
-	  }
-	  // trmsg ("Pre field_writer_trylock in %s,  %d", __func__, __LINE__);
-	  gboolean lock_result
-	    = table_file_field_writer_trylock (self->tf, ce->str, NULL);
-	  // trmsg ("Post field_writer_trylock in %s,  %d", __func__, __LINE__);
-	  if ( lock_result ) {
-	    g_ptr_array_add (fields_to_unlock, ce);
-	    GString *entry = table_file_get_field_value (self->tf, ce->str);
-	    time_t entry_date = entry_get_date (entry);
-	    g_string_free (entry, TRUE);
-	    if ( entry_date < oldest_entry_date ) {
-	      oldest_entry = ce;
-	      oldest_entry_date = entry_date;
-	    }
-	  }
-	}
-	if ( oldest_entry != NULL ) {
-	  remove_entry (self, oldest_entry);
-	}
-	for ( ii = 0 ; ii < fields_to_unlock->len ; ii++ ) {
-	  GString *ce = g_ptr_array_index (fields_to_unlock, ii);
-	  // trmsg ("Pre field_writer_unlock in %s line %d", __func__, __LINE__);
-	  table_file_field_writer_unlock (self->tf, ce->str);
-	  // trmsg ("Post field_writer_unlock in %s line %d", __func__, __LINE__);
-	}
-	g_ptr_array_free (fields_to_unlock, TRUE);
-	for ( ii = 0 ; ii < cat->len ; ii++ ) {
-	  GString *ce = g_ptr_array_index (cat, ii);
-	  g_string_free (ce, TRUE);
-	}
-	g_ptr_array_free (cat, TRUE);
-	// If we go through the entire list and don't find anything to
-	// remove, we're done, since apparently there isn't anything
-	// to remove.
-	if ( oldest_entry == NULL ) { 
-	  break;
-	}
-      }
-      // trmsg ("Pre table_writer_unlock in %s line %d", __func__, __LINE__);
-      table_file_table_writer_unlock (self->tf);
-      // trmsg ("Post table_writer_unlock in %s line %d", __func__, __LINE__);
+
+  g_ptr_array_sort (candidates, (GCompareFunc) compare_candidates_by_last_use);
+
+  // Nobody can get a new field lock while we hold the table writer
+  // lock, so the candidates should all still be free.  IMPROVEME: its
+  // sloppy and potentially slow to use disk_usage() to recompute the
+  // space the cache uses after each removal.
+  for ( ii = 0 ;
+	ii < candidates->len && disk_usage (self->dir) > target_size ;
+	ii++ ) {
+    eviction_candidate *cc = g_ptr_array_index (candidates, ii);
+    if ( table_file_field_writer_trylock (self->tf, cc->key->str, NULL) ) {
+      remove_entry (self, cc->key);
     }
   }
 
+  my_g_ptr_array_really_free (candidates, g_free);
+  my_g_ptr_array_really_free (cat, (FreeFunc) my_g_string_free);
+
+  table_file_table_writer_unlock (self->tf);
+}
+
+void
+pyramid_cache_add_entry (PyramidCache *self, GString *signature,
+			 GPtrArray *layers)
+{
+  // Old entries are removed to make room for this one when it is
+  // leased (see pyramid_cache_try_lease), so all that's left to do is
+  // install it.
+  guint ii;
   g_assert (my_g_hash_table_entry_exists (self->writer_locks, signature));
 
   GString *entry = table_file_get_field_value (self->tf, signature->str);
@@ -6,6 +6,11 @@
 // path via a reader/writer lock system (see method descriptions for
 // details).  The base layer (the image itself) is never stored in the
 // cache (since it exists elsewhere anyway).
+//
+// This class, the Pyramid class and the classes they use are also
+// built as libpyramid_cache.a, so other viewers and browse image
+// generators can share pyramids with ssv by opening the same cache
+// directory (see pyramid_new_using_cache in pyramid.h).
 
 #ifndef PYRAMID_CACHE_H
 #define PYRAMID_CACHE_H
@@ -36,9 +41,12 @@ typedef struct {
 // Open a pyramid cache using path as the working directory, and
 // treating max_size as the amount of data to allow in the cache
 // before we start implicitly removing old entries before adding new
-// ones.  A cache is created if it doesn't already exist.  The
-// directory argument specified should be for use as a cache
-// exclusively.
+// ones.  Entries are removed least recently used first, when the
+// cache is opened and when an entry is leased, and entries somebody
+// is using are never removed, so the cache may briefly grow past
+// max_size by the entry being built.  A cache is created if it
+// doesn't already exist.  The directory argument specified should be
+// for use as a cache exclusively.
 PyramidCache *
 pyramid_cache_new (const char *path, gint64 max_size);
 